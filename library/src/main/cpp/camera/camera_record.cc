@@ -50,6 +50,8 @@ CameraRecord::CameraRecord(JNIEnv* env) {
     packet_thread_ = nullptr;
     start_time_ = 0;
     speed_ = 1.0f;
+    frame_rate_ = 0;
+    encode_frame_index_ = -1;
     render_type_ = CROP;
     vertex_coordinate_ = nullptr;
     texture_coordinate_ = nullptr;
@@ -565,15 +567,23 @@ void CameraRecord::StartEncoding(const char* path,
     } else {
         encoder_ = new SoftEncoderAdapter(vertex_coordinate_, texture_coordinate_);
     }
+    frame_rate_ = frame_rate;
     encoder_->Init(video_width, video_height, video_bit_rate * 1000, frame_rate);
     if (nullptr != handler_) {
         handler_->PostMessage(new Message(MSG_START_RECORDING));
     }
 }
 
+void CameraRecord::SetFragmentDuration(int duration) {
+    if (nullptr != packet_thread_) {
+        packet_thread_->SetFragmentDuration(duration);
+    }
+}
+
 void CameraRecord::StartRecording() {
     LOGI("StartRecording");
     start_time_ = 0;
+    encode_frame_index_ = -1;
     if (nullptr != encoder_) {
         encoder_->CreateEncoder(egl_core_, frame_buffer_->GetTextureId());
         encoding_ = true;
@@ -615,12 +625,26 @@ void CameraRecord::RenderFrame() {
         }
 
         int64_t duration = getCurrentTime() - start_time_;
-        if (encoding_ && nullptr != encoder_) {
-            encoder_->Encode(static_cast<int>(duration * speed_));
+        int64_t time = static_cast<int64_t>(duration * speed_);
+        if (encoding_ && nullptr != encoder_ && NeedEncode(time)) {
+            encoder_->Encode(static_cast<int>(time));
         }
     }
 }
 
+bool CameraRecord::NeedEncode(int64_t time) {
+    // 原速和慢速时每一帧都需要, 不做处理, 避免相机帧间隔抖动时误丢帧
+    if (speed_ >= 1.0f || frame_rate_ <= 0) {
+        return true;
+    }
+    int64_t index = (time * frame_rate_ + 500) / 1000;
+    if (index <= encode_frame_index_) {
+        return false;
+    }
+    encode_frame_index_ = index;
+    return true;
+}
+
 void CameraRecord::SetFrameType(int frame) {
     enum RenderFrame frame_type = FIT;
     if (frame == 0) {
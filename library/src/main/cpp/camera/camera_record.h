@@ -97,6 +97,9 @@ class CameraRecord {
             int audio_channel,
             int audio_bit_rate);
 
+    // 需要在StartEncoding之前调用, 大于0时录制成分段mp4, 单位是毫秒
+    void SetFragmentDuration(int duration);
+
     void StartRecording();
 
     void StopEncoding();
@@ -130,6 +133,10 @@ class CameraRecord {
 
     void ProcessMessage();
 
+    // 快速录制时时间戳被压缩, 按编码帧率只保留每个帧间隔内的第一帧
+    // 在读取像素和编码之前丢帧, 4倍速时只需要1/4的读取和编码
+    bool NeedEncode(int64_t time);
+
  private:
     ANativeWindow *window_;
     JNIEnv* env_;
@@ -157,6 +164,9 @@ class CameraRecord {
     VideoConsumerThread* packet_thread_;
     int64_t start_time_;
     float speed_;
+    int frame_rate_;
+    /** 上一个编码帧所在的帧间隔序号 **/
+    int64_t encode_frame_index_;
     int render_type_;
 };
 
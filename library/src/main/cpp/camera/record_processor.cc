@@ -19,26 +19,20 @@
 //
 
 #include "record_processor.h"
-#include "tools.h"
 #include "android_xlog.h"
 
-#define MIN_DIFF_TIME_MILLS 50
-#define MAX_DIFF_TIME_MILLS 150
-
 namespace trinity {
 
 RecordProcessor::RecordProcessor() {
     audio_sample_rate_ = 0;
     audio_samples_ = nullptr;
-    audio_sample_time_mills_ = 0;
     audio_sample_cursor_ = 0;
     audio_buffer_size_ = 0;
-    audio_buffer_time_mills_ = 0;
     packet_pool_ = nullptr;
-    recording_flag_ = false;
-    start_time_mills_ = 0;
-    data_accumulate_time_mills_ = 0;
     audio_encoder_ = nullptr;
+    speed_ = 1.0f;
+    time_stretch_ = nullptr;
+    stretch_buffer_ = nullptr;
 }
 
 RecordProcessor::~RecordProcessor() {}
@@ -50,17 +44,50 @@ void RecordProcessor::InitAudioBufferSize(int sample_rate, int audio_buffer_size
     audio_sample_rate_ = sample_rate;
     audio_samples_ = new short[audio_buffer_size];
     packet_pool_ = PacketPool::GetInstance();
-    audio_buffer_time_mills_ = static_cast<int>(audio_buffer_size * 1000.0f / audio_sample_rate_);
+}
+
+void RecordProcessor::SetSpeed(float speed) {
+    LOGI("%s speed: %f", __FUNCTION__, speed);
+    speed_ = speed;
+    if (speed == 1.0f) {
+        return;
+    }
+    if (nullptr == time_stretch_) {
+        time_stretch_ = new TimeStretch();
+        time_stretch_->Init(audio_sample_rate_, 1);
+        stretch_buffer_ = new short[audio_buffer_size_];
+    }
+    time_stretch_->SetRatio(speed);
 }
 
 int RecordProcessor::PushAudioBufferToQueue(short *samples, int size) {
     if (size <= 0) {
         return size;
     }
-    if (!recording_flag_) {
-        recording_flag_ = true;
-        start_time_mills_ = currentTimeMills();
+    if (nullptr == time_stretch_ || speed_ == 1.0f) {
+        PushAudioSamples(samples, size);
+        return size;
+    }
+    time_stretch_->Write(samples, size);
+    int stretch_size;
+    while ((stretch_size = time_stretch_->Read(stretch_buffer_, audio_buffer_size_)) > 0) {
+        PushAudioSamples(stretch_buffer_, stretch_size);
     }
+    return size;
+}
+
+void RecordProcessor::FlushAudioBufferToQueue() {
+    if (nullptr != time_stretch_) {
+        time_stretch_->Flush();
+        int stretch_size;
+        while ((stretch_size = time_stretch_->Read(stretch_buffer_, audio_buffer_size_)) > 0) {
+            PushAudioSamples(stretch_buffer_, stretch_size);
+        }
+    }
+    FlushAudioSamples();
+}
+
+void RecordProcessor::PushAudioSamples(short *samples, int size) {
     int samplesCursor = 0;
     int samplesCnt = size;
     while (samplesCnt > 0) {
@@ -75,13 +102,12 @@ int RecordProcessor::PushAudioBufferToQueue(short *samples, int size) {
             audio_sample_cursor_ += subFullSize;
             samplesCursor += subFullSize;
             samplesCnt -= subFullSize;
-            FlushAudioBufferToQueue();
+            FlushAudioSamples();
         }
     }
-    return size;
 }
 
-void RecordProcessor::FlushAudioBufferToQueue() {
+void RecordProcessor::FlushAudioSamples() {
     if (audio_sample_cursor_ > 0) {
         if (NULL == audio_encoder_) {
             audio_encoder_ = new AudioEncoderAdapter();
@@ -100,12 +126,6 @@ void RecordProcessor::FlushAudioBufferToQueue() {
         audioPacket->size = audio_sample_cursor_;
         packet_pool_->PushAudioPacketToQueue(audioPacket);
         audio_sample_cursor_ = 0;
-        data_accumulate_time_mills_+=audio_buffer_time_mills_;
-        int correctDurationInTimeMills = 0;
-        if (DetectNeedCorrect(data_accumulate_time_mills_, audio_sample_time_mills_, &correctDurationInTimeMills)) {
-            // 检测到有问题了, 需要进行修复
-            this->CorrectRecordBuffer(correctDurationInTimeMills);
-        }
     }
 }
 
@@ -120,43 +140,20 @@ void RecordProcessor::Destroy() {
         delete audio_encoder_;
         audio_encoder_ = nullptr;
     }
-    LOGI("leave %s", __FUNCTION__);
-}
-
-bool RecordProcessor::DetectNeedCorrect(int64_t data_present_time_mills, int64_t recording_time_mills, int *correct_time_mills) {
-    bool ret = false;
-    (*correct_time_mills) = 0;
-    if (data_present_time_mills <= (recording_time_mills - MAX_DIFF_TIME_MILLS)) {
-        ret = true;
-        (*correct_time_mills) = MAX_DIFF_TIME_MILLS - MIN_DIFF_TIME_MILLS;
+    if (nullptr != time_stretch_) {
+        time_stretch_->Destroy();
+        delete time_stretch_;
+        time_stretch_ = nullptr;
     }
-    return ret;
+    if (nullptr != stretch_buffer_) {
+        delete[] stretch_buffer_;
+        stretch_buffer_ = nullptr;
+    }
+    LOGI("leave %s", __FUNCTION__);
 }
 
 void RecordProcessor::CopyToAudioSamples(short *buffer, int length) {
-    if (0 == audio_sample_cursor_) {
-        audio_sample_time_mills_ = currentTimeMills() - start_time_mills_;
-    }
     memcpy(audio_samples_ + audio_sample_cursor_, buffer, length * sizeof(short));
 }
 
-int RecordProcessor::CorrectRecordBuffer(int correct_time_mills) {
-    int correctBufferSize = static_cast<int>((correct_time_mills / 1000.0f) * audio_sample_rate_);
-    AudioPacket * audioPacket = GetSilentDataPacket(correctBufferSize);
-    packet_pool_->PushAudioPacketToQueue(audioPacket);
-    // TODO 混音
-//    AudioPacket * accompanyPacket = GetSilentDataPacket(correctBufferSize);
-//    packet_pool_->pushAccompanyPacketToQueue(accompanyPacket);
-//    data_accumulate_time_mills_ += correct_time_mills;
-    return 0;
-}
-
-AudioPacket* RecordProcessor::GetSilentDataPacket(int audioBufferSize) {
-    AudioPacket * audioPacket = new AudioPacket();
-    audioPacket->buffer = new short[audioBufferSize];
-    memset(audioPacket->buffer, 0, audioBufferSize * sizeof(short));
-    audioPacket->size = audioBufferSize;
-    return audioPacket;
-}
-
 }  // namespace trinity
\ No newline at end of file
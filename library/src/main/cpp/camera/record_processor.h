@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include "packet_pool.h"
 #include "audio_encoder_adapter.h"
+#include "time_stretch.h"
 
 namespace trinity {
 
@@ -34,28 +35,28 @@ class RecordProcessor {
     ~RecordProcessor();
 
     void InitAudioBufferSize(int sample_rate, int audio_buffer_size);
+    // 录制速度, 和CameraRecord::SetSpeed一致, 表示输出时长和录制时长的比例
+    // 不是1时声音经过变速不变调处理, 保持和视频时间戳对齐
+    void SetSpeed(float speed);
     int PushAudioBufferToQueue(short* samples, int size);
     void FlushAudioBufferToQueue();
     void Destroy();
 
  private:
-    bool DetectNeedCorrect(int64_t data_present_time_mills, int64_t recording_time_mills, int *correct_time_mills);
+    void PushAudioSamples(short* samples, int size);
+    void FlushAudioSamples();
     void CopyToAudioSamples(short* buffer, int length);
-    int CorrectRecordBuffer(int correct_time_mills);
-    AudioPacket* GetSilentDataPacket(int audioBufferSize);
 
  private:
     int audio_sample_rate_;
     short* audio_samples_;
-    float audio_sample_time_mills_;
     int audio_sample_cursor_;
     int audio_buffer_size_;
-    int audio_buffer_time_mills_;
     PacketPool* packet_pool_;
-    bool recording_flag_;
-    int64_t start_time_mills_;
-    int64_t data_accumulate_time_mills_;
     AudioEncoderAdapter* audio_encoder_;
+    float speed_;
+    TimeStretch* time_stretch_;
+    short* stretch_buffer_;
 };
 
 }  // namespace trinity
@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-02.
+//
+
+#include "audio_mixer.h"
+#include <math.h>
+#include <string.h>
+#include "android_xlog.h"
+
+namespace trinity {
+
+AudioMixer::AudioMixer()
+    : sample_rate_(0),
+      channels_(0),
+      block_frames_(0),
+      position_(0),
+      track_id_(0),
+      bus_(nullptr),
+      track_buffer_(nullptr),
+      track_gain_(nullptr),
+      limiter_gain_(1.0f),
+      limiter_release_(0) {
+    pthread_mutex_init(&lock_, nullptr);
+}
+
+AudioMixer::~AudioMixer() {
+    pthread_mutex_destroy(&lock_);
+}
+
+int AudioMixer::Init(int sample_rate, int channels, int block_frames) {
+    if (sample_rate <= 0 || channels <= 0 || block_frames <= 0) {
+        LOGE("AudioMixer Init error sample_rate: %d channels: %d block_frames: %d", sample_rate, channels, block_frames);
+        return -1;
+    }
+    sample_rate_ = sample_rate;
+    channels_ = channels;
+    block_frames_ = block_frames;
+    position_ = 0;
+    limiter_gain_ = 1.0f;
+    limiter_release_ = 1.0f - expf(-1000.0f / (MIXER_LIMITER_RELEASE_MS * sample_rate));
+    bus_ = new float*[channels];
+    track_buffer_ = new float*[channels];
+    for (int c = 0; c < channels; c++) {
+        bus_[c] = new float[block_frames];
+        track_buffer_[c] = new float[block_frames];
+    }
+    track_gain_ = new float[block_frames];
+    return 0;
+}
+
+int AudioMixer::AddTrack(AudioSource* source, int64_t start_time, int64_t end_time,
+        float volume, int fade_in, int fade_out) {
+    if (nullptr == source) {
+        return -1;
+    }
+    MixerTrack* track = new MixerTrack();
+    track->source = source;
+    track->start_frame = start_time * sample_rate_ / 1000;
+    track->end_frame = end_time > start_time ? end_time * sample_rate_ / 1000 : INT64_MAX;
+    track->fade_in_frames = static_cast<int>(static_cast<int64_t>(fade_in) * sample_rate_ / 1000);
+    track->fade_out_frames = static_cast<int>(static_cast<int64_t>(fade_out) * sample_rate_ / 1000);
+    track->volume = volume;
+    track->target_volume = volume;
+    track->finished = false;
+
+    // 按开始时间倒序排列, 最先开始的轨道在最后面
+    pthread_mutex_lock(&lock_);
+    track->id = track_id_++;
+    auto it = pending_tracks_.begin();
+    while (it != pending_tracks_.end() && (*it)->start_frame > track->start_frame) {
+        ++it;
+    }
+    pending_tracks_.insert(it, track);
+    int id = track->id;
+    pthread_mutex_unlock(&lock_);
+    return id;
+}
+
+void AudioMixer::SetVolume(int track_id, float volume) {
+    pthread_mutex_lock(&lock_);
+    for (auto track : active_tracks_) {
+        if (track->id == track_id) {
+            track->target_volume = volume;
+            pthread_mutex_unlock(&lock_);
+            return;
+        }
+    }
+    for (auto track : pending_tracks_) {
+        if (track->id == track_id) {
+            track->volume = volume;
+            track->target_volume = volume;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock_);
+}
+
+int AudioMixer::Mix(short* output, int frames) {
+    if (nullptr == bus_) {
+        return 0;
+    }
+    int offset = 0;
+    while (offset < frames) {
+        int block_frames = frames - offset < block_frames_ ? frames - offset : block_frames_;
+        MixBlock(block_frames);
+        // 总线上只在这里转换成short
+        for (int c = 0; c < channels_; c++) {
+            float* src = bus_[c];
+            short* dst = output + offset * channels_ + c;
+            for (int i = 0; i < block_frames; i++) {
+                float sample = src[i] * 32767.0f;
+                if (sample > 32767.0f) {
+                    sample = 32767.0f;
+                } else if (sample < -32768.0f) {
+                    sample = -32768.0f;
+                }
+                dst[i * channels_] = static_cast<short>(lrintf(sample));
+            }
+        }
+        offset += block_frames;
+    }
+    return frames;
+}
+
+int AudioMixer::Mix(float** output, int frames) {
+    if (nullptr == bus_) {
+        return 0;
+    }
+    int offset = 0;
+    while (offset < frames) {
+        int block_frames = frames - offset < block_frames_ ? frames - offset : block_frames_;
+        MixBlock(block_frames);
+        for (int c = 0; c < channels_; c++) {
+            memcpy(output[c] + offset, bus_[c], block_frames * sizeof(float));
+        }
+        offset += block_frames;
+    }
+    return frames;
+}
+
+int64_t AudioMixer::GetPosition() {
+    if (sample_rate_ == 0) {
+        return 0;
+    }
+    return position_ * 1000 / sample_rate_;
+}
+
+bool AudioMixer::IsFinished() {
+    pthread_mutex_lock(&lock_);
+    bool finished = active_tracks_.empty() && pending_tracks_.empty();
+    pthread_mutex_unlock(&lock_);
+    return finished;
+}
+
+int AudioMixer::GetActiveTrackSize() {
+    pthread_mutex_lock(&lock_);
+    int size = static_cast<int>(active_tracks_.size());
+    pthread_mutex_unlock(&lock_);
+    return size;
+}
+
+void AudioMixer::Reset() {
+    pthread_mutex_lock(&lock_);
+    for (auto track : active_tracks_) {
+        FreeTrack(track);
+    }
+    active_tracks_.clear();
+    for (auto track : pending_tracks_) {
+        FreeTrack(track);
+    }
+    pending_tracks_.clear();
+    position_ = 0;
+    limiter_gain_ = 1.0f;
+    pthread_mutex_unlock(&lock_);
+}
+
+void AudioMixer::Destroy() {
+    Reset();
+    if (nullptr != bus_) {
+        for (int c = 0; c < channels_; c++) {
+            delete[] bus_[c];
+            delete[] track_buffer_[c];
+        }
+        delete[] bus_;
+        delete[] track_buffer_;
+        bus_ = nullptr;
+        track_buffer_ = nullptr;
+    }
+    if (nullptr != track_gain_) {
+        delete[] track_gain_;
+        track_gain_ = nullptr;
+    }
+}
+
+void AudioMixer::MixBlock(int frames) {
+    for (int c = 0; c < channels_; c++) {
+        memset(bus_[c], 0, frames * sizeof(float));
+    }
+    // 持有锁时只复制当前块的轨道, 读取数据时可能需要解码, 不持有锁
+    int64_t block_end = position_ + frames;
+    pthread_mutex_lock(&lock_);
+    UpdateActiveTracks(block_end);
+    mixing_tracks_ = active_tracks_;
+    pthread_mutex_unlock(&lock_);
+    bool has_finished = false;
+    for (auto track : mixing_tracks_) {
+        MixTrack(track, frames);
+        if (track->finished || track->end_frame <= block_end) {
+            has_finished = true;
+        }
+    }
+    if (has_finished) {
+        pthread_mutex_lock(&lock_);
+        auto it = active_tracks_.begin();
+        while (it != active_tracks_.end()) {
+            MixerTrack* track = *it;
+            if (track->finished || track->end_frame <= block_end) {
+                FreeTrack(track);
+                it = active_tracks_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        pthread_mutex_unlock(&lock_);
+    }
+    mixing_tracks_.clear();
+    Limit(frames);
+    position_ = block_end;
+}
+
+void AudioMixer::UpdateActiveTracks(int64_t block_end) {
+    while (!pending_tracks_.empty() && pending_tracks_.back()->start_frame < block_end) {
+        active_tracks_.push_back(pending_tracks_.back());
+        pending_tracks_.pop_back();
+    }
+}
+
+void AudioMixer::MixTrack(MixerTrack* track, int frames) {
+    int begin = 0;
+    if (track->start_frame > position_) {
+        begin = static_cast<int>(track->start_frame - position_);
+    }
+    int end = frames;
+    if (track->end_frame - position_ < end) {
+        end = static_cast<int>(track->end_frame - position_);
+    }
+    int count = end - begin;
+    if (count <= 0) {
+        return;
+    }
+    int read_frames = track->source->Read(track_buffer_, count);
+    if (read_frames < count) {
+        track->finished = true;
+    }
+    if (read_frames <= 0) {
+        return;
+    }
+
+    // 轨道内的位置, 用来计算淡入淡出
+    int64_t track_frame = position_ + begin - track->start_frame;
+    int64_t remain_frames = track->end_frame == INT64_MAX ? INT64_MAX : track->end_frame - (position_ + begin);
+    bool fade = track_frame < track->fade_in_frames ||
+            (track->fade_out_frames > 0 && remain_frames - read_frames < track->fade_out_frames);
+    float volume = track->volume;
+    float target_volume = track->target_volume.load();
+    float volume_step = (target_volume - track->volume) / read_frames;
+    float* gain = track_gain_;
+    for (int i = 0; i < read_frames; i++) {
+        gain[i] = volume;
+        volume += volume_step;
+    }
+    if (fade) {
+        for (int i = 0; i < read_frames; i++) {
+            int64_t position = track_frame + i;
+            if (position < track->fade_in_frames) {
+                gain[i] *= static_cast<float>(position) / track->fade_in_frames;
+            }
+            int64_t remain = remain_frames - i;
+            if (remain < track->fade_out_frames) {
+                gain[i] *= static_cast<float>(remain) / track->fade_out_frames;
+            }
+        }
+    }
+    for (int c = 0; c < channels_; c++) {
+        float* src = track_buffer_[c];
+        float* dst = bus_[c] + begin;
+        for (int i = 0; i < read_frames; i++) {
+            dst[i] += src[i] * gain[i];
+        }
+    }
+    track->volume = target_volume;
+}
+
+void AudioMixer::Limit(int frames) {
+    // 瞬时压缩, 按释放时间恢复增益, 避免多轨叠加后削波
+    float gain = limiter_gain_;
+    for (int i = 0; i < frames; i++) {
+        float peak = 0;
+        for (int c = 0; c < channels_; c++) {
+            float value = fabsf(bus_[c][i]);
+            if (value > peak) {
+                peak = value;
+            }
+        }
+        float target = peak > MIXER_LIMITER_THRESHOLD ? MIXER_LIMITER_THRESHOLD / peak : 1.0f;
+        if (target < gain) {
+            gain = target;
+        } else {
+            gain += (target - gain) * limiter_release_;
+        }
+        if (gain < 1.0f) {
+            for (int c = 0; c < channels_; c++) {
+                bus_[c][i] *= gain;
+            }
+        }
+    }
+    limiter_gain_ = gain;
+}
+
+void AudioMixer::FreeTrack(MixerTrack* track) {
+    if (nullptr != track->source) {
+        delete track->source;
+        track->source = nullptr;
+    }
+    delete track;
+}
+
+}  // namespace trinity
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-02.
+//
+
+#ifndef TRINITY_AUDIO_MIXER_H
+#define TRINITY_AUDIO_MIXER_H
+
+#include <pthread.h>
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#define MIXER_DEFAULT_BLOCK_FRAMES      1024
+/** 限幅器的阈值和释放时间 **/
+#define MIXER_LIMITER_THRESHOLD         0.98f
+#define MIXER_LIMITER_RELEASE_MS        50
+
+namespace trinity {
+
+// 混音轨道的数据来源
+// 输出planar float采样, 采样率和声道数与AudioMixer保持一致
+class AudioSource {
+ public:
+    virtual ~AudioSource() {}
+    // 读取frames帧数据到buffer的每个声道, 返回实际读取的帧数, 小于frames表示数据已经结束
+    virtual int Read(float** buffer, int frames) = 0;
+};
+
+typedef struct {
+    int id;
+    AudioSource* source;
+    /** 轨道在时间线上的范围, 单位是帧 **/
+    int64_t start_frame;
+    int64_t end_frame;
+    int fade_in_frames;
+    int fade_out_frames;
+    float volume;
+    /** SetVolume在其它线程修改, 混音时读取 **/
+    std::atomic<float> target_volume;
+    bool finished;
+} MixerTrack;
+
+// 多轨混音
+// 所有轨道在planar float总线上按块混音, 经过限幅器后在输出时转换一次
+// 每一块只处理当前时间范围内活跃的轨道, 没有开始或已经结束的轨道不会读取数据
+// 轨道列表由lock_保护, SetVolume和AddTrack可以在其它线程调用
+// 混音时只在修改列表时持有锁, 读取数据来源和混音时不持有锁, 不会让调用线程等待解码
+// Reset和Destroy会释放轨道, 需要在混音线程停止时调用
+class AudioMixer {
+ public:
+    AudioMixer();
+    ~AudioMixer();
+
+    int Init(int sample_rate, int channels, int block_frames = MIXER_DEFAULT_BLOCK_FRAMES);
+    // 添加一个轨道, AudioMixer会接管source的释放
+    // start_time和end_time单位是毫秒, end_time <= start_time时一直播放到source结束
+    // fade_in和fade_out单位是毫秒, 返回轨道id
+    int AddTrack(AudioSource* source, int64_t start_time, int64_t end_time,
+            float volume = 1.0f, int fade_in = 0, int fade_out = 0);
+    // 音量变化会在下一块内平滑过渡, 避免出现杂音
+    void SetVolume(int track_id, float volume);
+    // 混音frames帧数据到output, short输出为交错格式, 给编码器和OpenSL使用
+    int Mix(short* output, int frames);
+    int Mix(float** output, int frames);
+    // 当前混音的位置, 单位是毫秒
+    int64_t GetPosition();
+    // 所有轨道都已经结束
+    bool IsFinished();
+    int GetActiveTrackSize();
+    // 释放所有轨道, 位置回到0
+    void Reset();
+    void Destroy();
+
+ private:
+    void MixBlock(int frames);
+    void UpdateActiveTracks(int64_t block_end);
+    void MixTrack(MixerTrack* track, int frames);
+    void Limit(int frames);
+    void FreeTrack(MixerTrack* track);
+
+ private:
+    int sample_rate_;
+    int channels_;
+    int block_frames_;
+    int64_t position_;
+    int track_id_;
+    pthread_mutex_t lock_;
+    /** 还没有开始的轨道, 按开始时间排序 **/
+    std::vector<MixerTrack*> pending_tracks_;
+    std::vector<MixerTrack*> active_tracks_;
+    /** 当前块混音的轨道, 只在混音线程使用 **/
+    std::vector<MixerTrack*> mixing_tracks_;
+    float** bus_;
+    float** track_buffer_;
+    /** 当前块每一帧的音量, 所有声道共用 **/
+    float* track_gain_;
+    float limiter_gain_;
+    float limiter_release_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_AUDIO_MIXER_H
@@ -19,6 +19,7 @@
 //
 
 #include "ffmpeg_decode.h"
+#include <time.h>
 #include "android_xlog.h"
 
 #define MIN_FRAMES 25
@@ -488,6 +489,10 @@ int decoder_decode_frame(MediaDecode* media_decode, Decoder *d, AVFrame *frame,
                         d->next_pts_tb = tb;
                     }
                     time = (int64_t) (d->pkt_temp.pts * av_q2d(media_decode->audio_stream->time_base) * 1000);
+                    if (media_decode->video_disable) {
+                        // 没有视频时由音频判断是否到了结束时间
+                        media_decode->finish = time > media_decode->end_time;
+                    }
                 }
                 break;
             case AVMEDIA_TYPE_SUBTITLE:
@@ -1119,6 +1124,10 @@ void* read_thread(void *arg) {
     }
     memset(st_index, -1, sizeof(st_index));
     media_decode->eof = 0;
+    // 没有打开的流的index是-1, 避免关闭时把0当成已经打开的流
+    media_decode->audio_stream_index = -1;
+    media_decode->video_stream_index = -1;
+    media_decode->subtitle_stream_index = -1;
     ic = avformat_alloc_context();
     if (!ic) {
         av_log(NULL, AV_LOG_FATAL, "Can't allocate context.\n");
@@ -1143,7 +1152,9 @@ void* read_thread(void *arg) {
         if (ic->start_time != AV_NOPTS_VALUE) {
             timestamp += ic->start_time;
         }
-        ret = avformat_seek_file(ic, -1, INT64_MIN, timestamp * (AV_TIME_BASE / 1000), INT64_MAX, 0);
+        // 精准seek时需要从开始时间之前的关键帧开始解码
+        ret = avformat_seek_file(ic, -1, INT64_MIN, timestamp * (AV_TIME_BASE / 1000),
+                media_decode->precision_seek ? timestamp * (AV_TIME_BASE / 1000) : INT64_MAX, 0);
         if (ret < 0) {
             av_err2str(ret);
             av_log(NULL, AV_LOG_WARNING, "%s: could not seek to position %0.3f\n",
@@ -1178,11 +1189,11 @@ void* read_thread(void *arg) {
                                                           NULL, 0);
 
     /* open the streams */
-    if (st_index[AVMEDIA_TYPE_AUDIO] >= 0) {
+    if (st_index[AVMEDIA_TYPE_AUDIO] >= 0 && !media_decode->audio_disable) {
         ret = stream_component_open(media_decode, st_index[AVMEDIA_TYPE_AUDIO]);
     }
     ret = -1;
-    if (st_index[AVMEDIA_TYPE_VIDEO] >= 0) {
+    if (st_index[AVMEDIA_TYPE_VIDEO] >= 0 && !media_decode->video_disable) {
         ret = stream_component_open(media_decode, st_index[AVMEDIA_TYPE_VIDEO]);
     }
 
@@ -1248,19 +1259,31 @@ void* read_thread(void *arg) {
 
         /* if the queue are full, no need to read more */
         if ((media_decode->audio_packet_queue.size + media_decode->video_packet_queue.size + media_decode->subtitle_packet_queue.size > MAX_QUEUE_SIZE ||
-             ((media_decode->audio_packet_queue.nb_packets > MIN_FRAMES || media_decode->audio_stream < 0 || media_decode->audio_packet_queue.abort_request) &&
-              (media_decode->video_packet_queue.nb_packets > MIN_FRAMES || media_decode->video_stream < 0 || media_decode->video_packet_queue.abort_request ||
+             ((media_decode->audio_packet_queue.nb_packets > MIN_FRAMES || !media_decode->audio_stream || media_decode->audio_packet_queue.abort_request) &&
+              (media_decode->video_packet_queue.nb_packets > MIN_FRAMES || !media_decode->video_stream || media_decode->video_packet_queue.abort_request ||
                (media_decode->video_stream->disposition & AV_DISPOSITION_ATTACHED_PIC)) &&
               (media_decode->subtitle_packet_queue.nb_packets > MIN_FRAMES || media_decode->subtitle_stream_index < 0 || media_decode->subtitle_packet_queue.abort_request)))) {
             /* wait 10 ms */
+            // 同时有多个解码实例时, 空转会占满cpu
+            struct timespec timeout;
+            clock_gettime(CLOCK_REALTIME, &timeout);
+            timeout.tv_nsec += 10 * 1000000;
+            if (timeout.tv_nsec >= 1000000000) {
+                timeout.tv_sec++;
+                timeout.tv_nsec -= 1000000000;
+            }
             pthread_mutex_lock(&wait_mutex);
-//            SDL_CondWaitTimeout(media_decode->continue_read_thread, wait_mutex, 10);
+            pthread_cond_timedwait(&media_decode->continue_read_thread, &wait_mutex, &timeout);
             pthread_mutex_unlock(&wait_mutex);
             continue;
         }
 //        LOGE("video_finished: %d serial: %d audio_finish: %d serial: %d", media_decode->video_decode.finished, media_decode->video_packet_queue.serial, media_decode->audio_decode.finished, media_decode->audio_packet_queue.serial);
-        if (!media_decode->paused &&
-            (!media_decode->video_stream || (media_decode->video_decode.finished == media_decode->video_packet_queue.serial && frame_queue_nb_remaining(&media_decode->video_frame_queue) == 0))) {
+        int decode_finished = !media_decode->video_stream || (media_decode->video_decode.finished == media_decode->video_packet_queue.serial && frame_queue_nb_remaining(&media_decode->video_frame_queue) == 0);
+        if (media_decode->video_disable) {
+            // 只解码音频时按音频是否结束判断
+            decode_finished = !media_decode->audio_stream || (media_decode->audio_decode.finished == media_decode->audio_packet_queue.serial && frame_queue_nb_remaining(&media_decode->sample_frame_queue) == 0);
+        }
+        if (!media_decode->paused && decode_finished) {
             media_decode->paused = 0;
             media_decode->audio_decode.finished = 0;
             media_decode->video_decode.finished = 0;
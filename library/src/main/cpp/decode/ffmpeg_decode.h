@@ -155,6 +155,10 @@ typedef struct {
     int precision_seek;
     // 是否结束了
     int finish;
+    // 不解码视频, 只需要音频时使用
+    int video_disable;
+    // 不解码音频, 只需要视频时使用
+    int audio_disable;
     // 视频解码的对列
     FrameQueue video_frame_queue;
     // 字幕的解码对列
@@ -237,6 +241,9 @@ Frame* frame_queue_peek(FrameQueue* f);
 
 void frame_queue_next(FrameQueue* f);
 
+// 中断读取, 等待中的frame_queue_peek_readable会返回NULL
+void packet_queue_abort(PacketQueue* q);
+
 // 开始解码
 int av_decode_start(MediaDecode* decode, const char* file_name);
 
@@ -147,13 +147,33 @@ AudioPacket *MusicDecoder::DecodePacket() {
     if (stereoSampleSize > 0) {
         samplePacket->buffer = samples;
         samplePacket->size = stereoSampleSize;
-        samplePacket->position = position_;
     } else {
         samplePacket->size = -1;
     }
     return samplePacket;
 }
 
+AVFrame* MusicDecoder::DecodeFrame() {
+    while (true) {
+        av_init_packet(&packet_);
+        if (av_read_frame(format_context_, &packet_) < 0) {
+            return nullptr;
+        }
+        int got_frame = 0;
+        if (packet_.stream_index == stream_index_) {
+            int len = avcodec_decode_audio4(codec_context_, audio_frame_, &got_frame, &packet_);
+            if (len < 0) {
+                LOGI("Decode audio error, skip packet_");
+            }
+        }
+        av_free_packet(&packet_);
+        if (got_frame) {
+            position_ = av_frame_get_best_effort_timestamp(audio_frame_) * time_base_;
+            return audio_frame_;
+        }
+    }
+}
+
 void MusicDecoder::SeekFrame() {
     float targetPosition = seek_seconds_;
     float currentPosition = position_;
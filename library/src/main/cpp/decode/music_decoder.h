@@ -40,6 +40,9 @@ class MusicDecoder {
     virtual int Init(const char* path);
     virtual void SetPacketBufferSize(int packet_buffer_size);
     virtual AudioPacket* DecodePacket();
+    // 返回解码后的原始AVFrame, 不做格式转换, 结束时返回nullptr
+    // 返回的AVFrame由MusicDecoder持有, 下次调用时会被覆盖
+    virtual AVFrame* DecodeFrame();
     virtual void SeekFrame();
     virtual void Destroy();
     virtual int GetSampleRate();
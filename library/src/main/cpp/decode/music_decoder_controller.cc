@@ -20,37 +20,34 @@
 //
 
 #include <unistd.h>
+#include <sys/time.h>
 #include "music_decoder_controller.h"
 #include "android_xlog.h"
-#include "tools.h"
 
 namespace trinity {
 
 MusicDecoderController::MusicDecoderController()
         : running_(false),
-          accompany_type_(-1),
           suspend_flag_(false),
-          packet_pool_(nullptr),
-          decoder_(nullptr),
-          resample_(nullptr),
-          need_resample_(false),
+          ring_buffer_(nullptr),
+          low_watermark_(0),
+          audio_mixer_(nullptr),
+          music_track_id_(-1),
           audio_render_(nullptr),
-          accompany_sample_rate_(0),
-          silent_samples_(nullptr),
-          accompany_packet_buffer_size_(0),
+          decode_buffer_(nullptr),
           vocal_sample_rate_(0),
           volume_(1.0f),
           volume_max_(1.0f),
-          buffer_queue_size_(0),
-          buffer_queue_cursor_(0),
-          buffer_queue_(nullptr) {
+          finished_(false),
+          underrun_count_(0),
+          underrun_samples_(0) {
 }
 
 MusicDecoderController::~MusicDecoderController() {}
 
 static int audioCallback(uint8_t* buffer, size_t buffer_size, void* context) {
     MusicDecoderController* controller = reinterpret_cast<MusicDecoderController*>(context);
-    return controller->ReadSamples(buffer, 2048) * 2;
+    return controller->ReadSamples(buffer, static_cast<int>(buffer_size));
 }
 
 void MusicDecoderController::Init(float packet_buffer_time_percent, int vocal_sample_rate) {
@@ -58,103 +55,51 @@ void MusicDecoderController::Init(float packet_buffer_time_percent, int vocal_sa
     volume_ = 1.0f;
     volume_max_ = 1.0f;
     vocal_sample_rate_ = vocal_sample_rate;
-    accompany_packet_buffer_size_ = 2048;
-    buffer_queue_cursor_ = 0;
-    buffer_queue_size_ = static_cast<int>(MAX(accompany_packet_buffer_size_ * 4,
-            vocal_sample_rate * CHANNEL_PER_FRAME * 1.0f));
-    buffer_queue_ = new short[buffer_queue_size_];
-    silent_samples_ = new short[accompany_packet_buffer_size_];
-    memset(silent_samples_, 0, accompany_packet_buffer_size_ * 2);
-    packet_pool_ = new PacketPool();
-    packet_pool_->InitDecoderAccompanyPacketQueue();
-    packet_pool_->InitAccompanyPacketQueue(vocal_sample_rate, CHANNEL_PER_FRAME);
-    InitDecoderThread();
-}
-
-int MusicDecoderController::ReadSamplesAndProducePacket(short *samples, int size, int *slient_size,
-                                                        int *extra_accompany_type) {
-    int result = -1;
-    if (accompany_type_ == ACCOMPANY_TYPE_SILENT_SAMPLE) {
-        extra_accompany_type[0] = ACCOMPANY_TYPE_SILENT_SAMPLE;
-        slient_size[0] = 0;
-        result = this->BuildSamples(samples);
-    } else if (accompany_type_ == ACCOMPANY_TYPE_SONG_SAMPLE) {
-        extra_accompany_type[0] = ACCOMPANY_TYPE_SONG_SAMPLE;
-        AudioPacket* accompanyPacket = nullptr;
-        packet_pool_->GetDecoderAccompanyPacket(&accompanyPacket, true);
-        if (nullptr != accompanyPacket) {
-            int samplePacketSize = accompanyPacket->size;
-            if (samplePacketSize != -1 && samplePacketSize <= size) {
-                // copy the raw data to samples
-                adjustSamplesVolume(accompanyPacket->buffer, samplePacketSize, volume_ / volume_max_);
-                memcpy(samples, accompanyPacket->buffer, samplePacketSize * 2);
-                // push accompany packet_ to accompany queue_
-                PushPacketToQueue(accompanyPacket);
-                result = samplePacketSize;
-            } else if (-1 == samplePacketSize) {
-                LOGI("decode eof");
-                // 解码到最后了
-                accompany_type_ = ACCOMPANY_TYPE_SILENT_SAMPLE;
-                extra_accompany_type[0] = ACCOMPANY_TYPE_SILENT_SAMPLE;
-                slient_size[0] = 0;
-                result = BuildSamples(samples);
-            }
-        } else {
-            result = -2;
-        }
-        if (extra_accompany_type[0] != ACCOMPANY_TYPE_SILENT_SAMPLE && packet_pool_->GeDecoderAccompanyPacketQueueSize() < QUEUE_SIZE_MIN_THRESHOLD) {
-            pthread_mutex_lock(&lock_);
-            if (result != -1) {
-                pthread_cond_signal(&condition_);
-            }
-            pthread_mutex_unlock(&lock_);
-        }
+    int ring_buffer_size = static_cast<int>(vocal_sample_rate * CHANNEL_PER_FRAME * packet_buffer_time_percent);
+    if (ring_buffer_size < DECODE_PACKET_BUFFER_SIZE * 2) {
+        ring_buffer_size = DECODE_PACKET_BUFFER_SIZE * 2;
     }
-    LOGI("leave ReadSamplesAndProducePacket");
-    return result;
+    ring_buffer_ = new AudioRingBuffer();
+    ring_buffer_->Init(ring_buffer_size);
+    low_watermark_ = static_cast<int>(ring_buffer_->GetCapacity() * RING_BUFFER_LOW_WATERMARK);
+    decode_buffer_ = new short[DECODE_PACKET_BUFFER_SIZE];
+    underrun_count_ = 0;
+    underrun_samples_ = 0;
+    audio_mixer_ = new AudioMixer();
+    audio_mixer_->Init(vocal_sample_rate, CHANNEL_PER_FRAME);
+    InitDecoderThread();
 }
 
 int MusicDecoderController::ReadSamples(uint8_t* samples, int size) {
-    int ret = -1;
-    AudioPacket* accompanyPacket = nullptr;
-    packet_pool_->GetDecoderAccompanyPacket(&accompanyPacket, true);
-    if (nullptr != accompanyPacket) {
-        int samplePacketSize = accompanyPacket->size;
-        if (samplePacketSize != -1 && samplePacketSize <= size) {
-            // copy the raw data to samples
-            adjustSamplesVolume(accompanyPacket->buffer, samplePacketSize, volume_ / volume_max_);
-            // TODO crash
-            memcpy(samples, accompanyPacket->buffer, samplePacketSize * 2);
-            // push accompany packet_ to accompany queue_
-            PushPacketToQueue(accompanyPacket);
-            ret = samplePacketSize;
-        } else if (-1 == samplePacketSize) {
-            LOGI("decode eof");
-            // 解码到最后了
+    short* buffer = reinterpret_cast<short*>(samples);
+    int sample_size = size / sizeof(short);
+    int read_size = ring_buffer_->Read(buffer, sample_size);
+    if (read_size < sample_size) {
+        memset(buffer + read_size, 0, (sample_size - read_size) * sizeof(short));
+        if (!finished_) {
+            underrun_count_++;
+            underrun_samples_ += sample_size - read_size;
         }
-    } else {
-        ret = -2;
     }
-
-    if (packet_pool_->GeDecoderAccompanyPacketQueueSize() < QUEUE_SIZE_MIN_THRESHOLD) {
-        pthread_mutex_lock(&lock_);
-        if (ret != -1) {
-            pthread_cond_signal(&condition_);
-        }
-        pthread_mutex_unlock(&lock_);
+    if (ring_buffer_->GetReadable() < low_watermark_) {
+        // 只通知不加锁, 解码线程有超时等待, 通知丢失也不会卡住
+        pthread_cond_signal(&condition_);
     }
-    return ret;
+    return sample_size * sizeof(short);
 }
 
 void MusicDecoderController::SetVolume(float volume, float volume_max) {
     volume_ = volume;
     volume_max_ = volume_max;
+    if (nullptr != audio_mixer_ && music_track_id_ >= 0) {
+        audio_mixer_->SetVolume(music_track_id_, volume_ / volume_max_);
+    }
 }
 
-void MusicDecoderController::Start(const char* path) {
-//    SuspendDecodeThread();
-    usleep(200 * 1000);
-    if (InitDecoder(path) >= 0) {
+void MusicDecoderController::Start(const char* path, int start_time, int end_time) {
+    // 解码线程可能正在混音, 先暂停再重置混音器
+    SuspendDecodeThread();
+    if (InitDecoder(path, start_time, end_time) >= 0) {
         ResumeDecodeThread();
     }
 
@@ -186,57 +131,58 @@ void MusicDecoderController::Stop() {
     if (nullptr != audio_render_) {
         audio_render_->Stop();
     }
-    packet_pool_->ClearDecoderAccompanyPacketToQueue();
-    DestroyResample();
-    DestroyDecoder();
     DestroyRender();
-    LOGI("leave stop");
+    // 回调和解码线程都已经停止, 可以清空环形缓冲区
+    ring_buffer_->Clear();
+    audio_mixer_->Reset();
+    music_track_id_ = -1;
+    LOGI("leave stop underrun count: %d samples: %d", underrun_count_.load(), underrun_samples_.load());
 }
 
 void MusicDecoderController::Destroy() {
     LOGI("enter MusicDecoderController::Destroy");
     DestroyDecoderThread();
     LOGI("after DestroyDecoderThread");
-    packet_pool_->AbortDecoderAccompanyPacketQueue();
-    packet_pool_->DestoryDecoderAccompanyPacketQueue();
-    DestroyResample();
-    DestroyDecoder();
     DestroyRender();
-    if (nullptr != silent_samples_) {
-        delete[] silent_samples_;
-        silent_samples_ = nullptr;
+    if (nullptr != audio_mixer_) {
+        audio_mixer_->Destroy();
+        delete audio_mixer_;
+        audio_mixer_ = nullptr;
     }
-    if (nullptr != packet_pool_) {
-        delete packet_pool_;
-        packet_pool_ = nullptr;
+    if (nullptr != ring_buffer_) {
+        ring_buffer_->Destroy();
+        delete ring_buffer_;
+        ring_buffer_ = nullptr;
+    }
+    if (nullptr != decode_buffer_) {
+        delete[] decode_buffer_;
+        decode_buffer_ = nullptr;
     }
     LOGI("leave MusicDecoderController::Destroy");
 }
 
-int MusicDecoderController::InitDecoder(const char *path) {
-    LOGI("enter path: %s", path);
-    packet_pool_->ClearDecoderAccompanyPacketToQueue();
-    DestroyResample();
-    DestroyDecoder();
-    decoder_ = new MusicDecoder();
-    int actualAccompanyPacketBufferSize = accompany_packet_buffer_size_;
-    int ret = decoder_->Init(path, accompany_packet_buffer_size_);
+int MusicDecoderController::GetUnderrunCount() {
+    return underrun_count_.load();
+}
+
+int MusicDecoderController::GetUnderrunSamples() {
+    return underrun_samples_.load();
+}
+
+int MusicDecoderController::InitDecoder(const char *path, int start_time, int end_time) {
+    LOGI("enter path: %s start_time: %d end_time: %d", path, start_time, end_time);
+    ring_buffer_->Clear();
+    audio_mixer_->Reset();
+    music_track_id_ = -1;
+    finished_ = false;
+    // 解码器的采样率和声道数由MusicSource转换成和混音器一致
+    MusicSource* source = new MusicSource(vocal_sample_rate_, CHANNEL_PER_FRAME);
+    int ret = source->Init(path);
     if (ret >= 0) {
-        // 初始化伴奏的采样率
-        accompany_sample_rate_ = decoder_->GetSampleRate();
-        if (vocal_sample_rate_ != accompany_sample_rate_) {
-            need_resample_ = true;
-            resample_ = new Resample();
-            float ratio = accompany_sample_rate_ * 1.0f / vocal_sample_rate_;
-            actualAccompanyPacketBufferSize = ratio * accompany_packet_buffer_size_;
-            ret = resample_->Init(accompany_sample_rate_, vocal_sample_rate_, actualAccompanyPacketBufferSize / 2, 2, 2);
-            if (ret < 0) {
-                LOGE("resampler_ Init error\n");
-            }
-        } else {
-            need_resample_ = false;
-        }
-        decoder_->SetPacketBufferSize(actualAccompanyPacketBufferSize);
+        music_track_id_ = audio_mixer_->AddTrack(source, start_time, end_time, volume_ / volume_max_);
+    } else {
+        LOGE("music source init error: %d", ret);
+        delete source;
     }
     LOGI("leave");
     return ret;
@@ -245,8 +191,7 @@ int MusicDecoderController::InitDecoder(const char *path) {
 int MusicDecoderController::InitRender() {
     DestroyRender();
     audio_render_ = new AudioRender();
-    int sample_rate = decoder_->GetSampleRate();
-    audio_render_->Init(2, sample_rate, audioCallback, this);
+    audio_render_->Init(CHANNEL_PER_FRAME, vocal_sample_rate_, audioCallback, this);
     return 0;
 }
 
@@ -260,12 +205,18 @@ void *MusicDecoderController::StartDecoderThread(void *context) {
             pthread_mutex_unlock(&decoderController->suspend_lock_);
 
             pthread_cond_wait(&decoderController->condition_, &decoderController->lock_);
-        } else {
+        } else if (!decoderController->audio_mixer_->IsFinished()
+                   && decoderController->ring_buffer_->GetWritable() >= DECODE_PACKET_BUFFER_SIZE) {
             decoderController->DecodePacket();
-            if (decoderController->packet_pool_->GeDecoderAccompanyPacketQueueSize() > QUEUE_SIZE_MAX_THRESHOLD) {
-                decoderController->accompany_type_ = ACCOMPANY_TYPE_SONG_SAMPLE;
-                pthread_cond_wait(&decoderController->condition_, &decoderController->lock_);
-            }
+        } else {
+            // 缓冲区已满或者播放结束, 等待回调低于水位线时的通知
+            struct timeval now;
+            gettimeofday(&now, nullptr);
+            int64_t nsec = now.tv_usec * 1000LL + DECODE_WAIT_TIMEOUT_MS * 1000000LL;
+            struct timespec timeout;
+            timeout.tv_sec = now.tv_sec + nsec / 1000000000LL;
+            timeout.tv_nsec = nsec % 1000000000LL;
+            pthread_cond_timedwait(&decoderController->condition_, &decoderController->lock_, &timeout);
         }
     }
     pthread_mutex_unlock(&decoderController->lock_);
@@ -283,38 +234,11 @@ void MusicDecoderController::InitDecoderThread() {
 }
 
 void MusicDecoderController::DecodePacket() {
-    AudioPacket* accompanyPacket = decoder_->DecodePacket();
-    // 是否需要重采样
-    if (need_resample_ && NULL != resample_) {
-        short* stereoSamples = accompanyPacket->buffer;
-        int stereoSampleSize = accompanyPacket->size;
-        if (stereoSampleSize > 0) {
-            int monoSampleSize = stereoSampleSize / 2;
-            short** samples = new short*[2];
-            samples[0] = new short[monoSampleSize];
-            samples[1] = new short[monoSampleSize];
-            for (int i = 0; i < monoSampleSize; i++) {
-                samples[0][i] = stereoSamples[2 * i];
-                samples[1][i] = stereoSamples[2 * i + 1];
-            }
-            float transfer_ratio = accompany_sample_rate_ / static_cast<float>(vocal_sample_rate_);
-            int accompanySampleSize = static_cast<int>(monoSampleSize * 1.0f / transfer_ratio);
-            uint8_t out_data[accompanySampleSize * 2 * 2];
-            int out_nb_bytes = 0;
-            resample_->Process(samples, out_data, monoSampleSize, &out_nb_bytes);
-            delete[] samples[0];
-            delete[] samples[1];
-            delete[] stereoSamples;
-            if (out_nb_bytes > 0) {
-                accompanySampleSize = out_nb_bytes / 2;
-                short* accompanySamples = new short[accompanySampleSize];
-                convertShortArrayFromByteArray(out_data, out_nb_bytes, accompanySamples, 1.0);
-                accompanyPacket->buffer = accompanySamples;
-                accompanyPacket->size = accompanySampleSize;
-            }
-        }
+    audio_mixer_->Mix(decode_buffer_, DECODE_PACKET_BUFFER_SIZE / CHANNEL_PER_FRAME);
+    ring_buffer_->Write(decode_buffer_, DECODE_PACKET_BUFFER_SIZE);
+    if (audio_mixer_->IsFinished()) {
+        finished_ = true;
     }
-    packet_pool_->PushDecoderAccompanyPacketToQueue(accompanyPacket);
 }
 
 void MusicDecoderController::SuspendDecodeThread() {
@@ -354,22 +278,6 @@ void MusicDecoderController::DestroyDecoderThread() {
     pthread_cond_destroy(&suspend_condition_);
 }
 
-void MusicDecoderController::DestroyResample() {
-    if (nullptr != resample_) {
-        resample_->Destroy();
-        delete resample_;
-        resample_ = NULL;
-    }
-}
-
-void MusicDecoderController::DestroyDecoder() {
-    if (nullptr != decoder_) {
-        decoder_->Destroy();
-        delete decoder_;
-        decoder_ = NULL;
-    }
-}
-
 void MusicDecoderController::DestroyRender() {
     if (nullptr != audio_render_) {
         audio_render_->DestroyContext();
@@ -378,40 +286,4 @@ void MusicDecoderController::DestroyRender() {
     }
 }
 
-void MusicDecoderController::PushPacketToQueue(AudioPacket *packet) {
-    memcpy(buffer_queue_ + buffer_queue_cursor_, packet->buffer, packet->size * sizeof(short));
-    buffer_queue_cursor_ += packet->size;
-    float position = packet->position;
-    delete packet;
-    while (buffer_queue_cursor_ >= accompany_packet_buffer_size_) {
-        short* buffer = new short[accompany_packet_buffer_size_];
-        memcpy(buffer, buffer_queue_, accompany_packet_buffer_size_ * sizeof(short));
-        int protectedSampleSize = buffer_queue_cursor_ - accompany_packet_buffer_size_;
-        memmove(buffer_queue_, buffer_queue_ + accompany_packet_buffer_size_, protectedSampleSize * sizeof(short));
-        buffer_queue_cursor_ -= accompany_packet_buffer_size_;
-        AudioPacket* actualPacket = new AudioPacket();
-        actualPacket->size = accompany_packet_buffer_size_;
-        actualPacket->buffer = buffer;
-        actualPacket->position = position;
-        if (position != -1) {
-            actualPacket->frameNum = static_cast<long>(position * this->vocal_sample_rate_);
-        } else {
-            actualPacket->frameNum = -1;
-        }
-        packet_pool_->PushAccompanyPacketToQueue(actualPacket);
-    }
-}
-
-int MusicDecoderController::BuildSamples(short *samples) {
-    AudioPacket* accompanyPacket = new AudioPacket();
-    int samplePacketSize = accompany_packet_buffer_size_;
-    accompanyPacket->size = samplePacketSize;
-    accompanyPacket->buffer = new short[samplePacketSize];
-    accompanyPacket->position = -1;
-    memcpy(accompanyPacket->buffer, silent_samples_, samplePacketSize * 2);
-    memcpy(samples, accompanyPacket->buffer, samplePacketSize * 2);
-    PushPacketToQueue(accompanyPacket);
-    return samplePacketSize;
-}
-
 }  // namespace trinity
@@ -21,20 +21,22 @@
 #ifndef TRINITY_MUSIC_DECODER_CONTROLLER_H
 #define TRINITY_MUSIC_DECODER_CONTROLLER_H
 
-#include "packet_pool.h"
-#include "resample.h"
-#include "music_decoder.h"
+#include <atomic>
+#include <pthread.h>
+#include "audio_ring_buffer.h"
+#include "audio_mixer.h"
+#include "music_source.h"
 #include "audio_render.h"
 
 #define CHANNEL_PER_FRAME    2
 #define BITS_PER_CHANNEL     16
 #define BITS_PER_BYTE        8
-/** decode data to queue and queue size **/
-#define QUEUE_SIZE_MAX_THRESHOLD    45
-#define QUEUE_SIZE_MIN_THRESHOLD    30
-
-#define ACCOMPANY_TYPE_SILENT_SAMPLE          0
-#define ACCOMPANY_TYPE_SONG_SAMPLE            1
+/** 解码线程每次混音的short个数 **/
+#define DECODE_PACKET_BUFFER_SIZE   2048
+/** 环形缓冲区的数据少于这个比例时通知解码线程 **/
+#define RING_BUFFER_LOW_WATERMARK   0.5f
+/** 解码线程等待通知的超时时间, 防止通知丢失 **/
+#define DECODE_WAIT_TIMEOUT_MS      20
 
 namespace trinity {
 
@@ -42,18 +44,23 @@ class MusicDecoderController {
  public:
     MusicDecoderController();
     virtual ~MusicDecoderController();
+    // packet_buffer_time_percent为环形缓冲区的时长, 单位是秒
     virtual void Init(float packet_buffer_time_percent, int vocal_sample_rate);
-    virtual int ReadSamplesAndProducePacket(short* samples, int size, int* slient_size, int* extra_accompany_type);
+    // OpenSL回调中调用, 不会阻塞, 数据不够时补静音, 返回填充的字节数
     virtual int ReadSamples(uint8_t* samples, int size);
     void SetVolume(float volume, float volume_max);
-    void Start(const char* path);
+    // start_time和end_time是音乐在时间线上的范围, 单位是毫秒
+    void Start(const char* path, int start_time = 0, int end_time = 0);
     void Pause();
     void Resume();
     void Stop();
     void Destroy();
+    // 回调中数据不够的次数和补静音的short个数
+    int GetUnderrunCount();
+    int GetUnderrunSamples();
 
  private:
-    virtual int InitDecoder(const char* path);
+    virtual int InitDecoder(const char* path, int start_time, int end_time);
     virtual int InitRender();
     static void* StartDecoderThread(void* context);
     virtual void InitDecoderThread();
@@ -61,38 +68,31 @@ class MusicDecoderController {
     void SuspendDecodeThread();
     void ResumeDecodeThread();
     void DestroyDecoderThread();
-    void DestroyResample();
-    void DestroyDecoder();
     void DestroyRender();
-    void PushPacketToQueue(AudioPacket* packet);
-    int BuildSamples(short* samples);
 
  public:
     bool running_;
     pthread_mutex_t lock_;
     pthread_cond_t condition_;
-    int accompany_type_;
     bool suspend_flag_;
     pthread_mutex_t suspend_lock_;
     pthread_cond_t suspend_condition_;
 
  private:
-    PacketPool* packet_pool_;
-    MusicDecoder* decoder_;
-    Resample* resample_;
-    bool need_resample_;
+    AudioRingBuffer* ring_buffer_;
+    int low_watermark_;
+    AudioMixer* audio_mixer_;
+    int music_track_id_;
     AudioRender* audio_render_;
-    /** 伴奏和原唱的采样频率与解码伴奏和原唱的每个packet的大小 **/
-    int accompany_sample_rate_;
-    short *silent_samples_;
-    int accompany_packet_buffer_size_;
+    short* decode_buffer_;
     int vocal_sample_rate_;
     float volume_;
     float volume_max_;
     pthread_t decoder_thread_;
-    int buffer_queue_size_;
-    int buffer_queue_cursor_;
-    short* buffer_queue_;
+    /** 所有轨道都已经混音结束, 之后补静音不算作underrun **/
+    std::atomic<bool> finished_;
+    std::atomic<int> underrun_count_;
+    std::atomic<int> underrun_samples_;
 };
 
 }  // namespace trinity
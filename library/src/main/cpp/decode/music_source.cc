@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-02.
+//
+
+#include "music_source.h"
+#include "android_xlog.h"
+
+namespace trinity {
+
+MusicSource::MusicSource(int sample_rate, int channels)
+    : ResampleSource(sample_rate, channels),
+      decoder_(nullptr) {
+}
+
+MusicSource::~MusicSource() {
+    if (nullptr != decoder_) {
+        decoder_->Destroy();
+        delete decoder_;
+        decoder_ = nullptr;
+    }
+}
+
+int MusicSource::Init(const char* path) {
+    decoder_ = new MusicDecoder();
+    int ret = decoder_->Init(path);
+    if (ret < 0) {
+        LOGE("MusicSource init decoder error: %d", ret);
+        decoder_->Destroy();
+        delete decoder_;
+        decoder_ = nullptr;
+    }
+    return ret;
+}
+
+int MusicSource::Read(float** buffer, int frames) {
+    while (!end_of_stream_ && Available() < frames) {
+        AVFrame* frame = nullptr == decoder_ ? nullptr : decoder_->DecodeFrame();
+        if (nullptr == frame || Write(frame) < 0) {
+            SetEndOfStream();
+        }
+    }
+    return ResampleSource::Read(buffer, frames);
+}
+
+}  // namespace trinity
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-02.
+//
+
+#ifndef TRINITY_MUSIC_SOURCE_H
+#define TRINITY_MUSIC_SOURCE_H
+
+#include "resample_source.h"
+#include "music_decoder.h"
+
+namespace trinity {
+
+// 把音乐文件解码成AudioMixer需要的采样率和声道数
+// 混音器读取时才按需解码
+class MusicSource : public ResampleSource {
+ public:
+    MusicSource(int sample_rate, int channels);
+    virtual ~MusicSource();
+
+    int Init(const char* path);
+    virtual int Read(float** buffer, int frames);
+
+ private:
+    MusicDecoder* decoder_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_MUSIC_SOURCE_H
@@ -19,142 +19,157 @@
 //
 
 #include "resample.h"
+#include "android_xlog.h"
+
+extern "C" {
+#include "libavutil/channel_layout.h"
+};
 
 namespace trinity {
 
 Resample::Resample()
     : src_rate_(0),
       dst_rate_(0),
-      src_nb_samples_(0),
-      src_ch_layout_(0),
-      dst_ch_layout_(0),
-      src_nb_channels_(0),
-      dst_nb_channels_(0),
-      src_line_size_(0),
-      dst_line_size_(0),
+      dst_channels_(0),
+      dst_format_(AV_SAMPLE_FMT_NONE),
       dst_nb_samples_(0),
-      max_dst_nb_samples_(0),
+      passthrough_(false),
       dst_data_(nullptr),
-      src_data_(nullptr),
-      dst_sample_fmt_(AV_SAMPLE_FMT_NONE),
-      dst_buffer_size_(0),
+      fifo_(nullptr),
       swr_context_(nullptr) {
 }
 
 Resample::~Resample() {}
 
-int Resample::Init(int src_rate, int dst_rate,
-        int max_src_nb_samples, int src_channels,
-        int dst_channels) {
+int Resample::Init(int src_rate, int src_channels, AVSampleFormat src_format,
+        int dst_rate, int dst_channels, AVSampleFormat dst_format,
+        int64_t src_channel_layout) {
     src_rate_ = src_rate;
     dst_rate_ = dst_rate;
-    src_nb_samples_ = max_src_nb_samples;
-    src_ch_layout_ = src_channels == 1 ? AV_CH_LAYOUT_MONO : AV_CH_LAYOUT_STEREO;
-    dst_ch_layout_ = dst_channels == 1 ? AV_CH_LAYOUT_MONO : AV_CH_LAYOUT_STEREO;
-    AVSampleFormat src_sample_fmt = AV_SAMPLE_FMT_S16;
-    dst_sample_fmt_ = AV_SAMPLE_FMT_S16;
-    swr_context_ = swr_alloc();
+    dst_channels_ = dst_channels;
+    dst_format_ = dst_format;
+    if (src_channel_layout == 0 || av_get_channel_layout_nb_channels(src_channel_layout) != src_channels) {
+        src_channel_layout = av_get_default_channel_layout(src_channels);
+    }
+    int64_t dst_channel_layout = av_get_default_channel_layout(dst_channels);
+    passthrough_ = src_rate == dst_rate && src_format == dst_format && src_channel_layout == dst_channel_layout;
+    if (passthrough_) {
+        fifo_ = av_audio_fifo_alloc(dst_format, dst_channels, RESAMPLE_DEFAULT_NB_SAMPLES);
+        return nullptr == fifo_ ? AVERROR(ENOMEM) : 0;
+    }
+    swr_context_ = swr_alloc_set_opts(nullptr, dst_channel_layout, dst_format, dst_rate,
+                                      src_channel_layout, src_format, src_rate, 0, nullptr);
     if (nullptr == swr_context_) {
         Destroy();
         return AVERROR(ENOMEM);
     }
-    int ret;
-    /* set options */
-    av_opt_set_int(swr_context_, "in_channel_layout", src_ch_layout_, 0);
-    av_opt_set_int(swr_context_, "in_sample_rate", src_rate, 0);
-    av_opt_set_sample_fmt(swr_context_, "in_sample_fmt", src_sample_fmt, 0);
-
-    av_opt_set_int(swr_context_, "out_channel_layout", dst_ch_layout_, 0);
-    av_opt_set_int(swr_context_, "out_sample_rate", dst_rate, 0);
-    av_opt_set_sample_fmt(swr_context_, "out_sample_fmt", dst_sample_fmt_, 0);
-
-    if ((ret = swr_init(swr_context_)) < 0) {
-        fprintf(stderr, "Failed to Initialize the resampling context_\n");
+    int ret = swr_init(swr_context_);
+    if (ret < 0) {
+        LOGE("Failed to Initialize the resampling context: %d", ret);
         Destroy();
         return ret;
     }
-
-    src_nb_channels_ = av_get_channel_layout_nb_channels(src_ch_layout_);
-    ret = av_samples_alloc_array_and_samples(&src_data_, &src_line_size_, src_nb_channels_, src_nb_samples_, src_sample_fmt, 0);
+    dst_nb_samples_ = RESAMPLE_DEFAULT_NB_SAMPLES;
+    ret = av_samples_alloc_array_and_samples(&dst_data_, nullptr, dst_channels, dst_nb_samples_, dst_format, 0);
     if (ret < 0) {
-        fprintf(stderr, "Could not allocate source samples\n");
+        LOGE("Could not allocate destination samples: %d", ret);
         Destroy();
         return ret;
     }
-
-    max_dst_nb_samples_ = dst_nb_samples_ = av_rescale_rnd(src_nb_samples_, dst_rate, src_rate, AV_ROUND_UP);
-    dst_nb_channels_ = av_get_channel_layout_nb_channels(dst_ch_layout_);
-    ret = av_samples_alloc_array_and_samples(&dst_data_, &dst_line_size_, dst_nb_channels_, dst_nb_samples_, dst_sample_fmt_, 0);
-    if (ret < 0 || dst_data_[0] == nullptr) {
+    fifo_ = av_audio_fifo_alloc(dst_format, dst_channels, dst_nb_samples_);
+    if (nullptr == fifo_) {
         Destroy();
-        return ret;
+        return AVERROR(ENOMEM);
     }
+    return 0;
+}
 
-    dst_nb_samples_ = av_rescale_rnd(swr_get_delay(swr_context_, src_rate) + src_nb_samples_, dst_rate, src_rate, AV_ROUND_UP);
-
-    if (dst_nb_samples_ > max_dst_nb_samples_) {
-        av_free(dst_data_[0]);
-        ret = av_samples_alloc(dst_data_, &dst_line_size_, dst_nb_channels_, dst_nb_samples_, dst_sample_fmt_, 1);
+int Resample::Write(const uint8_t** in, int nb_samples) {
+    if (passthrough_) {
+        if (nullptr == in || nb_samples <= 0) {
+            return 0;
+        }
+        return av_audio_fifo_write(fifo_, reinterpret_cast<void**>(const_cast<uint8_t**>(in)), nb_samples);
+    }
+    if (nullptr == swr_context_) {
+        return -1;
+    }
+    // 加上swr内部缓存的采样, 保证每次都能把能输出的数据全部取出来
+    int out_count = static_cast<int>(av_rescale_rnd(swr_get_delay(swr_context_, src_rate_) + nb_samples,
+                                                    dst_rate_, src_rate_, AV_ROUND_UP));
+    if (out_count > dst_nb_samples_) {
+        av_freep(&dst_data_[0]);
+        int ret = av_samples_alloc(dst_data_, nullptr, dst_channels_, out_count, dst_format_, 0);
         if (ret < 0) {
-            Destroy();
+            dst_nb_samples_ = 0;
+            return ret;
+        }
+        dst_nb_samples_ = out_count;
+    }
+    int ret = swr_convert(swr_context_, dst_data_, out_count, in, nb_samples);
+    if (ret < 0) {
+        LOGE("swr_convert error: %d", ret);
+        return ret;
+    }
+    if (ret > 0) {
+        int size = av_audio_fifo_write(fifo_, reinterpret_cast<void**>(dst_data_), ret);
+        if (size < ret) {
+            LOGE("av_audio_fifo_write error: %d", size);
+            return size < 0 ? size : AVERROR(ENOMEM);
         }
-        max_dst_nb_samples_ = dst_nb_samples_;
     }
-    dst_buffer_size_ = av_samples_get_buffer_size(&dst_line_size_, dst_nb_channels_, dst_nb_samples_, dst_sample_fmt_, 1);
     return ret;
 }
 
-int Resample::Process(short *in, uint8_t *out, int src_nb_samples, int *out_nb_samples) {
-    memcpy(src_data_[0], in, src_nb_samples * 2); // TODO: change to src_data[0] = in_data
-    return Convert(out, src_nb_samples, out_nb_samples);
+int Resample::Write(const short* in, int nb_samples) {
+    const uint8_t* data[1] = { reinterpret_cast<const uint8_t*>(in) };
+    return Write(data, nb_samples);
 }
 
-int Resample::Process(short **in, uint8_t *out, int src_nb_samples, int *out_nb_samples) {
-    short *dstp = (short *) src_data_[0];
-    for (int i = 0; i < src_nb_samples; i++) {
-        dstp[2 * i] = in[0][i];
-        dstp[2 * i + 1] = in[1][i];
-    }
-    return Convert(out, src_nb_samples, out_nb_samples);
+int Resample::Flush() {
+    return Write(static_cast<const uint8_t**>(nullptr), 0);
 }
 
-int Resample::Convert(uint8_t *out, int src_nb_samples, int *out_nb_samples) {
-    int real_dst_nb_samples = dst_nb_samples_;
-    int real_dst_bufsize = dst_buffer_size_;
-    if (src_nb_samples != src_nb_samples_) {
-        real_dst_nb_samples = av_rescale_rnd(src_nb_samples, dst_rate_, src_rate_, AV_ROUND_UP);
-        int real_dst_linesize = 0;
-        real_dst_bufsize = av_samples_get_buffer_size(&real_dst_linesize, dst_nb_channels_, real_dst_nb_samples,
-                                                      dst_sample_fmt_, 1);
-    }
-    int ret = swr_convert(swr_context_, dst_data_, real_dst_nb_samples, (const uint8_t **) src_data_, src_nb_samples);
-    if (ret < 0) {
-        return ret;
+int Resample::Available() {
+    if (nullptr == fifo_) {
+        return 0;
     }
-    if (dst_data_[0] != nullptr || out == nullptr) {
-        memcpy(out, dst_data_[0], real_dst_bufsize);
+    return av_audio_fifo_size(fifo_);
+}
+
+int Resample::Read(uint8_t** out, int nb_samples) {
+    if (nullptr == fifo_) {
+        return 0;
     }
-    if (out_nb_samples) {
-        *out_nb_samples = real_dst_bufsize;
+    return av_audio_fifo_read(fifo_, reinterpret_cast<void**>(out), nb_samples);
+}
+
+int64_t Resample::GetDelay() {
+    if (nullptr == swr_context_) {
+        return 0;
     }
-    return ret;
+    return swr_get_delay(swr_context_, dst_rate_);
+}
+
+bool Resample::IsPassthrough() {
+    return passthrough_;
 }
 
 void Resample::Destroy() {
-    if (nullptr != src_data_) {
-        av_freep(&src_data_[0]);
-        av_freep(&src_data_);
-        src_data_ = nullptr;
-    }
     if (nullptr != dst_data_) {
         av_freep(&dst_data_[0]);
         av_freep(&dst_data_);
         dst_data_ = nullptr;
     }
+    if (nullptr != fifo_) {
+        av_audio_fifo_free(fifo_);
+        fifo_ = nullptr;
+    }
     if (nullptr != swr_context_) {
         swr_free(&swr_context_);
         swr_context_ = nullptr;
     }
+    dst_nb_samples_ = 0;
 }
 
 }  // namespace trinity
@@ -26,44 +26,53 @@
 
 extern "C" {
 #include "libavutil/samplefmt.h"
+#include "libavutil/audio_fifo.h"
 #include "libswresample/swresample.h"
 #include "libavutil/opt.h"
 };
 
+#define RESAMPLE_DEFAULT_NB_SAMPLES     1024
+
 namespace trinity {
 
+// 流式重采样
+// 输入可以是任意大小的交错或planar数据, 转换后的数据进入内部的fifo, 按需要的数量读取
+// 每次转换都会把swr内部缓存的延迟计算在内, 缓冲区只在不够用时才会扩大
+// 输入和输出的采样率, 声道数和格式都相同时不创建swr, 直接写入fifo
 class Resample {
  public:
     Resample();
     virtual ~Resample();
 
-    virtual int Init(int src_rate = 48000, int dst_rate = 44100,
-            int max_src_nb_samples = 1024, int src_channels = 1,
-            int dst_channels = 1);
-    virtual int Process(short* in, uint8_t* out, int src_nb_samples,
-            int* out_nb_samples);
-    virtual int Process(short** in, uint8_t* out, int src_nb_samples,
-            int* out_nb_samples);
-    virtual int Convert(uint8_t* out, int src_nb_samples,
-            int* out_nb_samples);
+    // channel_layout为0时使用channels对应的默认布局
+    virtual int Init(int src_rate, int src_channels, AVSampleFormat src_format,
+            int dst_rate, int dst_channels, AVSampleFormat dst_format,
+            int64_t src_channel_layout = 0);
+    // 按src_format写入数据, packed格式只用in[0], nb_samples为每个声道的采样数
+    virtual int Write(const uint8_t** in, int nb_samples);
+    // 写入交错的s16数据
+    virtual int Write(const short* in, int nb_samples);
+    // 输入结束后调用, 取出swr中缓存的数据
+    virtual int Flush();
+    // fifo中可以读取的采样数
+    virtual int Available();
+    // 读取nb_samples个采样到out, 返回实际读取的数量
+    virtual int Read(uint8_t** out, int nb_samples);
+    // swr内部还没有输出的延迟, 单位是输出的采样数
+    virtual int64_t GetDelay();
+    // 是否跳过了重采样
+    bool IsPassthrough();
     virtual void Destroy();
 
  private:
     int src_rate_;
     int dst_rate_;
-    int src_nb_samples_;
-    int64_t src_ch_layout_;
-    int64_t dst_ch_layout_;
-    int src_nb_channels_;
-    int dst_nb_channels_;
-    int src_line_size_;
-    int dst_line_size_;
+    int dst_channels_;
+    AVSampleFormat dst_format_;
     int dst_nb_samples_;
-    int max_dst_nb_samples_;
+    bool passthrough_;
     uint8_t** dst_data_;
-    uint8_t** src_data_;
-    enum AVSampleFormat dst_sample_fmt_;
-    int dst_buffer_size_;
+    AVAudioFifo* fifo_;
     struct SwrContext* swr_context_;
 };
 
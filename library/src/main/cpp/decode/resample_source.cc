@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-04.
+//
+
+#include "resample_source.h"
+#include <string.h>
+#include "android_xlog.h"
+
+namespace trinity {
+
+ResampleSource::ResampleSource(int sample_rate, int channels)
+    : resample_(nullptr),
+      src_rate_(0),
+      src_channels_(0),
+      src_format_(AV_SAMPLE_FMT_NONE),
+      src_channel_layout_(0),
+      sample_rate_(sample_rate),
+      channels_(channels),
+      end_of_stream_(false) {
+    output_.resize(channels);
+}
+
+ResampleSource::~ResampleSource() {
+    for (auto resample : draining_) {
+        resample->Destroy();
+        delete resample;
+    }
+    draining_.clear();
+    if (nullptr != resample_) {
+        resample_->Destroy();
+        delete resample_;
+        resample_ = nullptr;
+    }
+}
+
+int ResampleSource::Write(AVFrame* frame) {
+    int channels = av_frame_get_channels(frame);
+    if (nullptr != resample_ && (frame->sample_rate != src_rate_ || channels != src_channels_
+            || frame->format != src_format_ || static_cast<int64_t>(frame->channel_layout) != src_channel_layout_)) {
+        LOGI("ResampleSource format changed sample_rate: %d -> %d channels: %d -> %d",
+                src_rate_, frame->sample_rate, src_channels_, channels);
+        resample_->Flush();
+        if (resample_->Available() > 0) {
+            draining_.push_back(resample_);
+        } else {
+            resample_->Destroy();
+            delete resample_;
+        }
+        resample_ = nullptr;
+    }
+    if (nullptr == resample_) {
+        int ret = InitResample(frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return resample_->Write(const_cast<const uint8_t**>(frame->extended_data), frame->nb_samples);
+}
+
+int ResampleSource::InitResample(AVFrame* frame) {
+    int channels = av_frame_get_channels(frame);
+    resample_ = new Resample();
+    int ret = resample_->Init(frame->sample_rate, channels, (AVSampleFormat) frame->format,
+            sample_rate_, channels_, AV_SAMPLE_FMT_FLTP, frame->channel_layout);
+    if (ret < 0) {
+        LOGE("ResampleSource init resample error sample_rate: %d format: %d", frame->sample_rate, frame->format);
+        delete resample_;
+        resample_ = nullptr;
+        return ret;
+    }
+    src_rate_ = frame->sample_rate;
+    src_channels_ = channels;
+    src_format_ = frame->format;
+    src_channel_layout_ = frame->channel_layout;
+    return 0;
+}
+
+int ResampleSource::Available() {
+    int available = nullptr == resample_ ? 0 : resample_->Available();
+    for (auto resample : draining_) {
+        available += resample->Available();
+    }
+    return available;
+}
+
+void ResampleSource::SetEndOfStream() {
+    if (nullptr != resample_ && !end_of_stream_) {
+        resample_->Flush();
+    }
+    end_of_stream_ = true;
+}
+
+int ResampleSource::Read(float** buffer, int frames) {
+    int read_frames = 0;
+    while (!draining_.empty() && read_frames < frames) {
+        Resample* resample = draining_.front();
+        for (int c = 0; c < channels_; c++) {
+            output_[c] = buffer[c] + read_frames;
+        }
+        int ret = resample->Read(reinterpret_cast<uint8_t**>(output_.data()), frames - read_frames);
+        if (ret > 0) {
+            read_frames += ret;
+        }
+        if (resample->Available() <= 0) {
+            resample->Destroy();
+            delete resample;
+            draining_.erase(draining_.begin());
+        }
+    }
+    if (nullptr != resample_ && read_frames < frames) {
+        for (int c = 0; c < channels_; c++) {
+            output_[c] = buffer[c] + read_frames;
+        }
+        int ret = resample_->Read(reinterpret_cast<uint8_t**>(output_.data()), frames - read_frames);
+        if (ret > 0) {
+            read_frames += ret;
+        }
+    }
+    if (read_frames < frames && !end_of_stream_) {
+        for (int c = 0; c < channels_; c++) {
+            memset(buffer[c] + read_frames, 0, (frames - read_frames) * sizeof(float));
+        }
+        return frames;
+    }
+    return read_frames;
+}
+
+}  // namespace trinity
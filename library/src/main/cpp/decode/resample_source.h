@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-04.
+//
+
+#ifndef TRINITY_RESAMPLE_SOURCE_H
+#define TRINITY_RESAMPLE_SOURCE_H
+
+#include <vector>
+#include "audio_mixer.h"
+#include "resample.h"
+
+extern "C" {
+#include "libavutil/frame.h"
+};
+
+namespace trinity {
+
+// 把解码后的AVFrame通过Resample转换成混音器使用的planar float
+// 根据AVFrame的格式初始化Resample, 多个clip之间格式变化时重新创建
+// 旧的Resample取出swr中缓存的数据后, 等fifo中的数据读完再释放
+class ResampleSource : public AudioSource {
+ public:
+    ResampleSource(int sample_rate, int channels);
+    virtual ~ResampleSource();
+
+    int Write(AVFrame* frame);
+    // 已经转换好可以读取的帧数
+    int Available();
+    // 数据写完后调用, 剩余数据读完之后轨道就结束了
+    void SetEndOfStream();
+    // 数据不够且没有结束时补静音
+    virtual int Read(float** buffer, int frames);
+
+ private:
+    int InitResample(AVFrame* frame);
+
+ protected:
+    Resample* resample_;
+    /** 格式变化之前的Resample, 按顺序先读取 **/
+    std::vector<Resample*> draining_;
+    int src_rate_;
+    int src_channels_;
+    int src_format_;
+    int64_t src_channel_layout_;
+    /** 从多个Resample拼接读取时每个声道的写入位置 **/
+    std::vector<float*> output_;
+    int sample_rate_;
+    int channels_;
+    bool end_of_stream_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_RESAMPLE_SOURCE_H
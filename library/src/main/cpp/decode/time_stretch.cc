@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-06.
+//
+
+#include "time_stretch.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "android_xlog.h"
+
+namespace trinity {
+
+static inline float DotProduct(const float* a, const float* b, int size) {
+    int i = 0;
+    float result = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+    for (; i + 8 <= size; i += 8) {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    sum0 = vaddq_f32(sum0, sum1);
+    float32x2_t sum = vadd_f32(vget_low_f32(sum0), vget_high_f32(sum0));
+    result = vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    // 4路累加, 没有NEON时编译器也可以自动向量化
+    float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    for (; i + 4 <= size; i += 4) {
+        sum0 += a[i] * b[i];
+        sum1 += a[i + 1] * b[i + 1];
+        sum2 += a[i + 2] * b[i + 2];
+        sum3 += a[i + 3] * b[i + 3];
+    }
+    result = (sum0 + sum1) + (sum2 + sum3);
+#endif
+    for (; i < size; i++) {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+TimeStretch::TimeStretch()
+    : sample_rate_(0),
+      channels_(0),
+      ratio_(1.0f),
+      sequence_frames_(0),
+      overlap_frames_(0),
+      seek_frames_(0),
+      skip_fract_(0),
+      overlap_buffer_(nullptr),
+      has_overlap_(false),
+      window_(nullptr),
+      energy_(nullptr),
+      mix_buffer_(nullptr),
+      expect_frames_(0),
+      output_frames_(0) {
+}
+
+TimeStretch::~TimeStretch() {}
+
+int TimeStretch::Init(int sample_rate, int channels) {
+    if (sample_rate <= 0 || channels <= 0) {
+        LOGE("TimeStretch Init error sample_rate: %d channels: %d", sample_rate, channels);
+        return -1;
+    }
+    sample_rate_ = sample_rate;
+    channels_ = channels;
+    sequence_frames_ = sample_rate * TIME_STRETCH_SEQUENCE_MS / 1000;
+    overlap_frames_ = sample_rate * TIME_STRETCH_OVERLAP_MS / 1000;
+    seek_frames_ = sample_rate * TIME_STRETCH_SEEK_MS / 1000;
+    overlap_buffer_ = new float[overlap_frames_ * channels];
+    mix_buffer_ = new float[overlap_frames_ * channels];
+    energy_ = new float[seek_frames_];
+    window_ = new float[overlap_frames_];
+    for (int i = 0; i < overlap_frames_; i++) {
+        window_[i] = 0.5f - 0.5f * cosf(static_cast<float>(M_PI) * i / overlap_frames_);
+    }
+    Clear();
+    return 0;
+}
+
+void TimeStretch::SetRatio(float ratio) {
+    if (ratio < TIME_STRETCH_MIN_RATIO) {
+        ratio = TIME_STRETCH_MIN_RATIO;
+    } else if (ratio > TIME_STRETCH_MAX_RATIO) {
+        ratio = TIME_STRETCH_MAX_RATIO;
+    }
+    ratio_ = ratio;
+}
+
+float TimeStretch::GetRatio() {
+    return ratio_;
+}
+
+void TimeStretch::Write(const short* samples, int size) {
+    if (nullptr == overlap_buffer_ || size <= 0) {
+        return;
+    }
+    int frames = size / channels_;
+    expect_frames_ += frames * ratio_;
+    // 原速并且没有处理中的数据时直接输出
+    if (ratio_ == 1.0f && !has_overlap_ && input_.empty()) {
+        output_.insert(output_.end(), samples, samples + frames * channels_);
+        output_frames_ += frames;
+        return;
+    }
+    size_t offset = input_.size();
+    input_.resize(offset + frames * channels_);
+    float* input = input_.data() + offset;
+    for (int i = 0; i < frames * channels_; i++) {
+        input[i] = samples[i] / 32768.0f;
+    }
+    Process();
+}
+
+int TimeStretch::Available() {
+    return static_cast<int>(output_.size());
+}
+
+int TimeStretch::Read(short* samples, int size) {
+    int count = size < static_cast<int>(output_.size()) ? size : static_cast<int>(output_.size());
+    if (count <= 0) {
+        return 0;
+    }
+    memcpy(samples, output_.data(), count * sizeof(short));
+    output_.erase(output_.begin(), output_.begin() + count);
+    return count;
+}
+
+void TimeStretch::Flush() {
+    if (nullptr == overlap_buffer_) {
+        return;
+    }
+    if (has_overlap_ || !input_.empty()) {
+        // 补充静音让剩余的输入都能处理完
+        int hop = sequence_frames_ - overlap_frames_;
+        int padding = seek_frames_ + sequence_frames_ + static_cast<int>(hop / ratio_) + 1;
+        input_.resize(input_.size() + padding * channels_, 0);
+        Process();
+    }
+    // 补充的静音会多出一部分, 按输入的总时长截断
+    int64_t expect_frames = llround(expect_frames_);
+    if (output_frames_ > expect_frames) {
+        int64_t remove = (output_frames_ - expect_frames) * channels_;
+        if (remove > static_cast<int64_t>(output_.size())) {
+            remove = output_.size();
+        }
+        output_.resize(output_.size() - remove);
+    } else if (output_frames_ < expect_frames) {
+        output_.resize(output_.size() + (expect_frames - output_frames_) * channels_, 0);
+    }
+    output_frames_ = expect_frames;
+    input_.clear();
+    has_overlap_ = false;
+    skip_fract_ = 0;
+}
+
+void TimeStretch::Clear() {
+    input_.clear();
+    output_.clear();
+    has_overlap_ = false;
+    skip_fract_ = 0;
+    expect_frames_ = 0;
+    output_frames_ = 0;
+}
+
+void TimeStretch::Destroy() {
+    Clear();
+    if (nullptr != overlap_buffer_) {
+        delete[] overlap_buffer_;
+        overlap_buffer_ = nullptr;
+    }
+    if (nullptr != mix_buffer_) {
+        delete[] mix_buffer_;
+        mix_buffer_ = nullptr;
+    }
+    if (nullptr != energy_) {
+        delete[] energy_;
+        energy_ = nullptr;
+    }
+    if (nullptr != window_) {
+        delete[] window_;
+        window_ = nullptr;
+    }
+}
+
+void TimeStretch::Process() {
+    int hop = sequence_frames_ - overlap_frames_;
+    while (true) {
+        int frames = static_cast<int>(input_.size()) / channels_;
+        // 每次输出hop帧, 输入前进hop / ratio帧
+        double next = skip_fract_ + hop / ratio_;
+        int skip = static_cast<int>(next);
+        int need = seek_frames_ + sequence_frames_;
+        if (skip > need) {
+            need = skip;
+        }
+        if (frames < need) {
+            break;
+        }
+        const float* input = input_.data();
+        int offset = has_overlap_ ? Seek(input) : 0;
+        const float* src = input + offset * channels_;
+        if (has_overlap_) {
+            for (int i = 0; i < overlap_frames_; i++) {
+                float fade_in = window_[i];
+                float fade_out = 1.0f - fade_in;
+                for (int c = 0; c < channels_; c++) {
+                    int index = i * channels_ + c;
+                    mix_buffer_[index] = overlap_buffer_[index] * fade_out + src[index] * fade_in;
+                }
+            }
+            Output(mix_buffer_, overlap_frames_);
+        } else {
+            Output(src, overlap_frames_);
+        }
+        Output(src + overlap_frames_ * channels_, sequence_frames_ - 2 * overlap_frames_);
+        memcpy(overlap_buffer_, src + hop * channels_, overlap_frames_ * channels_ * sizeof(float));
+        has_overlap_ = true;
+        skip_fract_ = next - skip;
+        input_.erase(input_.begin(), input_.begin() + skip * channels_);
+    }
+}
+
+int TimeStretch::Seek(const float* input) {
+    int size = overlap_frames_ * channels_;
+    // 滑动窗口计算每个位置的能量
+    float energy = 0;
+    for (int i = 0; i < size; i++) {
+        energy += input[i] * input[i];
+    }
+    energy_[0] = energy;
+    for (int offset = 1; offset < seek_frames_; offset++) {
+        const float* remove = input + (offset - 1) * channels_;
+        const float* add = remove + size;
+        for (int c = 0; c < channels_; c++) {
+            energy += add[c] * add[c] - remove[c] * remove[c];
+        }
+        energy_[offset] = energy > 0 ? energy : 0;
+    }
+
+    int best = 0;
+    float best_score = -FLT_MAX;
+    for (int offset = 0; offset < seek_frames_; offset += TIME_STRETCH_SEEK_COARSE_STEP) {
+        float score = DotProduct(overlap_buffer_, input + offset * channels_, size) / sqrtf(energy_[offset] + 1e-8f);
+        if (score > best_score) {
+            best_score = score;
+            best = offset;
+        }
+    }
+    int begin = best - TIME_STRETCH_SEEK_COARSE_STEP + 1;
+    int end = best + TIME_STRETCH_SEEK_COARSE_STEP;
+    if (begin < 0) {
+        begin = 0;
+    }
+    if (end > seek_frames_) {
+        end = seek_frames_;
+    }
+    int coarse = best;
+    for (int offset = begin; offset < end; offset++) {
+        if (offset == coarse) {
+            continue;
+        }
+        float score = DotProduct(overlap_buffer_, input + offset * channels_, size) / sqrtf(energy_[offset] + 1e-8f);
+        if (score > best_score) {
+            best_score = score;
+            best = offset;
+        }
+    }
+    return best;
+}
+
+void TimeStretch::Output(const float* samples, int frames) {
+    size_t offset = output_.size();
+    output_.resize(offset + frames * channels_);
+    short* output = output_.data() + offset;
+    for (int i = 0; i < frames * channels_; i++) {
+        float sample = samples[i] * 32768.0f;
+        if (sample > 32767.0f) {
+            sample = 32767.0f;
+        } else if (sample < -32768.0f) {
+            sample = -32768.0f;
+        }
+        output[i] = static_cast<short>(lrintf(sample));
+    }
+    output_frames_ += frames;
+}
+
+}  // namespace trinity
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-06.
+//
+
+#ifndef TRINITY_TIME_STRETCH_H
+#define TRINITY_TIME_STRETCH_H
+
+#include <stdint.h>
+#include <vector>
+
+/** 每次处理的片段长度, 片段之间的重叠长度, 和寻找最佳拼接位置的范围, 单位是毫秒 **/
+#define TIME_STRETCH_SEQUENCE_MS        40
+#define TIME_STRETCH_OVERLAP_MS         10
+#define TIME_STRETCH_SEEK_MS            15
+/** 先按这个间隔粗略查找, 再在最佳位置附近逐帧查找 **/
+#define TIME_STRETCH_SEEK_COARSE_STEP   4
+#define TIME_STRETCH_MIN_RATIO          0.25f
+#define TIME_STRETCH_MAX_RATIO          4.0f
+
+namespace trinity {
+
+// WSOLA变速不变调
+// 输入和输出都是交错的s16数据, 输出时长 = 输入时长 * ratio
+// 每个片段在查找范围内用互相关找到和上一个片段最相似的位置再做交叉淡化, 音高保持不变
+class TimeStretch {
+ public:
+    TimeStretch();
+    ~TimeStretch();
+
+    int Init(int sample_rate, int channels);
+    // 输出时长和输入时长的比例, 大于1变慢, 小于1变快
+    // 和CameraRecord的speed_一致, 录制4倍速时是0.25
+    void SetRatio(float ratio);
+    float GetRatio();
+    // size为short的个数
+    void Write(const short* samples, int size);
+    // 可以读取的short个数
+    int Available();
+    int Read(short* samples, int size);
+    // 输入已经结束, 把剩余的数据全部处理完, 输出的总长度和输入总长度 * ratio保持一致
+    void Flush();
+    void Clear();
+    void Destroy();
+
+ private:
+    void Process();
+    int Seek(const float* input);
+    void Output(const float* samples, int frames);
+
+ private:
+    int sample_rate_;
+    int channels_;
+    float ratio_;
+    /** 单位都是帧 **/
+    int sequence_frames_;
+    int overlap_frames_;
+    int seek_frames_;
+    /** 每次输入前进的帧数的小数部分 **/
+    double skip_fract_;
+    /** 交错的float数据, 还没有处理的输入 **/
+    std::vector<float> input_;
+    std::vector<short> output_;
+    /** 上一个片段的末尾, 和下一个片段做交叉淡化 **/
+    float* overlap_buffer_;
+    bool has_overlap_;
+    /** 淡入的窗口, 淡出使用1 - window **/
+    float* window_;
+    /** 每个查找位置的能量, 用来归一化互相关 **/
+    float* energy_;
+    float* mix_buffer_;
+    /** 按每次写入时的ratio累加的期望输出帧数 **/
+    double expect_frames_;
+    int64_t output_frames_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_TIME_STRETCH_H
@@ -424,6 +424,12 @@ void VideoEditor::Resume() {
     }
 }
 
+void VideoEditor::SetSpeed(float speed) {
+    if (nullptr != video_player_) {
+        video_player_->SetSpeed(speed);
+    }
+}
+
 void VideoEditor::Stop() {}
 
 void VideoEditor::Destroy() {
@@ -560,13 +566,12 @@ void VideoEditor::OnAddMusic(char *config, int action_id) {
         if (nullptr != start_time_json) {
             start_time = start_time_json->valueint;
         }
-        // TODO time
-        int end_time = INT32_MAX;
+        int end_time = 0;
         if (nullptr != end_time_json) {
             end_time = end_time_json->valueint;
         }
         if (nullptr != path_json) {
-            music_player_->Start(path_json->valuestring);
+            music_player_->Start(path_json->valuestring, start_time, end_time);
         }
     }
 
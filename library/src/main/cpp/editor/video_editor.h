@@ -123,6 +123,9 @@ class VideoEditor : public GLObserver {
     // 继续播放
     void Resume();
 
+    // 预览的播放速度, 视频原声变速不变调
+    void SetSpeed(float speed);
+
     // 停止播放
     void Stop();
 
@@ -20,12 +20,17 @@
 //
 
 #include <math.h>
+#include <limits.h>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "error_code.h"
 #include "video_export.h"
-#include "soft_encoder_adapter.h"
+#include "export_encoder_adapter.h"
 #include "media_encode_adapter.h"
 #include "android_xlog.h"
 #include "tools.h"
+#include "music_source.h"
 
 namespace trinity {
 
@@ -35,9 +40,10 @@ VideoExport::VideoExport(JNIEnv* env, jobject object) {
     vm_ = vm;
     object_ = env->NewGlobalRef(object);
     video_duration_ = 0;
-    accompany_packet_buffer_size_ = 2048;
-    accompany_sample_rate_ = 0;
+    audio_mixer_ = nullptr;
+    clip_audio_source_ = nullptr;
     vocal_sample_rate_ = 0;
+    vocal_channel_count_ = 0;
     export_ing = false;
     egl_core_ = nullptr;
     egl_surface_ = EGL_NO_SURFACE;
@@ -55,11 +61,10 @@ VideoExport::VideoExport(JNIEnv* env, jobject object) {
     image_process_ = nullptr;
     current_time_ = 0;
     previous_time_ = 0;
-    swr_context_ = nullptr;
-    audio_buf = nullptr;
-    audio_buf1 = nullptr;
     audio_samples_ = new short[8192];
     export_config_json_ = nullptr;
+    segment_export_ = false;
+    video_remux_ = nullptr;
 
     // 因为encoder_render时不能改变顶点和纹理坐标
     // 而glReadPixels读取的图像又是上下颠倒的
@@ -152,7 +157,8 @@ int VideoExport::OnComplete() {
             StartDecode(clip);
         }
     }
-    pthread_cond_signal(&media_cond_);
+    // 视频线程和音频线程都可能在等待
+    pthread_cond_broadcast(&media_cond_);
     pthread_mutex_unlock(&media_mutex_);
     return 0;
 }
@@ -195,6 +201,12 @@ void VideoExport::OnEffect() {
 }
 
 void VideoExport::OnMusics() {
+    audio_mixer_ = new AudioMixer();
+    audio_mixer_->Init(vocal_sample_rate_, vocal_channel_count_);
+    // 视频原声作为第一条轨道, 贯穿整个时间线
+    // 视频原声和合成的格式一致时不需要重采样
+    clip_audio_source_ = new ResampleSource(vocal_sample_rate_, vocal_channel_count_);
+    audio_mixer_->AddTrack(clip_audio_source_, 0, 0);
     if (nullptr != export_config_json_) {
         cJSON* musics = cJSON_GetObjectItem(export_config_json_, "musics");
         if (nullptr != musics) {
@@ -204,44 +216,70 @@ void VideoExport::OnMusics() {
                 cJSON* config_json = cJSON_GetObjectItem(music_child, "config");
                 if (nullptr != config_json) {
                     cJSON* config = cJSON_Parse(config_json->valuestring);
+                    if (nullptr == config) {
+                        continue;
+                    }
                     cJSON* path_json = cJSON_GetObjectItem(config, "path");
-                    cJSON* start_time_json = cJSON_GetObjectItem(config, "statTime");
+                    cJSON* start_time_json = cJSON_GetObjectItem(config, "startTime");
+                    if (nullptr == start_time_json) {
+                        start_time_json = cJSON_GetObjectItem(config, "statTime");
+                    }
                     cJSON* end_time_json = cJSON_GetObjectItem(config, "endTime");
+                    cJSON* volume_json = cJSON_GetObjectItem(config, "volume");
+                    cJSON* fade_in_json = cJSON_GetObjectItem(config, "fadeInTime");
+                    cJSON* fade_out_json = cJSON_GetObjectItem(config, "fadeOutTime");
 
                     if (nullptr != path_json) {
-                        char* path = path_json->valuestring;
-                        MusicDecoder* decoder = new MusicDecoder();
-                        int ret = decoder->Init(path, accompany_packet_buffer_size_);
-                        int actualAccompanyPacketBufferSize = accompany_packet_buffer_size_;
+                        MusicSource* source = new MusicSource(vocal_sample_rate_, vocal_channel_count_);
+                        int ret = source->Init(path_json->valuestring);
                         if (ret >= 0) {
-                            accompany_sample_rate_ = decoder->GetSampleRate();
-                            if (vocal_sample_rate_ != accompany_sample_rate_) {
-
-                            }
-                            trinity::Resample* resample = new trinity::Resample();
-                            float ratio = accompany_sample_rate_ * 1.0f / vocal_sample_rate_;
-                            actualAccompanyPacketBufferSize = ratio * accompany_packet_buffer_size_;
-                            ret = resample->Init(accompany_sample_rate_, vocal_sample_rate_, actualAccompanyPacketBufferSize / 2, 2);
-                            if (ret < 0) {
-                                LOGE("resample Init error");
-                            }
-                            resample_deque_.push_back(resample);
-                            decoder->SetPacketBufferSize(actualAccompanyPacketBufferSize);
-                            // TODO time
-                            music_decoder_deque_.push_back(decoder);
+                            int64_t start_time = nullptr == start_time_json ? 0 : start_time_json->valueint;
+                            int64_t end_time = nullptr == end_time_json ? 0 : end_time_json->valueint;
+                            float volume = nullptr == volume_json ? 1.0f : static_cast<float>(volume_json->valuedouble);
+                            int fade_in = nullptr == fade_in_json ? 0 : fade_in_json->valueint;
+                            int fade_out = nullptr == fade_out_json ? 0 : fade_out_json->valueint;
+                            audio_mixer_->AddTrack(source, start_time, end_time, volume, fade_in, fade_out);
+                        } else {
+                            LOGE("music source init error: %d", ret);
+                            delete source;
                         }
                     }
+                    cJSON_Delete(config);
                 }
             }
         }
     }
 }
 
+EncodeProfile VideoExport::GetEncodeProfile() {
+    // 配置中的encode_profile: live, balanced, quality, 默认使用balanced
+    cJSON* profile = cJSON_GetObjectItem(export_config_json_, "encode_profile");
+    if (nullptr == profile || nullptr == profile->valuestring) {
+        return ENCODE_PROFILE_EXPORT_BALANCED;
+    }
+    if (strcmp(profile->valuestring, "live") == 0) {
+        return ENCODE_PROFILE_LIVE;
+    } else if (strcmp(profile->valuestring, "quality") == 0) {
+        return ENCODE_PROFILE_EXPORT_QUALITY;
+    }
+    return ENCODE_PROFILE_EXPORT_BALANCED;
+}
+
+int VideoExport::GetFragmentDuration() {
+    cJSON* fragment_duration = cJSON_GetObjectItem(export_config_json_, "fragment_duration");
+    if (nullptr == fragment_duration || fragment_duration->valueint <= 0) {
+        return 0;
+    }
+    return fragment_duration->valueint;
+}
+
 void VideoExport::StartDecode(MediaClip *clip) {
     media_decode_ = reinterpret_cast<MediaDecode*>(av_malloc(sizeof(MediaDecode)));
     memset(media_decode_, 0, sizeof(MediaDecode));
     media_decode_->start_time = clip->start_time;
     media_decode_->end_time = clip->end_time == 0 ? INT64_MAX : clip->end_time;
+    // 分段导出时这里只解码音频
+    media_decode_->video_disable = segment_export_ ? 1 : 0;
 
     state_event_ = reinterpret_cast<StateEvent*>(av_malloc(sizeof(StateEvent)));
     memset(state_event_, 0, sizeof(StateEvent));
@@ -290,22 +328,12 @@ int VideoExport::Export(const char *export_config, const char *path, int width,
         return CLIP_EMPTY;
     }
     cJSON* item = clips->child;
+    // 所有clip都有结束时间时才知道导出的时长, 用来在文件头预留moov
+    bool known_duration = true;
 
     export_ing = true;
-    vocal_sample_rate_ = sample_rate;
-    packet_thread_ = new VideoConsumerThread();
-    int ret = packet_thread_->Init(path, width, height, frame_rate, video_bit_rate * 1000, sample_rate, channel_count, audio_bit_rate * 1000, "libfdk_aac");
-    if (ret < 0) {
-        return ret;
-    }
-    PacketPool::GetInstance()->InitRecordingVideoPacketQueue();
-    PacketPool::GetInstance()->InitAudioPacketQueue(44100);
-    AudioPacketPool::GetInstance()->InitAudioPacketQueue();
-    packet_thread_->StartAsync();
-
-    video_width_ = (int) (floor(width / 16.0f)) * 16;
-    video_height_ = (int) (floor(height / 16.0f)) * 16;
-
+    vocal_sample_rate_ = sample_rate > 0 ? sample_rate : 44100;
+    vocal_channel_count_ = channel_count == 2 ? 2 : 1;
     for (int i = 0; i < clip_size; i++) {
         cJSON* path_item = cJSON_GetObjectItem(item, "path");
         cJSON* start_time_item = cJSON_GetObjectItem(item, "start_time");
@@ -320,21 +348,75 @@ int VideoExport::Export(const char *export_config, const char *path, int width,
         clip_deque_.push_back(export_clip);
 
         video_duration_ += export_clip->end_time - export_clip->start_time;
+        known_duration = known_duration && export_clip->end_time > export_clip->start_time;
     }
+    free(buffer);
 
+    if (CanRemux()) {
+        video_remux_ = new VideoRemux();
+        video_remux_->SetFragmentDuration(GetFragmentDuration());
+        video_remux_->SetExpectedDuration(known_duration ? video_duration_ : 0);
+        if (video_remux_->Init(path, clip_deque_, width, height, vocal_sample_rate_, vocal_channel_count_) == 0) {
+            video_remux_->SetProgressCallback(OnRemuxProgress, this);
+            pthread_create(&export_video_thread_, nullptr, ExportRemuxThread, this);
+            return 0;
+        }
+        video_remux_->Destroy();
+        delete video_remux_;
+        video_remux_ = nullptr;
+    }
 
-    free(buffer);
-    encoder_ = new SoftEncoderAdapter(vertex_coordinate_, texture_coordinate_);
+    packet_thread_ = new VideoConsumerThread();
+    packet_thread_->SetFragmentDuration(GetFragmentDuration());
+    packet_thread_->SetExpectedDuration(known_duration ? video_duration_ : 0);
+    int ret = packet_thread_->Init(path, width, height, frame_rate, video_bit_rate * 1000, vocal_sample_rate_, vocal_channel_count_, audio_bit_rate * 1000, "libfdk_aac");
+    if (ret < 0) {
+        return ret;
+    }
+    PacketPool::GetInstance()->InitRecordingVideoPacketQueue();
+    PacketPool::GetInstance()->InitAudioPacketQueue(vocal_sample_rate_, vocal_channel_count_);
+    AudioPacketPool::GetInstance()->InitAudioPacketQueue();
+    packet_thread_->StartAsync();
+
+    video_width_ = (int) (floor(width / 16.0f)) * 16;
+    video_height_ = (int) (floor(height / 16.0f)) * 16;
+
+    // 没有变化的GOP直接复制, 只编码剪切点和特效所在的GOP
+    AVCodecParameters* copy_parameters = CreateSmartSegments(width, height);
+    if (nullptr == copy_parameters) {
+        CreateSegments();
+    }
+    int segment_encoder_count = GetSegmentEncoderCount();
+    if (nullptr != copy_parameters && segment_encoder_count < 2) {
+        // 直接复制的段需要和编码的段按顺序拼接
+        segment_encoder_count = 2;
+    }
+    segment_export_ = segment_encoder_count > 1;
+    encoder_ = new ExportEncoderAdapter(vertex_coordinate_, texture_coordinate_);
+    encoder_->SetEncodeProfile(GetEncodeProfile());
+    encoder_->SetSegmentEncoderCount(segment_encoder_count);
+    if (segment_export_) {
+        CreateSegmentCacheKeys(copy_parameters, width, height, frame_rate, video_bit_rate);
+    }
+    if (nullptr != copy_parameters) {
+        encoder_->SetCopyParameterSets(copy_parameters->extradata, copy_parameters->extradata_size);
+        avcodec_parameters_free(&copy_parameters);
+    }
     encoder_->Init(width, height, video_bit_rate * 1000, frame_rate);
+    // 导出由解码出来的时间戳驱动, 不按系统时间丢帧
+    encoder_->SetOffline(true);
+    // NV12的UV在shader中只需要一次采样, x264也可以直接使用
+    encoder_->SetYUVFormat(YUV_FORMAT_NV12);
     audio_encoder_adapter_ = new AudioEncoderAdapter();
-    audio_encoder_adapter_->Init(packet_pool_, 44100, 1, 128 * 1000, "libfdk_aac");
+    audio_encoder_adapter_->Init(packet_pool_, vocal_sample_rate_, vocal_channel_count_, audio_bit_rate * 1000, "libfdk_aac");
     MediaClip* clip = clip_deque_.at(0);
     LOGE("StartDecode");
     StartDecode(clip);
     pthread_mutex_init(&media_mutex_, nullptr);
     pthread_cond_init(&media_cond_, nullptr);
-    pthread_create(&export_video_thread_, nullptr, ExportVideoThread, this);
+    // 视频线程结束前会等待音频线程, 先创建音频线程
     pthread_create(&export_audio_thread_, nullptr, ExportAudioThread, this);
+    pthread_create(&export_video_thread_, nullptr, ExportVideoThread, this);
     return 0;
 }
 
@@ -358,7 +440,16 @@ void VideoExport::ProcessVideoExport() {
 
     FrameBuffer* frame_buffer = new FrameBuffer(video_width_, video_height_, DEFAULT_VERTEX_SHADER, DEFAULT_FRAGMENT_SHADER);
     encoder_->CreateEncoder(egl_core_, frame_buffer->GetTextureId());
-    while (true) {
+    if (segment_export_) {
+        ProcessSegmentExport(frame_buffer);
+        // 等待音频全部处理完成
+        pthread_mutex_lock(&media_mutex_);
+        while (export_ing) {
+            pthread_cond_wait(&media_cond_, &media_mutex_);
+        }
+        pthread_mutex_unlock(&media_mutex_);
+    }
+    while (!segment_export_) {
         pthread_mutex_lock(&media_mutex_);
         if (nullptr == media_decode_) {
             if (!export_ing) {
@@ -371,14 +462,11 @@ void VideoExport::ProcessVideoExport() {
         if (!export_ing) {
             break;
         }
-        if (media_decode_->video_frame_queue.size == 0) {
-            av_usleep(10000);
+        // 阻塞等待解码出新的一帧, 不用sleep轮询
+        Frame* vp = frame_queue_peek_readable(&media_decode_->video_frame_queue);
+        if (nullptr == vp) {
             continue;
         }
-        if (frame_queue_nb_remaining(&media_decode_->video_frame_queue) == 0) {
-            continue;
-        }
-        Frame* vp = frame_queue_peek(&media_decode_->video_frame_queue);
         if (vp->serial != media_decode_->video_packet_queue.serial) {
             frame_queue_next(&media_decode_->video_frame_queue);
             continue;
@@ -421,6 +509,8 @@ void VideoExport::ProcessVideoExport() {
             }
         }
     }
+    // 等待音频线程把剩余的数据送给编码器
+    pthread_join(export_audio_thread_, nullptr);
     encoder_->DestroyEncoder();
     delete encoder_;
     packet_thread_->Stop();
@@ -443,6 +533,10 @@ void VideoExport::ProcessVideoExport() {
         delete clip;
     }
     clip_deque_.clear();
+    for (auto segment : segments_) {
+        delete segment;
+    }
+    segments_.clear();
 
     egl_core_->ReleaseSurface(egl_surface_);
     egl_core_->Release();
@@ -453,6 +547,480 @@ void VideoExport::ProcessVideoExport() {
     OnExportComplete();
 }
 
+bool VideoExport::CanRemux() {
+    cJSON* effects = cJSON_GetObjectItem(export_config_json_, "effects");
+    if (nullptr != effects && cJSON_GetArraySize(effects) > 0) {
+        return false;
+    }
+    cJSON* musics = cJSON_GetObjectItem(export_config_json_, "musics");
+    if (nullptr != musics && cJSON_GetArraySize(musics) > 0) {
+        return false;
+    }
+    return true;
+}
+
+void* VideoExport::ExportRemuxThread(void *context) {
+    VideoExport* video_export = reinterpret_cast<VideoExport*>(context);
+    video_export->ProcessRemuxExport();
+    pthread_exit(0);
+}
+
+void VideoExport::OnRemuxProgress(int64_t time, void *context) {
+    VideoExport* video_export = reinterpret_cast<VideoExport*>(context);
+    video_export->OnExportProgress(static_cast<uint64_t>(time));
+}
+
+void VideoExport::ProcessRemuxExport() {
+    int ret = video_remux_->Remux();
+    if (ret < 0) {
+        LOGE("remux error: %d", ret);
+    }
+    video_remux_->Destroy();
+    delete video_remux_;
+    video_remux_ = nullptr;
+
+    if (nullptr != export_config_json_) {
+        cJSON_Delete(export_config_json_);
+        export_config_json_ = nullptr;
+    }
+    for (auto clip : clip_deque_) {
+        delete clip;
+    }
+    clip_deque_.clear();
+    export_ing = false;
+    // 通知java层合成完成
+    OnExportComplete();
+}
+
+void VideoExport::CreateSegments() {
+    int64_t timeline_offset = 0;
+    for (auto clip : clip_deque_) {
+        int64_t duration = clip->end_time - clip->start_time;
+        if (clip->end_time == 0 || duration <= 0) {
+            // 不知道时长时整个clip作为一段
+            ExportSegment* segment = new ExportSegment();
+            segment->index = static_cast<int>(segments_.size());
+            segment->clip = clip;
+            segment->start_time = clip->start_time;
+            segment->end_time = INT64_MAX;
+            segment->timeline_offset = timeline_offset;
+            segments_.push_back(segment);
+            continue;
+        }
+        int count = static_cast<int>((duration + EXPORT_SEGMENT_DURATION - 1) / EXPORT_SEGMENT_DURATION);
+        // 最后一段太短时合并到前一段, 减少多出来的关键帧
+        if (count > 1 && duration - (count - 1) * EXPORT_SEGMENT_DURATION < EXPORT_SEGMENT_DURATION / 2) {
+            count--;
+        }
+        for (int i = 0; i < count; i++) {
+            ExportSegment* segment = new ExportSegment();
+            segment->index = static_cast<int>(segments_.size());
+            segment->clip = clip;
+            segment->start_time = clip->start_time + i * EXPORT_SEGMENT_DURATION;
+            segment->end_time = i == count - 1 ? clip->end_time : segment->start_time + EXPORT_SEGMENT_DURATION;
+            segment->timeline_offset = timeline_offset + i * EXPORT_SEGMENT_DURATION;
+            segments_.push_back(segment);
+        }
+        timeline_offset += duration;
+    }
+}
+
+AVCodecParameters* VideoExport::CreateSmartSegments(int width, int height) {
+    if (GetEncodeProfile() == ENCODE_PROFILE_LIVE) {
+        return nullptr;
+    }
+    std::vector<std::pair<int64_t, int64_t>> effect_ranges;
+    GetEffectRanges(&effect_ranges);
+    AVRational mills_time_base = { 1, 1000 };
+    AVCodecParameters* parameters = nullptr;
+    bool has_copy = false;
+    bool success = true;
+    int64_t timeline_offset = 0;
+    for (auto clip : clip_deque_) {
+        // 不知道结束时间时不能确定最后一个GOP是否完整
+        if (clip->end_time <= clip->start_time) {
+            success = false;
+            break;
+        }
+        AVFormatContext* context = nullptr;
+        int video_index = -1;
+        int audio_index = -1;
+        if (VideoRemux::OpenClip(clip->file_name, &context, &video_index, &audio_index) < 0) {
+            success = false;
+            break;
+        }
+        AVStream* stream = context->streams[video_index];
+        AVCodecParameters* video = stream->codecpar;
+        // 有B帧时GOP的边界和显示顺序不一致, NAL的长度需要是4字节, 和编码出来的数据一致
+        // Annex-B格式或者不完整的extradata不是avcC, 不能直接复制
+        success = VideoRemux::IsCopyableVideo(video, width, height) && video->video_delay == 0 &&
+                nullptr != video->extradata && video->extradata_size >= 7 && video->extradata[0] == 1 &&
+                (video->extradata[4] & 0x03) == 0x03;
+        if (success && nullptr == parameters) {
+            parameters = avcodec_parameters_alloc();
+            avcodec_parameters_copy(parameters, video);
+        } else if (success) {
+            // 输出文件中只有一组源文件的参数集
+            success = parameters->extradata_size == video->extradata_size &&
+                    memcmp(parameters->extradata, video->extradata, video->extradata_size) == 0;
+        }
+        std::vector<int64_t> key_frames;
+        for (int i = 0; success && i < stream->nb_index_entries; i++) {
+            if (stream->index_entries[i].flags & AVINDEX_KEYFRAME) {
+                key_frames.push_back(av_rescale_q(stream->index_entries[i].timestamp, stream->time_base, mills_time_base));
+            }
+        }
+        int64_t stream_end = INT64_MAX;
+        if (stream->duration != AV_NOPTS_VALUE) {
+            int64_t start = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+            stream_end = av_rescale_q(start + stream->duration, stream->time_base, mills_time_base);
+        }
+        avformat_close_input(&context);
+        if (!success || key_frames.empty()) {
+            success = false;
+            break;
+        }
+
+        std::vector<int64_t> bounds;
+        bounds.push_back(clip->start_time);
+        for (auto key_frame : key_frames) {
+            if (key_frame > clip->start_time && key_frame < clip->end_time) {
+                bounds.push_back(key_frame);
+            }
+        }
+        bounds.push_back(clip->end_time);
+        ExportSegment* segment = nullptr;
+        for (size_t i = 0; i + 1 < bounds.size(); i++) {
+            int64_t begin = bounds.at(i);
+            int64_t end = bounds.at(i + 1);
+            // 从关键帧开始, 到下一个关键帧或者文件结束的GOP才能直接复制
+            bool copy = std::binary_search(key_frames.begin(), key_frames.end(), begin) &&
+                    (end >= stream_end || std::binary_search(key_frames.begin(), key_frames.end(), end));
+            for (auto& range : effect_ranges) {
+                if (range.first < end && range.second >= begin) {
+                    copy = false;
+                    break;
+                }
+            }
+            // 相邻的GOP合并, 编码的段不超过分段编码的时长, 保证可以并行编码
+            if (nullptr != segment && segment->copy == copy &&
+                    (copy || end - segment->start_time <= EXPORT_SEGMENT_DURATION)) {
+                segment->end_time = end;
+                continue;
+            }
+            segment = new ExportSegment();
+            segment->index = static_cast<int>(segments_.size());
+            segment->clip = clip;
+            segment->start_time = begin;
+            segment->end_time = end;
+            segment->timeline_offset = timeline_offset + begin - clip->start_time;
+            segment->copy = copy;
+            segments_.push_back(segment);
+            has_copy = has_copy || copy;
+        }
+        timeline_offset += clip->end_time - clip->start_time;
+    }
+    if (!success || !has_copy) {
+        for (auto segment : segments_) {
+            delete segment;
+        }
+        segments_.clear();
+        if (nullptr != parameters) {
+            avcodec_parameters_free(&parameters);
+        }
+        return nullptr;
+    }
+    LOGI("smart export segment count: %d", static_cast<int>(segments_.size()));
+    return parameters;
+}
+
+void VideoExport::GetEffectRanges(std::vector<std::pair<int64_t, int64_t>>* ranges) {
+    cJSON* effects = cJSON_GetObjectItem(export_config_json_, "effects");
+    if (nullptr == effects) {
+        return;
+    }
+    int effect_size = cJSON_GetArraySize(effects);
+    for (int i = 0; i < effect_size; ++i) {
+        cJSON* effects_child = cJSON_GetArrayItem(effects, i);
+        cJSON* config_json = cJSON_GetObjectItem(effects_child, "config");
+        if (nullptr == config_json || nullptr == config_json->valuestring) {
+            continue;
+        }
+        cJSON* config = cJSON_Parse(config_json->valuestring);
+        if (nullptr == config) {
+            continue;
+        }
+        // 和ImageProcess解析时的默认值一致
+        cJSON* start_time_json = cJSON_GetObjectItem(config, "startTime");
+        cJSON* end_time_json = cJSON_GetObjectItem(config, "endTime");
+        int64_t start_time = nullptr == start_time_json ? 0 : start_time_json->valueint;
+        int64_t end_time = nullptr == end_time_json ? INT_MAX : end_time_json->valueint;
+        ranges->push_back(std::make_pair(start_time, end_time));
+        cJSON_Delete(config);
+    }
+}
+
+ExportSegment* VideoExport::NextRenderSegment(size_t* next_segment, int64_t* finish_duration) {
+    while (*next_segment < segments_.size()) {
+        ExportSegment* segment = segments_.at((*next_segment)++);
+        if (!segment->copy && !encoder_->IsSegmentCached(segment->cache_key)) {
+            return segment;
+        }
+        *finish_duration += segment->end_time - segment->start_time;
+        if (!segment->copy) {
+            // 上一次导出时已经编码过, 输入没有变化
+            encoder_->StartCacheSegment(segment->index, segment->cache_key, segment->timeline_offset);
+            continue;
+        }
+        // 直接复制的段由自己的线程读取, 不占用解码器
+        encoder_->StartCopySegment(segment->index, segment->clip->file_name, segment->start_time,
+                segment->end_time, segment->timeline_offset);
+    }
+    return nullptr;
+}
+
+void VideoExport::CreateSegmentCacheKeys(AVCodecParameters* copy_parameters, int width, int height,
+        int frame_rate, int video_bit_rate) {
+    cJSON* directory = cJSON_GetObjectItem(export_config_json_, "segment_cache_dir");
+    if (nullptr == directory || nullptr == directory->valuestring) {
+        return;
+    }
+    encoder_->SetSegmentCache(directory->valuestring);
+    // 所有段共用的输入: 编码参数和智能导出时源文件的参数集
+    SegmentHash common;
+    common.Update(static_cast<int64_t>(EXPORT_SEGMENT_CACHE_VERSION));
+    common.Update(static_cast<int64_t>(width));
+    common.Update(static_cast<int64_t>(height));
+    common.Update(static_cast<int64_t>(frame_rate));
+    common.Update(static_cast<int64_t>(video_bit_rate));
+    common.Update(static_cast<int64_t>(GetEncodeProfile()));
+    if (nullptr != copy_parameters) {
+        common.Update(copy_parameters->extradata, copy_parameters->extradata_size);
+    }
+    cJSON* effects = cJSON_GetObjectItem(export_config_json_, "effects");
+    int effect_size = nullptr == effects ? 0 : cJSON_GetArraySize(effects);
+    int cache_count = 0;
+    for (auto segment : segments_) {
+        if (segment->copy || segment->end_time == INT64_MAX) {
+            continue;
+        }
+        // 源文件只比较路径, 大小和修改时间, 不读取文件内容
+        struct stat file_stat;
+        if (stat(segment->clip->file_name, &file_stat) != 0) {
+            continue;
+        }
+        SegmentHash hash = common;
+        hash.Update(segment->clip->file_name);
+        hash.Update(static_cast<int64_t>(file_stat.st_size));
+        hash.Update(static_cast<int64_t>(file_stat.st_mtime));
+        hash.Update(segment->start_time);
+        hash.Update(segment->end_time);
+        // 只有和这一段重叠的特效影响这一段, 修改其它位置的特效时这一段的缓存仍然可以使用
+        for (int i = 0; i < effect_size; ++i) {
+            cJSON* effects_child = cJSON_GetArrayItem(effects, i);
+            cJSON* config_json = cJSON_GetObjectItem(effects_child, "config");
+            cJSON* action_id_json = cJSON_GetObjectItem(effects_child, "actionId");
+            if (nullptr == config_json || nullptr == config_json->valuestring) {
+                continue;
+            }
+            cJSON* config = cJSON_Parse(config_json->valuestring);
+            if (nullptr == config) {
+                continue;
+            }
+            // 和GetEffectRanges的默认值一致
+            cJSON* start_time_json = cJSON_GetObjectItem(config, "startTime");
+            cJSON* end_time_json = cJSON_GetObjectItem(config, "endTime");
+            int64_t start_time = nullptr == start_time_json ? 0 : start_time_json->valueint;
+            int64_t end_time = nullptr == end_time_json ? INT_MAX : end_time_json->valueint;
+            cJSON_Delete(config);
+            if (start_time >= segment->end_time || end_time < segment->start_time) {
+                continue;
+            }
+            hash.Update(static_cast<int64_t>(nullptr == action_id_json ? 0 : action_id_json->valueint));
+            hash.Update(config_json->valuestring);
+        }
+        segment->cache_key = hash.Digest();
+        if (segment->cache_key == 0) {
+            segment->cache_key = 1;
+        }
+        if (encoder_->IsSegmentCached(segment->cache_key)) {
+            cache_count++;
+        }
+    }
+    LOGI("segment cache: %s cached: %d segments: %d", directory->valuestring, cache_count,
+            static_cast<int>(segments_.size()));
+}
+
+int VideoExport::GetSegmentEncoderCount() {
+    // 录制的编码配置使用一路编码
+    if (GetEncodeProfile() == ENCODE_PROFILE_LIVE) {
+        return 0;
+    }
+    // 每个核编码一段
+    int count = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    if (count > EXPORT_SEGMENT_MAX_ENCODERS) {
+        count = EXPORT_SEGMENT_MAX_ENCODERS;
+    }
+    if (count > static_cast<int>(segments_.size())) {
+        count = static_cast<int>(segments_.size());
+    }
+    return count;
+}
+
+void VideoExport::ProcessSegmentExport(FrameBuffer* frame_buffer) {
+    int decoder_count = encoder_->GetSegmentEncoderCount();
+    SegmentDecoder* decoders = new SegmentDecoder[decoder_count];
+    memset(decoders, 0, sizeof(SegmentDecoder) * decoder_count);
+    size_t next_segment = 0;
+    int active_count = 0;
+    // 已经结束的段的总时长, 用来计算进度
+    int64_t finish_duration = 0;
+    for (int i = 0; i < decoder_count; i++) {
+        ExportSegment* segment = NextRenderSegment(&next_segment, &finish_duration);
+        if (nullptr == segment) {
+            break;
+        }
+        StartSegmentDecode(decoders + i, segment);
+        active_count++;
+    }
+    while (active_count > 0) {
+        for (int i = 0; i < decoder_count; i++) {
+            SegmentDecoder* decoder = decoders + i;
+            if (nullptr == decoder->segment) {
+                continue;
+            }
+            if (RenderSegmentFrame(decoder, frame_buffer) > 0) {
+                continue;
+            }
+            ExportSegment* segment = decoder->segment;
+            encoder_->EndSegment(segment->index);
+            finish_duration += decoder->current_time - segment->start_time;
+            StopSegmentDecode(decoder);
+            active_count--;
+            ExportSegment* next = NextRenderSegment(&next_segment, &finish_duration);
+            if (nullptr != next) {
+                StartSegmentDecode(decoder, next);
+                active_count++;
+            }
+        }
+        int64_t current_time = finish_duration;
+        for (int i = 0; i < decoder_count; i++) {
+            if (nullptr != decoders[i].segment) {
+                current_time += decoders[i].current_time - decoders[i].segment->start_time;
+            }
+        }
+        OnExportProgress(static_cast<uint64_t>(current_time));
+    }
+    delete[] decoders;
+}
+
+void VideoExport::StartSegmentDecode(SegmentDecoder* decoder, ExportSegment* segment) {
+    decoder->segment = segment;
+    decoder->current_time = segment->start_time;
+    decoder->frame_width = 0;
+    decoder->frame_height = 0;
+    decoder->yuv_render = nullptr;
+
+    MediaDecode* media_decode = reinterpret_cast<MediaDecode*>(av_malloc(sizeof(MediaDecode)));
+    memset(media_decode, 0, sizeof(MediaDecode));
+    // 从开始时间之前的关键帧开始解码, 开始时间之前的帧在渲染时丢弃
+    int64_t start_time = segment->start_time - EXPORT_SEGMENT_MARGIN;
+    media_decode->start_time = start_time < segment->clip->start_time ? segment->clip->start_time : start_time;
+    media_decode->end_time = segment->end_time == INT64_MAX ? INT64_MAX : segment->end_time + EXPORT_SEGMENT_MARGIN;
+    media_decode->precision_seek = 1;
+    media_decode->audio_disable = 1;
+
+    StateEvent* state_event = reinterpret_cast<StateEvent*>(av_malloc(sizeof(StateEvent)));
+    memset(state_event, 0, sizeof(StateEvent));
+    state_event->context = decoder;
+    state_event->on_complete_event = OnSegmentCompleteState;
+    media_decode->state_event = state_event;
+    decoder->media_decode = media_decode;
+    decoder->state_event = state_event;
+
+    encoder_->StartSegment(segment->index, segment->cache_key, segment->timeline_offset);
+    av_decode_start(media_decode, segment->clip->file_name);
+}
+
+void VideoExport::StopSegmentDecode(SegmentDecoder* decoder) {
+    if (nullptr != decoder->media_decode) {
+        av_decode_destroy(decoder->media_decode);
+        av_free(decoder->media_decode);
+        decoder->media_decode = nullptr;
+    }
+    if (nullptr != decoder->state_event) {
+        av_free(decoder->state_event);
+        decoder->state_event = nullptr;
+    }
+    if (nullptr != decoder->yuv_render) {
+        delete decoder->yuv_render;
+        decoder->yuv_render = nullptr;
+    }
+    decoder->segment = nullptr;
+}
+
+int VideoExport::OnSegmentCompleteState(StateEvent* event) {
+    SegmentDecoder* decoder = reinterpret_cast<SegmentDecoder*>(event->context);
+    MediaDecode* media_decode = decoder->media_decode;
+    // 解码已经结束并且没有可以读取的帧时, 让等待中的渲染线程返回
+    if (frame_queue_nb_remaining(&media_decode->video_frame_queue) == 0) {
+        packet_queue_abort(&media_decode->video_packet_queue);
+        return 1;
+    }
+    return 0;
+}
+
+int VideoExport::RenderSegmentFrame(SegmentDecoder* decoder, FrameBuffer* frame_buffer) {
+    MediaDecode* media_decode = decoder->media_decode;
+    ExportSegment* segment = decoder->segment;
+    while (true) {
+        Frame* vp = frame_queue_peek_readable(&media_decode->video_frame_queue);
+        if (nullptr == vp) {
+            return 0;
+        }
+        if (vp->serial != media_decode->video_packet_queue.serial) {
+            frame_queue_next(&media_decode->video_frame_queue);
+            continue;
+        }
+        frame_queue_next(&media_decode->video_frame_queue);
+        Frame* frame = frame_queue_peek_last(&media_decode->video_frame_queue);
+        if (nullptr == frame->frame || isnan(frame->pts) || frame->uploaded) {
+            continue;
+        }
+        int64_t time = (int64_t) (frame->frame->pts * av_q2d(media_decode->video_stream->time_base) * 1000);
+        if (time < segment->start_time) {
+            continue;
+        }
+        if (time >= segment->end_time) {
+            return 0;
+        }
+        int width = MIN(frame->frame->linesize[0], frame->frame->width);
+        int height = frame->frame->height;
+        if (decoder->frame_width != width || decoder->frame_height != height) {
+            decoder->frame_width = width;
+            decoder->frame_height = height;
+            if (nullptr != decoder->yuv_render) {
+                delete decoder->yuv_render;
+            }
+            decoder->yuv_render = new YuvRender(frame->width, frame->height, video_width_, video_height_, 0);
+        }
+        int texture_id = decoder->yuv_render->DrawFrame(frame->frame);
+        if (image_process_ != nullptr) {
+            texture_id = image_process_->Process(texture_id, time, frame->width, frame->height, 0, 0);
+        }
+        frame_buffer->OnDrawFrame(texture_id);
+        if (!egl_core_->SwapBuffers(egl_surface_)) {
+            LOGE("eglSwapBuffers error: %d", eglGetError());
+        }
+        // 每一段在时间线上是连续的, 和clip中的开始时间无关
+        int64_t timeline = segment->timeline_offset + time - segment->start_time;
+        encoder_->Encode(static_cast<int>(timeline), segment->index);
+        frame->uploaded = 1;
+        decoder->current_time = time;
+        return 1;
+    }
+}
+
 void VideoExport::OnExportProgress(uint64_t current_time) {
     if (video_duration_ == 0) {
         LOGE("video_duration is 0");
@@ -522,142 +1090,47 @@ void VideoExport::ProcessAudioExport() {
             break;
         }
 
-        AudioPacket* music_packet = nullptr;
-        for (int i = 0; i < music_decoder_deque_.size(); ++i) {
-            auto* decoder = music_decoder_deque_.at(i);
-            music_packet = decoder->DecodePacket();
-            auto resample = resample_deque_.at(i);
-
-            short* stereoSamples = music_packet->buffer;
-            int stereoSampleSize = music_packet->size;
-            if (stereoSampleSize > 0) {
-                int monoSampleSize = stereoSampleSize / 2;
-                auto** samples = new short*[2];
-                samples[0] = new short[monoSampleSize];
-                samples[1] = new short[monoSampleSize];
-                for (int index = 0; index < monoSampleSize; index++) {
-                    samples[0][index] = stereoSamples[2 * index];
-                    samples[1][index] = stereoSamples[2 * index + 1];
-                }
-                float transfer_ratio = accompany_sample_rate_ / static_cast<float>(vocal_sample_rate_);
-                int accompanySampleSize = static_cast<int>(monoSampleSize * 1.0f / transfer_ratio);
-                uint8_t out_data[accompanySampleSize * 2 * 2];
-                int out_nb_bytes = 0;
-                resample->Process(samples, out_data, monoSampleSize, &out_nb_bytes);
-                delete[] samples[0];
-                delete[] samples[1];
-                delete[] stereoSamples;
-                if (out_nb_bytes > 0) {
-                    accompanySampleSize = out_nb_bytes / 2;
-                    auto* accompanySamples = new short[accompanySampleSize];
-                    convertShortArrayFromByteArray(out_data, out_nb_bytes, accompanySamples, 1.0);
-                    music_packet->buffer = accompanySamples;
-                    music_packet->size = accompanySampleSize;
-                }
-            }
-        }
-
-        int audio_size = Resample();
-        if (audio_size > 0) {
-            // TODO buffer池
-            auto *packet = new AudioPacket();
-            auto *samples = new short[audio_size / sizeof(short)];
-            memcpy(samples, audio_buf, audio_size);
-            if (music_packet != nullptr && nullptr != music_packet->buffer) {
-                auto* mix = new short[audio_size];
-                mixtureAccompanyAudio(samples, music_packet->buffer, audio_size / sizeof(short), mix);
-                packet->buffer = mix;
-            } else {
-                packet->buffer = samples;
-            }
-            packet->size = audio_size / sizeof(short);
-            packet_pool_->PushAudioPacketToQueue(packet);
+        AVFrame* frame = ReadAudioFrame();
+        if (nullptr == frame || clip_audio_source_->Write(frame) < 0) {
+            continue;
         }
+        // 按视频原声已经转换好的数据量混音
+        MixAudioPacket(clip_audio_source_->Available());
     }
-    if (nullptr != swr_context_) {
-        swr_free(&swr_context_);
-    }
-    for (auto decoder : music_decoder_deque_) {
-        decoder->Destroy();
-        delete decoder;
-    }
-    music_decoder_deque_.clear();
-    for (auto resample : resample_deque_) {
-        resample->Destroy();
-        delete resample;
+    // 取出重采样器和fifo中剩余的视频原声, 不然最后一段声音会丢失
+    clip_audio_source_->SetEndOfStream();
+    MixAudioPacket(clip_audio_source_->Available());
+    // 混音器会释放所有轨道的数据来源
+    audio_mixer_->Destroy();
+    delete audio_mixer_;
+    audio_mixer_ = nullptr;
+    clip_audio_source_ = nullptr;
+}
+
+void VideoExport::MixAudioPacket(int nb_samples) {
+    if (nb_samples <= 0) {
+        return;
     }
-    resample_deque_.clear();
+    // TODO buffer池
+    auto *packet = new AudioPacket();
+    packet->buffer = new short[nb_samples * vocal_channel_count_];
+    packet->size = nb_samples * vocal_channel_count_;
+    // 编码器使用的是s16, 只在混音输出时转换一次
+    audio_mixer_->Mix(packet->buffer, nb_samples);
+    packet_pool_->PushAudioPacketToQueue(packet);
 }
 
-int VideoExport::Resample() {
+AVFrame* VideoExport::ReadAudioFrame() {
     Frame* frame;
     do {
         frame = frame_queue_peek_readable(&media_decode_->sample_frame_queue);
         if (!frame) {
             LOGE("frame_queue_peek_readable error");
-            return 0;
+            return nullptr;
         }
         frame_queue_next(&media_decode_->sample_frame_queue);
     } while (frame->serial != media_decode_->audio_packet_queue.serial);
-
-    int data_size = av_samples_get_buffer_size(NULL, av_frame_get_channels(frame->frame),
-                                               frame->frame->nb_samples, (AVSampleFormat) frame->frame->format, 1);
-
-    if (nullptr == swr_context_) {
-        uint64_t dec_channel_layout = (frame->frame->channel_layout && av_frame_get_channels(frame->frame) == av_get_channel_layout_nb_channels(frame->frame->channel_layout)) ?
-                                      frame->frame->channel_layout : av_get_default_channel_layout(av_frame_get_channels(frame->frame));
-        swr_context_ = swr_alloc_set_opts(NULL, media_decode_->audio_tgt.channel_layout, media_decode_->audio_tgt.fmt, media_decode_->audio_tgt.freq,
-                                          dec_channel_layout, (AVSampleFormat) frame->frame->format, frame->frame->sample_rate, 0, NULL);
-        if (!swr_context_ || swr_init(swr_context_) < 0) {
-            av_log(NULL, AV_LOG_ERROR,
-                   "Cannot create sample rate converter for conversion of %d Hz %s %d channels to %d Hz %s %d channels!\n",
-                   frame->frame->sample_rate, av_get_sample_fmt_name((AVSampleFormat) frame->frame->format), av_frame_get_channels(frame->frame),
-                   media_decode_->audio_tgt.freq, av_get_sample_fmt_name(media_decode_->audio_tgt.fmt), media_decode_->audio_tgt.channels);
-            swr_free(&swr_context_);
-            return -1;
-        }
-    }
-    unsigned int audio_buf1_size = 0;
-    int wanted_nb_sample = frame->frame->nb_samples;
-    int resample_data_size;
-    if (swr_context_) {
-        const uint8_t **in = (const uint8_t **) frame->frame->extended_data;
-        uint8_t **out = &audio_buf1;
-        int out_count = wanted_nb_sample * media_decode_->audio_tgt.freq / frame->frame->sample_rate + 256;
-        int out_size = av_samples_get_buffer_size(NULL, media_decode_->audio_tgt.channels, out_count, media_decode_->audio_tgt.fmt, 0);
-        if (out_size < 0) {
-            av_log(NULL, AV_LOG_ERROR, "av_samples_get_buffer_size() failed\n");
-            return -1;
-        }
-        if (wanted_nb_sample != frame->frame->nb_samples) {
-            if (swr_set_compensation(swr_context_, (wanted_nb_sample - frame->frame->nb_samples) * media_decode_->audio_tgt.freq / frame->frame->sample_rate,
-                                     wanted_nb_sample * media_decode_->audio_tgt.freq / frame->frame->sample_rate) < 0) {
-                av_log(NULL, AV_LOG_ERROR, "swr_set_compensation() failed\n");
-                return -1;
-            }
-        }
-        av_fast_malloc(&audio_buf1, &audio_buf1_size, out_size);
-        if (!audio_buf1) {
-            return AVERROR(ENOMEM);
-        }
-        int len2 = swr_convert(swr_context_, out, out_count, in, frame->frame->nb_samples);
-        if (len2 < 0) {
-            av_log(NULL, AV_LOG_ERROR, "swr_convert() failed\n");
-            return -1;
-        }
-        if (len2 == out_count) {
-            av_log(NULL, AV_LOG_WARNING, "audio buffer is probably too samll.\n");
-            if (swr_init(swr_context_) < 0) {
-                swr_free(&swr_context_);
-            }
-        }
-        audio_buf = audio_buf1;
-        resample_data_size = len2 * media_decode_->audio_tgt.channels * av_get_bytes_per_sample(media_decode_->audio_tgt.fmt);
-    } else {
-        audio_buf = frame->frame->data[0];
-        resample_data_size = data_size;
-    }
-    return resample_data_size;
+    return frame->frame;
 }
 
 }  // namespace trinity
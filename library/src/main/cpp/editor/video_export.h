@@ -27,13 +27,18 @@
 #include <deque>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include "video_encoder_adapter.h"
+#include "video_x264_encoder.h"
+#include "export_encoder_adapter.h"
 #include "audio_encoder_adapter.h"
 #include "video_consumer_thread.h"
-#include "music_decoder.h"
-#include "decode/resample.h"
+#include "video_remux.h"
+#include "audio_mixer.h"
+#include "resample_source.h"
 #include "yuv_render.h"
+#include "frame_buffer.h"
 #include "image_process.h"
 #include "handler.h"
 #include "trinity.h"
@@ -43,12 +48,45 @@ extern "C" {
 #include "cJSON.h"
 };
 
+/** 分段编码时每一段的时长, 是关键帧间隔的整数倍, 单位是毫秒 **/
+#define EXPORT_SEGMENT_DURATION         (EXPORT_KEY_FRAME_INTERVAL * 3 * 1000)
+/** 每一段在开始和结束位置多解码的时长, 避免B帧的解码顺序导致边界上的帧丢失 **/
+#define EXPORT_SEGMENT_MARGIN           500
+/** 段缓存的版本, 编码或者渲染的方式变化时修改, 之前的缓存全部失效 **/
+#define EXPORT_SEGMENT_CACHE_VERSION    1
+
 namespace trinity {
 
 enum {
     kStartNextExport
 };
 
+typedef struct {
+    int index;
+    MediaClip* clip;
+    /** 在clip中的时间范围, 单位是毫秒 **/
+    int64_t start_time;
+    int64_t end_time;
+    /** 这一段在导出文件中的开始时间 **/
+    int64_t timeline_offset;
+    /** 智能导出时没有变化的段, 直接复制源文件的数据 **/
+    bool copy;
+    /** 影响这一段编码结果的输入的哈希, 为0时不使用缓存 **/
+    uint64_t cache_key;
+} ExportSegment;
+
+// 分段导出时每一段的解码和渲染状态
+typedef struct {
+    ExportSegment* segment;
+    MediaDecode* media_decode;
+    StateEvent* state_event;
+    YuvRender* yuv_render;
+    int frame_width;
+    int frame_height;
+    /** 已经渲染到的clip中的时间 **/
+    int64_t current_time;
+} SegmentDecoder;
+
 class VideoExportHandler;
 
 class VideoExport {
@@ -67,15 +105,46 @@ class VideoExport {
     static int OnCompleteState(StateEvent* event);
     static void* ExportAudioThread(void* context);
     static void* ExportMessageThread(void* context);
+    static void* ExportRemuxThread(void* context);
+    static void OnRemuxProgress(int64_t time, void* context);
     void StartDecode(MediaClip* clip);
+    EncodeProfile GetEncodeProfile();
+    // 配置中的fragment_duration, 大于0时导出分段mp4, 单位是毫秒
+    int GetFragmentDuration();
     void FreeResource();
     void OnEffect();
     void OnMusics();
     void ProcessVideoExport();
+    // 没有特效和音乐时可以尝试直接复制压缩数据
+    bool CanRemux();
+    void ProcessRemuxExport();
+    // 按关键帧间隔的整数倍把时间线切分成段
+    void CreateSegments();
+    // 智能导出, 按关键帧把clip切分成GOP, 只有剪切点和特效时间范围内的GOP需要编码
+    // 其它的GOP直接复制, 返回源文件的编码参数, 不能使用时返回nullptr
+    AVCodecParameters* CreateSmartSegments(int width, int height);
+    // 特效的时间范围, 单位是毫秒
+    void GetEffectRanges(std::vector<std::pair<int64_t, int64_t>>* ranges);
+    // 返回下一个需要解码的段, 中间直接复制的段交给encoder_
+    ExportSegment* NextRenderSegment(size_t* next_segment, int64_t* finish_duration);
+    // 计算每个编码的段的缓存key, 配置中没有segment_cache_dir时不使用缓存
+    void CreateSegmentCacheKeys(AVCodecParameters* copy_parameters, int width, int height,
+            int frame_rate, int video_bit_rate);
+    int GetSegmentEncoderCount();
+    // 多个段同时解码, 轮流渲染每一段的一帧, 每一段由自己的x264编码
+    void ProcessSegmentExport(FrameBuffer* frame_buffer);
+    void StartSegmentDecode(SegmentDecoder* decoder, ExportSegment* segment);
+    void StopSegmentDecode(SegmentDecoder* decoder);
+    // 渲染这一段的下一帧, 返回0表示这一段已经结束
+    int RenderSegmentFrame(SegmentDecoder* decoder, FrameBuffer* frame_buffer);
+    static int OnSegmentCompleteState(StateEvent* event);
     void ProcessAudioExport();
     void OnExportProgress(uint64_t current_time);
     void OnExportComplete();
-    int Resample();
+    // 取出下一帧解码后的视频原声
+    AVFrame* ReadAudioFrame();
+    // 混音nb_samples帧送给编码器
+    void MixAudioPacket(int nb_samples);
     void ProcessMessage();
 
  private:
@@ -85,11 +154,11 @@ class VideoExport {
     pthread_t export_video_thread_;
     pthread_t export_audio_thread_;
     std::deque<MediaClip*> clip_deque_;
-    std::deque<MusicDecoder*> music_decoder_deque_;
-    std::deque<trinity::Resample*> resample_deque_;
-    int accompany_packet_buffer_size_;
-    int accompany_sample_rate_;
+    AudioMixer* audio_mixer_;
+    ResampleSource* clip_audio_source_;
+    /** 合成音频的采样率和声道数, 所有音频源都转换成这个格式 **/
     int vocal_sample_rate_;
+    int vocal_channel_count_;
     bool export_ing;
     EGLCore* egl_core_;
     EGLSurface egl_surface_;
@@ -102,15 +171,12 @@ class VideoExport {
     int frame_height_;
     YuvRender* yuv_render_;
     ImageProcess* image_process_;
-    VideoEncoderAdapter* encoder_;
+    ExportEncoderAdapter* encoder_;
     AudioEncoderAdapter* audio_encoder_adapter_;
     VideoConsumerThread* packet_thread_;
     PacketPool* packet_pool_;
     uint64_t current_time_;
     uint64_t previous_time_;
-    SwrContext* swr_context_;
-    uint8_t *audio_buf;
-    uint8_t *audio_buf1;
     short* audio_samples_;
     VideoExportHandler* video_export_handler_;
     MessageQueue* video_export_message_queue_;
@@ -118,6 +184,11 @@ class VideoExport {
     int time_diff_;
     pthread_mutex_t media_mutex_;
     pthread_cond_t media_cond_;
+    std::vector<ExportSegment*> segments_;
+    /** 分段导出时视频由每一段自己解码, 按clip顺序的解码只处理音频 **/
+    bool segment_export_;
+    /** 不为空时使用复制压缩数据的快速导出 **/
+    VideoRemux* video_remux_;
 
     cJSON* export_config_json_;
     GLfloat* vertex_coordinate_;
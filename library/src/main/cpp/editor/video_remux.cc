@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include "video_remux.h"
+#include <string.h>
+#include "android_xlog.h"
+
+namespace trinity {
+
+static bool IsSameExtraData(AVCodecParameters* a, AVCodecParameters* b) {
+    return a->extradata_size == b->extradata_size &&
+           (a->extradata_size == 0 || memcmp(a->extradata, b->extradata, a->extradata_size) == 0);
+}
+
+VideoRemux::VideoRemux()
+    : muxer_(nullptr),
+      width_(0),
+      height_(0),
+      sample_rate_(0),
+      channels_(0),
+      has_audio_(false),
+      video_parameters_(nullptr),
+      audio_parameters_(nullptr),
+      timeline_offset_(0),
+      timeline_end_(0),
+      progress_callback_(nullptr),
+      progress_context_(nullptr),
+      fragment_duration_(0),
+      expected_duration_(0) {
+}
+
+VideoRemux::~VideoRemux() {}
+
+int VideoRemux::Init(const char *path, std::deque<MediaClip *> &clips, int width, int height,
+        int sample_rate, int channels) {
+    width_ = width;
+    height_ = height;
+    sample_rate_ = sample_rate;
+    channels_ = channels;
+    for (auto clip : clips) {
+        AVFormatContext* context = nullptr;
+        int video_index = -1;
+        int audio_index = -1;
+        int ret = OpenClip(clip->file_name, &context, &video_index, &audio_index);
+        if (ret < 0) {
+            return ret;
+        }
+        bool copy = CheckClip(context, video_index, audio_index);
+        avformat_close_input(&context);
+        if (!copy) {
+            LOGI("clip: %s can not remux", clip->file_name);
+            return -1;
+        }
+        clips_.push_back(clip);
+    }
+    if (nullptr == video_parameters_) {
+        return -1;
+    }
+    muxer_ = new CopyMuxer();
+    muxer_->SetFragmentDuration(fragment_duration_);
+    muxer_->SetExpectedDuration(expected_duration_);
+    int ret = muxer_->Init(path, video_parameters_, audio_parameters_);
+    if (ret < 0) {
+        muxer_->Stop();
+        delete muxer_;
+        muxer_ = nullptr;
+        return ret;
+    }
+    return 0;
+}
+
+void VideoRemux::SetProgressCallback(void (*progress)(int64_t, void *), void *context) {
+    progress_callback_ = progress;
+    progress_context_ = context;
+}
+
+void VideoRemux::SetFragmentDuration(int duration) {
+    fragment_duration_ = duration;
+}
+
+void VideoRemux::SetExpectedDuration(int64_t duration) {
+    expected_duration_ = duration;
+}
+
+int VideoRemux::OpenClip(const char *file_name, AVFormatContext **context, int *video_index, int *audio_index) {
+    int ret = avformat_open_input(context, file_name, nullptr, nullptr);
+    if (ret < 0) {
+        LOGE("open %s error: %s", file_name, av_err2str(ret));
+        return ret;
+    }
+    ret = avformat_find_stream_info(*context, nullptr);
+    if (ret < 0) {
+        LOGE("find stream info error: %s", av_err2str(ret));
+        avformat_close_input(context);
+        return ret;
+    }
+    *video_index = av_find_best_stream(*context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    *audio_index = av_find_best_stream(*context, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (*video_index < 0) {
+        LOGE("%s has no video stream", file_name);
+        avformat_close_input(context);
+        return -1;
+    }
+    return 0;
+}
+
+bool VideoRemux::IsCopyableVideo(AVCodecParameters *video, int width, int height) {
+    if (video->codec_id != AV_CODEC_ID_H264 || video->width != width || video->height != height) {
+        return false;
+    }
+    // mp4中需要avcC格式的extradata, Annex-B的源文件不直接复制
+    return video->extradata_size >= 7 && video->extradata[0] == 1;
+}
+
+bool VideoRemux::CheckClip(AVFormatContext *context, int video_index, int audio_index) {
+    AVCodecParameters* video = context->streams[video_index]->codecpar;
+    if (!IsCopyableVideo(video, width_, height_)) {
+        return false;
+    }
+    AVCodecParameters* audio = audio_index >= 0 ? context->streams[audio_index]->codecpar : nullptr;
+    if (nullptr != audio && (audio->codec_id != AV_CODEC_ID_AAC ||
+            audio->sample_rate != sample_rate_ || audio->channels != channels_)) {
+        return false;
+    }
+    if (nullptr == video_parameters_) {
+        video_parameters_ = avcodec_parameters_alloc();
+        avcodec_parameters_copy(video_parameters_, video);
+        has_audio_ = nullptr != audio;
+        if (has_audio_) {
+            audio_parameters_ = avcodec_parameters_alloc();
+            avcodec_parameters_copy(audio_parameters_, audio);
+        }
+        return true;
+    }
+    // 输出文件只有一份SPS/PPS, 所有clip的参数都必须一样
+    if (!IsSameExtraData(video_parameters_, video)) {
+        return false;
+    }
+    if (has_audio_ != (nullptr != audio)) {
+        return false;
+    }
+    return !has_audio_ || IsSameExtraData(audio_parameters_, audio);
+}
+
+int VideoRemux::Remux() {
+    if (nullptr == muxer_) {
+        return -1;
+    }
+    int ret = 0;
+    for (auto clip : clips_) {
+        ret = RemuxClip(clip);
+        if (ret < 0) {
+            break;
+        }
+        timeline_offset_ = timeline_end_;
+    }
+    muxer_->Stop();
+    delete muxer_;
+    muxer_ = nullptr;
+    return ret;
+}
+
+int VideoRemux::RemuxClip(MediaClip *clip) {
+    AVFormatContext* context = nullptr;
+    int video_index = -1;
+    int audio_index = -1;
+    int ret = OpenClip(clip->file_name, &context, &video_index, &audio_index);
+    if (ret < 0) {
+        return ret;
+    }
+    if (!has_audio_) {
+        audio_index = -1;
+    }
+    int64_t start_time = clip->start_time * (AV_TIME_BASE / 1000);
+    int64_t end_time = clip->end_time == 0 ? INT64_MAX : clip->end_time * (AV_TIME_BASE / 1000);
+    if (start_time > 0) {
+        int64_t timestamp = start_time;
+        if (context->start_time != AV_NOPTS_VALUE) {
+            timestamp += context->start_time;
+        }
+        // 从开始时间之前的关键帧开始复制
+        ret = avformat_seek_file(context, -1, INT64_MIN, timestamp, timestamp, 0);
+        if (ret < 0) {
+            LOGE("seek %s error: %s", clip->file_name, av_err2str(ret));
+        }
+    }
+
+    AVStream* video_stream = context->streams[video_index];
+    AVStream* audio_stream = audio_index >= 0 ? context->streams[audio_index] : nullptr;
+    /** 第一个视频关键帧的dts, 作为这个clip在时间线上的0点, 单位是微秒 **/
+    int64_t origin = AV_NOPTS_VALUE;
+    /** 关键帧之前读到的音频, 确定了0点之后再写入 **/
+    std::vector<AVPacket*> pending_audio;
+    bool video_end = false;
+    bool audio_end = nullptr == audio_stream;
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = nullptr;
+    packet.size = 0;
+    ret = 0;
+    while (!video_end || !audio_end) {
+        ret = av_read_frame(context, &packet);
+        if (ret < 0) {
+            if (ret == AVERROR_EOF) {
+                ret = 0;
+            } else {
+                LOGE("read %s error: %s", clip->file_name, av_err2str(ret));
+            }
+            break;
+        }
+        bool video = packet.stream_index == video_index;
+        if (!video && packet.stream_index != audio_index) {
+            av_packet_unref(&packet);
+            continue;
+        }
+        AVStream* stream = video ? video_stream : audio_stream;
+        int64_t timestamp = packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+        if (timestamp == AV_NOPTS_VALUE) {
+            av_packet_unref(&packet);
+            continue;
+        }
+        int64_t time = av_rescale_q(timestamp, stream->time_base, AV_TIME_BASE_Q);
+        if (!video) {
+            if (audio_end || time >= end_time) {
+                audio_end = true;
+                av_packet_unref(&packet);
+                continue;
+            }
+            if (origin == AV_NOPTS_VALUE) {
+                AVPacket* audio_packet = av_packet_alloc();
+                av_packet_move_ref(audio_packet, &packet);
+                pending_audio.push_back(audio_packet);
+                continue;
+            }
+            if (time < origin) {
+                av_packet_unref(&packet);
+                continue;
+            }
+        } else {
+            // 按dts截断, 保证结束时间之前的帧参考的帧都已经写入
+            if (video_end || time >= end_time) {
+                video_end = true;
+                av_packet_unref(&packet);
+                continue;
+            }
+            if (origin == AV_NOPTS_VALUE) {
+                if (!(packet.flags & AV_PKT_FLAG_KEY)) {
+                    av_packet_unref(&packet);
+                    continue;
+                }
+                origin = time;
+                for (auto audio_packet : pending_audio) {
+                    int64_t audio_time = av_rescale_q(audio_packet->dts != AV_NOPTS_VALUE ? audio_packet->dts : audio_packet->pts,
+                            audio_stream->time_base, AV_TIME_BASE_Q);
+                    if (ret >= 0 && audio_time >= origin) {
+                        ret = WritePacket(audio_packet, audio_stream, false, origin);
+                    }
+                    av_packet_free(&audio_packet);
+                }
+                pending_audio.clear();
+                if (ret < 0) {
+                    av_packet_unref(&packet);
+                    break;
+                }
+            }
+        }
+        ret = WritePacket(&packet, stream, video, origin);
+        av_packet_unref(&packet);
+        if (ret < 0) {
+            break;
+        }
+        if (video && nullptr != progress_callback_) {
+            progress_callback_((timeline_offset_ + time - origin) / 1000, progress_context_);
+        }
+    }
+    for (auto audio_packet : pending_audio) {
+        av_packet_free(&audio_packet);
+    }
+    avformat_close_input(&context);
+    return ret;
+}
+
+int VideoRemux::WritePacket(AVPacket *packet, AVStream *stream, bool video, int64_t origin) {
+    int64_t offset = av_rescale_q(timeline_offset_ - origin, AV_TIME_BASE_Q, stream->time_base);
+    if (packet->pts != AV_NOPTS_VALUE) {
+        packet->pts += offset;
+    }
+    if (packet->dts != AV_NOPTS_VALUE) {
+        packet->dts += offset;
+    }
+    // 下一个clip接在这个clip最后一帧的后面
+    int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (packet->dts != AV_NOPTS_VALUE && packet->dts > timestamp) {
+        timestamp = packet->dts;
+    }
+    int64_t end = av_rescale_q(timestamp + packet->duration, stream->time_base, AV_TIME_BASE_Q);
+    if (end > timeline_end_) {
+        timeline_end_ = end;
+    }
+    return muxer_->WritePacket(packet, stream->time_base, video);
+}
+
+void VideoRemux::Destroy() {
+    if (nullptr != muxer_) {
+        muxer_->Stop();
+        delete muxer_;
+        muxer_ = nullptr;
+    }
+    if (nullptr != video_parameters_) {
+        avcodec_parameters_free(&video_parameters_);
+    }
+    if (nullptr != audio_parameters_) {
+        avcodec_parameters_free(&audio_parameters_);
+    }
+    clips_.clear();
+}
+
+}  // namespace trinity
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#ifndef TRINITY_VIDEO_REMUX_H
+#define TRINITY_VIDEO_REMUX_H
+
+#include <deque>
+#include <vector>
+
+#include "copy_muxer.h"
+#include "trinity.h"
+
+namespace trinity {
+
+// 没有特效和音乐时的快速导出
+// 所有clip的编码参数和导出参数一致时, 不解码直接复制压缩数据
+// 每个clip从开始时间之前的关键帧开始复制, 时间戳依次接到上一个clip的后面
+class VideoRemux {
+ public:
+    VideoRemux();
+    ~VideoRemux();
+
+    // 检查所有clip是否可以直接复制, 可以复制时打开输出文件并返回0
+    // 返回负数时需要使用解码再编码的导出
+    int Init(const char* path, std::deque<MediaClip*>& clips, int width, int height,
+            int sample_rate, int channels);
+    // 进度回调的时间单位是毫秒
+    void SetProgressCallback(void (*progress)(int64_t time, void* context), void* context);
+    // 需要在Init之前调用, 大于0时写入分段mp4, 单位是毫秒
+    void SetFragmentDuration(int duration);
+    // 需要在Init之前调用, 按预计的时长在文件头预留moov, 单位是毫秒
+    void SetExpectedDuration(int64_t duration);
+    // 在当前线程按顺序复制所有clip, 结束时已经写入文件尾
+    int Remux();
+    void Destroy();
+
+    // 打开clip并找到音视频流, 没有视频流时返回负数
+    static int OpenClip(const char* file_name, AVFormatContext** context, int* video_index, int* audio_index);
+    // 目标尺寸的H.264, 并且extradata是avcC格式时才可以直接复制到mp4
+    static bool IsCopyableVideo(AVCodecParameters* video, int width, int height);
+
+ private:
+    // 检查clip的编码参数, 第一个clip的参数作为输出文件的参数
+    bool CheckClip(AVFormatContext* context, int video_index, int audio_index);
+    int RemuxClip(MediaClip* clip);
+    // 把时间戳移到时间线上, 并写入muxer
+    int WritePacket(AVPacket* packet, AVStream* stream, bool video, int64_t origin);
+
+ private:
+    std::vector<MediaClip*> clips_;
+    CopyMuxer* muxer_;
+    int width_;
+    int height_;
+    int sample_rate_;
+    int channels_;
+    bool has_audio_;
+    /** 第一个clip的编码参数 **/
+    AVCodecParameters* video_parameters_;
+    AVCodecParameters* audio_parameters_;
+    /** 当前clip在时间线上的开始时间, 和时间线的结束时间, 单位是微秒 **/
+    int64_t timeline_offset_;
+    int64_t timeline_end_;
+    void (*progress_callback_)(int64_t time, void* context);
+    void* progress_context_;
+    int fragment_duration_;
+    int64_t expected_duration_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_VIDEO_REMUX_H
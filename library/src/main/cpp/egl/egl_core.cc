@@ -147,17 +147,32 @@ bool EGLCore::Init(EGLContext sharedContext) {
         return false;
     }
 
-    if (!eglChooseConfig(display_, attribs, &config_, 1, &numConfigs)) {
-        LOGE("eglChooseConfig() returned error %d", eglGetError());
-        Release();
-        return false;
+    context_ = EGL_NO_CONTEXT;
+    // 优先创建GLES3的环境, 编码时可以使用PBO异步读取像素, 不支持时使用GLES2
+    // 只链接GLESv2时也创建, GLES3的函数在EncodeRender中运行时获取
+    const EGLint attribs3[] = { EGL_BUFFER_SIZE, 32, EGL_ALPHA_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_RED_SIZE, 8, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+                                EGL_SURFACE_TYPE, EGL_WINDOW_BIT, EGL_NONE };
+    EGLint eglContext3Attributes[] = { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE };
+    if (eglChooseConfig(display_, attribs3, &config_, 1, &numConfigs) && numConfigs > 0) {
+        context_ = eglCreateContext(display_, config_, NULL == sharedContext ? EGL_NO_CONTEXT : sharedContext, eglContext3Attributes);
+    }
+    if (EGL_NO_CONTEXT == context_) {
+        LOGI("create GLES3 context failed, fallback to GLES2");
     }
 
-    EGLint eglContextAttributes[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
-    if (!(context_ = eglCreateContext(display_, config_, NULL == sharedContext ? EGL_NO_CONTEXT : sharedContext, eglContextAttributes))) {
-        LOGE("eglCreateContext() returned error %d", eglGetError());
-        Release();
-        return false;
+    if (EGL_NO_CONTEXT == context_) {
+        if (!eglChooseConfig(display_, attribs, &config_, 1, &numConfigs)) {
+            LOGE("eglChooseConfig() returned error %d", eglGetError());
+            Release();
+            return false;
+        }
+
+        EGLint eglContextAttributes[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+        if (!(context_ = eglCreateContext(display_, config_, NULL == sharedContext ? EGL_NO_CONTEXT : sharedContext, eglContextAttributes))) {
+            LOGE("eglCreateContext() returned error %d", eglGetError());
+            Release();
+            return false;
+        }
     }
 
     pfneglPresentationTimeANDROID = (PFNEGLPRESENTATIONTIMEANDROIDPROC)eglGetProcAddress("eglPresentationTimeANDROID");
@@ -41,7 +41,7 @@ AudioEncoder::AudioEncoder()
 AudioEncoder::~AudioEncoder() {}
 
 int AudioEncoder::Init(int bit_rate, int channels, int sample_rate, const char *codec_name,
-                       int (*PCMFrameCallback)(int16_t *, int, int, double *, void *context), void *context) {
+                       int (*PCMFrameCallback)(int16_t *, int, int, int64_t *, void *context), void *context) {
     bit_rate_ = bit_rate;
     channels_ = channels;
     sample_rate_ = sample_rate;
@@ -53,8 +53,8 @@ int AudioEncoder::Init(int bit_rate, int channels, int sample_rate, const char *
 }
 
 int AudioEncoder::Encode(AudioPacket **packet) {
-    double presentation_time_mills = -1;
-    int sample_size = pcm_frame_callback_((int16_t*) audio_samples_data_[0], audio_nb_frames_, channels_, &presentation_time_mills, pcm_frame_context_);
+    int64_t pts = -1;
+    int sample_size = pcm_frame_callback_((int16_t*) audio_samples_data_[0], audio_nb_frames_, channels_, &pts, pcm_frame_context_);
     if (sample_size <= 0) {
         LOGE("audio_frame_callback failed return size: %d", sample_size);
         return -1;
@@ -69,8 +69,9 @@ int AudioEncoder::Encode(AudioPacket **packet) {
     pkt.pts = pkt.dts = 0;
     encode_frame_->nb_samples = frame_num;
     avcodec_fill_audio_frame(encode_frame_, codec_context_->channels, codec_context_->sample_fmt, audio_samples_data_[0], audio_sample_size, 0);
-    encode_frame_->pts = audio_next_pts_;
-    audio_next_pts_ += encode_frame_->nb_samples;
+    // 输入的数据带有时间戳时使用输入的时间戳, 否则按已经编码的采样数累加
+    encode_frame_->pts = pts >= 0 ? pts : audio_next_pts_;
+    audio_next_pts_ = encode_frame_->pts + encode_frame_->nb_samples;
     int got_packet;
     int ret = avcodec_encode_audio2(codec_context_, &pkt, encode_frame_, &got_packet);
     if (ret < 0 || !got_packet) {
@@ -84,7 +85,7 @@ int AudioEncoder::Encode(AudioPacket **packet) {
         (*packet)->data = new uint8_t[pkt.size];
         memcpy((*packet)->data, pkt.data, pkt.size);
         (*packet)->size = pkt.size;
-        (*packet)->position = (float) (pkt.pts * av_q2d(time_base) * 1000.0f);
+        (*packet)->pts = pkt.pts;
     }
     av_free_packet(&pkt);
     return ret;
@@ -142,6 +143,7 @@ int AudioEncoder::AllocAudioStream(const char *codec_name) {
     codec_context_ = avcodec_alloc_context3(codec);
     codec_context_->codec_type = AVMEDIA_TYPE_AUDIO;
     codec_context_->sample_rate = sample_rate_;
+    codec_context_->time_base = { 1, sample_rate_ };
     codec_context_->bit_rate = bit_rate_;
     codec_context_->sample_fmt = AV_SAMPLE_FMT_S16;
     codec_context_->channel_layout = channels_ == 1 ? AV_CH_LAYOUT_MONO : AV_CH_LAYOUT_STEREO;
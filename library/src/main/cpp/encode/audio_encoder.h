@@ -43,7 +43,7 @@ class AudioEncoder {
     int channels_;
     int sample_rate_;
 
-    typedef int (*PCMFrameCallback)(int16_t *, int, int, double *, void *context);
+    typedef int (*PCMFrameCallback)(int16_t *, int, int, int64_t *, void *context);
     PCMFrameCallback pcm_frame_callback_;
     void *pcm_frame_context_;
 
@@ -56,7 +56,7 @@ class AudioEncoder {
     virtual ~AudioEncoder();
 
     int Init(int bit_rate, int channels, int sample_rate, const char* codec_name,
-             int (*PCMFrameCallback)(int16_t *, int, int, double *, void *context),
+             int (*PCMFrameCallback)(int16_t *, int, int, int64_t *, void *context),
              void* context);
 
     int Encode(AudioPacket** packet);
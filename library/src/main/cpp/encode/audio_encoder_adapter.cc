@@ -35,7 +35,7 @@ AudioEncoderAdapter::AudioEncoderAdapter() {
     audio_channels_ = 0;
     audio_bit_rate_ = 0;
     audio_codec_name_ = nullptr;
-    packet_buffer_presentation_time_mills_ = 0;
+    packet_buffer_pts_ = -1;
 }
 
 AudioEncoderAdapter::~AudioEncoderAdapter() {
@@ -61,7 +61,7 @@ void AudioEncoderAdapter::Init(PacketPool *pool, int audio_sample_rate, int audi
     pthread_create(&audio_encoder_thread_, nullptr, StartEncodeThread, this);
 }
 
-int AudioEncoderAdapter::GetAudioFrame(int16_t *samples, int frame_size, int nb_channels, double *presentation_time_mills) {
+int AudioEncoderAdapter::GetAudioFrame(int16_t *samples, int frame_size, int nb_channels, int64_t *pts) {
     int size = frame_size * nb_channels * 2;
     int sample_cursor = 0;
     while (true) {
@@ -74,12 +74,12 @@ int AudioEncoderAdapter::GetAudioFrame(int16_t *samples, int frame_size, int nb_
 
         int samples_short_size = (size - sample_cursor * 2) / 2;
         if (packet_buffer_cursor_ + samples_short_size <= packet_buffer_size_) {
-            CopyToSamples(samples, sample_cursor, samples_short_size, presentation_time_mills);
+            CopyToSamples(samples, sample_cursor, samples_short_size, pts);
             packet_buffer_cursor_ += samples_short_size;
             break;
         } else {
             int packet_buffer_size = packet_buffer_size_ - packet_buffer_cursor_;
-            CopyToSamples(samples, sample_cursor, packet_buffer_size, presentation_time_mills);
+            CopyToSamples(samples, sample_cursor, packet_buffer_size, pts);
             sample_cursor += packet_buffer_size;
             packet_buffer_size_ = 0;
             continue;
@@ -114,10 +114,10 @@ void *AudioEncoderAdapter::StartEncodeThread(void *context) {
     pthread_exit(0);
 }
 
-static int PCMFrameCallback(int16_t *samples, int frame_size, int nb_channels, double *presentationTimeMills,
+static int PCMFrameCallback(int16_t *samples, int frame_size, int nb_channels, int64_t *pts,
                             void *context) {
     AudioEncoderAdapter* adapter = reinterpret_cast<AudioEncoderAdapter*>(context);
-    return adapter->GetAudioFrame(samples, frame_size, nb_channels, presentationTimeMills);
+    return adapter->GetAudioFrame(samples, frame_size, nb_channels, pts);
 }
 
 void AudioEncoderAdapter::StartEncode() {
@@ -133,10 +133,9 @@ void AudioEncoderAdapter::StartEncode() {
 }
 
 int AudioEncoderAdapter::CopyToSamples(int16_t *samples, int sample_cursor, int buffer_size,
-                                       double *presentation_time_mills) {
+                                       int64_t *pts) {
     if (0 == sample_cursor) {
-        double packet_buffer_cursor_duration = (double) packet_buffer_cursor_ * 1000.0f / (double) (audio_sample_rate_ * 2.0);
-        (*presentation_time_mills) = packet_buffer_presentation_time_mills_ + packet_buffer_cursor_duration;
+        (*pts) = packet_buffer_pts_ < 0 ? -1 : packet_buffer_pts_ + packet_buffer_cursor_ / audio_channels_;
     }
     memcpy(samples + sample_cursor, packet_buffer_ + packet_buffer_cursor_, buffer_size * sizeof(short));
     return 1;
@@ -153,7 +152,7 @@ int AudioEncoderAdapter::GetAudioPacket() {
         }
     }
     packet_buffer_cursor_ = 0;
-    packet_buffer_presentation_time_mills_ = audioPacket->position;
+    packet_buffer_pts_ = audioPacket->pts;
     /**
      * 在Android平台 录制是单声道的 经过音效处理之后是双声道 channelRatio 2
      * 在iOS平台 录制的是双声道的 是已经处理音效过后的 channelRatio 1
@@ -35,7 +35,8 @@ class AudioEncoderAdapter {
     AudioEncoderAdapter();
     virtual ~AudioEncoderAdapter();
     virtual void Init(PacketPool* pool, int audio_sample_rate, int audio_channels, int audio_bit_rate, const char* audio_codec_name);
-    int GetAudioFrame(int16_t* samples, int frame_size, int nb_channels, double* presentation_time_mills);
+    // pts为这一帧第一个采样的时间戳, 单位是采样数
+    int GetAudioFrame(int16_t* samples, int frame_size, int nb_channels, int64_t* pts);
     virtual void Destroy();
 
  protected:
@@ -52,13 +53,14 @@ class AudioEncoderAdapter {
     int audio_channels_;
     int audio_bit_rate_;
     char* audio_codec_name_;
-    double packet_buffer_presentation_time_mills_;
+    /** 当前pcm包的时间戳, 单位是采样数 **/
+    int64_t packet_buffer_pts_;
     std::fstream output_stream_;
 
  protected:
     static void* StartEncodeThread(void* context);
     void StartEncode();
-    int CopyToSamples(int16_t* samples, int sample_cursor, int buffer_size, double* presentation_time_mills);
+    int CopyToSamples(int16_t* samples, int sample_cursor, int buffer_size, int64_t* pts);
     int GetAudioPacket();
 };
 
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include "color_convert.h"
+#include <string.h>
+#include <sys/time.h>
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COLOR_CONVERT_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define COLOR_CONVERT_SSE2
+#endif
+#include "android_xlog.h"
+
+namespace trinity {
+
+// 系数放大了256倍, 和EncodeRender中shader使用的系数一致
+static const ColorCoefficient BT601_LIMITED = { 66, 129, 25, 16, -38, -74, 112, 112, -94, -18 };
+static const ColorCoefficient BT601_FULL = { 77, 150, 29, 0, -43, -85, 128, 128, -107, -21 };
+static const ColorCoefficient BT709_LIMITED = { 47, 157, 16, 16, -26, -87, 112, 112, -102, -10 };
+static const ColorCoefficient BT709_FULL = { 54, 183, 18, 0, -29, -99, 128, 128, -116, -12 };
+
+static inline uint8_t Clamp(int value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline uint8_t Luma(const ColorCoefficient& c, const uint8_t* p) {
+    return Clamp(((c.yr * p[0] + c.yg * p[1] + c.yb * p[2] + 128) >> 8) + c.y_offset);
+}
+
+// 从begin开始转换一行或两行, begin需要是偶数, SIMD处理不完的部分也使用这个函数
+static void ConvertRowsC(const ColorCoefficient& c, const uint8_t* row0, const uint8_t* row1,
+        uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint8_t* uv, int begin, int width) {
+    for (int x = begin; x < width; x += 2) {
+        const uint8_t* p00 = row0 + x * 4;
+        const uint8_t* p10 = row1 + x * 4;
+        // 宽度是奇数时最后一列重复使用
+        const uint8_t* p01 = x + 1 < width ? p00 + 4 : p00;
+        const uint8_t* p11 = x + 1 < width ? p10 + 4 : p10;
+        y0[x] = Luma(c, p00);
+        if (x + 1 < width) {
+            y0[x + 1] = Luma(c, p01);
+        }
+        if (nullptr != y1) {
+            y1[x] = Luma(c, p10);
+            if (x + 1 < width) {
+                y1[x + 1] = Luma(c, p11);
+            }
+        }
+        int r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+        int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+        int b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+        uint8_t cb = Clamp(((c.ur * r + c.ug * g + c.ub * b + 128) >> 8) + 128);
+        uint8_t cr = Clamp(((c.vr * r + c.vg * g + c.vb * b + 128) >> 8) + 128);
+        int index = x >> 1;
+        if (nullptr != uv) {
+            uv[index * 2] = cb;
+            uv[index * 2 + 1] = cr;
+        } else {
+            u[index] = cb;
+            v[index] = cr;
+        }
+    }
+}
+
+#if defined(COLOR_CONVERT_NEON)
+
+static inline uint8x16_t LumaNEON(const uint8x16x4_t& p, uint8x8_t yr, uint8x8_t yg, uint8x8_t yb, uint8x16_t offset) {
+    uint16x8_t low = vmull_u8(vget_low_u8(p.val[0]), yr);
+    low = vmlal_u8(low, vget_low_u8(p.val[1]), yg);
+    low = vmlal_u8(low, vget_low_u8(p.val[2]), yb);
+    uint16x8_t high = vmull_u8(vget_high_u8(p.val[0]), yr);
+    high = vmlal_u8(high, vget_high_u8(p.val[1]), yg);
+    high = vmlal_u8(high, vget_high_u8(p.val[2]), yb);
+    return vqaddq_u8(vcombine_u8(vqrshrn_n_u16(low, 8), vqrshrn_n_u16(high, 8)), offset);
+}
+
+static inline uint8x8_t ChromaNEON(int16x8_t r, int16x8_t g, int16x8_t b, int16x8_t cr, int16x8_t cg, int16x8_t cb) {
+    // 平均值和系数的乘积不会超出int16的范围
+    int16x8_t sum = vmulq_s16(r, cr);
+    sum = vmlaq_s16(sum, g, cg);
+    sum = vmlaq_s16(sum, b, cb);
+    return vqmovun_s16(vaddq_s16(vrshrq_n_s16(sum, 8), vdupq_n_s16(128)));
+}
+
+// 每次处理16个像素, 返回处理完成的像素个数
+static int ConvertRowsSIMD(const ColorCoefficient& c, const uint8_t* row0, const uint8_t* row1,
+        uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint8_t* uv, int width) {
+    uint8x8_t yr = vdup_n_u8(static_cast<uint8_t>(c.yr));
+    uint8x8_t yg = vdup_n_u8(static_cast<uint8_t>(c.yg));
+    uint8x8_t yb = vdup_n_u8(static_cast<uint8_t>(c.yb));
+    uint8x16_t offset = vdupq_n_u8(static_cast<uint8_t>(c.y_offset));
+    int16x8_t ur = vdupq_n_s16(c.ur);
+    int16x8_t ug = vdupq_n_s16(c.ug);
+    int16x8_t ub = vdupq_n_s16(c.ub);
+    int16x8_t vr = vdupq_n_s16(c.vr);
+    int16x8_t vg = vdupq_n_s16(c.vg);
+    int16x8_t vb = vdupq_n_s16(c.vb);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t p0 = vld4q_u8(row0 + x * 4);
+        uint8x16x4_t p1 = vld4q_u8(row1 + x * 4);
+        vst1q_u8(y0 + x, LumaNEON(p0, yr, yg, yb, offset));
+        if (nullptr != y1) {
+            vst1q_u8(y1 + x, LumaNEON(p1, yr, yg, yb, offset));
+        }
+        // 相邻两个像素相加, 再加上下一行, 得到2x2的平均值
+        int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(vaddq_u16(vpaddlq_u8(p0.val[0]), vpaddlq_u8(p1.val[0])), 2));
+        int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(vaddq_u16(vpaddlq_u8(p0.val[1]), vpaddlq_u8(p1.val[1])), 2));
+        int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(vaddq_u16(vpaddlq_u8(p0.val[2]), vpaddlq_u8(p1.val[2])), 2));
+        uint8x8_t cb = ChromaNEON(r, g, b, ur, ug, ub);
+        uint8x8_t cr = ChromaNEON(r, g, b, vr, vg, vb);
+        if (nullptr != uv) {
+            uint8x8x2_t chroma;
+            chroma.val[0] = cb;
+            chroma.val[1] = cr;
+            vst2_u8(uv + x, chroma);
+        } else {
+            vst1_u8(u + (x >> 1), cb);
+            vst1_u8(v + (x >> 1), cr);
+        }
+    }
+    return x;
+}
+
+#elif defined(COLOR_CONVERT_SSE2)
+
+// lo和hi中各有两个扩展成int16的像素, 返回4个像素和系数的点积
+static inline __m128i Dot4SSE2(__m128i lo, __m128i hi, __m128i coefficient) {
+    __m128 t0 = _mm_castsi128_ps(_mm_madd_epi16(lo, coefficient));
+    __m128 t1 = _mm_castsi128_ps(_mm_madd_epi16(hi, coefficient));
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_add_epi32(even, odd);
+}
+
+static inline __m128i Luma4SSE2(__m128i pixel, __m128i coefficient) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i sum = Dot4SSE2(_mm_unpacklo_epi8(pixel, zero), _mm_unpackhi_epi8(pixel, zero), coefficient);
+    return _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+}
+
+// 两行各4个像素, 返回2x2平均之后的两个像素, 每个分量是int16
+static inline __m128i Average2SSE2(__m128i pixel0, __m128i pixel1) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(pixel0, zero), _mm_unpacklo_epi8(pixel1, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(pixel0, zero), _mm_unpackhi_epi8(pixel1, zero));
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    __m128i sum = _mm_unpacklo_epi64(lo, hi);
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+static inline __m128i Chroma8SSE2(const __m128i* average, __m128i coefficient) {
+    __m128i round = _mm_set1_epi32(128);
+    __m128i c0 = _mm_srai_epi32(_mm_add_epi32(Dot4SSE2(average[0], average[1], coefficient), round), 8);
+    __m128i c1 = _mm_srai_epi32(_mm_add_epi32(Dot4SSE2(average[2], average[3], coefficient), round), 8);
+    __m128i chroma = _mm_add_epi16(_mm_packs_epi32(c0, c1), _mm_set1_epi16(128));
+    return _mm_packus_epi16(chroma, chroma);
+}
+
+// 每次处理16个像素, 返回处理完成的像素个数
+static int ConvertRowsSIMD(const ColorCoefficient& c, const uint8_t* row0, const uint8_t* row1,
+        uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint8_t* uv, int width) {
+    __m128i y_coefficient = _mm_setr_epi16(c.yr, c.yg, c.yb, 0, c.yr, c.yg, c.yb, 0);
+    __m128i u_coefficient = _mm_setr_epi16(c.ur, c.ug, c.ub, 0, c.ur, c.ug, c.ub, 0);
+    __m128i v_coefficient = _mm_setr_epi16(c.vr, c.vg, c.vb, 0, c.vr, c.vg, c.vb, 0);
+    __m128i offset = _mm_set1_epi8(static_cast<char>(c.y_offset));
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i p0[4];
+        __m128i p1[4];
+        __m128i y[4];
+        __m128i average[4];
+        for (int i = 0; i < 4; i++) {
+            p0[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + (x + i * 4) * 4));
+            p1[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + (x + i * 4) * 4));
+            average[i] = Average2SSE2(p0[i], p1[i]);
+        }
+        for (int i = 0; i < 4; i++) {
+            y[i] = Luma4SSE2(p0[i], y_coefficient);
+        }
+        __m128i luma = _mm_packus_epi16(_mm_packs_epi32(y[0], y[1]), _mm_packs_epi32(y[2], y[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm_adds_epu8(luma, offset));
+        if (nullptr != y1) {
+            for (int i = 0; i < 4; i++) {
+                y[i] = Luma4SSE2(p1[i], y_coefficient);
+            }
+            luma = _mm_packus_epi16(_mm_packs_epi32(y[0], y[1]), _mm_packs_epi32(y[2], y[3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm_adds_epu8(luma, offset));
+        }
+        __m128i cb = Chroma8SSE2(average, u_coefficient);
+        __m128i cr = Chroma8SSE2(average, v_coefficient);
+        if (nullptr != uv) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), _mm_unpacklo_epi8(cb, cr));
+        } else {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(u + (x >> 1)), cb);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(v + (x >> 1)), cr);
+        }
+    }
+    return x;
+}
+
+#endif
+
+ColorConvert::ColorConvert()
+    : coefficient_(BT601_LIMITED),
+#if defined(COLOR_CONVERT_NEON) || defined(COLOR_CONVERT_SSE2)
+      simd_(true) {
+#else
+      simd_(false) {
+#endif
+}
+
+ColorConvert::~ColorConvert() {}
+
+void ColorConvert::SetColorSpace(ColorSpace color_space, bool full_range) {
+    if (color_space == COLOR_SPACE_BT709) {
+        coefficient_ = full_range ? BT709_FULL : BT709_LIMITED;
+    } else {
+        coefficient_ = full_range ? BT601_FULL : BT601_LIMITED;
+    }
+}
+
+void ColorConvert::SetSimd(bool simd) {
+#if defined(COLOR_CONVERT_NEON) || defined(COLOR_CONVERT_SSE2)
+    simd_ = simd;
+#else
+    simd_ = false;
+#endif
+}
+
+bool ColorConvert::IsSimd() {
+    return simd_;
+}
+
+const char* ColorConvert::GetSimdName() {
+#if defined(COLOR_CONVERT_NEON)
+    return "neon";
+#elif defined(COLOR_CONVERT_SSE2)
+    return "sse2";
+#else
+    return "none";
+#endif
+}
+
+int ColorConvert::RGBAToI420(const uint8_t* rgba, int rgba_stride, int width, int height,
+        uint8_t* y, int y_stride, uint8_t* u, int u_stride, uint8_t* v, int v_stride) {
+    if (nullptr == u || nullptr == v) {
+        return -1;
+    }
+    return Convert(rgba, rgba_stride, width, height, y, y_stride, u, u_stride, v, v_stride, nullptr, 0);
+}
+
+int ColorConvert::RGBAToNV12(const uint8_t* rgba, int rgba_stride, int width, int height,
+        uint8_t* y, int y_stride, uint8_t* uv, int uv_stride) {
+    if (nullptr == uv) {
+        return -1;
+    }
+    return Convert(rgba, rgba_stride, width, height, y, y_stride, nullptr, 0, nullptr, 0, uv, uv_stride);
+}
+
+int ColorConvert::Convert(const uint8_t* rgba, int rgba_stride, int width, int height,
+        uint8_t* y, int y_stride, uint8_t* u, int u_stride, uint8_t* v, int v_stride,
+        uint8_t* uv, int uv_stride) {
+    if (nullptr == rgba || nullptr == y || width <= 0 || height <= 0) {
+        return -1;
+    }
+    for (int row = 0; row < height; row += 2) {
+        // 高度是奇数时最后一行重复使用
+        bool has_next = row + 1 < height;
+        const uint8_t* row0 = rgba + row * rgba_stride;
+        const uint8_t* row1 = has_next ? row0 + rgba_stride : row0;
+        uint8_t* y0 = y + row * y_stride;
+        uint8_t* y1 = has_next ? y0 + y_stride : nullptr;
+        int chroma_row = row >> 1;
+        uint8_t* u_row = nullptr == u ? nullptr : u + chroma_row * u_stride;
+        uint8_t* v_row = nullptr == v ? nullptr : v + chroma_row * v_stride;
+        uint8_t* uv_row = nullptr == uv ? nullptr : uv + chroma_row * uv_stride;
+        int x = 0;
+#if defined(COLOR_CONVERT_NEON) || defined(COLOR_CONVERT_SSE2)
+        if (simd_) {
+            x = ConvertRowsSIMD(coefficient_, row0, row1, y0, y1, u_row, v_row, uv_row, width);
+        }
+#endif
+        ConvertRowsC(coefficient_, row0, row1, y0, y1, u_row, v_row, uv_row, x, width);
+    }
+    return 0;
+}
+
+int64_t ColorConvert::Benchmark(int width, int height, int count) {
+    if (width <= 0 || height <= 0 || count <= 0) {
+        return -1;
+    }
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    uint8_t* rgba = new uint8_t[width * height * 4];
+    uint8_t* yuv = new uint8_t[width * height + chroma_width * chroma_height * 2];
+    for (int i = 0; i < width * height * 4; i++) {
+        rgba[i] = static_cast<uint8_t>(i * 7);
+    }
+    uint8_t* u = yuv + width * height;
+    uint8_t* v = u + chroma_width * chroma_height;
+    struct timeval begin;
+    struct timeval end;
+    gettimeofday(&begin, nullptr);
+    for (int i = 0; i < count; i++) {
+        RGBAToI420(rgba, width * 4, width, height, yuv, width, u, chroma_width, v, chroma_width);
+    }
+    gettimeofday(&end, nullptr);
+    delete[] rgba;
+    delete[] yuv;
+    int64_t time = (end.tv_sec - begin.tv_sec) * 1000000LL + (end.tv_usec - begin.tv_usec);
+    LOGI("ColorConvert Benchmark %dx%d simd: %s %lld us", width, height, simd_ ? GetSimdName() : "none",
+            time / count);
+    return time / count;
+}
+
+}  // namespace trinity
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#ifndef TRINITY_COLOR_CONVERT_H
+#define TRINITY_COLOR_CONVERT_H
+
+#include <stdint.h>
+
+namespace trinity {
+
+/** 编码器输入的YUV格式 **/
+enum YUVFormat {
+    YUV_FORMAT_I420 = 0,
+    YUV_FORMAT_NV12
+};
+
+enum ColorSpace {
+    COLOR_SPACE_BT601 = 0,
+    COLOR_SPACE_BT709
+};
+
+/** RGB转YUV的系数, 放大了256倍 **/
+typedef struct {
+    int yr, yg, yb, y_offset;
+    int ur, ug, ub;
+    int vr, vg, vb;
+} ColorCoefficient;
+
+// CPU上把RGBA转换成I420或NV12
+// 支持BT.601/BT.709和limited/full range, 有NEON和SSE2的实现, 不支持时使用普通的C实现
+// 每2x2个像素取平均值计算一个UV, 和EncodeRender中shader的采样方式一致
+class ColorConvert {
+ public:
+    ColorConvert();
+    ~ColorConvert();
+
+    void SetColorSpace(ColorSpace color_space, bool full_range);
+    // false时强制使用C实现, 用来对比和测试
+    void SetSimd(bool simd);
+    bool IsSimd();
+    // 当前编译的SIMD实现, 没有时返回"none"
+    static const char* GetSimdName();
+
+    int RGBAToI420(const uint8_t* rgba, int rgba_stride, int width, int height,
+            uint8_t* y, int y_stride, uint8_t* u, int u_stride, uint8_t* v, int v_stride);
+    int RGBAToNV12(const uint8_t* rgba, int rgba_stride, int width, int height,
+            uint8_t* y, int y_stride, uint8_t* uv, int uv_stride);
+    // 转换count次width x height的I420, 返回平均每帧使用的时间, 单位是微秒
+    int64_t Benchmark(int width, int height, int count);
+
+ private:
+    int Convert(const uint8_t* rgba, int rgba_stride, int width, int height,
+            uint8_t* y, int y_stride, uint8_t* u, int u_stride, uint8_t* v, int v_stride,
+            uint8_t* uv, int uv_stride);
+
+ private:
+    ColorCoefficient coefficient_;
+    bool simd_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_COLOR_CONVERT_H
@@ -0,0 +1,592 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-10.
+//
+
+#include "export_encoder_adapter.h"
+#include <unistd.h>
+#include "android_xlog.h"
+
+namespace trinity {
+
+ExportEncoderAdapter::ExportEncoderAdapter(GLfloat* vertex_coordinate, GLfloat* texture_coordinate)
+    : vertex_coordinate_(nullptr),
+      texture_coordinate_(nullptr),
+      fbo_(0),
+      output_texture_id_(0),
+      yuv_texture_id_(0),
+      renderer_(nullptr),
+      encode_render_(nullptr),
+      pixel_size_(0),
+      yuv_packet_queue_(nullptr),
+      encoder_(nullptr),
+      encoder_thread_(0),
+      encoder_thread_created_(false),
+      encode_profile_(ENCODE_PROFILE_EXPORT_BALANCED),
+      segment_encoder_count_(0),
+      segment_input_finished_(false),
+      stitch_thread_(0),
+      stitch_thread_created_(false),
+      sps_buffer_(nullptr),
+      sps_size_(0),
+      last_dts_(INT64_MIN),
+      copy_extradata_(nullptr),
+      copy_extradata_size_(0),
+      parameter_sets_(nullptr),
+      parameter_sets_size_(0),
+      sps_id_(0),
+      segment_cache_(nullptr) {
+    pthread_mutex_init(&segment_mutex_, nullptr);
+    pthread_cond_init(&segment_condition_, nullptr);
+    // 和SoftEncoderAdapter一样, 通过坐标把图像旋转180度, 保证glReadPixels读取的数据不是上下颠倒的
+    if (nullptr != vertex_coordinate) {
+        vertex_coordinate_ = new GLfloat[8];
+        memcpy(vertex_coordinate_, vertex_coordinate, sizeof(GLfloat) * 8);
+    }
+    if (nullptr != texture_coordinate) {
+        texture_coordinate_ = new GLfloat[8];
+        memcpy(texture_coordinate_, texture_coordinate, sizeof(GLfloat) * 8);
+    }
+}
+
+ExportEncoderAdapter::~ExportEncoderAdapter() {
+    if (nullptr != vertex_coordinate_) {
+        delete[] vertex_coordinate_;
+        vertex_coordinate_ = nullptr;
+    }
+    if (nullptr != texture_coordinate_) {
+        delete[] texture_coordinate_;
+        texture_coordinate_ = nullptr;
+    }
+    if (nullptr != segment_cache_) {
+        delete segment_cache_;
+        segment_cache_ = nullptr;
+    }
+    pthread_mutex_destroy(&segment_mutex_);
+    pthread_cond_destroy(&segment_condition_);
+}
+
+void ExportEncoderAdapter::CreateEncoder(EGLCore* core, int texture_id) {
+    LOGI("enter ExportEncoderAdapter CreateEncoder");
+    texture_id_ = texture_id;
+    pixel_size_ = video_width_ * video_height_ * 3 / 2;
+    start_time_ = 0;
+    fps_change_time_ = 0;
+
+    renderer_ = new OpenGL(video_width_, video_height_);
+    encode_render_ = new EncodeRender(yuv_format_);
+    glGenFramebuffers(1, &fbo_);
+    output_texture_id_ = CreateTexture();
+    yuv_texture_id_ = CreateTexture();
+    // 有的GPU上shader转换比读取RGBA后在CPU上转换慢, 测试之后选择更快的方式
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, yuv_texture_id_, 0);
+    encode_render_->SelectConvertMode(output_texture_id_, video_width_, video_height_);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (segment_encoder_count_ > 1) {
+        // 每一段在StartSegment时创建编码器, 这里只启动拼接线程
+        if (nullptr != copy_extradata_ && CreateParameterSets() < 0) {
+            LOGE("create parameter sets error, copy segments may not decode");
+        }
+        segment_input_finished_ = false;
+        last_dts_ = INT64_MIN;
+        stitch_thread_created_ = pthread_create(&stitch_thread_, nullptr, StartStitchThread, this) == 0;
+        LOGI("leave ExportEncoderAdapter CreateEncoder segment_encoder_count: %d", segment_encoder_count_);
+        return;
+    }
+    // 同一路H.264只能按顺序编码, 多核交给x264内部的线程
+    int thread_count = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    if (thread_count > EXPORT_ENCODE_MAX_THREADS) {
+        thread_count = EXPORT_ENCODE_MAX_THREADS;
+    }
+    encoder_ = new VideoX264Encoder(0);
+    encoder_->SetThreadCount(thread_count);
+    encoder_->SetEncodeProfile(encode_profile_);
+    encoder_->SetPixelFormat(yuv_format_ == YUV_FORMAT_NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P);
+    encoder_->Init(video_width_, video_height_, video_bit_rate_, frame_rate_, packet_pool_);
+    yuv_packet_queue_ = new VideoPacketQueue();
+    yuv_packet_queue_->SetMaxSize(EXPORT_ENCODE_QUEUE_SIZE);
+    encoder_thread_created_ = pthread_create(&encoder_thread_, nullptr, StartEncodeThread, this) == 0;
+    LOGI("leave ExportEncoderAdapter CreateEncoder thread_count: %d", thread_count);
+}
+
+void ExportEncoderAdapter::Encode(int time_mills) {
+    if (nullptr == encode_render_ || nullptr == yuv_packet_queue_) {
+        return;
+    }
+    encode_frame_count_++;
+    uint8_t* buffer = new uint8_t[pixel_size_];
+    int packet_time_mills = 0;
+    if (ReadYUV(time_mills, buffer, &packet_time_mills) > 0) {
+        PutYUVPacket(buffer, packet_time_mills);
+    } else {
+        delete[] buffer;
+    }
+}
+
+void ExportEncoderAdapter::Encode(int time_mills, int segment) {
+    if (segment_encoder_count_ <= 1) {
+        Encode(time_mills);
+        return;
+    }
+    if (nullptr == encode_render_) {
+        return;
+    }
+    encode_frame_count_++;
+    pending_segments_.push_back(segment);
+    uint8_t* buffer = new uint8_t[pixel_size_];
+    int packet_time_mills = 0;
+    if (ReadYUV(time_mills, buffer, &packet_time_mills) > 0) {
+        PutSegmentPacket(buffer, packet_time_mills);
+    } else {
+        delete[] buffer;
+    }
+}
+
+void ExportEncoderAdapter::StartSegment(int segment, uint64_t cache_key, int64_t timeline_offset) {
+    SegmentEncoder* encoder = new SegmentEncoder(segment);
+    encoder->SetSpsId(sps_id_);
+    if (nullptr != segment_cache_ && cache_key != 0) {
+        encoder->SetCacheFile(segment_cache_->GetPath(cache_key), timeline_offset);
+    }
+    encoder->Start(video_width_, video_height_, video_bit_rate_, frame_rate_, GetSegmentThreadCount(), encode_profile_,
+            yuv_format_ == YUV_FORMAT_NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P);
+    pthread_mutex_lock(&segment_mutex_);
+    segment_encoders_.push_back(encoder);
+    pthread_cond_signal(&segment_condition_);
+    pthread_mutex_unlock(&segment_mutex_);
+}
+
+void ExportEncoderAdapter::EndSegment(int segment) {
+    // PBO中可能还有这一段的帧, 全部读取出来之后再结束
+    FlushSegmentPackets();
+    SegmentEncoder* encoder = FindSegment(segment);
+    if (nullptr != encoder) {
+        encoder->End();
+    }
+}
+
+void ExportEncoderAdapter::StartCopySegment(int segment, const char* file_name, int64_t start_time,
+        int64_t end_time, int64_t timeline_offset) {
+    SegmentEncoder* encoder = new SegmentEncoder(segment);
+    encoder->StartCopy(file_name, start_time, end_time, timeline_offset);
+    pthread_mutex_lock(&segment_mutex_);
+    segment_encoders_.push_back(encoder);
+    pthread_cond_signal(&segment_condition_);
+    pthread_mutex_unlock(&segment_mutex_);
+}
+
+void ExportEncoderAdapter::StartCacheSegment(int segment, uint64_t cache_key, int64_t timeline_offset) {
+    SegmentEncoder* encoder = new SegmentEncoder(segment);
+    encoder->StartCache(segment_cache_->GetPath(cache_key), timeline_offset);
+    pthread_mutex_lock(&segment_mutex_);
+    segment_encoders_.push_back(encoder);
+    pthread_cond_signal(&segment_condition_);
+    pthread_mutex_unlock(&segment_mutex_);
+}
+
+void ExportEncoderAdapter::SetSegmentCache(const char* directory) {
+    if (nullptr != segment_cache_) {
+        delete segment_cache_;
+        segment_cache_ = nullptr;
+    }
+    if (nullptr != directory && strlen(directory) > 0) {
+        segment_cache_ = new SegmentCache(directory);
+    }
+}
+
+bool ExportEncoderAdapter::IsSegmentCached(uint64_t cache_key) {
+    return nullptr != segment_cache_ && cache_key != 0 && segment_cache_->Contains(cache_key);
+}
+
+void ExportEncoderAdapter::SetCopyParameterSets(const uint8_t* extradata, int size) {
+    if (nullptr != copy_extradata_) {
+        delete[] copy_extradata_;
+        copy_extradata_ = nullptr;
+        copy_extradata_size_ = 0;
+    }
+    if (nullptr == extradata || size <= 0) {
+        return;
+    }
+    copy_extradata_ = new uint8_t[size];
+    memcpy(copy_extradata_, extradata, size);
+    copy_extradata_size_ = size;
+}
+
+int ExportEncoderAdapter::GetSegmentThreadCount() {
+    int thread_count = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)) / segment_encoder_count_;
+    return thread_count < 1 ? 1 : thread_count;
+}
+
+int ExportEncoderAdapter::CreateParameterSets() {
+    int source_size = H264AvccToAnnexb(copy_extradata_, copy_extradata_size_, nullptr);
+    if (source_size <= 0) {
+        return -1;
+    }
+    uint8_t* source = new uint8_t[source_size];
+    H264AvccToAnnexb(copy_extradata_, copy_extradata_size_, source);
+    H264Nal nals[H264_MAX_NAL_COUNT];
+    int count = H264ParseNals(source, source_size, nals, H264_MAX_NAL_COUNT);
+    // x264的sps和pps使用同一个id, 选一个源文件的sps和pps都没有用到的
+    uint32_t used_ids = 0;
+    for (int i = 0; i < count; i++) {
+        int id = H264ParameterSetId(source + nals[i].offset, nals[i].size);
+        if (id >= 0 && id < 32) {
+            used_ids |= 1u << id;
+        }
+    }
+    sps_id_ = 0;
+    while (sps_id_ < 32 && (used_ids & (1u << sps_id_))) {
+        sps_id_++;
+    }
+    if (sps_id_ >= 32) {
+        sps_id_ = 0;
+        delete[] source;
+        return -1;
+    }
+    // 打开一个和每一段配置相同的编码器, 打开时就可以得到参数集, 不需要编码
+    VideoX264Encoder* encoder = new VideoX264Encoder(0);
+    encoder->SetThreadCount(GetSegmentThreadCount());
+    encoder->SetEncodeProfile(encode_profile_);
+    encoder->SetPixelFormat(yuv_format_ == YUV_FORMAT_NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P);
+    encoder->SetSpsId(sps_id_);
+    encoder->SetGlobalHeader(true);
+    int ret = encoder->Init(video_width_, video_height_, video_bit_rate_, frame_rate_, nullptr);
+    int header_size = 0;
+    const uint8_t* header = ret < 0 ? nullptr : encoder->GetExtraData(&header_size);
+    const H264Nal* sps = nullptr;
+    const H264Nal* pps = nullptr;
+    H264Nal header_nals[H264_MAX_NAL_COUNT];
+    int header_count = nullptr == header ? 0 : H264ParseNals(header, header_size, header_nals, H264_MAX_NAL_COUNT);
+    for (int i = 0; i < header_count; i++) {
+        if (nullptr == sps && header_nals[i].type == H264_NALU_TYPE_SEQUENCE_PARAMETER_SET) {
+            sps = header_nals + i;
+        } else if (nullptr == pps && header_nals[i].type == H264_NALU_TYPE_PICTURE_PARAMETER_SET) {
+            pps = header_nals + i;
+        }
+    }
+    if (nullptr == sps || nullptr == pps) {
+        encoder->Destroy();
+        delete encoder;
+        delete[] source;
+        return -1;
+    }
+    // 和编码时输出的sps和pps的格式一样, 用来检查每一段的参数集是否一致
+    static const uint8_t start_code[4] = { 0x00, 0x00, 0x00, 0x01 };
+    sps_size_ = 4 + sps->size + 4 + pps->size;
+    sps_buffer_ = new uint8_t[sps_size_];
+    memcpy(sps_buffer_, start_code, 4);
+    memcpy(sps_buffer_ + 4, header + sps->offset, sps->size);
+    memcpy(sps_buffer_ + 4 + sps->size, start_code, 4);
+    memcpy(sps_buffer_ + 8 + sps->size, header + pps->offset, pps->size);
+    encoder->Destroy();
+    delete encoder;
+
+    parameter_sets_size_ = source_size + sps_size_;
+    parameter_sets_ = new uint8_t[parameter_sets_size_];
+    memcpy(parameter_sets_, source, source_size);
+    memcpy(parameter_sets_ + source_size, sps_buffer_, sps_size_);
+    delete[] source;
+    LOGI("create parameter sets sps_id: %d size: %d", sps_id_, parameter_sets_size_);
+    return 0;
+}
+
+int ExportEncoderAdapter::ReadYUV(int time_mills, uint8_t* buffer, int* out_time_mills) {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, output_texture_id_, 0);
+    if (nullptr != vertex_coordinate_ && nullptr != texture_coordinate_) {
+        renderer_->ProcessImage(texture_id_, vertex_coordinate_, texture_coordinate_);
+    } else {
+        renderer_->ProcessImage(texture_id_);
+    }
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, yuv_texture_id_, 0);
+    // GLES3时读取的是之前提交的帧, 当前帧在GPU上继续处理
+    int ret = encode_render_->CopyYUV420ImageAsync(output_texture_id_, buffer, video_width_, video_height_,
+            time_mills, out_time_mills);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return ret;
+}
+
+void ExportEncoderAdapter::DestroyEncoder() {
+    if (stitch_thread_created_) {
+        FlushSegmentPackets();
+        pthread_mutex_lock(&segment_mutex_);
+        // 异常退出时可能还有没有结束的段, 持有锁时拼接线程不会释放这些段
+        // 这些段的数据不完整, 不能保存到缓存
+        for (auto encoder : segment_encoders_) {
+            encoder->Cancel();
+        }
+        segment_input_finished_ = true;
+        pthread_cond_signal(&segment_condition_);
+        pthread_mutex_unlock(&segment_mutex_);
+        pthread_join(stitch_thread_, nullptr);
+        stitch_thread_created_ = false;
+    }
+    if (nullptr != sps_buffer_) {
+        delete[] sps_buffer_;
+        sps_buffer_ = nullptr;
+        sps_size_ = 0;
+    }
+    if (nullptr != parameter_sets_) {
+        delete[] parameter_sets_;
+        parameter_sets_ = nullptr;
+        parameter_sets_size_ = 0;
+    }
+    SetCopyParameterSets(nullptr, 0);
+    if (nullptr != encode_render_ && nullptr != yuv_packet_queue_) {
+        // 把还在PBO中的帧送去编码
+        while (true) {
+            uint8_t* buffer = new uint8_t[pixel_size_];
+            int packet_time_mills = 0;
+            if (encode_render_->FlushYUV420Image(buffer, &packet_time_mills) <= 0) {
+                delete[] buffer;
+                break;
+            }
+            PutYUVPacket(buffer, packet_time_mills);
+        }
+    }
+    if (nullptr != yuv_packet_queue_) {
+        // 空的packet表示输入结束, 编码线程处理完队列中的帧后退出
+        yuv_packet_queue_->Put(new VideoPacket());
+    }
+    if (encoder_thread_created_) {
+        pthread_join(encoder_thread_, nullptr);
+        encoder_thread_created_ = false;
+    }
+    if (nullptr != yuv_packet_queue_) {
+        yuv_packet_queue_->Abort();
+        delete yuv_packet_queue_;
+        yuv_packet_queue_ = nullptr;
+    }
+    if (nullptr != encoder_) {
+        encoder_->Destroy();
+        delete encoder_;
+        encoder_ = nullptr;
+    }
+    if (nullptr != encode_render_) {
+        encode_render_->Destroy();
+        delete encode_render_;
+        encode_render_ = nullptr;
+    }
+    if (output_texture_id_ != 0) {
+        glDeleteTextures(1, &output_texture_id_);
+        output_texture_id_ = 0;
+    }
+    if (yuv_texture_id_ != 0) {
+        glDeleteTextures(1, &yuv_texture_id_);
+        yuv_texture_id_ = 0;
+    }
+    if (fbo_ != 0) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo_);
+        fbo_ = 0;
+    }
+    if (nullptr != renderer_) {
+        delete renderer_;
+        renderer_ = nullptr;
+    }
+}
+
+void ExportEncoderAdapter::SetEncodeProfile(EncodeProfile profile) {
+    encode_profile_ = profile;
+}
+
+void ExportEncoderAdapter::SetSegmentEncoderCount(int count) {
+    segment_encoder_count_ = count > EXPORT_SEGMENT_MAX_ENCODERS ? EXPORT_SEGMENT_MAX_ENCODERS : count;
+}
+
+int ExportEncoderAdapter::GetSegmentEncoderCount() {
+    return segment_encoder_count_;
+}
+
+void ExportEncoderAdapter::PutYUVPacket(uint8_t* buffer, int time_mills) {
+    VideoPacket* packet = new VideoPacket();
+    packet->buffer = buffer;
+    packet->size = pixel_size_;
+    packet->timeMills = time_mills;
+    // 队列满时阻塞, 避免导出线程读取的速度超过编码速度导致内存增长
+    yuv_packet_queue_->Put(packet);
+}
+
+GLuint ExportEncoderAdapter::CreateTexture() {
+    GLuint texture_id = 0;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, video_width_, video_height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture_id;
+}
+
+void* ExportEncoderAdapter::StartEncodeThread(void* context) {
+    ExportEncoderAdapter* adapter = reinterpret_cast<ExportEncoderAdapter*>(context);
+    adapter->ProcessEncode();
+    pthread_exit(0);
+}
+
+void ExportEncoderAdapter::ProcessEncode() {
+    VideoPacket* packet = nullptr;
+    while (true) {
+        if (yuv_packet_queue_->Get(&packet, true) < 0) {
+            break;
+        }
+        if (nullptr == packet) {
+            continue;
+        }
+        if (nullptr == packet->buffer) {
+            delete packet;
+            break;
+        }
+        encoder_->Encode(packet);
+        delete packet;
+        packet = nullptr;
+    }
+    encoder_->Flush();
+}
+
+void ExportEncoderAdapter::PutSegmentPacket(uint8_t* buffer, int time_mills) {
+    if (pending_segments_.empty()) {
+        delete[] buffer;
+        return;
+    }
+    int segment = pending_segments_.front();
+    pending_segments_.pop_front();
+    SegmentEncoder* encoder = FindSegment(segment);
+    if (nullptr == encoder) {
+        delete[] buffer;
+        return;
+    }
+    // 这一段的队列满时阻塞, 其它段的编码线程继续工作
+    encoder->Put(buffer, pixel_size_, time_mills);
+}
+
+void ExportEncoderAdapter::FlushSegmentPackets() {
+    if (nullptr == encode_render_) {
+        return;
+    }
+    while (true) {
+        uint8_t* buffer = new uint8_t[pixel_size_];
+        int packet_time_mills = 0;
+        if (encode_render_->FlushYUV420Image(buffer, &packet_time_mills) <= 0) {
+            delete[] buffer;
+            break;
+        }
+        PutSegmentPacket(buffer, packet_time_mills);
+    }
+    pending_segments_.clear();
+}
+
+SegmentEncoder* ExportEncoderAdapter::FindSegment(int segment) {
+    SegmentEncoder* result = nullptr;
+    pthread_mutex_lock(&segment_mutex_);
+    for (auto encoder : segment_encoders_) {
+        if (encoder->GetIndex() == segment) {
+            result = encoder;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&segment_mutex_);
+    return result;
+}
+
+void* ExportEncoderAdapter::StartStitchThread(void* context) {
+    ExportEncoderAdapter* adapter = reinterpret_cast<ExportEncoderAdapter*>(context);
+    adapter->ProcessStitch();
+    pthread_exit(0);
+}
+
+void ExportEncoderAdapter::ProcessStitch() {
+    // 拼接线程一次放入一整段的数据, 队列满时必须阻塞等待muxer, 不能丢GOP
+    packet_pool_->SetRecordingVideoPacketQueueOffline(true);
+    if (nullptr != parameter_sets_) {
+        // 第一段可能是直接复制的段, 两组参数集在所有数据之前写入
+        VideoPacket* packet = new VideoPacket();
+        packet->buffer = new uint8_t[parameter_sets_size_];
+        memcpy(packet->buffer, parameter_sets_, parameter_sets_size_);
+        packet->size = parameter_sets_size_;
+        packet_pool_->PushRecordingVideoPacketToQueue(packet);
+    }
+    while (true) {
+        pthread_mutex_lock(&segment_mutex_);
+        while (segment_encoders_.empty() && !segment_input_finished_) {
+            pthread_cond_wait(&segment_condition_, &segment_mutex_);
+        }
+        if (segment_encoders_.empty()) {
+            pthread_mutex_unlock(&segment_mutex_);
+            break;
+        }
+        // 最早的一段编码完成之前, 后面的段的数据留在各自的队列中
+        SegmentEncoder* encoder = segment_encoders_.front();
+        pthread_mutex_unlock(&segment_mutex_);
+        VideoPacket* packet = nullptr;
+        while (encoder->GetPacket(&packet) >= 0) {
+            if (nullptr == packet) {
+                continue;
+            }
+            if (nullptr == packet->buffer) {
+                delete packet;
+                break;
+            }
+            WriteSegmentPacket(packet);
+            packet = nullptr;
+        }
+        pthread_mutex_lock(&segment_mutex_);
+        segment_encoders_.pop_front();
+        pthread_mutex_unlock(&segment_mutex_);
+        encoder->Destroy();
+        delete encoder;
+    }
+}
+
+void ExportEncoderAdapter::WriteSegmentPacket(VideoPacket* packet) {
+    if (packet->size > 4 && (packet->buffer[4] & 0x1F) == H264_NALU_TYPE_SEQUENCE_PARAMETER_SET) {
+        // 所有段的编码参数相同, 只写入第一段的sps和pps
+        if (nullptr == sps_buffer_) {
+            sps_size_ = packet->size;
+            sps_buffer_ = new uint8_t[sps_size_];
+            memcpy(sps_buffer_, packet->buffer, sps_size_);
+            packet_pool_->PushRecordingVideoPacketToQueue(packet);
+            return;
+        }
+        if (packet->size != sps_size_ || memcmp(packet->buffer, sps_buffer_, sps_size_) != 0) {
+            LOGE("segment sps pps is different from the first segment");
+        }
+        delete packet;
+        return;
+    }
+    if (packet->dts != DTS_PARAM_UN_SETTIED_FLAG && packet->dts != DTS_PARAM_NOT_A_NUM_FLAG) {
+        // 每一段的dts从第一帧的pts减去B帧的延迟开始, 正好接在上一段后面
+        // 帧间隔不均匀时可能和上一段重叠, 只调整重叠的帧, 不移动整段, 避免和音频产生累积的偏差
+        if (last_dts_ != INT64_MIN && packet->dts <= last_dts_) {
+            LOGI("segment dts overlap, dts %lld -> %lld", packet->dts, last_dts_ + 1);
+            packet->dts = last_dts_ + 1;
+        }
+        if (packet->pts != PTS_PARAM_UN_SETTIED_FLAG && packet->pts < packet->dts) {
+            packet->pts = packet->dts;
+        }
+        last_dts_ = packet->dts;
+    }
+    packet_pool_->PushRecordingVideoPacketToQueue(packet);
+}
+
+}  // namespace trinity
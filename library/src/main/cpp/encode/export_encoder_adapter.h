@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-10.
+//
+
+#ifndef TRINITY_EXPORT_ENCODER_ADAPTER_H
+#define TRINITY_EXPORT_ENCODER_ADAPTER_H
+
+#include <deque>
+#include "video_encoder_adapter.h"
+#include "video_x264_encoder.h"
+#include "segment_encoder.h"
+#include "segment_cache.h"
+#include "egl_core.h"
+#include "opengl.h"
+#include "encode_render.h"
+
+/** 等待编码的YUV帧的最大数量, 队列满时导出线程等待编码线程 **/
+#define EXPORT_ENCODE_QUEUE_SIZE        4
+/** x264内部编码线程数的上限 **/
+#define EXPORT_ENCODE_MAX_THREADS       4
+/** 分段编码时同时编码的段数的上限 **/
+#define EXPORT_SEGMENT_MAX_ENCODERS     8
+
+namespace trinity {
+
+// 导出专用的视频编码
+// 在导出线程自己的EGLContext上完成绘制, 转换YUV和读取数据, 不再创建共享的context和下载线程
+// 读取出来的YUV数据放入有长度限制的队列, 由编码线程交给x264编码
+// 分段编码时每一段由自己的SegmentEncoder编码, 多个段同时编码, 再按段的顺序拼接成一路H.264
+class ExportEncoderAdapter : public VideoEncoderAdapter {
+ public:
+    explicit ExportEncoderAdapter(GLfloat* vertex_coordinate = nullptr, GLfloat* texture_coordinate = nullptr);
+
+    virtual ~ExportEncoderAdapter();
+
+    // 需要在导出线程调用, 并且core的context是当前的context
+    void CreateEncoder(EGLCore* core, int texture_id);
+
+    void Encode(int time_mills = -1);
+
+    // 分段编码时使用, segment是StartSegment时的序号
+    void Encode(int time_mills, int segment);
+
+    // 开始编码一段, 序号需要从0开始递增, 最多同时有GetSegmentEncoderCount个段
+    // 设置了缓存目录并且cache_key不为0时, 编码完成的段保存到缓存中
+    void StartSegment(int segment, uint64_t cache_key = 0, int64_t timeline_offset = 0);
+
+    // 这一段的帧已经全部调用了Encode
+    void EndSegment(int segment);
+
+    // 智能导出时没有变化的段直接复制源文件的数据, 和编码的段按序号拼接, 时间单位是毫秒
+    void StartCopySegment(int segment, const char* file_name, int64_t start_time, int64_t end_time,
+            int64_t timeline_offset);
+
+    // 上一次导出缓存过的段不编码, 直接读取缓存, 时间戳移到timeline_offset开始
+    void StartCacheSegment(int segment, uint64_t cache_key, int64_t timeline_offset);
+
+    // 缓存编码后的段的目录, 为空时不使用缓存
+    void SetSegmentCache(const char* directory);
+
+    bool IsSegmentCached(uint64_t cache_key);
+
+    // 需要在CreateEncoder之前调用, 直接复制的源文件的avcC
+    // x264使用源文件没有用到的参数集id, 两组参数集一起写入extradata
+    void SetCopyParameterSets(const uint8_t* extradata, int size);
+
+    // 把还没有读取的帧和队列中的帧全部编码完成后退出
+    void DestroyEncoder();
+
+    // 需要在CreateEncoder之前调用, 默认使用ENCODE_PROFILE_EXPORT_BALANCED
+    void SetEncodeProfile(EncodeProfile profile);
+
+    // 需要在CreateEncoder之前调用, 大于1时使用分段编码
+    void SetSegmentEncoderCount(int count);
+
+    int GetSegmentEncoderCount();
+
+ private:
+    static void* StartEncodeThread(void* context);
+
+    void ProcessEncode();
+
+    void PutYUVPacket(uint8_t* buffer, int time_mills);
+
+    // 绘制当前帧并转换成YUV, GLES3时读取的是之前提交的帧
+    int ReadYUV(int time_mills, uint8_t* buffer, int* out_time_mills);
+
+    static void* StartStitchThread(void* context);
+
+    // 按段的顺序把每一段编码后的数据写入PacketPool
+    void ProcessStitch();
+
+    void WriteSegmentPacket(VideoPacket* packet);
+
+    // 读取出来的帧交给对应的段, pending_segments_和PBO中的帧一一对应
+    void PutSegmentPacket(uint8_t* buffer, int time_mills);
+
+    // 把PBO中的帧全部读取出来
+    void FlushSegmentPackets();
+
+    SegmentEncoder* FindSegment(int segment);
+
+    int GetSegmentThreadCount();
+
+    // 生成源文件和x264的参数集, 在拼接线程中最先写入
+    int CreateParameterSets();
+
+    GLuint CreateTexture();
+
+ private:
+    GLfloat* vertex_coordinate_;
+    GLfloat* texture_coordinate_;
+    GLuint fbo_;
+    GLuint output_texture_id_;
+    /** 导出线程的surface很小, 转换YUV时画到这个纹理上再读取 **/
+    GLuint yuv_texture_id_;
+    OpenGL* renderer_;
+    EncodeRender* encode_render_;
+    int pixel_size_;
+    VideoPacketQueue* yuv_packet_queue_;
+    VideoX264Encoder* encoder_;
+    pthread_t encoder_thread_;
+    bool encoder_thread_created_;
+    EncodeProfile encode_profile_;
+    int segment_encoder_count_;
+    /** 还没有拼接完成的段, 按序号排列 **/
+    std::deque<SegmentEncoder*> segment_encoders_;
+    /** 已经提交到PBO还没有读取出来的帧所属的段 **/
+    std::deque<int> pending_segments_;
+    pthread_mutex_t segment_mutex_;
+    pthread_cond_t segment_condition_;
+    bool segment_input_finished_;
+    pthread_t stitch_thread_;
+    bool stitch_thread_created_;
+    /** 第一段的sps和pps, 后面的段不再写入 **/
+    uint8_t* sps_buffer_;
+    int sps_size_;
+    int64_t last_dts_;
+    /** 直接复制的源文件的avcC **/
+    uint8_t* copy_extradata_;
+    int copy_extradata_size_;
+    /** 源文件和x264的sps和pps, Annex-B格式 **/
+    uint8_t* parameter_sets_;
+    int parameter_sets_size_;
+    int sps_id_;
+    SegmentCache* segment_cache_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_EXPORT_ENCODER_ADAPTER_H
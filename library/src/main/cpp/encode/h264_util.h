@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <stdint.h>
+#include <string.h>
 
 #define _H264_NALU_TYPE_NON_IDR_PICTURE                                  	1
 #define _H264_NALU_TYPE_IDR_PICTURE                                      	5
@@ -114,4 +115,217 @@ static inline void parseH264SpsPps(uint8_t* in_pBuffer, uint32_t in_ui32Size,
 }
 
 
+/** 一个packet中最多的NAL个数, 用固定大小的数组保存, 不需要分配内存 **/
+#define H264_MAX_NAL_COUNT                                                  64
+
+/** NAL在buffer中的位置, offset和size不包含起始码 **/
+typedef struct {
+    int type;
+    int offset;
+    int size;
+    int start_code_size;
+} H264Nal;
+
+// 从begin开始查找3字节的起始码00 00 01, 返回第一个00的位置, 没有找到时返回size
+// 每次检查8个字节, 没有0的部分直接跳过
+static inline int H264FindStartCode(const uint8_t* buffer, int begin, int size) {
+    int i = begin;
+    while (i + 3 <= size) {
+        if (i + 8 <= size) {
+            uint64_t word;
+            memcpy(&word, buffer + i, sizeof(word));
+            if (((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL) == 0) {
+                // 这8个字节中没有0, 起始码不可能从这里开始
+                i += 8;
+                continue;
+            }
+        }
+        if (buffer[i + 2] > 1) {
+            i += 3;
+        } else if (buffer[i] == 0 && buffer[i + 1] == 0 && buffer[i + 2] == 1) {
+            return i;
+        } else {
+            i++;
+        }
+    }
+    return size;
+}
+
+// 解析Annex-B数据中所有NAL的位置, 返回NAL的个数, 超过max_count时返回-1
+static inline int H264ParseNals(const uint8_t* buffer, int size, H264Nal* nals, int max_count) {
+    int count = 0;
+    int previous_end = 0;
+    int start = H264FindStartCode(buffer, 0, size);
+    while (start < size) {
+        int body = start + 3;
+        int next = H264FindStartCode(buffer, body, size);
+        int end = next;
+        // 下一个是4字节起始码时, 前面的0属于起始码
+        if (next < size && next > body && buffer[next - 1] == 0) {
+            end = next - 1;
+        }
+        if (count >= max_count) {
+            return -1;
+        }
+        H264Nal* nal = nals + count++;
+        nal->start_code_size = start > previous_end && buffer[start - 1] == 0 ? 4 : 3;
+        nal->offset = body;
+        nal->size = end - body;
+        nal->type = body < size ? (buffer[body] & 0x1F) : 0;
+        previous_end = end;
+        start = next;
+    }
+    return count;
+}
+
+static inline bool H264IsParameterSet(int type) {
+    return type == _H264_NALU_TYPE_SEQUENCE_PARAMETER_SET || type == _H264_NALU_TYPE_PICTURE_PARAMETER_SET;
+}
+
+// 转换成AVCC之后的大小, 每个NAL前面是4字节的长度
+static inline int H264AvccSize(const H264Nal* nals, int count, bool skip_parameter_set) {
+    int size = 0;
+    for (int i = 0; i < count; i++) {
+        if (skip_parameter_set && H264IsParameterSet(nals[i].type)) {
+            continue;
+        }
+        size += 4 + nals[i].size;
+    }
+    return size;
+}
+
+// 把Annex-B转换成AVCC写入out, 返回写入的长度
+// out可以和buffer相同, 这时只能有4字节的起始码, 起始码直接改写成长度, 数据不需要移动
+// 否则返回-1, buffer不会被修改
+static inline int H264WriteAvcc(uint8_t* buffer, const H264Nal* nals, int count,
+                                uint8_t* out, bool skip_parameter_set) {
+    if (out == buffer) {
+        int position = 0;
+        for (int i = 0; i < count; i++) {
+            if (skip_parameter_set && H264IsParameterSet(nals[i].type)) {
+                continue;
+            }
+            if (position + 4 > nals[i].offset) {
+                return -1;
+            }
+            position += 4 + nals[i].size;
+        }
+    }
+    int position = 0;
+    for (int i = 0; i < count; i++) {
+        const H264Nal* nal = nals + i;
+        if (skip_parameter_set && H264IsParameterSet(nal->type)) {
+            continue;
+        }
+        uint8_t* dst = out + position;
+        dst[0] = static_cast<uint8_t>((nal->size >> 24) & 0xFF);
+        dst[1] = static_cast<uint8_t>((nal->size >> 16) & 0xFF);
+        dst[2] = static_cast<uint8_t>((nal->size >> 8) & 0xFF);
+        dst[3] = static_cast<uint8_t>(nal->size & 0xFF);
+        if (dst + 4 != buffer + nal->offset) {
+            memmove(dst + 4, buffer + nal->offset, nal->size);
+        }
+        position += 4 + nal->size;
+    }
+    return position;
+}
+
+// AVCC数据中是否有IDR, 一个访问单元中可能先有SEI等其它NAL
+static inline bool H264AvccHasIdr(const uint8_t* buffer, int size) {
+    int offset = 0;
+    while (offset + 4 < size) {
+        int length = (buffer[offset] << 24) | (buffer[offset + 1] << 16) | (buffer[offset + 2] << 8) | buffer[offset + 3];
+        if (length <= 0 || length > size - offset - 4) {
+            return false;
+        }
+        if ((buffer[offset + 4] & 0x1F) == _H264_NALU_TYPE_IDR_PICTURE) {
+            return true;
+        }
+        offset += 4 + length;
+    }
+    return false;
+}
+
+// 读取无符号指数哥伦布编码, bit是当前读取的位置
+// 只用来读取参数集开头的字段, 这些字段中不会出现防竞争字节, 越界时返回-1
+static inline int H264ReadUE(const uint8_t* buffer, int size, int* bit) {
+    int zeros = 0;
+    while (true) {
+        if (*bit >= size * 8) {
+            return -1;
+        }
+        int value = (buffer[*bit >> 3] >> (7 - (*bit & 7))) & 1;
+        (*bit)++;
+        if (value) {
+            break;
+        }
+        if (++zeros > 31) {
+            return -1;
+        }
+    }
+    int result = 0;
+    for (int i = 0; i < zeros; i++) {
+        if (*bit >= size * 8) {
+            return -1;
+        }
+        result = (result << 1) | ((buffer[*bit >> 3] >> (7 - (*bit & 7))) & 1);
+        (*bit)++;
+    }
+    return (1 << zeros) - 1 + result;
+}
+
+// sps或pps自己的id, nal从nal头开始, 不是参数集或者解析失败时返回-1
+static inline int H264ParameterSetId(const uint8_t* nal, int size) {
+    if (size < 2) {
+        return -1;
+    }
+    int type = nal[0] & 0x1F;
+    // sps的id在profile, constraint和level之后, pps的id紧跟nal头
+    int bit = 8;
+    if (type == _H264_NALU_TYPE_SEQUENCE_PARAMETER_SET) {
+        bit = 4 * 8;
+    } else if (type != _H264_NALU_TYPE_PICTURE_PARAMETER_SET) {
+        return -1;
+    }
+    return H264ReadUE(nal, size, &bit);
+}
+
+// 把avcC格式的extradata中的sps和pps转换成4字节起始码的Annex-B
+// out为nullptr时只计算长度, 返回写入的长度, 格式错误时返回-1
+static inline int H264AvccToAnnexb(const uint8_t* extradata, int size, uint8_t* out) {
+    if (nullptr == extradata || size < 7 || extradata[0] != 1) {
+        return -1;
+    }
+    int position = 0;
+    int offset = 5;
+    // 先是sps, 再是pps
+    for (int i = 0; i < 2; i++) {
+        if (offset >= size) {
+            return -1;
+        }
+        int count = i == 0 ? (extradata[offset] & 0x1F) : extradata[offset];
+        offset++;
+        for (int j = 0; j < count; j++) {
+            if (offset + 2 > size) {
+                return -1;
+            }
+            int length = (extradata[offset] << 8) | extradata[offset + 1];
+            offset += 2;
+            if (offset + length > size) {
+                return -1;
+            }
+            if (nullptr != out) {
+                out[position] = 0;
+                out[position + 1] = 0;
+                out[position + 2] = 0;
+                out[position + 3] = 1;
+                memcpy(out + position + 4, extradata + offset, length);
+            }
+            position += 4 + length;
+            offset += length;
+        }
+    }
+    return position;
+}
+
 #endif //TRINITY_H264_UTIL_H
@@ -122,24 +122,28 @@ void MediaEncodeAdapter::DestroyEncoder() {
 }
 
 void MediaEncodeAdapter::Encode(int timeMills) {
-    if (start_time_ == 0)
-        start_time_ = getCurrentTime();
+    int64_t curTime = timeMills;
+    if (!offline_) {
+        if (start_time_ == 0)
+            start_time_ = getCurrentTime();
 
-    if (fps_change_time_ == -1){
-        fps_change_time_ = getCurrentTime();
-    }
+        if (fps_change_time_ == -1) {
+            fps_change_time_ = getCurrentTime();
+        }
 
-    if (handler_->GetQueueSize() > MAX_ENCODER_Q_SIZE) {
-        LOGE("HWEncoderAdapter:dropped frame_, encoder_ queue_ full");// See webrtc bug 2887.
-        return;
-    }
-    int64_t curTime = getCurrentTime() - start_time_;
-    // need drop frames
-    int expectedFrameCount = (int) ((getCurrentTime() - fps_change_time_) / 1000.0f * frame_rate_ + 0.5f);
-    if (expectedFrameCount < encode_frame_count_) {
-        LOGE("drop frame encode_count: %d frame_count: %d", encode_frame_count_, expectedFrameCount);
-        return;
+        if (handler_->GetQueueSize() > MAX_ENCODER_Q_SIZE) {
+            LOGE("HWEncoderAdapter:dropped frame_, encoder_ queue_ full");// See webrtc bug 2887.
+            return;
+        }
+        curTime = getCurrentTime() - start_time_;
+        // need drop frames
+        int expectedFrameCount = (int) ((getCurrentTime() - fps_change_time_) / 1000.0f * frame_rate_ + 0.5f);
+        if (expectedFrameCount < encode_frame_count_) {
+            LOGE("drop frame encode_count: %d frame_count: %d", encode_frame_count_, expectedFrameCount);
+            return;
+        }
     }
+    // 离线模式下不丢帧, 编码器输入surface满了时SwapBuffers会阻塞, 由编码速度决定导出速度
     encode_frame_count_++;
     if (EGL_NO_SURFACE != encoder_surface_) {
         core_->MakeCurrent(encoder_surface_);
@@ -174,77 +178,42 @@ void MediaEncodeAdapter::DrainEncodeData() {
     int timeMills = (int) (lastPresentationTimeUs / 1000.0f);
 
     // push to queue_
-    int nalu_type = (outputData[4] & 0x1F);
-    if (H264_NALU_TYPE_SEQUENCE_PARAMETER_SET == nalu_type) {
-        vector<NALUnit*>* units = new vector<NALUnit*>();
-        parseH264SpsPps(outputData, size, units);
-        int unitSize = units->size();
-        if(unitSize > 2) {
-            //证明是sps和pps后边有I帧
-            const char bytesHeader[] = "\x00\x00\x00\x01";
-            size_t headerLength = 4; //string literals have implicit trailing '\0'
-            NALUnit* idrUnit = units->at(2);
-            int idrSize = idrUnit->naluSize + headerLength;
-            VideoPacket *videoPacket = new VideoPacket();
-            videoPacket->buffer = new uint8_t[idrSize];
-            memcpy(videoPacket->buffer, bytesHeader, headerLength);
-            memcpy(videoPacket->buffer + headerLength, idrUnit->naluBody, idrUnit->naluSize);
-            videoPacket->size = idrSize;
-            videoPacket->timeMills = timeMills;
-            if (videoPacket->size > 0)
-                packet_pool_->PushRecordingVideoPacketToQueue(videoPacket);
-        }
+    // 只记录NAL的位置, 不为每个NAL分配内存
+    H264Nal nals[H264_MAX_NAL_COUNT];
+    int count = size > 0 ? H264ParseNals(outputData, size, nals, H264_MAX_NAL_COUNT) : 0;
+    if (count < 0) {
+        LOGE("parse h264 packet error size: %d", size);
+    } else if (count > 0 && H264_NALU_TYPE_SEQUENCE_PARAMETER_SET == nals[0].type) {
         if (sps_write_flag_) {
+            // sps和pps只写出一次, 由muxer生成extradata
             VideoPacket *videoPacket = new VideoPacket();
             videoPacket->buffer = new uint8_t[size];
             memcpy(videoPacket->buffer, outputData, size);
             videoPacket->size = size;
             videoPacket->timeMills = timeMills;
-            if (videoPacket->size > 0)
-                packet_pool_->PushRecordingVideoPacketToQueue(videoPacket);
+            packet_pool_->PushRecordingVideoPacketToQueue(videoPacket);
             sps_write_flag_ = false;
         }
-    } else  if (size > 0){
-        //为了兼容有一些设备的MediaCodec编码出来的每一帧有多个Slice的问题(华为荣耀6，华为P9)
-        int frameBufferSize = 0;
-        size_t headerLength = 4;
-        uint8_t* frameBuffer;
-        const char bytesHeader[] = "\x00\x00\x00\x01";
-
-        vector<NALUnit*>* units = new vector<NALUnit*>();
-
-        parseH264SpsPps(outputData, size, units);
-        vector<NALUnit*>::iterator i;
-        for (i = units->begin(); i != units->end(); ++i) {
-            NALUnit* unit = *i;
-            int frameLen = unit->naluSize;
-            frameBufferSize+=headerLength;
-            frameBufferSize+=frameLen;
-        }
-        frameBuffer = new uint8_t[frameBufferSize];
-        int frameBufferCursor = 0;
-        for (i = units->begin(); i != units->end(); ++i) {
-            NALUnit* unit = *i;
-            uint8_t* nonIDRFrame = unit->naluBody;
-            int nonIDRFrameLen = unit->naluSize;
-            memcpy(frameBuffer + frameBufferCursor, bytesHeader, headerLength);
-            frameBufferCursor+=headerLength;
-            memcpy(frameBuffer + frameBufferCursor, nonIDRFrame, nonIDRFrameLen);
-            frameBufferCursor+=nonIDRFrameLen;
-            frameBuffer[frameBufferCursor - nonIDRFrameLen - headerLength] = ((nonIDRFrameLen) >> 24) & 0x00ff;
-            frameBuffer[frameBufferCursor - nonIDRFrameLen - headerLength + 1] = ((nonIDRFrameLen) >> 16) & 0x00ff;
-            frameBuffer[frameBufferCursor - nonIDRFrameLen - headerLength + 2] = ((nonIDRFrameLen) >> 8) & 0x00ff;
-            frameBuffer[frameBufferCursor - nonIDRFrameLen - headerLength + 3] = ((nonIDRFrameLen)) & 0x00ff;
-            delete unit;
+        //sps和pps后边有I帧时, 把I帧单独写出去
+        int idrSize = H264AvccSize(nals, count, true);
+        if (idrSize > 0) {
+            VideoPacket *videoPacket = new VideoPacket();
+            videoPacket->buffer = new uint8_t[idrSize];
+            H264WriteAvcc(outputData, nals, count, videoPacket->buffer, true);
+            videoPacket->size = idrSize;
+            videoPacket->timeMills = timeMills;
+            packet_pool_->PushRecordingVideoPacketToQueue(videoPacket);
         }
-        delete units;
-
+    } else if (count > 0) {
+        //为了兼容有一些设备的MediaCodec编码出来的每一帧有多个Slice的问题(华为荣耀6，华为P9)
+        //每个Slice的起始码都换成4字节的长度
+        int frameBufferSize = H264AvccSize(nals, count, false);
         VideoPacket *videoPacket = new VideoPacket();
-        videoPacket->buffer = frameBuffer;
+        videoPacket->buffer = new uint8_t[frameBufferSize];
+        H264WriteAvcc(outputData, nals, count, videoPacket->buffer, false);
         videoPacket->size = frameBufferSize;
         videoPacket->timeMills = timeMills;
-        if (videoPacket->size > 0)
-            packet_pool_->PushRecordingVideoPacketToQueue(videoPacket);
+        packet_pool_->PushRecordingVideoPacketToQueue(videoPacket);
     }
     env->ReleaseByteArrayElements(output_buffer_, (jbyte *) outputData, 0);
     if (needAttach) {
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include "segment_cache.h"
+#include <string.h>
+#include <unistd.h>
+#include "android_xlog.h"
+
+/** 缓存文件的格式版本, 格式变化时修改, 旧的缓存不会再被读取 **/
+#define SEGMENT_CACHE_MAGIC             "TSC1"
+#define SEGMENT_CACHE_PTS               0x01
+#define SEGMENT_CACHE_DTS               0x02
+#define SEGMENT_CACHE_DTS_NAN           0x04
+/** 一个packet的最大长度, 超过时认为文件已经损坏 **/
+#define SEGMENT_CACHE_MAX_PACKET_SIZE   (32 * 1024 * 1024)
+
+namespace trinity {
+
+typedef struct {
+    int32_t size;
+    int32_t flags;
+    int32_t time_mills;
+    int32_t reserved;
+    int64_t pts;
+    int64_t dts;
+} SegmentCacheRecord;
+
+SegmentHash::SegmentHash() : hash_(0xcbf29ce484222325ULL) {}
+
+void SegmentHash::Update(const void* data, int size) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (int i = 0; i < size; i++) {
+        hash_ ^= bytes[i];
+        hash_ *= 0x100000001b3ULL;
+    }
+}
+
+void SegmentHash::Update(const char* value) {
+    if (nullptr == value) {
+        Update(static_cast<int64_t>(-1));
+        return;
+    }
+    // 长度也参与计算, 避免两个字符串拼接后相同
+    int size = static_cast<int>(strlen(value));
+    Update(static_cast<int64_t>(size));
+    Update(value, size);
+}
+
+void SegmentHash::Update(int64_t value) {
+    Update(&value, sizeof(value));
+}
+
+uint64_t SegmentHash::Digest() {
+    return hash_;
+}
+
+SegmentCache::SegmentCache(const char* directory) : directory_(directory) {
+    if (!directory_.empty() && directory_.at(directory_.size() - 1) != '/') {
+        directory_.append("/");
+    }
+}
+
+SegmentCache::~SegmentCache() {}
+
+std::string SegmentCache::GetPath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.seg", static_cast<unsigned long long>(key));
+    return directory_ + name;
+}
+
+bool SegmentCache::Contains(uint64_t key) {
+    return access(GetPath(key).c_str(), R_OK) == 0;
+}
+
+SegmentCacheWriter::SegmentCacheWriter() : file_(nullptr), timeline_offset_(0) {}
+
+SegmentCacheWriter::~SegmentCacheWriter() {
+    Close(false);
+}
+
+int SegmentCacheWriter::Open(const std::string& path, int64_t timeline_offset) {
+    path_ = path;
+    // 同一个源文件的同一段可能在时间线上出现多次, 每个写入使用自己的临时文件
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%p.tmp", this);
+    temp_path_ = path + suffix;
+    timeline_offset_ = timeline_offset;
+    file_ = fopen(temp_path_.c_str(), "wb");
+    if (nullptr == file_) {
+        LOGE("open segment cache %s error", temp_path_.c_str());
+        return -1;
+    }
+    if (fwrite(SEGMENT_CACHE_MAGIC, 1, 4, file_) != 4) {
+        Close(false);
+        return -1;
+    }
+    return 0;
+}
+
+int SegmentCacheWriter::Write(VideoPacket* packet) {
+    if (nullptr == file_) {
+        return -1;
+    }
+    SegmentCacheRecord record;
+    memset(&record, 0, sizeof(record));
+    record.size = packet->size;
+    record.time_mills = static_cast<int32_t>(packet->timeMills - timeline_offset_);
+    if (packet->pts != PTS_PARAM_UN_SETTIED_FLAG) {
+        record.flags |= SEGMENT_CACHE_PTS;
+        record.pts = packet->pts - timeline_offset_;
+    }
+    if (packet->dts == DTS_PARAM_NOT_A_NUM_FLAG) {
+        record.flags |= SEGMENT_CACHE_DTS_NAN;
+    } else if (packet->dts != DTS_PARAM_UN_SETTIED_FLAG) {
+        record.flags |= SEGMENT_CACHE_DTS;
+        record.dts = packet->dts - timeline_offset_;
+    }
+    if (fwrite(&record, sizeof(record), 1, file_) != 1 ||
+        fwrite(packet->buffer, 1, packet->size, file_) != static_cast<size_t>(packet->size)) {
+        LOGE("write segment cache %s error", temp_path_.c_str());
+        Close(false);
+        return -1;
+    }
+    return 0;
+}
+
+void SegmentCacheWriter::Close(bool commit) {
+    if (nullptr == file_) {
+        return;
+    }
+    bool success = fclose(file_) == 0;
+    file_ = nullptr;
+    if (commit && success && rename(temp_path_.c_str(), path_.c_str()) == 0) {
+        return;
+    }
+    remove(temp_path_.c_str());
+}
+
+SegmentCacheReader::SegmentCacheReader() : file_(nullptr), timeline_offset_(0) {}
+
+SegmentCacheReader::~SegmentCacheReader() {
+    Close();
+}
+
+int SegmentCacheReader::Open(const std::string& path, int64_t timeline_offset) {
+    timeline_offset_ = timeline_offset;
+    file_ = fopen(path.c_str(), "rb");
+    if (nullptr == file_) {
+        LOGE("open segment cache %s error", path.c_str());
+        return -1;
+    }
+    char magic[4];
+    if (fread(magic, 1, 4, file_) != 4 || memcmp(magic, SEGMENT_CACHE_MAGIC, 4) != 0) {
+        LOGE("segment cache %s format error", path.c_str());
+        Close();
+        return -1;
+    }
+    return 0;
+}
+
+int SegmentCacheReader::Read(VideoPacket** packet) {
+    if (nullptr == file_) {
+        return -1;
+    }
+    SegmentCacheRecord record;
+    if (fread(&record, sizeof(record), 1, file_) != 1) {
+        return -1;
+    }
+    if (record.size <= 0 || record.size > SEGMENT_CACHE_MAX_PACKET_SIZE) {
+        return -1;
+    }
+    VideoPacket* result = new VideoPacket();
+    result->buffer = new uint8_t[record.size];
+    result->size = record.size;
+    if (fread(result->buffer, 1, record.size, file_) != static_cast<size_t>(record.size)) {
+        delete result;
+        return -1;
+    }
+    result->timeMills = static_cast<int>(record.time_mills + timeline_offset_);
+    if (record.flags & SEGMENT_CACHE_PTS) {
+        result->pts = record.pts + timeline_offset_;
+    }
+    if (record.flags & SEGMENT_CACHE_DTS_NAN) {
+        result->dts = DTS_PARAM_NOT_A_NUM_FLAG;
+    } else if (record.flags & SEGMENT_CACHE_DTS) {
+        result->dts = record.dts + timeline_offset_;
+    }
+    *packet = result;
+    return 0;
+}
+
+void SegmentCacheReader::Close() {
+    if (nullptr != file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+}  // namespace trinity
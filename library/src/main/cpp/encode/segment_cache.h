@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#ifndef TRINITY_SEGMENT_CACHE_H
+#define TRINITY_SEGMENT_CACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include "video_packet_queue.h"
+
+namespace trinity {
+
+// 计算缓存key的64位FNV-1a哈希
+class SegmentHash {
+ public:
+    SegmentHash();
+
+    void Update(const void* data, int size);
+    void Update(const char* value);
+    void Update(int64_t value);
+    uint64_t Digest();
+
+ private:
+    uint64_t hash_;
+};
+
+// 导出时编码好的段的缓存
+// 每一段保存成一个文件, 文件名是输入内容的哈希, 内容和SegmentEncoder输出的packet完全一致
+// 时间戳保存为相对这一段开始的时间, 读取时再移到新的时间线上
+class SegmentCache {
+ public:
+    explicit SegmentCache(const char* directory);
+    ~SegmentCache();
+
+    std::string GetPath(uint64_t key);
+    bool Contains(uint64_t key);
+
+ private:
+    std::string directory_;
+};
+
+// 写入时先写临时文件, Close(true)时才改成正式的文件名, 中途取消的段不会被使用
+class SegmentCacheWriter {
+ public:
+    SegmentCacheWriter();
+    ~SegmentCacheWriter();
+
+    int Open(const std::string& path, int64_t timeline_offset);
+    int Write(VideoPacket* packet);
+    void Close(bool commit);
+
+ private:
+    FILE* file_;
+    std::string path_;
+    std::string temp_path_;
+    int64_t timeline_offset_;
+};
+
+class SegmentCacheReader {
+ public:
+    SegmentCacheReader();
+    ~SegmentCacheReader();
+
+    int Open(const std::string& path, int64_t timeline_offset);
+    // 读取下一个packet, 文件结束或者数据错误时返回-1
+    int Read(VideoPacket** packet);
+    void Close();
+
+ private:
+    FILE* file_;
+    int64_t timeline_offset_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_SEGMENT_CACHE_H
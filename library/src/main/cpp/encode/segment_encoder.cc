@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include "segment_encoder.h"
+#include <string.h>
+#include "android_xlog.h"
+
+extern "C" {
+#include "libavformat/avformat.h"
+};
+
+/** 每一段等待编码的YUV帧的最大数量 **/
+#define SEGMENT_ENCODE_QUEUE_SIZE       3
+/** 直接复制时队列中packet的最大数量, 拼接线程还没有处理到这一段时读取线程等待 **/
+#define SEGMENT_COPY_QUEUE_SIZE         30
+
+namespace trinity {
+
+SegmentEncoder::SegmentEncoder(int index)
+    : index_(index),
+      encoder_(nullptr),
+      yuv_packet_queue_(nullptr),
+      h264_packet_queue_(nullptr),
+      encode_thread_(0),
+      encode_thread_created_(false),
+      ended_(false),
+      sps_id_(0),
+      file_name_(nullptr),
+      copy_start_time_(0),
+      copy_end_time_(0),
+      timeline_offset_(0),
+      cache_writer_(nullptr),
+      canceled_(false) {
+}
+
+SegmentEncoder::~SegmentEncoder() {}
+
+int SegmentEncoder::Start(int width, int height, int bit_rate, int frame_rate, int thread_count,
+        EncodeProfile profile, AVPixelFormat pixel_format) {
+    yuv_packet_queue_ = new VideoPacketQueue();
+    yuv_packet_queue_->SetMaxSize(SEGMENT_ENCODE_QUEUE_SIZE);
+    h264_packet_queue_ = new VideoPacketQueue();
+    encoder_ = new VideoX264Encoder(0);
+    encoder_->SetThreadCount(thread_count);
+    encoder_->SetEncodeProfile(profile);
+    encoder_->SetPixelFormat(pixel_format);
+    encoder_->SetSpsId(sps_id_);
+    encoder_->SetPacketQueue(h264_packet_queue_);
+    int ret = encoder_->Init(width, height, bit_rate, frame_rate, nullptr);
+    if (ret < 0) {
+        LOGE("SegmentEncoder %d init error: %d", index_, ret);
+        canceled_ = true;
+        // 没有编码器时编码线程直接结束这一段
+        encoder_->Destroy();
+        delete encoder_;
+        encoder_ = nullptr;
+    }
+    if (!cache_path_.empty()) {
+        cache_writer_ = new SegmentCacheWriter();
+        if (cache_writer_->Open(cache_path_, timeline_offset_) < 0) {
+            delete cache_writer_;
+            cache_writer_ = nullptr;
+        }
+    }
+    encode_thread_created_ = pthread_create(&encode_thread_, nullptr, EncodeThread, this) == 0;
+    if (!encode_thread_created_) {
+        canceled_ = true;
+        h264_packet_queue_->Put(new VideoPacket());
+        return -1;
+    }
+    return ret;
+}
+
+int SegmentEncoder::StartCopy(const char* file_name, int64_t start_time, int64_t end_time, int64_t timeline_offset) {
+    h264_packet_queue_ = new VideoPacketQueue();
+    h264_packet_queue_->SetMaxSize(SEGMENT_COPY_QUEUE_SIZE);
+    file_name_ = strdup(file_name);
+    copy_start_time_ = start_time;
+    copy_end_time_ = end_time;
+    timeline_offset_ = timeline_offset;
+    // 没有输入, 读取线程结束时这一段就结束了
+    ended_ = true;
+    encode_thread_created_ = pthread_create(&encode_thread_, nullptr, CopyThread, this) == 0;
+    if (!encode_thread_created_) {
+        h264_packet_queue_->Put(new VideoPacket());
+        return -1;
+    }
+    return 0;
+}
+
+int SegmentEncoder::StartCache(const std::string& path, int64_t timeline_offset) {
+    h264_packet_queue_ = new VideoPacketQueue();
+    h264_packet_queue_->SetMaxSize(SEGMENT_COPY_QUEUE_SIZE);
+    cache_path_ = path;
+    timeline_offset_ = timeline_offset;
+    ended_ = true;
+    encode_thread_created_ = pthread_create(&encode_thread_, nullptr, CacheThread, this) == 0;
+    if (!encode_thread_created_) {
+        h264_packet_queue_->Put(new VideoPacket());
+        return -1;
+    }
+    return 0;
+}
+
+void SegmentEncoder::SetSpsId(int sps_id) {
+    sps_id_ = sps_id;
+}
+
+void SegmentEncoder::SetCacheFile(const std::string& path, int64_t timeline_offset) {
+    cache_path_ = path;
+    timeline_offset_ = timeline_offset;
+}
+
+void SegmentEncoder::Put(uint8_t* buffer, int size, int time_mills) {
+    VideoPacket* packet = new VideoPacket();
+    packet->buffer = buffer;
+    packet->size = size;
+    packet->timeMills = time_mills;
+    yuv_packet_queue_->Put(packet);
+}
+
+void SegmentEncoder::End() {
+    if (ended_) {
+        return;
+    }
+    ended_ = true;
+    yuv_packet_queue_->Put(new VideoPacket());
+}
+
+void SegmentEncoder::Cancel() {
+    if (ended_) {
+        return;
+    }
+    canceled_ = true;
+    End();
+}
+
+int SegmentEncoder::GetPacket(VideoPacket** packet) {
+    int ret = h264_packet_queue_->Get(packet, true);
+    if (nullptr == cache_writer_ || ret < 0 || nullptr == *packet) {
+        return ret;
+    }
+    // 在拼接线程修改时间戳之前写入缓存
+    if (nullptr != (*packet)->buffer) {
+        if (cache_writer_->Write(*packet) < 0) {
+            delete cache_writer_;
+            cache_writer_ = nullptr;
+        }
+    } else {
+        cache_writer_->Close(!canceled_);
+        delete cache_writer_;
+        cache_writer_ = nullptr;
+    }
+    return ret;
+}
+
+int SegmentEncoder::GetIndex() {
+    return index_;
+}
+
+void SegmentEncoder::Destroy() {
+    if (encode_thread_created_) {
+        if (nullptr != yuv_packet_queue_) {
+            yuv_packet_queue_->Abort();
+        } else {
+            // 读取线程可能在等待队列有空间
+            h264_packet_queue_->Abort();
+        }
+        pthread_join(encode_thread_, nullptr);
+        encode_thread_created_ = false;
+    }
+    if (nullptr != encoder_) {
+        encoder_->Destroy();
+        delete encoder_;
+        encoder_ = nullptr;
+    }
+    if (nullptr != yuv_packet_queue_) {
+        delete yuv_packet_queue_;
+        yuv_packet_queue_ = nullptr;
+    }
+    if (nullptr != h264_packet_queue_) {
+        h264_packet_queue_->Abort();
+        delete h264_packet_queue_;
+        h264_packet_queue_ = nullptr;
+    }
+    if (nullptr != file_name_) {
+        free(file_name_);
+        file_name_ = nullptr;
+    }
+    if (nullptr != cache_writer_) {
+        // 没有读取到结束的packet, 这一段不完整
+        cache_writer_->Close(false);
+        delete cache_writer_;
+        cache_writer_ = nullptr;
+    }
+}
+
+void* SegmentEncoder::EncodeThread(void* context) {
+    SegmentEncoder* encoder = reinterpret_cast<SegmentEncoder*>(context);
+    encoder->ProcessEncode();
+    pthread_exit(0);
+}
+
+void SegmentEncoder::ProcessEncode() {
+    VideoPacket* packet = nullptr;
+    while (true) {
+        if (yuv_packet_queue_->Get(&packet, true) < 0) {
+            break;
+        }
+        if (nullptr == packet) {
+            continue;
+        }
+        if (nullptr == packet->buffer) {
+            delete packet;
+            break;
+        }
+        if (nullptr != encoder_) {
+            encoder_->Encode(packet);
+        }
+        delete packet;
+        packet = nullptr;
+    }
+    if (nullptr != encoder_) {
+        encoder_->Flush();
+    }
+    // 空的packet表示这一段已经全部编码完成
+    h264_packet_queue_->Put(new VideoPacket());
+}
+
+void* SegmentEncoder::CopyThread(void* context) {
+    SegmentEncoder* encoder = reinterpret_cast<SegmentEncoder*>(context);
+    encoder->ProcessCopy();
+    pthread_exit(0);
+}
+
+void SegmentEncoder::ProcessCopy() {
+    AVFormatContext* context = nullptr;
+    int ret = avformat_open_input(&context, file_name_, nullptr, nullptr);
+    if (ret >= 0) {
+        ret = avformat_find_stream_info(context, nullptr);
+    }
+    int video_index = ret >= 0 ? av_find_best_stream(context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0) : -1;
+    if (video_index < 0) {
+        LOGE("SegmentEncoder %d open %s error: %d", index_, file_name_, ret < 0 ? ret : video_index);
+    } else {
+        AVStream* stream = context->streams[video_index];
+        AVRational mills_time_base = { 1, 1000 };
+        ret = av_seek_frame(context, video_index, av_rescale_q(copy_start_time_, mills_time_base, stream->time_base),
+                AVSEEK_FLAG_BACKWARD);
+        if (ret < 0) {
+            LOGE("SegmentEncoder %d seek error: %s", index_, av_err2str(ret));
+        }
+        AVPacket packet;
+        av_init_packet(&packet);
+        packet.data = nullptr;
+        packet.size = 0;
+        bool started = false;
+        while (av_read_frame(context, &packet) >= 0) {
+            int64_t pts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            if (packet.stream_index != video_index || pts == AV_NOPTS_VALUE || packet.size <= 4) {
+                av_packet_unref(&packet);
+                continue;
+            }
+            int64_t time = av_rescale_q(pts, stream->time_base, mills_time_base);
+            bool key = (packet.flags & AV_PKT_FLAG_KEY) != 0;
+            if (!started) {
+                // seek到了更早的关键帧, 跳过开始时间之前的GOP
+                if (!key || time < copy_start_time_) {
+                    av_packet_unref(&packet);
+                    continue;
+                }
+                started = true;
+            } else if (key && time >= copy_end_time_) {
+                av_packet_unref(&packet);
+                break;
+            }
+            // 参数集已经在extradata中, 去掉帧中带的sps和pps, 拼接时也不会被当作参数集
+            VideoPacket* video_packet = new VideoPacket();
+            video_packet->buffer = new uint8_t[packet.size];
+            int size = 0;
+            int offset = 0;
+            while (offset + 4 <= packet.size) {
+                int length = (packet.data[offset] << 24) | (packet.data[offset + 1] << 16) |
+                        (packet.data[offset + 2] << 8) | packet.data[offset + 3];
+                if (length <= 0 || length > packet.size - offset - 4) {
+                    break;
+                }
+                if (!H264IsParameterSet(packet.data[offset + 4] & 0x1F)) {
+                    memcpy(video_packet->buffer + size, packet.data + offset, 4 + length);
+                    size += 4 + length;
+                }
+                offset += 4 + length;
+            }
+            video_packet->size = size;
+            video_packet->key = key;
+            int64_t timeline = timeline_offset_ - copy_start_time_;
+            video_packet->pts = time + timeline;
+            video_packet->timeMills = static_cast<int>(video_packet->pts);
+            if (packet.dts != AV_NOPTS_VALUE) {
+                video_packet->dts = av_rescale_q(packet.dts, stream->time_base, mills_time_base) + timeline;
+            }
+            av_packet_unref(&packet);
+            if (size == 0) {
+                delete video_packet;
+                continue;
+            }
+            // 队列满时等待拼接线程, 停止导出时队列被abort
+            if (h264_packet_queue_->Put(video_packet) < 0) {
+                break;
+            }
+        }
+        av_packet_unref(&packet);
+    }
+    if (nullptr != context) {
+        avformat_close_input(&context);
+    }
+    // 空的packet表示这一段已经全部复制完成
+    h264_packet_queue_->Put(new VideoPacket());
+}
+
+void* SegmentEncoder::CacheThread(void* context) {
+    SegmentEncoder* encoder = reinterpret_cast<SegmentEncoder*>(context);
+    encoder->ProcessCache();
+    pthread_exit(0);
+}
+
+void SegmentEncoder::ProcessCache() {
+    SegmentCacheReader reader;
+    if (reader.Open(cache_path_, timeline_offset_) == 0) {
+        VideoPacket* packet = nullptr;
+        while (reader.Read(&packet) == 0) {
+            if (h264_packet_queue_->Put(packet) < 0) {
+                break;
+            }
+            packet = nullptr;
+        }
+        reader.Close();
+    }
+    // 空的packet表示这一段已经全部读取完成
+    h264_packet_queue_->Put(new VideoPacket());
+}
+
+}  // namespace trinity
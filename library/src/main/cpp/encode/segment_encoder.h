@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#ifndef TRINITY_SEGMENT_ENCODER_H
+#define TRINITY_SEGMENT_ENCODER_H
+
+#include <pthread.h>
+#include <string>
+#include "video_packet_queue.h"
+#include "segment_cache.h"
+#include "video_x264_encoder.h"
+
+namespace trinity {
+
+// 导出时分段编码中的一段
+// 每一段使用自己的x264和编码线程, 从IDR开始, 和其它段之间没有参考关系
+// 编码出来的数据放入自己的队列, 由ExportEncoderAdapter按段的顺序写入PacketPool
+// 智能导出时没有变化的段不编码, 由读取线程直接从源文件复制压缩数据放入队列
+// 上一次导出缓存过的段也不编码, 由读取线程从缓存文件读取
+class SegmentEncoder {
+ public:
+    explicit SegmentEncoder(int index);
+    ~SegmentEncoder();
+
+    int Start(int width, int height, int bit_rate, int frame_rate, int thread_count,
+            EncodeProfile profile, AVPixelFormat pixel_format);
+
+    // 不编码, 直接复制源文件中这一段的压缩数据, 时间单位是毫秒
+    // start_time需要是关键帧的时间, 复制到end_time或者之后的第一个关键帧为止
+    // 时间戳按timeline_offset + pts - start_time移到时间线上
+    int StartCopy(const char* file_name, int64_t start_time, int64_t end_time, int64_t timeline_offset);
+
+    // 不编码, 读取SegmentCache中缓存的这一段, 时间戳加上timeline_offset
+    int StartCache(const std::string& path, int64_t timeline_offset);
+
+    // 需要在Start之前调用
+    void SetSpsId(int sps_id);
+
+    // 需要在Start之前调用, 编码出来的数据同时写入缓存文件, 这一段完整结束时才保存
+    void SetCacheFile(const std::string& path, int64_t timeline_offset);
+
+    // 放入一帧YUV数据, 队列满时阻塞, buffer由SegmentEncoder释放
+    void Put(uint8_t* buffer, int size, int time_mills);
+
+    // 这一段的输入结束, 编码线程把剩余的帧编码完成后放入一个空的packet, 多次调用只有第一次有效
+    void End();
+
+    // 停止导出时调用, 没有结束的段不完整, 不保存缓存
+    void Cancel();
+
+    // 阻塞读取编码后的数据, buffer为空的packet表示这一段已经结束
+    int GetPacket(VideoPacket** packet);
+
+    int GetIndex();
+
+    // 等待编码线程退出, 释放编码器
+    void Destroy();
+
+ private:
+    static void* EncodeThread(void* context);
+
+    void ProcessEncode();
+
+    static void* CopyThread(void* context);
+
+    void ProcessCopy();
+
+    static void* CacheThread(void* context);
+
+    void ProcessCache();
+
+ private:
+    int index_;
+    VideoX264Encoder* encoder_;
+    VideoPacketQueue* yuv_packet_queue_;
+    VideoPacketQueue* h264_packet_queue_;
+    pthread_t encode_thread_;
+    bool encode_thread_created_;
+    bool ended_;
+    int sps_id_;
+    /** 直接复制时的源文件和时间范围 **/
+    char* file_name_;
+    int64_t copy_start_time_;
+    int64_t copy_end_time_;
+    int64_t timeline_offset_;
+    /** 缓存文件的路径, 读取缓存时是读取的文件, 编码时是写入的文件 **/
+    std::string cache_path_;
+    SegmentCacheWriter* cache_writer_;
+    bool canceled_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_SEGMENT_ENCODER_H
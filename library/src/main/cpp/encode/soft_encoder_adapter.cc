@@ -36,6 +36,7 @@ SoftEncoderAdapter::SoftEncoderAdapter(GLfloat* vertex_coordinate, GLfloat* text
       encoder_(nullptr),
       renderer_(nullptr),
       time_mills_(0),
+      initialized_(false),
       msg_(MSG_NONE),
       copy_texture_surface_(EGL_NO_SURFACE) {
     pthread_mutex_init(&lock_, NULL);
@@ -82,6 +83,7 @@ void SoftEncoderAdapter::CreateEncoder(EGLCore *eglCore, int inputTexId) {
     fps_change_time_ = 0;
 
     encoder_ = new VideoX264Encoder(0);
+    encoder_->SetPixelFormat(yuv_format_ == YUV_FORMAT_NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P);
     encoder_->Init(video_width_, video_height_, video_bit_rate_, frame_rate_, packet_pool_);
     yuy_packet_pool_ = new VideoPacketQueue();
     pthread_create(&x264_encoder_thread_, NULL, StartEncodeThread, this);
@@ -106,23 +108,34 @@ void SoftEncoderAdapter::HotConfig(int maxBitrate, int avgBitrate, int fps) {
 }
 
 void SoftEncoderAdapter::Encode(int timeMills) {
-    while (msg_ == MSG_WINDOW_SET || NULL == egl_core_) {
-        usleep(100 * 1000);
+    if (offline_) {
+        // 等待下载线程初始化完成的通知, 不轮询
+        pthread_mutex_lock(&preview_thread_lock_);
+        while (!initialized_) {
+            pthread_cond_wait(&preview_thread_condition_, &preview_thread_lock_);
+        }
+        pthread_mutex_unlock(&preview_thread_lock_);
+    } else {
+        while (msg_ == MSG_WINDOW_SET || NULL == egl_core_) {
+            usleep(100 * 1000);
+        }
     }
     if (start_time_ == 0)
         start_time_ = getCurrentTime();
 
-    if (fps_change_time_ == 0) {
-        fps_change_time_ = getCurrentTime();
-    }
+    if (!offline_) {
+        if (fps_change_time_ == 0) {
+            fps_change_time_ = getCurrentTime();
+        }
 
-    // need drop frames
-    int expectedFrameCount = (int) ((getCurrentTime() - fps_change_time_) / 1000.0f * frame_rate_ + 0.5f);
-//    if (expectedFrameCount < encode_frame_count_) {
-//        LOGE("expectedFrameCount is %d while encoded_frame_count_ is %d", expectedFrameCount,
-//             encode_frame_count_);
-//        return;
-//    }
+        // need drop frames
+        int expectedFrameCount = (int) ((getCurrentTime() - fps_change_time_) / 1000.0f * frame_rate_ + 0.5f);
+//        if (expectedFrameCount < encode_frame_count_) {
+//            LOGE("expectedFrameCount is %d while encoded_frame_count_ is %d", expectedFrameCount,
+//                 encode_frame_count_);
+//            return;
+//        }
+    }
     time_mills_ = timeMills;
     encode_frame_count_++;
     pthread_mutex_lock(&preview_thread_lock_);
@@ -134,6 +147,13 @@ void SoftEncoderAdapter::Encode(int timeMills) {
 }
 
 void SoftEncoderAdapter::DestroyEncoder() {
+    // 先退出下载线程, 异步读取中的帧需要在编码线程退出之前放入队列
+    pthread_mutex_lock(&lock_);
+    msg_ = MSG_RENDER_LOOP_EXIT;
+    pthread_cond_signal(&condition_);
+    pthread_mutex_unlock(&lock_);
+    pthread_join(image_download_thread_, 0);
+
     yuy_packet_pool_->Abort();
     pthread_join(x264_encoder_thread_, 0);
     delete yuy_packet_pool_;
@@ -143,12 +163,6 @@ void SoftEncoderAdapter::DestroyEncoder() {
         delete encoder_;
         encoder_ = NULL;
     }
-
-    pthread_mutex_lock(&lock_);
-    msg_ = MSG_RENDER_LOOP_EXIT;
-    pthread_cond_signal(&condition_);
-    pthread_mutex_unlock(&lock_);
-    pthread_join(image_download_thread_, 0);
 }
 
 void *SoftEncoderAdapter::StartDownloadThread(void *ptr) {
@@ -165,10 +179,16 @@ void SoftEncoderAdapter::renderLoop() {
             case MSG_WINDOW_SET:
                 LOGI("receive msg MSG_WINDOW_SET");
                 Initialize();
+                pthread_mutex_lock(&preview_thread_lock_);
+                initialized_ = true;
+                pthread_cond_signal(&preview_thread_condition_);
+                pthread_mutex_unlock(&preview_thread_lock_);
                 break;
             case MSG_RENDER_LOOP_EXIT:
                 LOGI("receive msg MSG_RENDER_LOOP_EXIT");
                 renderingEnabled = false;
+                // 把还在PBO中的帧送去编码
+                FlushTexture();
                 Destroy();
                 break;
             default:
@@ -203,16 +223,45 @@ void SoftEncoderAdapter::LoadTexture() {
     this->SignalPreviewThread();
     // TODO 这里需要设置一个buffer池
     uint8_t *packetBuffer = new uint8_t[pixel_size_];
-    encode_render_->CopyYUV420Image(output_texture_id_, packetBuffer, video_width_, video_height_);
-    VideoPacket *videoPacket = new VideoPacket();
-    videoPacket->buffer = packetBuffer;
-    videoPacket->size = pixel_size_;
-    videoPacket->timeMills = time_mills_;
+    int packet_time_mills = 0;
+    // GLES3时读取的是之前提交的帧, GPU在这期间处理当前帧, 不需要等待
+    int ret = encode_render_->CopyYUV420ImageAsync(output_texture_id_, packetBuffer, video_width_, video_height_,
+            time_mills_, &packet_time_mills);
     if (time_mills_ != -1) {
         time_mills_ = NO_TIME_MILLS;
     }
+    if (ret > 0) {
+        PutYUVPacket(packetBuffer, packet_time_mills);
+    } else {
+        delete[] packetBuffer;
+    }
+}
+
+void SoftEncoderAdapter::FlushTexture() {
+    if (nullptr == egl_core_ || nullptr == encode_render_) {
+        return;
+    }
+    egl_core_->MakeCurrent(copy_texture_surface_);
+    while (true) {
+        uint8_t *packetBuffer = new uint8_t[pixel_size_];
+        int packet_time_mills = 0;
+        if (encode_render_->FlushYUV420Image(packetBuffer, &packet_time_mills) <= 0) {
+            delete[] packetBuffer;
+            break;
+        }
+        PutYUVPacket(packetBuffer, packet_time_mills);
+    }
+}
+
+void SoftEncoderAdapter::PutYUVPacket(uint8_t *buffer, int time_mills) {
+    VideoPacket *videoPacket = new VideoPacket();
+    videoPacket->buffer = buffer;
+    videoPacket->size = pixel_size_;
+    videoPacket->timeMills = time_mills;
     if (nullptr != yuy_packet_pool_) {
         yuy_packet_pool_->Put(videoPacket);
+    } else {
+        delete videoPacket;
     }
 }
 
@@ -228,7 +277,7 @@ bool SoftEncoderAdapter::Initialize() {
     copy_texture_surface_ = egl_core_->CreateOffscreenSurface(video_width_, video_height_);
     egl_core_->MakeCurrent(copy_texture_surface_);
     renderer_ = new OpenGL(video_width_, video_height_);
-    encode_render_ = new EncodeRender();
+    encode_render_ = new EncodeRender(yuv_format_);
     glGenFramebuffers(1, &fbo_);
     //初始化outputTexId
     glGenTextures(1, &output_texture_id_);
@@ -290,6 +339,7 @@ void SoftEncoderAdapter::startEncode() {
             videoPacket = nullptr;
         }
     }
+    encoder_->Flush();
 }
 
 }  // namespace trinity
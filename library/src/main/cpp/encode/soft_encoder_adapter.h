@@ -56,6 +56,10 @@ class SoftEncoderAdapter : public VideoEncoderAdapter {
 
     void LoadTexture();
 
+    void FlushTexture();
+
+    void PutYUVPacket(uint8_t* buffer, int time_mills);
+
     void SignalPreviewThread();
 
     void Destroy();
@@ -75,6 +79,8 @@ class SoftEncoderAdapter : public VideoEncoderAdapter {
     };
     pthread_mutex_t preview_thread_lock_;
     pthread_cond_t preview_thread_condition_;
+    /** 下载线程的EGL环境已经创建 **/
+    bool initialized_;
     pthread_mutex_t lock_;
     pthread_cond_t condition_;
     enum DownloadThreadMessage msg_;
@@ -34,6 +34,8 @@ VideoEncoderAdapter::VideoEncoderAdapter()
       fps_change_time_(0),
       texture_id_(0),
       start_time_(0),
+      offline_(false),
+      yuv_format_(YUV_FORMAT_I420),
       packet_pool_(nullptr) {
 }
 
@@ -48,6 +50,15 @@ void VideoEncoderAdapter::Init(int width, int height, int video_bit_rate, int fr
     encode_frame_count_ = 0;
 }
 
+void VideoEncoderAdapter::SetOffline(bool offline) {
+    offline_ = offline;
+    PacketPool::GetInstance()->SetRecordingVideoPacketQueueOffline(offline);
+}
+
+void VideoEncoderAdapter::SetYUVFormat(YUVFormat format) {
+    yuv_format_ = format;
+}
+
 void VideoEncoderAdapter::ResetFpsStartTimeIfNeed(int fps) {
     if (fabs(fps - frame_rate_) > FLOAT_DELTA) {
         frame_rate_ = fps;
@@ -24,6 +24,7 @@
 
 #include "egl_core.h"
 #include "packet_pool.h"
+#include "color_convert.h"
 
 namespace trinity {
 
@@ -42,6 +43,15 @@ class VideoEncoderAdapter {
 
     void ResetFpsStartTimeIfNeed(int fps);
 
+    // 离线模式, 导出时使用
+    // 只按传入的媒体时间戳编码, 不根据系统时间丢帧和等待, 每一帧都会编码
+    // 编码后的视频包队列满时阻塞等待muxer, 不使用录制的丢GOP策略
+    void SetOffline(bool offline);
+
+    // 读取和编码使用的YUV格式, 需要在CreateEncoder之前调用
+    // 使用Surface输入的硬编码不需要读取YUV, 会忽略这个设置
+    void SetYUVFormat(YUVFormat format);
+
  protected:
     int encode_frame_count_;
     int video_width_;
@@ -51,6 +61,8 @@ class VideoEncoderAdapter {
     int64_t fps_change_time_;
     int texture_id_;
     int64_t start_time_;
+    bool offline_;
+    YUVFormat yuv_format_;
     const float FLOAT_DELTA = 1e-4;
     PacketPool* packet_pool_;
 };
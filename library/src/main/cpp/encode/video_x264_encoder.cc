@@ -24,10 +24,7 @@ VideoX264Encoder::VideoX264Encoder(int strategy) {
 	strategy_ = strategy;
     codec_context_ = nullptr;
     codec_ = nullptr;
-    picture_buf_ = nullptr;
     frame_ = nullptr;
-	yuy2_picture_buf_ = nullptr;
-	video_yuy2_frame_ = nullptr;
 	packet_pool_ = nullptr;
 	sps_unwrite_flag_ = false;
 }
@@ -35,137 +32,143 @@ VideoX264Encoder::VideoX264Encoder(int strategy) {
 VideoX264Encoder::~VideoX264Encoder() {
 }
 
+void VideoX264Encoder::SetThreadCount(int thread_count) {
+	thread_count_ = thread_count;
+}
+
+void VideoX264Encoder::SetEncodeProfile(EncodeProfile profile) {
+	encode_profile_ = profile;
+}
+
+void VideoX264Encoder::SetPixelFormat(AVPixelFormat pixel_format) {
+	pixel_format_ = pixel_format == AV_PIX_FMT_NV12 ? AV_PIX_FMT_NV12 : X264_INPUT_COLOR_FORMAT;
+}
+
+void VideoX264Encoder::SetPacketQueue(VideoPacketQueue *queue) {
+	packet_queue_ = queue;
+}
+
+void VideoX264Encoder::SetSpsId(int sps_id) {
+	sps_id_ = sps_id;
+}
+
+void VideoX264Encoder::SetGlobalHeader(bool global_header) {
+	global_header_ = global_header;
+}
+
+const uint8_t *VideoX264Encoder::GetExtraData(int *size) {
+	if (nullptr == codec_context_ || nullptr == codec_context_->extradata) {
+		*size = 0;
+		return nullptr;
+	}
+	*size = codec_context_->extradata_size;
+	return codec_context_->extradata;
+}
+
 int VideoX264Encoder::Init(int width, int height, int videoBitRate, float frameRate, PacketPool *packetPool) {
 	if (AllocVideoStream(width, height, videoBitRate, frameRate) < 0) {
 		LOGE("alloc Video Stream Failed... \n");
 		return -1;
 	}
-	AllocAVFrame();
+	frame_ = av_frame_alloc();
 	frame_->width = width;
 	frame_->height = height;
-	frame_->format = AV_PIX_FMT_YUV420P;
+	frame_->format = pixel_format_;
 	packet_pool_ = packetPool;
 	sps_unwrite_flag_ = true;
 	return 0;
 }
 
-int VideoX264Encoder::Encode(VideoPacket *yuy2VideoPacket) {
-	memcpy(yuy2_picture_buf_, yuy2VideoPacket->buffer, yuy2VideoPacket->size);
-    frame_->data[0] = yuy2VideoPacket->buffer;
-    frame_->data[1] = yuy2VideoPacket->buffer + frame_->width * frame_->height;
-    frame_->data[2] = yuy2VideoPacket->buffer + frame_->width * frame_->height + frame_->width * frame_->height / 4;
-	int presentationTimeMills = yuy2VideoPacket->timeMills;
-	AVRational time_base = {1, 1000};
-	int64_t pts = (int64_t) (presentationTimeMills / 1000.0f / av_q2d(time_base));
-	frame_->pts = pts;
-	AVPacket pkt = {0};
-	int got_packet;
-	av_init_packet(&pkt);
-	int ret = avcodec_encode_video2(codec_context_, &pkt, frame_, &got_packet);
+int VideoX264Encoder::Encode(VideoPacket *videoPacket) {
+	// 直接使用packet中的数据, 不再拷贝, avcodec_send_frame返回时x264已经把数据复制到自己的缓存中
+	av_image_fill_arrays(frame_->data, frame_->linesize, videoPacket->buffer, pixel_format_,
+						 frame_->width, frame_->height, 1);
+	frame_->pts = videoPacket->timeMills;
+	int ret = avcodec_send_frame(codec_context_, frame_);
 	if (ret < 0) {
 		LOGE("Error encoding video frame_: %s\n", av_err2str(ret));
-		ret = -1;
-	} else if (got_packet && pkt.size) {
-		int presentationTimeMills = (int) (pkt.pts * av_q2d(time_base) * 1000.0f);
-		int nalu_type = (pkt.data[4] & 0x1F);
-		bool isKeyFrame = false;
-		uint8_t *frameBuffer;
-		int frameBufferSize = 0;
-		const char bytesHeader[] = "\x00\x00\x00\x01";
-		size_t headerLength = 4; //string literals have implicit trailing '\0'
-		if (H264_NALU_TYPE_SEQUENCE_PARAMETER_SET == nalu_type) {
-			//说明是关键帧
-			isKeyFrame = true;
-			//分离出sps pps
-			vector<NALUnit *> *units = new vector<NALUnit *>();
-			parseH264SpsPps(pkt.data, pkt.size, units);
-			if (sps_unwrite_flag_) {
-				NALUnit *spsUnit = units->at(0);
-				uint8_t *spsFrame = spsUnit->naluBody;
-				int spsFrameLen = spsUnit->naluSize;
-				NALUnit *ppsUnit = units->at(1);
-				uint8_t *ppsFrame = ppsUnit->naluBody;
-				int ppsFrameLen = ppsUnit->naluSize;
-				//将sps、pps写出去
-				int metaBuffertSize = headerLength + spsFrameLen + headerLength + ppsFrameLen;
-				uint8_t *metaBuffer = new uint8_t[metaBuffertSize];
-				memcpy(metaBuffer, bytesHeader, headerLength);
-				memcpy(metaBuffer + headerLength, spsFrame, spsFrameLen);
-				memcpy(metaBuffer + headerLength + spsFrameLen, bytesHeader, headerLength);
-				memcpy(metaBuffer + headerLength + spsFrameLen + headerLength, ppsFrame, ppsFrameLen);
-				PushToQueue(metaBuffer, metaBuffertSize, presentationTimeMills, pkt.pts, pkt.dts);
-				sps_unwrite_flag_ = false;
-			}
-			vector<NALUnit *>::iterator i;
-			bool isFirstIDRFrame = true;
-			for (i = units->begin(); i != units->end(); ++i) {
-				NALUnit *unit = *i;
-				int naluType = unit->naluType;
-				if (H264_NALU_TYPE_SEQUENCE_PARAMETER_SET != naluType &&
-					H264_NALU_TYPE_PICTURE_PARAMETER_SET != naluType) {
-					int idrFrameLen = unit->naluSize;
-					frameBufferSize += headerLength;
-					frameBufferSize += idrFrameLen;
-				}
-			}
-			frameBuffer = new uint8_t[frameBufferSize];
-			int frameBufferCursor = 0;
-			for (i = units->begin(); i != units->end(); ++i) {
-				NALUnit *unit = *i;
-				int naluType = unit->naluType;
-				if (H264_NALU_TYPE_SEQUENCE_PARAMETER_SET != naluType &&
-					H264_NALU_TYPE_PICTURE_PARAMETER_SET != naluType) {
-					uint8_t *idrFrame = unit->naluBody;
-					int idrFrameLen = unit->naluSize;
-					//将关键帧分离出来
-					memcpy(frameBuffer + frameBufferCursor, bytesHeader, headerLength);
-					frameBufferCursor += headerLength;
-					memcpy(frameBuffer + frameBufferCursor, idrFrame, idrFrameLen);
-					frameBufferCursor += idrFrameLen;
-					frameBuffer[frameBufferCursor - idrFrameLen - headerLength] = ((idrFrameLen) >> 24) & 0x00ff;
-					frameBuffer[frameBufferCursor - idrFrameLen - headerLength + 1] = ((idrFrameLen) >> 16) & 0x00ff;
-					frameBuffer[frameBufferCursor - idrFrameLen - headerLength + 2] = ((idrFrameLen) >> 8) & 0x00ff;
-					frameBuffer[frameBufferCursor - idrFrameLen - headerLength + 3] = ((idrFrameLen)) & 0x00ff;
-				}
-				delete unit;
-			}
-			delete units;
-		} else {
-			//说明是非关键帧, 从Packet里面分离出来
-			isKeyFrame = false;
-			vector<NALUnit *> *units = new vector<NALUnit *>();
-			parseH264SpsPps(pkt.data, pkt.size, units);
-			vector<NALUnit *>::iterator i;
-			for (i = units->begin(); i != units->end(); ++i) {
-				NALUnit *unit = *i;
-				int nonIDRFrameLen = unit->naluSize;
-				frameBufferSize += headerLength;
-				frameBufferSize += nonIDRFrameLen;
-			}
-			frameBuffer = new uint8_t[frameBufferSize];
-			int frameBufferCursor = 0;
-			for (i = units->begin(); i != units->end(); ++i) {
-				NALUnit *unit = *i;
-				uint8_t *nonIDRFrame = unit->naluBody;
-				int nonIDRFrameLen = unit->naluSize;
-				memcpy(frameBuffer + frameBufferCursor, bytesHeader, headerLength);
-				frameBufferCursor += headerLength;
-				memcpy(frameBuffer + frameBufferCursor, nonIDRFrame, nonIDRFrameLen);
-				frameBufferCursor += nonIDRFrameLen;
-				frameBuffer[frameBufferCursor - nonIDRFrameLen - headerLength] = ((nonIDRFrameLen) >> 24) & 0x00ff;
-				frameBuffer[frameBufferCursor - nonIDRFrameLen - headerLength + 1] = ((nonIDRFrameLen) >> 16) & 0x00ff;
-				frameBuffer[frameBufferCursor - nonIDRFrameLen - headerLength + 2] = ((nonIDRFrameLen) >> 8) & 0x00ff;
-				frameBuffer[frameBufferCursor - nonIDRFrameLen - headerLength + 3] = ((nonIDRFrameLen)) & 0x00ff;
-				delete unit;
+		return -1;
+	}
+	return ReceivePacket();
+}
+
+int VideoX264Encoder::Flush() {
+	if (nullptr == codec_context_) {
+		return 0;
+	}
+	// 送入空帧之后取出编码器中缓存的所有帧
+	int ret = avcodec_send_frame(codec_context_, nullptr);
+	if (ret < 0 && ret != AVERROR_EOF) {
+		LOGE("Error flush video encoder: %s\n", av_err2str(ret));
+		return -1;
+	}
+	return ReceivePacket();
+}
+
+int VideoX264Encoder::ReceivePacket() {
+	// 一帧输入可能对应零个或多个输出
+	AVPacket packet;
+	av_init_packet(&packet);
+	packet.data = nullptr;
+	packet.size = 0;
+	while (true) {
+		int ret = avcodec_receive_packet(codec_context_, &packet);
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+			return 0;
+		}
+		if (ret < 0) {
+			LOGE("Error receive video packet: %s\n", av_err2str(ret));
+			return -1;
+		}
+		if (packet.size > 0) {
+			ProcessPacket(&packet);
+		}
+		av_packet_unref(&packet);
+	}
+}
+
+void VideoX264Encoder::ProcessPacket(AVPacket *packet) {
+	AVRational time_base = {1, 1000};
+	int presentationTimeMills = (int) (packet->pts * av_q2d(time_base) * 1000.0f);
+	// 只记录NAL的位置, 不为每个NAL分配内存
+	H264Nal nals[H264_MAX_NAL_COUNT];
+	int count = H264ParseNals(packet->data, packet->size, nals, H264_MAX_NAL_COUNT);
+	if (count <= 0) {
+		LOGE("parse h264 packet error count: %d size: %d", count, packet->size);
+		return;
+	}
+	if (sps_unwrite_flag_ && H264_NALU_TYPE_SEQUENCE_PARAMETER_SET == nals[0].type) {
+		// sps和pps只写出一次, 由muxer生成extradata
+		const H264Nal* sps = nullptr;
+		const H264Nal* pps = nullptr;
+		for (int i = 0; i < count; i++) {
+			if (nullptr == sps && H264_NALU_TYPE_SEQUENCE_PARAMETER_SET == nals[i].type) {
+				sps = nals + i;
+			} else if (nullptr == pps && H264_NALU_TYPE_PICTURE_PARAMETER_SET == nals[i].type) {
+				pps = nals + i;
 			}
-			delete units;
 		}
-		PushToQueue(frameBuffer, frameBufferSize, presentationTimeMills, pkt.pts, pkt.dts);
-	} else {
-		LOGI("No Output Frame...");
+		if (nullptr != sps && nullptr != pps) {
+			const char bytesHeader[] = "\x00\x00\x00\x01";
+			size_t headerLength = 4; //string literals have implicit trailing '\0'
+			int metaBufferSize = headerLength + sps->size + headerLength + pps->size;
+			uint8_t *metaBuffer = new uint8_t[metaBufferSize];
+			memcpy(metaBuffer, bytesHeader, headerLength);
+			memcpy(metaBuffer + headerLength, packet->data + sps->offset, sps->size);
+			memcpy(metaBuffer + headerLength + sps->size, bytesHeader, headerLength);
+			memcpy(metaBuffer + headerLength + sps->size + headerLength, packet->data + pps->offset, pps->size);
+			PushToQueue(metaBuffer, metaBufferSize, presentationTimeMills, packet->pts, packet->dts);
+			sps_unwrite_flag_ = false;
+		}
+	}
+	// 去掉sps和pps, 起始码换成4字节的长度, 一次写入VideoPacket的buffer
+	int frameBufferSize = H264AvccSize(nals, count, true);
+	if (frameBufferSize <= 0) {
+		return;
 	}
-	av_free_packet(&pkt);
-	return ret;
+	uint8_t *frameBuffer = new uint8_t[frameBufferSize];
+	H264WriteAvcc(packet->data, nals, count, frameBuffer, true);
+	PushToQueue(frameBuffer, frameBufferSize, presentationTimeMills, packet->pts, packet->dts);
 }
 
 void VideoX264Encoder::PushToQueue(uint8_t *buffer, int size, int timeMills, int64_t pts, int64_t dts) {
@@ -173,26 +176,26 @@ void VideoX264Encoder::PushToQueue(uint8_t *buffer, int size, int timeMills, int
 	h264Packet->buffer = buffer;
 	h264Packet->size = size;
 	h264Packet->timeMills = timeMills;
-//	h264Packet->pts = pts;
-//	h264Packet->dts = dts;
+	// 有B帧时输出按解码顺序, pts和dts不相同, 单位都是毫秒
+	h264Packet->pts = pts;
+	h264Packet->dts = dts;
+	if (nullptr != packet_queue_) {
+		packet_queue_->Put(h264Packet);
+		return;
+	}
 	packet_pool_->PushRecordingVideoPacketToQueue(h264Packet);
 }
 
 int VideoX264Encoder::Destroy() {
 	//Clean
 	if (nullptr != codec_context_) {
-        avcodec_close(codec_context_);
+        avcodec_free_context(&codec_context_);
         codec_context_ = nullptr;
     }
     if (frame_ != nullptr) {
-        av_free(frame_);
+        av_frame_free(&frame_);
         frame_ = nullptr;
     }
-    if (picture_buf_ != nullptr) {
-        av_free(picture_buf_);
-        picture_buf_ = nullptr;
-    }
-    // TODO release yuy2_picture_buf_
 	return 0;
 }
 
@@ -214,6 +217,43 @@ void VideoX264Encoder::ReConfigure(int bitRate) {
 		 codec_context_->rc_max_rate, codec_context_->rc_min_rate, codec_context_->bit_rate);
 }
 
+void VideoX264Encoder::ConfigureExport(int bitRate, float frameRate) {
+	// 导出不需要低延迟, 使用帧级线程, lookahead和B帧
+	// 使用CRF控制质量, 传入的码率作为VBV的上限, 简单的画面可以使用更低的码率
+	const char *preset = "veryfast";
+	const char *crf = "23";
+	int lookahead = 20;
+	int max_b_frames = 2;
+	int max_rate = bitRate;
+	if (encode_profile_ == ENCODE_PROFILE_EXPORT_QUALITY) {
+		preset = "medium";
+		crf = "20";
+		lookahead = 40;
+		max_b_frames = 3;
+		max_rate = bitRate * 2;
+	}
+	codec_context_->max_b_frames = max_b_frames;
+	codec_context_->gop_size = (int) (frameRate * EXPORT_KEY_FRAME_INTERVAL);
+	codec_context_->keyint_min = (int) frameRate;
+	codec_context_->bit_rate = 0;
+	codec_context_->rc_max_rate = max_rate;
+	codec_context_->rc_buffer_size = max_rate * 2;
+	if (thread_count_ > 0) {
+		codec_context_->thread_type = FF_THREAD_FRAME;
+	}
+	av_opt_set(codec_context_->priv_data, "preset", preset, 0);
+	av_opt_set(codec_context_->priv_data, "crf", crf, 0);
+	av_opt_set_int(codec_context_->priv_data, "rc-lookahead", lookahead, 0);
+	av_opt_set(codec_context_->priv_data, "profile", "main", 0);
+	if (sps_id_ > 0) {
+		char params[32];
+		snprintf(params, sizeof(params), "sps-id=%d", sps_id_);
+		av_opt_set(codec_context_->priv_data, "x264-params", params, 0);
+	}
+	LOGI("VideoX264Encoder export profile: %d preset: %s crf: %s max_rate: %d b_frames: %d lookahead: %d threads: %d",
+		 encode_profile_, preset, crf, max_rate, max_b_frames, lookahead, thread_count_);
+}
+
 int VideoX264Encoder::AllocVideoStream(int width, int height, int videoBitRate, float frameRate) {
 	codec_ = avcodec_find_encoder(AV_CODEC_ID_H264);
 	if (nullptr == codec_) {
@@ -221,13 +261,31 @@ int VideoX264Encoder::AllocVideoStream(int width, int height, int videoBitRate,
 		return -1;
 	}
 	codec_context_ = avcodec_alloc_context3(codec_);
-	codec_context_->pix_fmt = AV_PIX_FMT_YUV420P;
+	codec_context_->pix_fmt = pixel_format_;
 	codec_context_->width = width;
 	codec_context_->height = height;
+	// 输入的pts是毫秒, 帧率单独设置, x264的码率控制按真实的时间计算
 	codec_context_->time_base.num = 1;
-	codec_context_->time_base.den = frameRate;
+	codec_context_->time_base.den = 1000;
+	codec_context_->framerate.num = (int) frameRate;
+	codec_context_->framerate.den = 1;
 	codec_context_->gop_size = (int) frameRate;
 	codec_context_->max_b_frames = 0;
+	if (global_header_) {
+		codec_context_->flags |= CODEC_FLAG_GLOBAL_HEADER;
+	}
+	if (thread_count_ > 0) {
+		// zerolatency下x264使用slice线程, 不会增加编码延迟
+		codec_context_->thread_count = thread_count_;
+	}
+	if (encode_profile_ != ENCODE_PROFILE_LIVE) {
+		ConfigureExport(videoBitRate, frameRate);
+		if (avcodec_open2(codec_context_, codec_, nullptr) < 0) {
+			LOGE("Failed to open encoder_! \n");
+			return -1;
+		}
+		return 0;
+	}
 
 	ReConfigure(videoBitRate);
 	if (strategy_ == 1) {
@@ -263,20 +321,4 @@ int VideoX264Encoder::AllocVideoStream(int width, int height, int videoBitRate,
 	return 0;
 }
 
-void VideoX264Encoder::AllocAVFrame() {
-	// target yuv420p buffer_
-	frame_ = av_frame_alloc();
-	int pictureInYUV420PSize = avpicture_get_size(codec_context_->pix_fmt, codec_context_->width,
-												  codec_context_->height);
-	picture_buf_ = (uint8_t *) av_malloc(pictureInYUV420PSize);
-	avpicture_fill((AVPicture *) frame_, picture_buf_, codec_context_->pix_fmt, codec_context_->width,
-				   codec_context_->height);
-	// origin yuy2 buffer_
-	video_yuy2_frame_ = av_frame_alloc();
-	int pictureInYUY2Size = avpicture_get_size(ORIGIN_COLOR_FORMAT, codec_context_->width, codec_context_->height);
-	yuy2_picture_buf_ = (uint8_t *) av_malloc(pictureInYUY2Size);
-	avpicture_fill((AVPicture *) video_yuy2_frame_, yuy2_picture_buf_, ORIGIN_COLOR_FORMAT, codec_context_->width,
-				   codec_context_->height);
-}
-
 }  // namespace trinity
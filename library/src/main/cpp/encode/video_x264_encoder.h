@@ -25,42 +25,87 @@
 
 extern "C" {
 #include "libavutil/opt.h"
+#include "libavutil/imgutils.h"
 #include "libavcodec/avcodec.h"
 }
 
 #define X264_INPUT_COLOR_FORMAT AV_PIX_FMT_YUV420P
-#define ORIGIN_COLOR_FORMAT     AV_PIX_FMT_YUYV422
+/** 导出时关键帧的间隔, 单位是秒 **/
+#define EXPORT_KEY_FRAME_INTERVAL 2
 
 namespace trinity {
 
+// 编码配置, 录制使用LIVE, 导出时可以使用更慢但是压缩率更高的配置
+enum EncodeProfile {
+	ENCODE_PROFILE_LIVE = 0,
+	ENCODE_PROFILE_EXPORT_BALANCED,
+	ENCODE_PROFILE_EXPORT_QUALITY
+};
+
 class VideoX264Encoder {
  private:
 	AVCodecContext *codec_context_;
 	AVCodec *codec_;
-	/** 扔给x264编码器编码的Frame **/
-	uint8_t *picture_buf_;
+	/** 扔给x264编码器编码的Frame, 数据指向输入的VideoPacket **/
 	AVFrame *frame_;
-	/** 从预览线程那边扔过来的YUY2数据 **/
-	uint8_t *yuy2_picture_buf_;
-	AVFrame *video_yuy2_frame_;
 	PacketPool *packet_pool_;
+	/** 设置之后编码出来的数据放入这个队列, 不放入PacketPool **/
+	VideoPacketQueue *packet_queue_ = nullptr;
 	bool sps_unwrite_flag_;
 	const int delta_ = 30 * 1000;
 	int strategy_ = 0;
+	/** x264内部的编码线程数, 0表示使用默认值 **/
+	int thread_count_ = 0;
+	/** 输入的YUV格式, 支持YUV420P和NV12 **/
+	AVPixelFormat pixel_format_ = X264_INPUT_COLOR_FORMAT;
+	EncodeProfile encode_profile_ = ENCODE_PROFILE_LIVE;
+	/** sps和pps的id, 智能导出时和直接复制的源文件使用不同的id **/
+	int sps_id_ = 0;
+	/** 打开编码器时生成sps和pps, 放在extradata中 **/
+	bool global_header_ = false;
 
 	int AllocVideoStream(int width, int height, int videoBitRate, float frameRate);
 
-	void AllocAVFrame();
+	void ConfigureExport(int bitRate, float frameRate);
+
+	int ReceivePacket();
+
+	void ProcessPacket(AVPacket *packet);
 
  public:
 	explicit VideoX264Encoder(int strategy);
 
 	virtual ~VideoX264Encoder();
 
+	// 需要在Init之前调用
+	void SetThreadCount(int thread_count);
+
+	// 需要在Init之前调用
+	void SetEncodeProfile(EncodeProfile profile);
+
+	// 需要在Init之前调用, NV12时x264使用X264_CSP_NV12, 不需要再转换
+	void SetPixelFormat(AVPixelFormat pixel_format);
+
+	// 需要在Init之前调用, 分段编码时每一段的数据先放入自己的队列, 再按顺序写入PacketPool
+	void SetPacketQueue(VideoPacketQueue *queue);
+
+	// 需要在Init之前调用, 只对导出的编码配置有效
+	void SetSpsId(int sps_id);
+
+	// 需要在Init之前调用, 设置之后sps和pps不再和第一帧一起输出, 只能通过GetExtraData获取
+	void SetGlobalHeader(bool global_header);
+
 	int Init(int width, int height, int videoBitRate, float frameRate, PacketPool *packetPool);
 
+	// Annex-B格式的sps和pps, 可能还有SEI
+	const uint8_t *GetExtraData(int *size);
+
+	// 编码一帧, 编码出来的数据会放入PacketPool, 一帧输入可能没有输出也可能有多个输出
 	int Encode(VideoPacket *videoPacket);
 
+	// 输入结束, 取出编码器中缓存的帧, 之后不能再调用Encode
+	int Flush();
+
 	void ReConfigure(int bitRate);
 
 	void PushToQueue(uint8_t *buffer, int size, int timeMills, int64_t pts, int64_t dts);
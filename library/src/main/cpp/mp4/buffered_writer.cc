@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include "buffered_writer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/falloc.h>
+#endif
+#include "android_xlog.h"
+
+extern "C" {
+#include "libavutil/mem.h"
+#include "libavutil/error.h"
+};
+
+namespace trinity {
+
+BufferedWriter::BufferedWriter()
+    : fd_(-1),
+      io_context_(nullptr),
+      current_block_(nullptr),
+      position_(0),
+      file_size_(0),
+      write_thread_(0),
+      write_thread_created_(false),
+      finished_(false),
+      error_(0),
+      write_count_(0) {
+    pthread_mutex_init(&mutex_, nullptr);
+    pthread_cond_init(&condition_, nullptr);
+}
+
+BufferedWriter::~BufferedWriter() {
+    Close();
+    pthread_mutex_destroy(&mutex_);
+    pthread_cond_destroy(&condition_);
+}
+
+int BufferedWriter::Open(const char* path, int64_t expected_size) {
+    fd_ = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        LOGE("open %s error: %s", path, strerror(errno));
+        return AVERROR(errno);
+    }
+#if defined(__linux__)
+    if (expected_size > 0) {
+        // 只分配空间, 不改变文件的大小, 文件系统不支持时忽略
+        if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, expected_size) != 0) {
+            LOGI("fallocate %lld error: %s", expected_size, strerror(errno));
+        }
+    }
+#endif
+    for (int i = 0; i < BUFFERED_WRITER_BLOCK_COUNT; i++) {
+        WriteBlock* block = new WriteBlock();
+        block->data = new uint8_t[BUFFERED_WRITER_BLOCK_SIZE];
+        block->size = 0;
+        block->offset = 0;
+        free_blocks_.push_back(block);
+    }
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(av_malloc(BUFFERED_WRITER_IO_BUFFER_SIZE));
+    io_context_ = avio_alloc_context(buffer, BUFFERED_WRITER_IO_BUFFER_SIZE, 1, this, nullptr, WritePacket, Seek);
+    if (nullptr == io_context_) {
+        av_free(buffer);
+        Close();
+        return AVERROR(ENOMEM);
+    }
+    io_context_->seekable = AVIO_SEEKABLE_NORMAL;
+    position_ = 0;
+    file_size_ = 0;
+    finished_ = false;
+    error_ = 0;
+    write_count_ = 0;
+    write_thread_created_ = pthread_create(&write_thread_, nullptr, WriteThread, this) == 0;
+    if (!write_thread_created_) {
+        Close();
+        return -1;
+    }
+    return 0;
+}
+
+AVIOContext* BufferedWriter::GetIOContext() {
+    return io_context_;
+}
+
+int BufferedWriter::Close() {
+    if (nullptr != io_context_) {
+        avio_flush(io_context_);
+    }
+    pthread_mutex_lock(&mutex_);
+    SubmitBlock();
+    finished_ = true;
+    pthread_cond_broadcast(&condition_);
+    pthread_mutex_unlock(&mutex_);
+    if (write_thread_created_) {
+        pthread_join(write_thread_, nullptr);
+        write_thread_created_ = false;
+    }
+    if (nullptr != io_context_) {
+        av_freep(&io_context_->buffer);
+        av_freep(&io_context_);
+    }
+    for (auto block : free_blocks_) {
+        delete[] block->data;
+        delete block;
+    }
+    free_blocks_.clear();
+    // 写入线程没有启动时可能还有没有写入的块
+    for (auto block : full_blocks_) {
+        delete[] block->data;
+        delete block;
+    }
+    full_blocks_.clear();
+    int ret = error_;
+    if (fd_ >= 0) {
+        if (close(fd_) != 0 && ret == 0) {
+            ret = AVERROR(errno);
+        }
+        fd_ = -1;
+    }
+    return ret;
+}
+
+int64_t BufferedWriter::GetWriteCount() {
+    return write_count_;
+}
+
+int BufferedWriter::WritePacket(void* opaque, uint8_t* buffer, int size) {
+    BufferedWriter* writer = reinterpret_cast<BufferedWriter*>(opaque);
+    return writer->Write(buffer, size);
+}
+
+int64_t BufferedWriter::Seek(void* opaque, int64_t offset, int whence) {
+    BufferedWriter* writer = reinterpret_cast<BufferedWriter*>(opaque);
+    return writer->Seek(offset, whence);
+}
+
+int BufferedWriter::Write(const uint8_t* buffer, int size) {
+    pthread_mutex_lock(&mutex_);
+    int remain = size;
+    while (remain > 0 && error_ == 0) {
+        if (nullptr == current_block_) {
+            // 所有的块都在等待写入时等待写入线程
+            while (free_blocks_.empty() && error_ == 0) {
+                pthread_cond_wait(&condition_, &mutex_);
+            }
+            if (error_ != 0) {
+                break;
+            }
+            current_block_ = free_blocks_.front();
+            free_blocks_.pop_front();
+            current_block_->size = 0;
+            current_block_->offset = position_;
+        }
+        int count = BUFFERED_WRITER_BLOCK_SIZE - current_block_->size;
+        if (count > remain) {
+            count = remain;
+        }
+        memcpy(current_block_->data + current_block_->size, buffer + size - remain, count);
+        current_block_->size += count;
+        remain -= count;
+        position_ += count;
+        if (position_ > file_size_) {
+            file_size_ = position_;
+        }
+        if (current_block_->size == BUFFERED_WRITER_BLOCK_SIZE) {
+            SubmitBlock();
+        }
+    }
+    int ret = error_ != 0 ? error_ : size;
+    pthread_mutex_unlock(&mutex_);
+    return ret;
+}
+
+int64_t BufferedWriter::Seek(int64_t offset, int whence) {
+    pthread_mutex_lock(&mutex_);
+    int64_t result = -1;
+    if (whence & AVSEEK_SIZE) {
+        result = file_size_;
+    } else {
+        int64_t position = -1;
+        switch (whence & ~AVSEEK_FORCE) {
+            case SEEK_SET:
+                position = offset;
+                break;
+            case SEEK_CUR:
+                position = position_ + offset;
+                break;
+            case SEEK_END:
+                position = file_size_ + offset;
+                break;
+            default:
+                break;
+        }
+        if (position >= 0) {
+            if (position != position_) {
+                // 之后写入的数据不再连续, 当前的块先提交
+                SubmitBlock();
+                position_ = position;
+            }
+            result = position_;
+        } else {
+            result = AVERROR(EINVAL);
+        }
+    }
+    pthread_mutex_unlock(&mutex_);
+    return result;
+}
+
+void BufferedWriter::SubmitBlock() {
+    if (nullptr == current_block_) {
+        return;
+    }
+    if (current_block_->size > 0) {
+        full_blocks_.push_back(current_block_);
+        pthread_cond_broadcast(&condition_);
+    } else {
+        free_blocks_.push_back(current_block_);
+    }
+    current_block_ = nullptr;
+}
+
+void* BufferedWriter::WriteThread(void* context) {
+    BufferedWriter* writer = reinterpret_cast<BufferedWriter*>(context);
+    writer->ProcessWrite();
+    pthread_exit(0);
+}
+
+void BufferedWriter::ProcessWrite() {
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+        while (full_blocks_.empty() && !finished_) {
+            pthread_cond_wait(&condition_, &mutex_);
+        }
+        if (full_blocks_.empty()) {
+            break;
+        }
+        WriteBlock* block = full_blocks_.front();
+        full_blocks_.pop_front();
+        pthread_mutex_unlock(&mutex_);
+        int ret = WriteBlockToFile(block);
+        pthread_mutex_lock(&mutex_);
+        if (ret < 0 && error_ == 0) {
+            error_ = ret;
+        }
+        free_blocks_.push_back(block);
+        pthread_cond_broadcast(&condition_);
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+int BufferedWriter::WriteBlockToFile(WriteBlock* block) {
+    int written = 0;
+    while (written < block->size) {
+        ssize_t ret = pwrite(fd_, block->data + written, block->size - written, block->offset + written);
+        write_count_++;
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("write error: %s", strerror(errno));
+            return AVERROR(errno);
+        }
+        written += ret;
+    }
+    return 0;
+}
+
+}  // namespace trinity
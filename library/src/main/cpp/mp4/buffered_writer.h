@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#ifndef TRINITY_BUFFERED_WRITER_H
+#define TRINITY_BUFFERED_WRITER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+
+extern "C" {
+#include "libavformat/avio.h"
+};
+
+/** 每次写入文件的块大小, 和块的数量, 一共缓存8M数据 **/
+#define BUFFERED_WRITER_BLOCK_SIZE          (1024 * 1024)
+#define BUFFERED_WRITER_BLOCK_COUNT         8
+/** AVIOContext自己的缓冲区大小 **/
+#define BUFFERED_WRITER_IO_BUFFER_SIZE      (64 * 1024)
+
+namespace trinity {
+
+typedef struct {
+    uint8_t* data;
+    int size;
+    /** 这一块在文件中的位置 **/
+    int64_t offset;
+} WriteBlock;
+
+// muxer的输出, 代替avio_open2打开的文件
+// 写入的数据先合并到1M的块中, 由写入线程用pwrite写入文件, muxer的线程不等待存储
+// 所有的块都在等待写入时muxer的线程才会等待
+// seek时当前的块提交写入, 写入线程按提交的顺序写入, 后写入的数据覆盖之前的数据
+// 写入线程和muxer之间没有读取, 需要读取输出文件的faststart不能使用
+class BufferedWriter {
+ public:
+    BufferedWriter();
+    ~BufferedWriter();
+
+    // expected_size大于0时预先分配文件空间, 减少写入时文件系统分配空间的次数
+    int Open(const char* path, int64_t expected_size);
+
+    AVIOContext* GetIOContext();
+
+    // 写入所有数据后关闭文件, 写入出错时返回负数
+    int Close();
+
+    // 调用write的次数
+    int64_t GetWriteCount();
+
+ private:
+    static int WritePacket(void* opaque, uint8_t* buffer, int size);
+
+    static int64_t Seek(void* opaque, int64_t offset, int whence);
+
+    int Write(const uint8_t* buffer, int size);
+
+    int64_t Seek(int64_t offset, int whence);
+
+    // 把当前的块交给写入线程
+    void SubmitBlock();
+
+    static void* WriteThread(void* context);
+
+    void ProcessWrite();
+
+    int WriteBlockToFile(WriteBlock* block);
+
+ private:
+    int fd_;
+    AVIOContext* io_context_;
+    std::deque<WriteBlock*> free_blocks_;
+    std::deque<WriteBlock*> full_blocks_;
+    WriteBlock* current_block_;
+    /** muxer当前的写入位置, 和写入过的最大位置 **/
+    int64_t position_;
+    int64_t file_size_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t condition_;
+    pthread_t write_thread_;
+    bool write_thread_created_;
+    bool finished_;
+    int error_;
+    // 写入线程修改, 其它线程通过GetWriteCount读取
+    std::atomic<int64_t> write_count_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_BUFFERED_WRITER_H
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include "copy_muxer.h"
+#include "android_xlog.h"
+
+namespace trinity {
+
+CopyMuxer::CopyMuxer()
+    : last_video_dts_(AV_NOPTS_VALUE),
+      last_audio_dts_(AV_NOPTS_VALUE) {
+}
+
+CopyMuxer::~CopyMuxer() {}
+
+int CopyMuxer::Init(const char *path, AVCodecParameters *video_parameters, AVCodecParameters *audio_parameters) {
+    last_video_dts_ = AV_NOPTS_VALUE;
+    last_audio_dts_ = AV_NOPTS_VALUE;
+    int ret = avformat_alloc_output_context2(&format_context_, nullptr, "mp4", path);
+    if (ret < 0 || nullptr == format_context_) {
+        LOGE("alloc output context error: %d", ret);
+        return ret < 0 ? ret : -1;
+    }
+    video_stream_ = CopyStream(video_parameters);
+    if (nullptr == video_stream_) {
+        return -1;
+    }
+    video_width_ = video_parameters->width;
+    video_height_ = video_parameters->height;
+    video_bit_rate_ = static_cast<int>(video_parameters->bit_rate);
+    if (nullptr != audio_parameters) {
+        audio_stream_ = CopyStream(audio_parameters);
+        if (nullptr == audio_stream_) {
+            return -1;
+        }
+        audio_sample_rate_ = audio_parameters->sample_rate;
+        audio_channels_ = audio_parameters->channels;
+        audio_bit_rate_ = static_cast<int>(audio_parameters->bit_rate);
+    }
+    ret = OpenOutput(path);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = WriteHeader(format_context_);
+    return ret < 0 ? ret : 0;
+}
+
+AVStream* CopyMuxer::CopyStream(AVCodecParameters *parameters) {
+    AVStream* stream = avformat_new_stream(format_context_, nullptr);
+    if (nullptr == stream) {
+        LOGE("alloc stream error");
+        return nullptr;
+    }
+    int ret = avcodec_parameters_copy(stream->codecpar, parameters);
+    if (ret < 0) {
+        LOGE("copy codec parameters error: %s", av_err2str(ret));
+        return nullptr;
+    }
+    // 源文件的tag不一定适用于mp4, 由muxer重新选择
+    stream->codecpar->codec_tag = 0;
+    if (parameters->codec_type == AVMEDIA_TYPE_AUDIO) {
+        stream->time_base = (AVRational) { 1, parameters->sample_rate };
+    } else {
+        // 不同clip的time_base可能不一样, 统一使用90000, 避免拼接后精度不够
+        stream->time_base = (AVRational) { 1, 90000 };
+    }
+    return stream;
+}
+
+int CopyMuxer::WritePacket(AVPacket *packet, AVRational time_base, bool video) {
+    AVStream* stream = video ? video_stream_ : audio_stream_;
+    if (nullptr == stream || !write_header_success_) {
+        return -1;
+    }
+    av_packet_rescale_ts(packet, time_base, stream->time_base);
+    if (packet->dts == AV_NOPTS_VALUE) {
+        packet->dts = packet->pts;
+    }
+    int64_t* last_dts = video ? &last_video_dts_ : &last_audio_dts_;
+    if (*last_dts != AV_NOPTS_VALUE && packet->dts <= *last_dts) {
+        packet->dts = *last_dts + 1;
+    }
+    if (packet->pts != AV_NOPTS_VALUE && packet->pts < packet->dts) {
+        packet->pts = packet->dts;
+    }
+    *last_dts = packet->dts;
+    packet->stream_index = stream->index;
+    packet->pos = -1;
+    if (!video) {
+        last_audio_packet_pts_ = av_rescale_q(packet->dts, stream->time_base, (AVRational) { 1, audio_sample_rate_ });
+    }
+    int ret = av_interleaved_write_frame(format_context_, packet);
+    if (ret != 0) {
+        LOGE("write %s packet error: %s", video ? "video" : "audio", av_err2str(ret));
+    } else if (video) {
+        video_sample_count_++;
+    } else {
+        audio_sample_count_++;
+    }
+    return ret;
+}
+
+int CopyMuxer::WriteVideoFrame(AVFormatContext *oc, AVStream *st, VideoPacket* packet) {
+    // 复制的数据由WritePacket写入, 不从队列中获取
+    delete packet;
+    return -1;
+}
+
+double CopyMuxer::GetVideoStreamTimeInSecs() {
+    if (nullptr == video_stream_ || last_video_dts_ == AV_NOPTS_VALUE) {
+        return 0;
+    }
+    return last_video_dts_ * av_q2d(video_stream_->time_base);
+}
+
+}  // namespace trinity
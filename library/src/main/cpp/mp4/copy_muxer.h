@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#ifndef TRINITY_COPY_MUXER_H
+#define TRINITY_COPY_MUXER_H
+
+#include "mp4_muxer.h"
+
+namespace trinity {
+
+// 直接复制压缩数据的muxer, 不经过编码器
+// 流的参数从源文件复制, 所有写入的包必须使用相同的编码参数
+class CopyMuxer : public Mp4Muxer {
+ public:
+    CopyMuxer();
+    virtual ~CopyMuxer();
+
+    // audio_parameters可以为nullptr, 初始化成功后已经写入了文件头
+    int Init(const char* path, AVCodecParameters* video_parameters, AVCodecParameters* audio_parameters);
+    // time_base是packet时间戳的单位, 写入时转换成输出流的time_base
+    // dts小于等于上一个包时会被调整, 保证单调递增
+    int WritePacket(AVPacket* packet, AVRational time_base, bool video);
+
+ protected:
+    virtual int WriteVideoFrame(AVFormatContext* oc, AVStream* st, VideoPacket* packet);
+    virtual double GetVideoStreamTimeInSecs();
+
+ private:
+    AVStream* CopyStream(AVCodecParameters* parameters);
+
+ private:
+    /** 输出流time_base的最后一个dts **/
+    int64_t last_video_dts_;
+    int64_t last_audio_dts_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_COPY_MUXER_H
@@ -21,10 +21,9 @@
 //
 
 #include "h264_muxer.h"
+#include "h264_util.h"
 #include "android_xlog.h"
 
-#define is_start_code(code)	(((code) & 0x0ffffff) == 0x01)
-
 namespace trinity {
 
 H264Muxer::H264Muxer() {
@@ -44,16 +43,10 @@ int H264Muxer::Stop() {
     return ret;
 }
 
-int H264Muxer::WriteVideoFrame(AVFormatContext *oc, AVStream *st) {
+int H264Muxer::WriteVideoFrame(AVFormatContext *oc, AVStream *st, VideoPacket* h264Packet) {
     int ret = 0;
     AVCodecContext *c = st->codec;
 
-    VideoPacket *h264Packet = nullptr;
-    video_packet_callback_(&h264Packet, video_packet_context_);
-    if (h264Packet == nullptr) {
-        LOGE("fill_h264_packet_callback_ Get null packet_");
-        return VIDEO_QUEUE_ABORT_ERR_CODE;
-    }
     int bufferSize = (h264Packet)->size;
     uint8_t* outputData = h264Packet->buffer;
     last_presentation_time_ms_ = h264Packet->timeMills;
@@ -61,93 +54,107 @@ int H264Muxer::WriteVideoFrame(AVFormatContext *oc, AVStream *st) {
     av_init_packet(&pkt);
     pkt.stream_index = st->index;
     int64_t cal_pts = last_presentation_time_ms_ / 1000.0f / av_q2d(video_stream_->time_base);
-    int64_t pts = h264Packet->pts == PTS_PARAM_UN_SETTIED_FLAG ? cal_pts : h264Packet->pts;
-    int64_t dts = h264Packet->dts == DTS_PARAM_UN_SETTIED_FLAG ? pts : h264Packet->dts == DTS_PARAM_NOT_A_NUM_FLAG ? AV_NOPTS_VALUE : h264Packet->dts;
+    // 编码器设置的pts和dts单位是毫秒, 有B帧时两者不同
+    AVRational mills_time_base = { 1, 1000 };
+    int64_t pts = h264Packet->pts == PTS_PARAM_UN_SETTIED_FLAG ? cal_pts
+            : av_rescale_q(h264Packet->pts, mills_time_base, video_stream_->time_base);
+    int64_t dts = h264Packet->dts == DTS_PARAM_UN_SETTIED_FLAG ? pts : h264Packet->dts == DTS_PARAM_NOT_A_NUM_FLAG ? AV_NOPTS_VALUE
+            : av_rescale_q(h264Packet->dts, mills_time_base, video_stream_->time_base);
+    if (h264Packet->dts != DTS_PARAM_UN_SETTIED_FLAG && h264Packet->dts != DTS_PARAM_NOT_A_NUM_FLAG) {
+        // 按解码顺序写入, 和音频交错时使用单调递增的dts
+        last_presentation_time_ms_ = static_cast<int>(h264Packet->dts);
+    }
     int nalu_type = (outputData[4] & 0x1F);
     if (nalu_type == H264_NALU_TYPE_SEQUENCE_PARAMETER_SET) {
         // 我们这里要求sps和pps一块拼接起来构造成AVPacket传过来
-        header_size_ = bufferSize;
-        header_data_ = new uint8_t[header_size_];
-        memcpy(header_data_, outputData, bufferSize);
-
-        uint8_t* spsFrame = 0;
-        uint8_t* ppsFrame = 0;
-
-        int spsFrameLen = 0;
-        int ppsFrameLen = 0;
-
-        ParseH264SequenceHeader(header_data_, header_size_, &spsFrame, spsFrameLen,
-                                &ppsFrame, ppsFrameLen);
+        // 只在这里解析一次, 生成AVCC格式的extradata
+        // 智能导出时直接复制的源文件和x264的参数集id不同, 全部写入extradata
+        H264Nal nals[H264_MAX_NAL_COUNT];
+        int count = H264ParseNals(outputData, bufferSize, nals, H264_MAX_NAL_COUNT);
+        const H264Nal* sps = nullptr;
+        int sps_count = 0;
+        int pps_count = 0;
+        int extradata_len = 7;
+        for (int i = 0; i < count; i++) {
+            if (nals[i].type == H264_NALU_TYPE_SEQUENCE_PARAMETER_SET) {
+                if (nullptr == sps) {
+                    sps = nals + i;
+                }
+                sps_count++;
+                extradata_len += 2 + nals[i].size;
+            } else if (nals[i].type == H264_NALU_TYPE_PICTURE_PARAMETER_SET) {
+                pps_count++;
+                extradata_len += 2 + nals[i].size;
+            }
+        }
+        if (nullptr == sps || pps_count == 0 || sps->size < 4 || sps_count > 31 || pps_count > 255) {
+            LOGE("parse sps pps error count: %d size: %d", count, bufferSize);
+            delete h264Packet;
+            return -1;
+        }
+        uint8_t* spsFrame = outputData + sps->offset;
 
         // Extradata contains PPS & SPS for AVCC format
-        int extradata_len = 8 + spsFrameLen - 4 + 1 + 2 + ppsFrameLen - 4;
-        c->extradata = reinterpret_cast<uint8_t*>(av_mallocz(extradata_len));
+        c->extradata = reinterpret_cast<uint8_t*>(av_mallocz(extradata_len + AV_INPUT_BUFFER_PADDING_SIZE));
         c->extradata_size = extradata_len;
         c->extradata[0] = 0x01;
-        c->extradata[1] = spsFrame[4 + 1];
-        c->extradata[2] = spsFrame[4 + 2];
-        c->extradata[3] = spsFrame[4 + 3];
+        c->extradata[1] = spsFrame[1];
+        c->extradata[2] = spsFrame[2];
+        c->extradata[3] = spsFrame[3];
         c->extradata[4] = 0xFC | 3;
-        c->extradata[5] = 0xE0 | 1;
-        int tmp = spsFrameLen - 4;
-        c->extradata[6] = (tmp >> 8) & 0x00ff;
-        c->extradata[7] = tmp & 0x00ff;
-        int i = 0;
-        for (i = 0; i < tmp; i++)
-            c->extradata[8 + i] = spsFrame[4 + i];
-        c->extradata[8 + tmp] = 0x01;
-        int tmp2 = ppsFrameLen - 4;
-        c->extradata[8 + tmp + 1] = (tmp2 >> 8) & 0x00ff;
-        c->extradata[8 + tmp + 2] = tmp2 & 0x00ff;
-        for (i = 0; i < tmp2; i++)
-            c->extradata[8 + tmp + 3 + i] = ppsFrame[4 + i];
-
-        ret = avformat_write_header(oc, nullptr);
-        if (ret < 0) {
-            LOGE("Error occurred when opening output file: %s\n", av_err2str(ret));
-        } else {
-            write_header_success_ = true;
-        }
-    } else {
-        if (nalu_type == H264_NALU_TYPE_IDR_PICTURE || nalu_type == H264_NALU_TYPE_SEI) {
-            pkt.size = bufferSize;
-            pkt.data = outputData;
-
-            if (pkt.data[0] == 0x00 && pkt.data[1] == 0x00 &&
-               pkt.data[2] == 0x00 && pkt.data[3] == 0x01) {
-                bufferSize -= 4;
-                pkt.data[0] = ((bufferSize) >> 24) & 0x00ff;
-                pkt.data[1] = ((bufferSize) >> 16) & 0x00ff;
-                pkt.data[2] = ((bufferSize) >> 8) & 0x00ff;
-                pkt.data[3] = ((bufferSize)) & 0x00ff;
+        c->extradata[5] = 0xE0 | sps_count;
+        int position = 6;
+        for (int type = H264_NALU_TYPE_SEQUENCE_PARAMETER_SET; type <= H264_NALU_TYPE_PICTURE_PARAMETER_SET; type++) {
+            if (type == H264_NALU_TYPE_PICTURE_PARAMETER_SET) {
+                c->extradata[position++] = static_cast<uint8_t>(pps_count);
             }
-
-            pkt.pts = pts;
-            pkt.dts = dts;
-            pkt.flags = AV_PKT_FLAG_KEY;
-            c->frame_number++;
-        } else {
-            pkt.size = bufferSize;
-            pkt.data = outputData;
-
-            if (pkt.data[0] == 0x00 && pkt.data[1] == 0x00 &&
-               pkt.data[2] == 0x00 && pkt.data[3] == 0x01) {
-                bufferSize -= 4;
-                pkt.data[0] = ((bufferSize) >> 24) & 0x00ff;
-                pkt.data[1] = ((bufferSize) >> 16) & 0x00ff;
-                pkt.data[2] = ((bufferSize) >> 8) & 0x00ff;
-                pkt.data[3] = ((bufferSize)) & 0x00ff;
+            for (int i = 0; i < count; i++) {
+                if (nals[i].type != type) {
+                    continue;
+                }
+                c->extradata[position] = (nals[i].size >> 8) & 0x00ff;
+                c->extradata[position + 1] = nals[i].size & 0x00ff;
+                memcpy(c->extradata + position + 2, outputData + nals[i].offset, nals[i].size);
+                position += 2 + nals[i].size;
             }
+        }
 
-            pkt.pts = pts;
-            pkt.dts = dts;
-            pkt.flags = 0;
-            c->frame_number++;
+        ret = WriteHeader(oc);
+    } else {
+        pkt.size = bufferSize;
+        pkt.data = outputData;
+        // 编码器输出的已经是AVCC格式, 只有还是Annex-B时才转换
+        // 4字节的起始码原地改写成长度, 有3字节的起始码时才需要新的buffer
+        if (bufferSize > 4 && outputData[0] == 0x00 && outputData[1] == 0x00 &&
+            outputData[2] == 0x00 && outputData[3] == 0x01) {
+            H264Nal nals[H264_MAX_NAL_COUNT];
+            int count = H264ParseNals(outputData, bufferSize, nals, H264_MAX_NAL_COUNT);
+            if (count > 0) {
+                int size = H264WriteAvcc(outputData, nals, count, outputData, false);
+                if (size < 0) {
+                    size = H264AvccSize(nals, count, false);
+                    uint8_t* buffer = new uint8_t[size];
+                    H264WriteAvcc(outputData, nals, count, buffer, false);
+                    delete[] h264Packet->buffer;
+                    h264Packet->buffer = buffer;
+                    h264Packet->size = size;
+                }
+                pkt.data = h264Packet->buffer;
+                pkt.size = size;
+            }
         }
+        pkt.pts = pts;
+        pkt.dts = dts;
+        // 访问单元中可能先有SEI或AUD, 只有包含IDR时才是关键帧
+        bool key = h264Packet->key || H264AvccHasIdr(pkt.data, pkt.size);
+        pkt.flags = key ? AV_PKT_FLAG_KEY : 0;
+        c->frame_number++;
         if (pkt.size) {
             ret = av_interleaved_write_frame(oc, &pkt);
             if (ret != 0) {
                 LOGE("write frame error: %d", ret);
+            } else {
+                video_sample_count_++;
             }
         } else {
             ret = 0;
@@ -162,65 +169,4 @@ double H264Muxer::GetVideoStreamTimeInSecs() {
     return last_presentation_time_ms_ / 1000.0f;
 }
 
-uint32_t H264Muxer::FindStartCode(uint8_t *in_buffer, uint32_t in_ui32_buffer_size, uint32_t in_ui32_code,
-                                  uint32_t &out_ui32_processed_bytes) {
-    uint32_t ui32Code = in_ui32_code;
-
-    const uint8_t * ptr = in_buffer;
-    while (ptr < in_buffer + in_ui32_buffer_size) {
-        ui32Code = *ptr++ + (ui32Code << 8);
-        if (is_start_code(ui32Code))
-            break;
-    }
-
-    out_ui32_processed_bytes = (uint32_t)(ptr - in_buffer);
-
-    return ui32Code;
-}
-
-void
-H264Muxer::ParseH264SequenceHeader(uint8_t *in_buffer, uint32_t in_ui32_size, uint8_t **in_sps_buffer, int &in_sps_size,
-                                   uint8_t **in_pps_buffer, int &in_pps_size) {
-    uint32_t ui32StartCode = 0x0ff;
-
-    uint8_t* pBuffer = in_buffer;
-    uint32_t ui32BufferSize = in_ui32_size;
-
-    uint32_t sps = 0;
-    uint32_t pps = 0;
-
-    uint32_t idr = in_ui32_size;
-
-    do {
-        uint32_t ui32ProcessedBytes = 0;
-        ui32StartCode = FindStartCode(pBuffer, ui32BufferSize, ui32StartCode,
-                                      ui32ProcessedBytes);
-        pBuffer += ui32ProcessedBytes;
-        ui32BufferSize -= ui32ProcessedBytes;
-
-        if (ui32BufferSize < 1)
-            break;
-
-        uint8_t val = (*pBuffer & 0x1f);
-
-        if (val == 5) {
-            idr = pps + ui32ProcessedBytes - 4;
-        }
-
-        if (val == 7) {
-            sps = ui32ProcessedBytes;
-        }
-
-        if (val == 8) {
-            pps = sps + ui32ProcessedBytes;
-        }
-    } while (ui32BufferSize > 0);
-
-    *in_sps_buffer = in_buffer + sps - 4;
-    in_sps_size = pps - sps;
-
-    *in_pps_buffer = in_buffer + pps - 4;
-    in_pps_size = idr - pps + 4;
-}
-
 }  // namespace trinity
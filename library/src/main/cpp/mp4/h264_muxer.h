@@ -35,14 +35,8 @@ class H264Muxer : public Mp4Muxer {
 
  protected:
     int last_presentation_time_ms_;
-    virtual int WriteVideoFrame(AVFormatContext* oc, AVStream* st);
+    virtual int WriteVideoFrame(AVFormatContext* oc, AVStream* st, VideoPacket* packet);
     virtual double GetVideoStreamTimeInSecs();
-    // TODO cpplint检查有问题
-    uint32_t FindStartCode(uint8_t* in_buffer, uint32_t in_ui32_buffer_size,
-            uint32_t in_ui32_code, uint32_t &out_ui32_processed_bytes);
-    void ParseH264SequenceHeader(uint8_t* in_buffer, uint32_t in_ui32_size,
-            uint8_t** in_sps_buffer, int& in_sps_size,
-            uint8_t** in_pps_buffer, int& in_pps_size);
 };
 
 }  // namespace trinity
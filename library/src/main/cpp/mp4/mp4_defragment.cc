@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include "mp4_defragment.h"
+#include <stdio.h>
+#include "android_xlog.h"
+
+namespace trinity {
+
+Mp4Defragment::Mp4Defragment()
+    : input_context_(nullptr),
+      muxer_(nullptr) {
+}
+
+Mp4Defragment::~Mp4Defragment() {
+    Close();
+}
+
+int Mp4Defragment::Process(const char* input, const char* output) {
+    int ret = avformat_open_input(&input_context_, input, nullptr, nullptr);
+    if (ret < 0) {
+        LOGE("open %s error: %s", input, av_err2str(ret));
+        return ret;
+    }
+    ret = avformat_find_stream_info(input_context_, nullptr);
+    if (ret < 0) {
+        LOGE("find stream info error: %s", av_err2str(ret));
+        Close();
+        return ret;
+    }
+    int video_index = av_find_best_stream(input_context_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    int audio_index = av_find_best_stream(input_context_, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (video_index < 0) {
+        LOGE("%s has no video stream", input);
+        Close();
+        return video_index;
+    }
+    muxer_ = new CopyMuxer();
+    muxer_->SetFaststart(true);
+    ret = muxer_->Init(output, input_context_->streams[video_index]->codecpar,
+            audio_index >= 0 ? input_context_->streams[audio_index]->codecpar : nullptr);
+    if (ret < 0) {
+        Close();
+        return ret;
+    }
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = nullptr;
+    packet.size = 0;
+    int write_ret = 0;
+    while ((ret = av_read_frame(input_context_, &packet)) >= 0) {
+        if (packet.stream_index == video_index || packet.stream_index == audio_index) {
+            AVStream* stream = input_context_->streams[packet.stream_index];
+            write_ret = muxer_->WritePacket(&packet, stream->time_base, packet.stream_index == video_index);
+        }
+        av_packet_unref(&packet);
+        if (write_ret < 0) {
+            break;
+        }
+    }
+    // 异常退出的分段mp4最后一个分段可能不完整, 读取到的数据全部保留
+    if (ret < 0 && ret != AVERROR_EOF) {
+        LOGE("read %s error: %s", input, av_err2str(ret));
+    }
+    int close_ret = Close();
+    if (write_ret >= 0) {
+        write_ret = close_ret;
+    }
+    if (write_ret < 0) {
+        LOGE("defragment %s error: %s", input, av_err2str(write_ret));
+        remove(output);
+        return write_ret;
+    }
+    LOGI("defragment %s to %s", input, output);
+    return 0;
+}
+
+int Mp4Defragment::Close() {
+    int ret = 0;
+    if (nullptr != muxer_) {
+        // Stop时写入moov, 并移到mdat之前
+        ret = muxer_->Stop();
+        delete muxer_;
+        muxer_ = nullptr;
+    }
+    if (nullptr != input_context_) {
+        avformat_close_input(&input_context_);
+    }
+    return ret;
+}
+
+}  // namespace trinity
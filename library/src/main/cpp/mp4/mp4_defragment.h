@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#ifndef TRINITY_MP4_DEFRAGMENT_H
+#define TRINITY_MP4_DEFRAGMENT_H
+
+#include "copy_muxer.h"
+
+namespace trinity {
+
+// 把分段mp4转换成普通的mp4, moov写在mdat之前
+// 不解码, 直接复制视频和音频的压缩数据
+class Mp4Defragment {
+ public:
+    Mp4Defragment();
+    ~Mp4Defragment();
+
+    // input和output不能是同一个文件, 成功返回0, 写入失败时返回错误码并删除output
+    int Process(const char* input, const char* output);
+
+ private:
+    int Close();
+
+ private:
+    AVFormatContext* input_context_;
+    CopyMuxer* muxer_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_MP4_DEFRAGMENT_H
@@ -21,6 +21,10 @@
 //
 
 #include "mp4_muxer.h"
+#include <limits.h>
+#include <stdio.h>
+#include <string>
+#include "mp4_defragment.h"
 #include "android_xlog.h"
 #include "tools.h"
 
@@ -32,9 +36,8 @@ Mp4Muxer::Mp4Muxer()
       format_context_(nullptr),
       video_stream_(nullptr),
       audio_stream_(nullptr),
-      bit_stream_filter_context_(nullptr),
       duration_(0),
-      last_audio_packet_presentation_time_mills_(0),
+      last_audio_packet_pts_(0),
       video_width_(0),
       video_height_(0),
       video_frame_rate_(0),
@@ -46,7 +49,16 @@ Mp4Muxer::Mp4Muxer()
       audio_packet_context_(nullptr),
       video_packet_callback_(nullptr),
       video_packet_context_(nullptr),
-      write_header_success_(false) {
+      write_header_success_(false),
+      fragment_duration_(0),
+      faststart_(false),
+      expected_duration_(0),
+      moov_reserve_size_(0),
+      video_sample_count_(0),
+      audio_sample_count_(0),
+      video_ended_(false),
+      audio_ended_(false),
+      writer_(nullptr) {
 }
 
 Mp4Muxer::~Mp4Muxer() {}
@@ -64,6 +76,8 @@ int Mp4Muxer::Init(const char *path, int video_width, int video_height, int fram
     audio_sample_rate_ = audio_sample_rate;
     audio_channels_ = audio_channels;
     audio_bit_rate_ = audio_bit_rate;
+    video_ended_ = false;
+    audio_ended_ = false;
     int ret = avformat_alloc_output_context2(&format_context_, nullptr, "mp4", path);
     if (ret != 0) {
         LOGE("alloc output context error: %d", ret);
@@ -84,12 +98,9 @@ int Mp4Muxer::Init(const char *path, int video_width, int video_height, int fram
             return ret;
         }
     }
-    if (!(format_context_->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open2(&format_context_->pb, path, AVIO_FLAG_WRITE, nullptr, nullptr);
-        if (ret != 0) {
-            LOGE("avio open error: %d message: %s", ret, av_err2str(ret));
-            return ret;
-        }
+    ret = OpenOutput(path);
+    if (ret != 0) {
+        return ret;
     }
     AVCodec* codec = av_codec_next(nullptr);
     while (codec != nullptr) {
@@ -109,33 +120,152 @@ int Mp4Muxer::Init(const char *path, int video_width, int video_height, int fram
     return 0;
 }
 
-void Mp4Muxer::RegisterAudioPacketCallback(int (*audio_packet)(AudioPacket **, void *context), void *context) {
+void Mp4Muxer::RegisterAudioPacketCallback(int (*audio_packet)(AudioPacket **, bool block, void *context),
+        void *context) {
     audio_packet_callback_ = audio_packet;
     audio_packet_context_ = context;
 }
 
-void Mp4Muxer::RegisterVideoPacketCallback(int (*video_packet)(VideoPacket **, void *context), void *context) {
+void Mp4Muxer::RegisterVideoPacketCallback(int (*video_packet)(VideoPacket **, bool block, void *context),
+        void *context) {
     video_packet_callback_ = video_packet;
     video_packet_context_ = context;
 }
 
 int Mp4Muxer::Encode() {
-    double video_time = GetVideoStreamTimeInSecs();
-    double audio_time = GetAudioStreamTimeInSecs();
-    int ret = 0;
-    /* write interleaved audio and video frames */
-    if (!video_stream_ || (video_stream_ && audio_stream_ && audio_time < video_time)) {
-        ret = WriteAudioFrame(format_context_, audio_stream_);
-    } else if (video_stream_) {
-        ret = WriteVideoFrame(format_context_, video_stream_);
+    ReadVideoPackets(false);
+    ReadAudioPackets(false);
+    while (true) {
+        bool has_video = !video_packets_.empty();
+        bool has_audio = !audio_packets_.empty();
+        bool write_video = false;
+        bool write_audio = false;
+        if (!write_header_success_ && nullptr != video_stream_) {
+            // 文件头在收到sps和pps时写入, 之前只能写视频
+            if (has_video) {
+                write_video = true;
+            } else if (video_ended_) {
+                return VIDEO_QUEUE_ABORT_ERR_CODE;
+            } else {
+                ReadVideoPackets(true);
+                continue;
+            }
+        } else if (has_video && has_audio) {
+            write_video = GetVideoPacketTime(video_packets_.front()) <= GetAudioPacketTime(audio_packets_.front());
+            write_audio = !write_video;
+        } else if (has_video && audio_ended_) {
+            write_video = true;
+        } else if (has_audio && video_ended_) {
+            write_audio = true;
+        } else if (video_ended_ && audio_ended_) {
+            return VIDEO_QUEUE_ABORT_ERR_CODE;
+        } else if (!has_video && !video_ended_) {
+            // 只等待决定写入顺序的那一路, 另一路的数据已经在缓存中
+            ReadVideoPackets(true);
+            continue;
+        } else {
+            ReadAudioPackets(true);
+            continue;
+        }
+        int ret = 0;
+        if (write_video) {
+            VideoPacket* packet = video_packets_.front();
+            video_packets_.pop_front();
+            ret = WriteVideoFrame(format_context_, video_stream_, packet);
+        } else if (write_audio) {
+            AudioPacket* packet = audio_packets_.front();
+            audio_packets_.pop_front();
+            ret = WriteAudioFrame(format_context_, audio_stream_, packet);
+        }
+        duration_ = MIN(GetAudioStreamTimeInSecs(), GetVideoStreamTimeInSecs());
+        return ret;
     }
-    duration_ = MIN(audio_time, video_time);
-    return ret;
+}
+
+void Mp4Muxer::ReadVideoPackets(bool block) {
+    if (video_ended_ || nullptr == video_stream_ || nullptr == video_packet_callback_) {
+        video_ended_ = true;
+        return;
+    }
+    while (video_packets_.size() < MP4_INTERLEAVE_MAX_PACKETS) {
+        VideoPacket* packet = nullptr;
+        int ret = video_packet_callback_(&packet, block, video_packet_context_);
+        if (ret < 0) {
+            video_ended_ = true;
+            break;
+        }
+        if (ret == 0 || nullptr == packet) {
+            break;
+        }
+        video_packets_.push_back(packet);
+        // 阻塞时只等待第一个packet, 之后的不再阻塞
+        block = false;
+    }
+}
+
+void Mp4Muxer::ReadAudioPackets(bool block) {
+    if (audio_ended_ || nullptr == audio_stream_ || nullptr == audio_packet_callback_) {
+        audio_ended_ = true;
+        return;
+    }
+    while (audio_packets_.size() < MP4_INTERLEAVE_MAX_PACKETS) {
+        AudioPacket* packet = nullptr;
+        int ret = audio_packet_callback_(&packet, block, audio_packet_context_);
+        if (ret < 0) {
+            audio_ended_ = true;
+            break;
+        }
+        if (ret == 0 || nullptr == packet) {
+            break;
+        }
+        audio_packets_.push_back(packet);
+        block = false;
+    }
+}
+
+int64_t Mp4Muxer::GetVideoPacketTime(VideoPacket* packet) {
+    if (packet->dts != DTS_PARAM_UN_SETTIED_FLAG && packet->dts != DTS_PARAM_NOT_A_NUM_FLAG) {
+        return packet->dts;
+    }
+    return packet->pts != PTS_PARAM_UN_SETTIED_FLAG ? packet->pts : packet->timeMills;
+}
+
+int64_t Mp4Muxer::GetAudioPacketTime(AudioPacket* packet) {
+    // 没有时间戳时接在上一个音频包后面
+    int64_t pts = packet->pts >= 0 ? packet->pts : last_audio_packet_pts_;
+    return audio_sample_rate_ > 0 ? pts * 1000 / audio_sample_rate_ : 0;
+}
+
+void Mp4Muxer::ClearPackets() {
+    for (auto packet : video_packets_) {
+        delete packet;
+    }
+    video_packets_.clear();
+    for (auto packet : audio_packets_) {
+        delete packet;
+    }
+    audio_packets_.clear();
 }
 
 int Mp4Muxer::Stop() {
+    std::string rewrite_path;
+    if (write_header_success_ && moov_reserve_size_ > 0) {
+        int64_t moov_size = GetMoovSize(video_sample_count_, audio_sample_count_);
+        // 预留的空间写入moov之后还需要放下一个free box
+        if (moov_size + 8 > moov_reserve_size_) {
+            LOGE("reserved moov size: %lld is too small, need: %lld, rewrite the file",
+                    moov_reserve_size_, moov_size);
+            av_opt_set_int(format_context_->priv_data, "moov_size", 0, 0);
+            rewrite_path = format_context_->filename;
+        }
+    }
+    ClearPackets();
+    int ret = 0;
     if (write_header_success_) {
-        av_write_trailer(format_context_);
+        ret = av_write_trailer(format_context_);
+        if (ret < 0) {
+            LOGE("write trailer error: %s", av_err2str(ret));
+        }
     }
     if (nullptr != video_stream_) {
         CloseVideo(format_context_, video_stream_);
@@ -146,16 +276,153 @@ int Mp4Muxer::Stop() {
         audio_stream_ = nullptr;
     }
     if (nullptr != format_context_) {
-        if (!(format_context_->oformat->flags & AVFMT_NOFILE)) {
-            avio_close(format_context_->pb);
-        }
-
+        CloseOutput();
         avformat_free_context(format_context_);
         format_context_ = nullptr;
     }
+    write_header_success_ = false;
+    if (!rewrite_path.empty()) {
+        RewriteFaststart(rewrite_path.c_str());
+    }
+    moov_reserve_size_ = 0;
+    return ret;
+}
+
+void Mp4Muxer::SetFragmentDuration(int duration) {
+    fragment_duration_ = duration;
+}
+
+void Mp4Muxer::SetFaststart(bool faststart) {
+    faststart_ = faststart;
+}
+
+void Mp4Muxer::SetExpectedDuration(int64_t duration) {
+    expected_duration_ = duration;
+}
+
+int64_t Mp4Muxer::GetMoovSize(int64_t video_samples, int64_t audio_samples) {
+    int64_t size = MP4_MOOV_FIXED_SIZE;
+    for (unsigned int i = 0; i < format_context_->nb_streams; i++) {
+        size += format_context_->streams[i]->codecpar->extradata_size;
+    }
+    return size + video_samples * MP4_MOOV_VIDEO_SAMPLE_SIZE + audio_samples * MP4_MOOV_AUDIO_SAMPLE_SIZE;
+}
+
+int Mp4Muxer::RewriteFaststart(const char* path) {
+    FILE* file = fopen(path, "r+b");
+    if (nullptr == file) {
+        LOGE("open %s error", path);
+        return -1;
+    }
+    // 预留的空间紧跟在ftyp后面, 还没有写入任何box
+    uint8_t header[8];
+    int ret = -1;
+    if (fread(header, 1, 8, file) == 8 && memcmp(header + 4, "ftyp", 4) == 0) {
+        uint32_t ftyp_size = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        uint32_t free_size = static_cast<uint32_t>(moov_reserve_size_);
+        uint8_t free_box[8] = {
+            static_cast<uint8_t>(free_size >> 24), static_cast<uint8_t>(free_size >> 16),
+            static_cast<uint8_t>(free_size >> 8), static_cast<uint8_t>(free_size),
+            'f', 'r', 'e', 'e'
+        };
+        if (fseek(file, ftyp_size, SEEK_SET) == 0 && fwrite(free_box, 1, 8, file) == 8) {
+            ret = 0;
+        }
+    }
+    fclose(file);
+    if (ret < 0) {
+        LOGE("write free box to %s error", path);
+        return ret;
+    }
+    std::string temp_path = std::string(path) + ".faststart";
+    Mp4Defragment rewrite;
+    ret = rewrite.Process(path, temp_path.c_str());
+    if (ret < 0 || rename(temp_path.c_str(), path) != 0) {
+        // 重写失败时保留moov在最后的文件, 仍然可以播放
+        LOGE("rewrite %s error: %d", path, ret);
+        remove(temp_path.c_str());
+        return -1;
+    }
     return 0;
 }
 
+int Mp4Muxer::OpenOutput(const char* path) {
+    if (format_context_->oformat->flags & AVFMT_NOFILE) {
+        return 0;
+    }
+    int ret = 0;
+    // 分片输出时每个moof+mdat写完后movenc会在flush point调用avio_flush, 直接写文件
+    // 这样进程被杀时已经完成的分片都在文件中, BufferedWriter会把最多8M的数据留在内存里
+    if (fragment_duration_ > 0 || (faststart_ && expected_duration_ <= 0)) {
+        ret = avio_open2(&format_context_->pb, path, AVIO_FLAG_WRITE, nullptr, nullptr);
+    } else {
+        // 按码率估计文件大小, 预先分配空间
+        int64_t expected_size = expected_duration_ * (video_bit_rate_ + audio_bit_rate_) / 8 / 1000;
+        writer_ = new BufferedWriter();
+        ret = writer_->Open(path, expected_size);
+        if (ret == 0) {
+            format_context_->pb = writer_->GetIOContext();
+        } else {
+            delete writer_;
+            writer_ = nullptr;
+        }
+    }
+    if (ret != 0) {
+        LOGE("avio open error: %d message: %s", ret, av_err2str(ret));
+    }
+    return ret;
+}
+
+void Mp4Muxer::CloseOutput() {
+    if (nullptr != writer_) {
+        // 等待写入线程把缓存的数据全部写入文件
+        int ret = writer_->Close();
+        if (ret < 0) {
+            LOGE("close output error: %s", av_err2str(ret));
+        }
+        LOGI("close output write count: %lld", writer_->GetWriteCount());
+        delete writer_;
+        writer_ = nullptr;
+        format_context_->pb = nullptr;
+    } else if (!(format_context_->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&format_context_->pb);
+    }
+}
+
+int Mp4Muxer::WriteHeader(AVFormatContext* oc) {
+    AVDictionary* options = nullptr;
+    if (fragment_duration_ > 0) {
+        // 按时长分段, 不等关键帧, 每个分段的时长固定, 采样表只保存当前分段的数据
+        av_dict_set(&options, "movflags", "empty_moov+default_base_moof", 0);
+        av_dict_set_int(&options, "frag_duration", static_cast<int64_t>(fragment_duration_) * 1000, 0);
+    } else if (expected_duration_ > 0) {
+        // 在mdat之前预留moov的空间, 不需要像faststart一样在结束时移动整个文件
+        float frame_rate = video_frame_rate_ > 0 ? video_frame_rate_ : MP4_MOOV_DEFAULT_FRAME_RATE;
+        int64_t video_samples = nullptr == video_stream_ ? 0 : static_cast<int64_t>(expected_duration_ * frame_rate / 1000);
+        int64_t audio_samples = nullptr == audio_stream_ ? 0 : expected_duration_ * audio_sample_rate_ / 1000 / 1024;
+        moov_reserve_size_ = GetMoovSize(video_samples, audio_samples) * (100 + MP4_MOOV_RESERVE_MARGIN) / 100;
+        if (moov_reserve_size_ > INT_MAX) {
+            moov_reserve_size_ = INT_MAX;
+        }
+        av_dict_set_int(&options, "moov_size", moov_reserve_size_, 0);
+    } else if (faststart_) {
+        av_dict_set(&options, "movflags", "faststart", 0);
+    }
+    video_sample_count_ = 0;
+    audio_sample_count_ = 0;
+    int ret = avformat_write_header(oc, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        LOGE("write header error: %s", av_err2str(ret));
+        moov_reserve_size_ = 0;
+        return ret;
+    }
+    LOGI("write header fragment_duration: %d faststart: %d moov_reserve_size: %lld",
+            fragment_duration_, faststart_, moov_reserve_size_);
+    write_header_success_ = true;
+    return ret;
+}
+
 AVStream *
 Mp4Muxer::AddStream(AVFormatContext *oc, AVCodec **codec, enum AVCodecID codec_id, char *codec_name) {
     if (AV_CODEC_ID_NONE == codec_id) {
@@ -212,39 +479,46 @@ Mp4Muxer::AddStream(AVFormatContext *oc, AVCodec **codec, enum AVCodecID codec_i
     return stream;
 }
 
-int Mp4Muxer::WriteAudioFrame(AVFormatContext *oc, AVStream *st) {
-    AudioPacket* audio_packet = nullptr;
-    int ret = audio_packet_callback_(&audio_packet, audio_packet_context_);
-    if (ret < 0) {
-        return ret;
+static void FreeAudioBuffer(void* opaque, uint8_t* data) {
+    delete[] data;
+}
+
+int Mp4Muxer::WriteAudioFrame(AVFormatContext *oc, AVStream *st, AudioPacket* audio_packet) {
+    AVRational sample_time_base = { 1, audio_sample_rate_ };
+    last_audio_packet_pts_ = audio_packet->pts;
+    // 编码器使用global header, 输出的是没有ADTS头的原始AAC, extradata在BuildAudioStream中已经设置
+    // 不再经过aac_adtstoasc, 如果带有ADTS头只需要跳过
+    int offset = 0;
+    uint8_t* data = audio_packet->data;
+    if (audio_packet->size > 7 && data[0] == 0xFF && (data[1] & 0xF6) == 0xF0) {
+        offset = (data[1] & 0x01) ? 7 : 9;
+    }
+    if (nullptr == data || audio_packet->size <= offset) {
+        delete audio_packet;
+        return 0;
     }
-    AVPacket pkt = { 0 };
+    AVPacket pkt;
     av_init_packet(&pkt);
-    last_audio_packet_presentation_time_mills_ = audio_packet->position;
-    pkt.data = audio_packet->data;
-    pkt.size = audio_packet->size;
-    pkt.dts = pkt.pts = (int64_t) (last_audio_packet_presentation_time_mills_ / 1000.0f / av_q2d(st->time_base));
-    pkt.duration = 1024;
+    // 数据交给AVBufferRef管理, av_interleaved_write_frame直接引用, 不会再分配和复制一次
+    pkt.buf = av_buffer_create(data, audio_packet->size, FreeAudioBuffer, nullptr, 0);
+    if (nullptr == pkt.buf) {
+        delete audio_packet;
+        return AVERROR(ENOMEM);
+    }
+    audio_packet->data = nullptr;
+    pkt.data = data + offset;
+    pkt.size = audio_packet->size - offset;
+    pkt.dts = pkt.pts = av_rescale_q(last_audio_packet_pts_, sample_time_base, st->time_base);
+    pkt.duration = av_rescale_q(1024, sample_time_base, st->time_base);
+    pkt.flags = AV_PKT_FLAG_KEY;
     pkt.stream_index = st->index;
-    AVPacket new_packet;
-    av_init_packet(&new_packet);
-    ret = av_bitstream_filter_filter(bit_stream_filter_context_, st->codec, nullptr,
-            &new_packet.data, &new_packet.size,
-            pkt.data, pkt.size, pkt.flags & AV_PKT_FLAG_KEY);
-    if (ret >= 0) {
-        new_packet.pts = pkt.pts;
-        new_packet.dts = pkt.dts;
-        new_packet.duration = pkt.duration;
-        new_packet.stream_index = pkt.stream_index;
-        ret = av_interleaved_write_frame(oc, &new_packet);
-        if (ret != 0) {
-            LOGE("write audio frame error: %s", av_err2str(ret));
-        }
+    int ret = av_interleaved_write_frame(oc, &pkt);
+    if (ret != 0) {
+        LOGE("write audio frame error: %s", av_err2str(ret));
     } else {
-        LOGE("av_bitstream_filter_filter: %s", av_err2str(ret));
+        audio_sample_count_++;
     }
-    av_free_packet(&new_packet);
-    av_free_packet(&pkt);
+    av_packet_unref(&pkt);
     delete audio_packet;
     return ret;
 }
@@ -259,13 +533,10 @@ void Mp4Muxer::CloseAudio(AVFormatContext *oc, AVStream *st) {
     if (nullptr != st->codec) {
         avcodec_close(st->codec);
     }
-    if (nullptr != bit_stream_filter_context_) {
-        av_bitstream_filter_close(bit_stream_filter_context_);
-    }
 }
 
 double Mp4Muxer::GetAudioStreamTimeInSecs() {
-    return last_audio_packet_presentation_time_mills_ / 1000.0f;
+    return audio_sample_rate_ > 0 ? static_cast<double>(last_audio_packet_pts_) / audio_sample_rate_ : 0;
 }
 
 int Mp4Muxer::BuildVideoStream() {
@@ -320,7 +591,6 @@ int Mp4Muxer::BuildAudioStream(char *audio_codec_name) {
         dsi[0] = (object_type << 3) | (GetSampleRateIndex(context->sample_rate) >> 1);
         dsi[1] = ((GetSampleRateIndex(context->sample_rate) & 1) << 7) | (context->channels << 3);
         memcpy(context->extradata, dsi, 2);
-        bit_stream_filter_context_ = av_bitstream_filter_init("aac_adtstoasc");
     }
     return 0;
 }
@@ -24,8 +24,10 @@
 #define TRINITY_MP4_MUXER_H
 
 #include <stdint.h>
+#include <deque>
 #include "audio_packet_queue.h"
 #include "video_packet_queue.h"
+#include "buffered_writer.h"
 
 extern "C" {
 #include "libavformat/avformat.h"
@@ -34,6 +36,17 @@ extern "C" {
 
 #define AUDIO_QUEUE_ABORT_ERR_CODE               -100200
 #define VIDEO_QUEUE_ABORT_ERR_CODE               -100201
+/** 预留moov时每个采样在采样表中最多占用的字节数, 每个采样都是一个chunk时的最坏情况 **/
+#define MP4_MOOV_VIDEO_SAMPLE_SIZE               45
+#define MP4_MOOV_AUDIO_SAMPLE_SIZE               32
+/** moov中采样表以外的部分, 不包括extradata **/
+#define MP4_MOOV_FIXED_SIZE                      4096
+/** 预留的大小比预计的采样数多出的比例, 百分比 **/
+#define MP4_MOOV_RESERVE_MARGIN                  20
+/** 不知道帧率时按这个帧率预留 **/
+#define MP4_MOOV_DEFAULT_FRAME_RATE              60
+/** 交错写入时每一路最多缓存的packet数量, 超过时不再从队列中读取 **/
+#define MP4_INTERLEAVE_MAX_PACKETS               64
 
 namespace trinity {
 
@@ -44,22 +57,41 @@ class Mp4Muxer {
     virtual int Init(const char* path, int video_width, int video_height, int frame_rate, int video_bit_rate,
             int audio_sample_rate, int audio_channels, int audio_bit_rate, char* audio_codec_name);
 
-    virtual void RegisterAudioPacketCallback(int (*audio_packet)(AudioPacket**, void* context), void* context);
-    virtual void RegisterVideoPacketCallback(int (*video_packet)(VideoPacket**, void* context), void* context);
+    // 回调的返回值和队列的Get一致, 1表示取到了数据, 0表示不阻塞时队列为空, 负数表示队列已经结束
+    virtual void RegisterAudioPacketCallback(int (*audio_packet)(AudioPacket**, bool block, void* context),
+            void* context);
+    virtual void RegisterVideoPacketCallback(int (*video_packet)(VideoPacket**, bool block, void* context),
+            void* context);
 
+    // 写入一个packet, 两路都结束时返回负数
+    // 不阻塞地把两个队列中的数据取到各自的缓存中, 按dts的顺序写入
+    // 只有需要的那一路还没有数据时才阻塞等待, 一路编码慢时另一路不会堆积在队列中
     int Encode();
 
     virtual int Stop();
 
-    typedef int (*AudioPacketCallback) (AudioPacket**, void* context);
-    typedef int (*VideoPacketCallback) (VideoPacket**, void* context);
+    // 需要在写入文件头之前调用, 大于0时写入分段mp4, 单位是毫秒
+    // 文件头中只有空的moov, 每个分段有自己的moof, 异常退出时已经写入的分段仍然可以播放
+    void SetFragmentDuration(int duration);
+
+    // 需要在写入文件头之前调用, moov写在mdat之前, 边下载边播放
+    void SetFaststart(bool faststart);
+
+    // 需要在写入文件头之前调用, 单位是毫秒
+    // 按时长, 帧率和音频采样率在mdat之前预留moov的空间, 结束时moov直接写入预留的空间
+    // 实际的采样数超过预留的大小时, 结束后再重写一次文件
+    void SetExpectedDuration(int64_t duration);
+
+    typedef int (*AudioPacketCallback) (AudioPacket**, bool block, void* context);
+    typedef int (*VideoPacketCallback) (VideoPacket**, bool block, void* context);
 
  protected:
     virtual AVStream* AddStream(AVFormatContext* oc, AVCodec** codec, enum AVCodecID codec_id, char* codec_name);
 
-    virtual int WriteVideoFrame(AVFormatContext* oc, AVStream* st) = 0;
+    // 写入一帧数据, 需要释放packet
+    virtual int WriteVideoFrame(AVFormatContext* oc, AVStream* st, VideoPacket* packet) = 0;
 
-    virtual int WriteAudioFrame(AVFormatContext* oc, AVStream* st);
+    virtual int WriteAudioFrame(AVFormatContext* oc, AVStream* st, AudioPacket* packet);
 
     virtual void CloseVideo(AVFormatContext* oc, AVStream* st);
 
@@ -75,6 +107,30 @@ class Mp4Muxer {
 
     int BuildAudioStream(char *audio_codec_name);
 
+    // 打开输出文件, faststart需要读取输出文件, 使用avio_open2, 其它情况使用BufferedWriter
+    int OpenOutput(const char* path);
+
+    void CloseOutput();
+
+    // 按分段和faststart的设置写入文件头
+    int WriteHeader(AVFormatContext* oc);
+
+    // 从队列中读取数据放入缓存, block为true时等待到有数据或者队列结束
+    void ReadVideoPackets(bool block);
+    void ReadAudioPackets(bool block);
+
+    // 缓存中packet的dts, 单位是毫秒
+    int64_t GetVideoPacketTime(VideoPacket* packet);
+    int64_t GetAudioPacketTime(AudioPacket* packet);
+
+    void ClearPackets();
+
+    // 按采样数计算moov最大的大小
+    int64_t GetMoovSize(int64_t video_samples, int64_t audio_samples);
+
+    // 预留的空间不够时moov写在文件最后, 把预留的空间改成free box, 再重写成faststart
+    int RewriteFaststart(const char* path);
+
  protected:
     // sps and pps data
     uint8_t *header_data_;
@@ -82,9 +138,9 @@ class Mp4Muxer {
     AVFormatContext* format_context_;
     AVStream* video_stream_;
     AVStream* audio_stream_;
-    AVBitStreamFilterContext* bit_stream_filter_context_;
     double duration_;
-    double last_audio_packet_presentation_time_mills_;
+    /** 最后写入的音频包的时间戳, 单位是采样数, 只在写入时转换成流的time_base **/
+    int64_t last_audio_packet_pts_;
     int video_width_;
     int video_height_;
     float video_frame_rate_;
@@ -97,6 +153,19 @@ class Mp4Muxer {
     VideoPacketCallback video_packet_callback_;
     void* video_packet_context_;
     bool write_header_success_;
+    int fragment_duration_;
+    bool faststart_;
+    int64_t expected_duration_;
+    /** 写入文件头时预留的moov的大小 **/
+    int64_t moov_reserve_size_;
+    int64_t video_sample_count_;
+    int64_t audio_sample_count_;
+    /** 已经从队列中读取还没有写入的packet, 每一路按dts递增 **/
+    std::deque<VideoPacket*> video_packets_;
+    std::deque<AudioPacket*> audio_packets_;
+    bool video_ended_;
+    bool audio_ended_;
+    BufferedWriter* writer_;
 };
 
 }  // namespace trinity
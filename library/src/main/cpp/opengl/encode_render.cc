@@ -21,6 +21,10 @@
 //
 
 #include "encode_render.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/time.h>
+#include <map>
 #include "android_xlog.h"
 #include "gl.h"
 
@@ -32,86 +36,90 @@
 // V’= 0.615*R’ - 0.515*G’ - 0.100*B’ = 0.877*(R’- Y’)
 // 导出原理：采样坐标只作为确定输出位置使用，通过输出纹理计算实际采样位置，进行采样和并转换,
 // 然后将转换的结果填充到输出位置
-static const char* ENCODER_FRAGMENT =
-        "precision highp float;\n"
-        "precision highp int;\n"
-        "varying vec2 textureCoordinate;\n"
-        "uniform sampler2D inputImageTexture;\n"
-        "uniform float width;\n"
-        "uniform float height;\n"
-        "float cY(float x, float y) {\n"
-        "    vec4 c = texture2D(inputImageTexture, vec2(x, y));\n"
-        "    return c.r * 0.257 + c.g * 0.504 + c.b * 0.098 + 0.0625;\n"
-        "}\n"
-        "vec4 cC(float x, float y, float dx, float dy) {\n"
-        "    vec4 c0 = texture2D(inputImageTexture, vec2(x, y));\n"
-        "    vec4 c1 = texture2D(inputImageTexture, vec2(x + dx, y));\n"
-        "    vec4 c2 = texture2D(inputImageTexture, vec2(x, y + dy));\n"
-        "    vec4 c3 = texture2D(inputImageTexture, vec2(x + dx, y + dy));\n"
-        "    return (c0 + c1 + c2 + c3) / 4.;\n"
-        "}\n"
-        "float cU(float x, float y, float dx, float dy) {\n"
-        "    vec4 c = cC(x, y, dx, dy);\n"
-        "    return -0.148 * c.r - 0.291 * c.g + 0.439 * c.b + 0.5000;\n"
-        "}\n"
-        "float cV(float x, float y, float dx, float dy) {\n"
-        "    vec4 c = cC(x, y, dx, dy);\n"
-        "    return 0.439 * c.r - 0.368 * c.g - 0.071 * c.b + 0.5000;\n"
-        "}\n"
-        "vec2 cPos(float t, float shiftx, float gy) {\n"
-        "    vec2 pos = vec2(floor(width * textureCoordinate.x), floor(height * gy));\n"
-        "    return vec2(mod(pos.x * shiftx, width), (pos.y * shiftx + floor(pos.x * shiftx / width)) * t);\n"
-        "}\n"
-        "vec4 calculateY() {\n"
-        "    vec2 pos = cPos(1., 4., textureCoordinate.y);\n"
-        "    vec4 oColor = vec4(0);\n"
-        "    float textureYPos = pos.y / height;\n"
-        "    oColor[0] = cY(pos.x / width, textureYPos);\n"
-        "    oColor[1] = cY((pos.x + 1.) / width, textureYPos);\n"
-        "    oColor[2] = cY((pos.x + 2.) / width, textureYPos);\n"
-        "    oColor[3] = cY((pos.x + 3.) / width, textureYPos);\n"
-        "    return oColor;\n"
-        "}\n"
-        "vec4 calculateU(float gy, float dx, float dy) {\n"
-        "    vec2 pos = cPos(2., 8., textureCoordinate.y - gy);\n"
-        "    vec4 oColor = vec4(0);\n"
-        "    float textureYPos = pos.y / height;\n"
-        "    oColor[0] = cU(pos.x / width, textureYPos, dx, dy);\n"
-        "    oColor[1] = cU((pos.x + 2.) / width, textureYPos, dx, dy);\n"
-        "    oColor[2] = cU((pos.x + 4.) / width, textureYPos, dx, dy);\n"
-        "    oColor[3] = cU((pos.x + 6.) / width, textureYPos, dx, dy);\n"
-        "    return oColor;\n"
-        "}\n"
-        "vec4 calculateV(float gy, float dx, float dy) {\n"
-        "    vec2 pos = cPos(2., 8., textureCoordinate.y - gy);\n"
-        "    vec4 oColor = vec4(0);\n"
-        "    float textureYPos = pos.y / height;\n"
-        "    oColor[0] = cV(pos.x / width, textureYPos, dx, dy);\n"
-        "    oColor[1] = cV((pos.x + 2.) / width, textureYPos, dx, dy);\n"
-        "    oColor[2] = cV((pos.x + 4.) / width, textureYPos, dx, dy);\n"
-        "    oColor[3] = cV((pos.x + 6.) / width, textureYPos, dx, dy);\n"
-        "    return oColor;\n"
-        "}\n"
-        "vec4 calculateUV(float dx, float dy) {\n"
-        "    vec2 pos = cPos(2., 4., textureCoordinate.y - 0.2500);\n"
-        "    vec4 oColor = vec4(0);\n"
-        "    float textureYPos = pos.y / height;\n"
-        "    oColor[0] = cU(pos.x / width, textureYPos, dx, dy);\n"
-        "    oColor[1] = cV(pos.x / width, textureYPos, dx, dy);\n"
-        "    oColor[2] = cU((pos.x + 2.) / width, textureYPos, dx, dy);\n"
-        "    oColor[3] = cV((pos.x + 2.) / width, textureYPos, dx, dy);\n"
-        "    return oColor;\n"
-        "}\n"
-        "vec4 calculateVU(float dx, float dy) {\n"
-        "    vec2 pos = cPos(2., 4., textureCoordinate.y - 0.2500);\n"
-        "    vec4 oColor = vec4(0);\n"
-        "    float textureYPos = pos.y / height;\n"
-        "    oColor[0] = cV(pos.x / width, textureYPos, dx, dy);\n"
-        "    oColor[1] = cU(pos.x / width, textureYPos, dx, dy);\n"
-        "    oColor[2] = cV((pos.x + 2.) / width, textureYPos, dx, dy);\n"
-        "    oColor[3] = cU((pos.x + 2.) / width, textureYPos, dx, dy);\n"
-        "    return oColor;\n"
+#define ENCODER_FRAGMENT_HEADER \
+        "precision highp float;\n" \
+        "precision highp int;\n" \
+        "varying vec2 textureCoordinate;\n" \
+        "uniform sampler2D inputImageTexture;\n" \
+        "uniform float width;\n" \
+        "uniform float height;\n" \
+        "float cY(float x, float y) {\n" \
+        "    vec4 c = texture2D(inputImageTexture, vec2(x, y));\n" \
+        "    return c.r * 0.257 + c.g * 0.504 + c.b * 0.098 + 0.0625;\n" \
+        "}\n" \
+        "vec4 cC(float x, float y, float dx, float dy) {\n" \
+        "    vec4 c0 = texture2D(inputImageTexture, vec2(x, y));\n" \
+        "    vec4 c1 = texture2D(inputImageTexture, vec2(x + dx, y));\n" \
+        "    vec4 c2 = texture2D(inputImageTexture, vec2(x, y + dy));\n" \
+        "    vec4 c3 = texture2D(inputImageTexture, vec2(x + dx, y + dy));\n" \
+        "    return (c0 + c1 + c2 + c3) / 4.;\n" \
+        "}\n" \
+        "float cU(float x, float y, float dx, float dy) {\n" \
+        "    vec4 c = cC(x, y, dx, dy);\n" \
+        "    return -0.148 * c.r - 0.291 * c.g + 0.439 * c.b + 0.5000;\n" \
+        "}\n" \
+        "float cV(float x, float y, float dx, float dy) {\n" \
+        "    vec4 c = cC(x, y, dx, dy);\n" \
+        "    return 0.439 * c.r - 0.368 * c.g - 0.071 * c.b + 0.5000;\n" \
+        "}\n" \
+        "vec2 cPos(float t, float shiftx, float gy) {\n" \
+        "    vec2 pos = vec2(floor(width * textureCoordinate.x), floor(height * gy));\n" \
+        "    return vec2(mod(pos.x * shiftx, width), (pos.y * shiftx + floor(pos.x * shiftx / width)) * t);\n" \
+        "}\n" \
+        "vec4 calculateY() {\n" \
+        "    vec2 pos = cPos(1., 4., textureCoordinate.y);\n" \
+        "    vec4 oColor = vec4(0);\n" \
+        "    float textureYPos = pos.y / height;\n" \
+        "    oColor[0] = cY(pos.x / width, textureYPos);\n" \
+        "    oColor[1] = cY((pos.x + 1.) / width, textureYPos);\n" \
+        "    oColor[2] = cY((pos.x + 2.) / width, textureYPos);\n" \
+        "    oColor[3] = cY((pos.x + 3.) / width, textureYPos);\n" \
+        "    return oColor;\n" \
+        "}\n" \
+        "vec4 calculateU(float gy, float dx, float dy) {\n" \
+        "    vec2 pos = cPos(2., 8., textureCoordinate.y - gy);\n" \
+        "    vec4 oColor = vec4(0);\n" \
+        "    float textureYPos = pos.y / height;\n" \
+        "    oColor[0] = cU(pos.x / width, textureYPos, dx, dy);\n" \
+        "    oColor[1] = cU((pos.x + 2.) / width, textureYPos, dx, dy);\n" \
+        "    oColor[2] = cU((pos.x + 4.) / width, textureYPos, dx, dy);\n" \
+        "    oColor[3] = cU((pos.x + 6.) / width, textureYPos, dx, dy);\n" \
+        "    return oColor;\n" \
+        "}\n" \
+        "vec4 calculateV(float gy, float dx, float dy) {\n" \
+        "    vec2 pos = cPos(2., 8., textureCoordinate.y - gy);\n" \
+        "    vec4 oColor = vec4(0);\n" \
+        "    float textureYPos = pos.y / height;\n" \
+        "    oColor[0] = cV(pos.x / width, textureYPos, dx, dy);\n" \
+        "    oColor[1] = cV((pos.x + 2.) / width, textureYPos, dx, dy);\n" \
+        "    oColor[2] = cV((pos.x + 4.) / width, textureYPos, dx, dy);\n" \
+        "    oColor[3] = cV((pos.x + 6.) / width, textureYPos, dx, dy);\n" \
+        "    return oColor;\n" \
+        "}\n" \
+        "vec2 cUV(vec4 c) {\n" \
+        "    return vec2(-0.148 * c.r - 0.291 * c.g + 0.439 * c.b + 0.5000,\n" \
+        "        0.439 * c.r - 0.368 * c.g - 0.071 * c.b + 0.5000);\n" \
+        "}\n" \
+        "vec4 calculateUV(float dx, float dy) {\n" \
+        "    vec2 pos = cPos(2., 4., textureCoordinate.y - 0.2500);\n" \
+        "    float textureYPos = pos.y / height;\n" \
+        "    vec2 uv0 = cUV(cC(pos.x / width, textureYPos, dx, dy));\n" \
+        "    vec2 uv1 = cUV(cC((pos.x + 2.) / width, textureYPos, dx, dy));\n" \
+        "    return vec4(uv0, uv1);\n" \
+        "}\n" \
+        "vec4 calculateVU(float dx, float dy) {\n" \
+        "    vec2 pos = cPos(2., 4., textureCoordinate.y - 0.2500);\n" \
+        "    vec4 oColor = vec4(0);\n" \
+        "    float textureYPos = pos.y / height;\n" \
+        "    oColor[0] = cV(pos.x / width, textureYPos, dx, dy);\n" \
+        "    oColor[1] = cU(pos.x / width, textureYPos, dx, dy);\n" \
+        "    oColor[2] = cV((pos.x + 2.) / width, textureYPos, dx, dy);\n" \
+        "    oColor[3] = cU((pos.x + 2.) / width, textureYPos, dx, dy);\n" \
+        "    return oColor;\n" \
         "}\n"
+
+static const char* ENCODER_FRAGMENT =
+        ENCODER_FRAGMENT_HEADER
         "void main() {\n"
         "   if (textureCoordinate.y < 0.2500) {\n"
         "       gl_FragColor = calculateY();\n"
@@ -124,6 +132,19 @@ static const char* ENCODER_FRAGMENT =
         "   }\n"
         "}\n";
 
+// NV12, Y之后是交错的UV, 每个UV只采样一次2x2的平均值
+static const char* ENCODER_NV12_FRAGMENT =
+        ENCODER_FRAGMENT_HEADER
+        "void main() {\n"
+        "   if (textureCoordinate.y < 0.2500) {\n"
+        "       gl_FragColor = calculateY();\n"
+        "   } else if (textureCoordinate.y < 0.3750) {\n"
+        "       gl_FragColor = calculateUV(1. / width, 1. / height);\n"
+        "   } else { \n"
+        "       gl_FragColor = vec4(0, 0, 0, 0);"
+        "   }\n"
+        "}\n";
+
 /**
  * YV12
  * "void main() {\n" +
@@ -139,19 +160,6 @@ static const char* ENCODER_FRAGMENT =
     "}")
  */
 
-/**
- * NV12
- * "void main() {\n" +
-    "    if(vTextureCo.y<0.2500){\n" +
-    "        gl_FragColor=calculateY();\n" +
-    "    }else if(vTextureCo.y<0.3750){\n" +
-    "        gl_FragColor=calculateUV(1./uWidth,1./uHeight);\n" +
-    "    }else{\n" +
-    "        gl_FragColor=vec4(0,0,0,0);\n" +
-    "    }\n" +
-    "}"
- */
-
 /**
  * NV21
  * "void main() {\n" +
@@ -167,9 +175,29 @@ static const char* ENCODER_FRAGMENT =
 
 namespace trinity {
 
-EncodeRender::EncodeRender() : OpenGL(DEFAULT_VERTEX_SHADER, ENCODER_FRAGMENT) {
+EncodeRender::EncodeRender(YUVFormat format)
+    : OpenGL(DEFAULT_VERTEX_SHADER, format == YUV_FORMAT_NV12 ? ENCODER_NV12_FRAGMENT : ENCODER_FRAGMENT) {
+    format_ = format;
     width_ = 0;
     height_ = 0;
+    pixel_buffer_init_ = false;
+    use_pixel_buffer_ = false;
+    pixel_buffer_size_ = 0;
+    pixel_buffer_index_ = 0;
+    convert_mode_ = ENCODE_CONVERT_GPU;
+    read_frame_buffer_ = 0;
+    rgba_buffer_ = nullptr;
+    rgba_buffer_size_ = 0;
+    for (int i = 0; i < ENCODE_PIXEL_BUFFER_COUNT; i++) {
+        pixel_buffers_[i] = 0;
+        pixel_buffer_fences_[i] = nullptr;
+        pixel_buffer_times_[i] = 0;
+    }
+    map_buffer_range_ = nullptr;
+    unmap_buffer_ = nullptr;
+    fence_sync_ = nullptr;
+    client_wait_sync_ = nullptr;
+    delete_sync_ = nullptr;
 }
 
 EncodeRender::~EncodeRender() {
@@ -181,7 +209,178 @@ void EncodeRender::CopyYUV420Image(GLuint texture, uint8_t *buffer, int width, i
     ConvertYUV420(texture, width, height, buffer);
 }
 
+int EncodeRender::CopyYUV420ImageAsync(GLuint texture, uint8_t *buffer, int width, int height, int time, int* out_time) {
+    if (!pixel_buffer_init_) {
+        InitPixelBuffer(width, height);
+    }
+    if (!use_pixel_buffer_) {
+        CopyYUV420Image(texture, buffer, width, height);
+        *out_time = time;
+        return 1;
+    }
+    int ret = 0;
+    int index = pixel_buffer_index_;
+    // 当前位置是最早提交的一帧, 已经过了ENCODE_PIXEL_BUFFER_COUNT帧, 一般不需要等待
+    if (nullptr != pixel_buffer_fences_[index]) {
+        ReadPixelBuffer(index, buffer);
+        *out_time = pixel_buffer_times_[index];
+        ret = 1;
+    }
+    width_ = width;
+    height_ = height;
+    // 绑定PBO之后glReadPixels只提交读取命令, 不等待GPU
+    if (convert_mode_ == ENCODE_CONVERT_CPU) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers_[index]);
+        ReadRGBA(texture, width, height, 0);
+    } else {
+        glViewport(0, 0, width, height);
+        ProcessImage(texture);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers_[index]);
+        glReadPixels(0, 0, width, height * 3 / 8, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pixel_buffer_fences_[index] = fence_sync_(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    pixel_buffer_times_[index] = time;
+    pixel_buffer_index_ = (index + 1) % ENCODE_PIXEL_BUFFER_COUNT;
+    return ret;
+}
+
+int EncodeRender::FlushYUV420Image(uint8_t *buffer, int* out_time) {
+    if (!use_pixel_buffer_) {
+        return 0;
+    }
+    for (int i = 0; i < ENCODE_PIXEL_BUFFER_COUNT; i++) {
+        int index = (pixel_buffer_index_ + i) % ENCODE_PIXEL_BUFFER_COUNT;
+        if (nullptr != pixel_buffer_fences_[index]) {
+            ReadPixelBuffer(index, buffer);
+            *out_time = pixel_buffer_times_[index];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void EncodeRender::SetConvertMode(int mode) {
+    convert_mode_ = mode == ENCODE_CONVERT_CPU ? ENCODE_CONVERT_CPU : ENCODE_CONVERT_GPU;
+}
+
+int EncodeRender::GetConvertMode() {
+    return convert_mode_;
+}
+
+/** 每个分辨率测试出来的转换方式, key为width << 32 | height **/
+static std::map<int64_t, int> convert_modes;
+static pthread_mutex_t convert_mode_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int EncodeRender::SelectConvertMode(GLuint texture, int width, int height) {
+    int64_t key = (static_cast<int64_t>(width) << 32) | static_cast<uint32_t>(height);
+    int select_mode = -1;
+    // 测试期间持有锁, 多个分段编码器同时测试会互相影响结果
+    pthread_mutex_lock(&convert_mode_lock);
+    auto it = convert_modes.find(key);
+    if (it != convert_modes.end()) {
+        select_mode = it->second;
+    } else {
+        uint8_t* buffer = new uint8_t[width * height * 3 / 2];
+        int64_t gpu_time = BenchmarkConvert(ENCODE_CONVERT_GPU, texture, width, height, buffer);
+        int64_t cpu_time = BenchmarkConvert(ENCODE_CONVERT_CPU, texture, width, height, buffer);
+        delete[] buffer;
+        select_mode = cpu_time < gpu_time ? ENCODE_CONVERT_CPU : ENCODE_CONVERT_GPU;
+        LOGI("SelectConvertMode %dx%d gpu: %lld us cpu(%s): %lld us use %s", width, height, gpu_time,
+                ColorConvert::GetSimdName(), cpu_time, select_mode == ENCODE_CONVERT_CPU ? "cpu" : "gpu");
+        convert_modes[key] = select_mode;
+    }
+    pthread_mutex_unlock(&convert_mode_lock);
+    convert_mode_ = select_mode;
+    return select_mode;
+}
+
 void EncodeRender::Destroy() {
+    if (read_frame_buffer_ != 0) {
+        glDeleteFramebuffers(1, &read_frame_buffer_);
+        read_frame_buffer_ = 0;
+    }
+    if (nullptr != rgba_buffer_) {
+        delete[] rgba_buffer_;
+        rgba_buffer_ = nullptr;
+    }
+    rgba_buffer_size_ = 0;
+    for (int i = 0; i < ENCODE_PIXEL_BUFFER_COUNT; i++) {
+        if (nullptr != pixel_buffer_fences_[i]) {
+            delete_sync_(pixel_buffer_fences_[i]);
+            pixel_buffer_fences_[i] = nullptr;
+        }
+    }
+    if (use_pixel_buffer_) {
+        glDeleteBuffers(ENCODE_PIXEL_BUFFER_COUNT, pixel_buffers_);
+        for (int i = 0; i < ENCODE_PIXEL_BUFFER_COUNT; i++) {
+            pixel_buffers_[i] = 0;
+        }
+    }
+    pixel_buffer_init_ = false;
+    use_pixel_buffer_ = false;
+    pixel_buffer_index_ = 0;
+}
+
+void EncodeRender::InitPixelBuffer(int width, int height) {
+    pixel_buffer_init_ = true;
+    use_pixel_buffer_ = false;
+    // 运行时的环境可能是GLES2, 只链接GLESv2时也可以在GLES3的环境中使用PBO
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if (nullptr == version || nullptr == strstr(version, "OpenGL ES 3") || !LoadPixelBufferFunctions()) {
+        LOGI("GL_VERSION: %s use glReadPixels", nullptr == version ? "" : version);
+        return;
+    }
+    // CPU转换时PBO中是完整的RGBA数据
+    pixel_buffer_size_ = convert_mode_ == ENCODE_CONVERT_CPU ? width * height * 4 : width * height * 3 / 2;
+    glGenBuffers(ENCODE_PIXEL_BUFFER_COUNT, pixel_buffers_);
+    for (int i = 0; i < ENCODE_PIXEL_BUFFER_COUNT; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers_[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, pixel_buffer_size_, nullptr, GL_STREAM_READ);
+        pixel_buffer_fences_[i] = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pixel_buffer_index_ = 0;
+    use_pixel_buffer_ = true;
+    LOGI("GL_VERSION: %s use %d pixel buffers", version, ENCODE_PIXEL_BUFFER_COUNT);
+}
+
+bool EncodeRender::LoadPixelBufferFunctions() {
+    // Android的eglGetProcAddress也可以获取核心函数, 不需要链接GLESv3
+    map_buffer_range_ = reinterpret_cast<PFNGLMAPBUFFERRANGEPROC>(eglGetProcAddress("glMapBufferRange"));
+    unmap_buffer_ = reinterpret_cast<PFNGLUNMAPBUFFERPROC>(eglGetProcAddress("glUnmapBuffer"));
+    fence_sync_ = reinterpret_cast<PFNGLFENCESYNCPROC>(eglGetProcAddress("glFenceSync"));
+    client_wait_sync_ = reinterpret_cast<PFNGLCLIENTWAITSYNCPROC>(eglGetProcAddress("glClientWaitSync"));
+    delete_sync_ = reinterpret_cast<PFNGLDELETESYNCPROC>(eglGetProcAddress("glDeleteSync"));
+    if (nullptr == map_buffer_range_ || nullptr == unmap_buffer_ || nullptr == fence_sync_ ||
+        nullptr == client_wait_sync_ || nullptr == delete_sync_) {
+        LOGE("load GLES3 pixel buffer functions failed");
+        return false;
+    }
+    return true;
+}
+
+void EncodeRender::ReadPixelBuffer(int index, uint8_t *buffer) {
+    GLenum result = client_wait_sync_(pixel_buffer_fences_[index], GL_SYNC_FLUSH_COMMANDS_BIT, ENCODE_PIXEL_BUFFER_TIMEOUT);
+    if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+        LOGE("glClientWaitSync error: %d", result);
+    }
+    delete_sync_(pixel_buffer_fences_[index]);
+    pixel_buffer_fences_[index] = nullptr;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers_[index]);
+    void* data = map_buffer_range_(GL_PIXEL_PACK_BUFFER, 0, pixel_buffer_size_, GL_MAP_READ_BIT);
+    if (nullptr != data) {
+        if (convert_mode_ == ENCODE_CONVERT_CPU) {
+            ConvertRGBA(reinterpret_cast<const uint8_t*>(data), buffer);
+        } else {
+            memcpy(buffer, data, pixel_buffer_size_);
+        }
+        unmap_buffer_(GL_PIXEL_PACK_BUFFER);
+    } else {
+        LOGE("glMapBufferRange error: %d", glGetError());
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
 void EncodeRender::RunOnDrawTasks() {
@@ -190,10 +389,63 @@ void EncodeRender::RunOnDrawTasks() {
 }
 
 void EncodeRender::ConvertYUV420(int texture_id, int width, int height, void *buffer) {
+    if (convert_mode_ == ENCODE_CONVERT_CPU) {
+        // 分辨率变化时重新分配
+        int size = width * height * 4;
+        if (nullptr == rgba_buffer_ || rgba_buffer_size_ != size) {
+            delete[] rgba_buffer_;
+            rgba_buffer_ = new uint8_t[size];
+            rgba_buffer_size_ = size;
+        }
+        ReadRGBA(texture_id, width, height, rgba_buffer_);
+        ConvertRGBA(rgba_buffer_, reinterpret_cast<uint8_t*>(buffer));
+        return;
+    }
     glViewport(0, 0, width, height);
     // 这里画的时候不能改变顶点或纹理的坐标
     ProcessImage(texture_id);
     glReadPixels(0, 0, width, height * 3 / 8, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 }
 
+void EncodeRender::ReadRGBA(GLuint texture, int width, int height, void *buffer) {
+    GLint frame_buffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &frame_buffer);
+    if (read_frame_buffer_ == 0) {
+        glGenFramebuffers(1, &read_frame_buffer_);
+    }
+    // texture的第一行就是glReadPixels的第一行, 和shader转换时的方向一致
+    glBindFramebuffer(GL_FRAMEBUFFER, read_frame_buffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(frame_buffer));
+}
+
+void EncodeRender::ConvertRGBA(const uint8_t *rgba, uint8_t *buffer) {
+    int y_size = width_ * height_;
+    if (format_ == YUV_FORMAT_NV12) {
+        color_convert_.RGBAToNV12(rgba, width_ * 4, width_, height_, buffer, width_, buffer + y_size, width_);
+        return;
+    }
+    color_convert_.RGBAToI420(rgba, width_ * 4, width_, height_, buffer, width_,
+            buffer + y_size, width_ / 2, buffer + y_size * 5 / 4, width_ / 2);
+}
+
+int64_t EncodeRender::BenchmarkConvert(int mode, GLuint texture, int width, int height, uint8_t *buffer) {
+    int previous_mode = convert_mode_;
+    convert_mode_ = mode;
+    // 第一帧包含shader编译和内存分配, 不计算在内
+    CopyYUV420Image(texture, buffer, width, height);
+    glFinish();
+    struct timeval begin;
+    struct timeval end;
+    gettimeofday(&begin, nullptr);
+    for (int i = 0; i < ENCODE_CONVERT_BENCHMARK_COUNT; i++) {
+        CopyYUV420Image(texture, buffer, width, height);
+    }
+    glFinish();
+    gettimeofday(&end, nullptr);
+    convert_mode_ = previous_mode;
+    return ((end.tv_sec - begin.tv_sec) * 1000000LL + (end.tv_usec - begin.tv_usec)) / ENCODE_CONVERT_BENCHMARK_COUNT;
+}
+
 }  // namespace trinity
@@ -24,15 +24,62 @@
 #define TRINITY_ENCODE_RENDER_H
 
 #include "opengl.h"
+#include "color_convert.h"
+#ifdef _OPENGL30_
+#include <GLES3/gl3.h>
+#endif
+
+// 只链接GLESv2时没有GLES3的声明, PBO和fence的函数运行时通过eglGetProcAddress获取
+#ifndef GL_ES_VERSION_3_0
+#define GL_PIXEL_PACK_BUFFER                0x88EB
+#define GL_STREAM_READ                      0x88E1
+#define GL_MAP_READ_BIT                     0x0001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE       0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT          0x00000001
+#define GL_TIMEOUT_EXPIRED                  0x911B
+#define GL_WAIT_FAILED                      0x911D
+typedef struct __GLsync *GLsync;
+typedef khronos_uint64_t GLuint64;
+typedef void *(GL_APIENTRYP PFNGLMAPBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (GL_APIENTRYP PFNGLUNMAPBUFFERPROC) (GLenum target);
+typedef GLsync (GL_APIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (GL_APIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (GL_APIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
+#endif
+
+/** PBO的个数, 一帧在提交之后第ENCODE_PIXEL_BUFFER_COUNT帧时才会读取 **/
+#define ENCODE_PIXEL_BUFFER_COUNT       3
+/** 等待GPU读取完成的最长时间, 单位是纳秒 **/
+#define ENCODE_PIXEL_BUFFER_TIMEOUT     1000000000
+/** 用shader转换YUV, 或者读取RGBA之后在CPU上转换 **/
+#define ENCODE_CONVERT_GPU              0
+#define ENCODE_CONVERT_CPU              1
+/** 选择转换方式时每种方式测试的帧数 **/
+#define ENCODE_CONVERT_BENCHMARK_COUNT  5
 
 namespace trinity {
 
 class EncodeRender : public OpenGL {
  public:
-    EncodeRender();
+    explicit EncodeRender(YUVFormat format = YUV_FORMAT_I420);
     virtual ~EncodeRender();
 
+    // 读取的数据按format排列, 大小都是width * height * 3 / 2
+    // 同步读取, 调用glReadPixels时会等待GPU画完当前帧
     void CopyYUV420Image(GLuint texture, uint8_t *buffer, int width, int height);
+    // 异步读取, 当前帧提交到PBO之后立即返回, 同时取出最早提交的一帧
+    // 返回1时buffer中是之前提交的帧, out_time是那一帧的时间, 返回0时还没有可以读取的帧
+    // 不支持GLES3时使用同步读取, 直接返回当前帧
+    int CopyYUV420ImageAsync(GLuint texture, uint8_t *buffer, int width, int height, int time, int* out_time);
+    // 依次取出还在PBO中的帧, 返回0时已经全部取出
+    int FlushYUV420Image(uint8_t *buffer, int* out_time);
+    // 需要在第一次读取之前设置
+    void SetConvertMode(int mode);
+    int GetConvertMode();
+    // 分别测试两种转换方式, 使用更快的一种
+    // GPU和CPU的快慢和分辨率有关, 结果按宽高缓存, 同一个分辨率在进程内只测试一次
+    // 需要在GL线程调用, GPU转换时画到当前绑定的framebuffer上
+    int SelectConvertMode(GLuint texture, int width, int height);
     void Destroy();
 
  protected:
@@ -40,10 +87,36 @@ class EncodeRender : public OpenGL {
 
  private:
     void ConvertYUV420(int texture_id, int width, int height, void *buffer);
+    // 把texture的RGBA数据读取到buffer, 绑定PBO时buffer是PBO中的偏移
+    void ReadRGBA(GLuint texture, int width, int height, void* buffer);
+    void ConvertRGBA(const uint8_t* rgba, uint8_t* buffer);
+    int64_t BenchmarkConvert(int mode, GLuint texture, int width, int height, uint8_t* buffer);
+    void InitPixelBuffer(int width, int height);
+    // 获取GLES3的函数, 有一个获取失败时返回false
+    bool LoadPixelBufferFunctions();
+    void ReadPixelBuffer(int index, uint8_t* buffer);
 
  private:
+    YUVFormat format_;
     int width_;
     int height_;
+    bool pixel_buffer_init_;
+    bool use_pixel_buffer_;
+    int pixel_buffer_size_;
+    int pixel_buffer_index_;
+    int convert_mode_;
+    ColorConvert color_convert_;
+    GLuint read_frame_buffer_;
+    uint8_t* rgba_buffer_;
+    int rgba_buffer_size_;
+    GLuint pixel_buffers_[ENCODE_PIXEL_BUFFER_COUNT];
+    GLsync pixel_buffer_fences_[ENCODE_PIXEL_BUFFER_COUNT];
+    int pixel_buffer_times_[ENCODE_PIXEL_BUFFER_COUNT];
+    PFNGLMAPBUFFERRANGEPROC map_buffer_range_;
+    PFNGLUNMAPBUFFERPROC unmap_buffer_;
+    PFNGLFENCESYNCPROC fence_sync_;
+    PFNGLCLIENTWAITSYNCPROC client_wait_sync_;
+    PFNGLDELETESYNCPROC delete_sync_;
 };
 
 }  // namespace trinity
@@ -86,6 +86,11 @@ VideoPlayer::VideoPlayer() {
     egl_destroy_ = false;
     gl_observer_ = nullptr;
     destroy_ = false;
+    speed_ = 1.0f;
+    time_stretch_ = nullptr;
+    stretch_buffer_ = nullptr;
+    stretch_buffer_size_ = 0;
+    stretch_serial_ = -1;
 
     audio_render_ = new AudioRender();
     message_queue_ = new MessageQueue("Video Render Message Queue");
@@ -110,6 +115,15 @@ VideoPlayer::~VideoPlayer() {
         delete handler_;
         handler_ = nullptr;
     }
+    if (nullptr != time_stretch_) {
+        time_stretch_->Destroy();
+        delete time_stretch_;
+        time_stretch_ = nullptr;
+    }
+    if (nullptr != stretch_buffer_) {
+        delete[] stretch_buffer_;
+        stretch_buffer_ = nullptr;
+    }
 }
 
 void VideoPlayer::InitCoordinates() {
@@ -523,6 +537,13 @@ void VideoPlayer::Resume() {
     }
 }
 
+void VideoPlayer::SetSpeed(float speed) {
+    if (speed <= 0) {
+        return;
+    }
+    speed_ = speed;
+}
+
 void VideoPlayer::Pause() {
     if (video_play_state_ == kPlaying || video_play_state_ == kResume) {
         video_play_state_ = kPause;
@@ -552,6 +573,12 @@ void VideoPlayer::Stop() {
 
     av_decode_destroy(media_decode_);
     pthread_join(sync_thread_, nullptr);
+    if (nullptr != time_stretch_) {
+        // 下一个视频的声道数可能不一样, 重新创建
+        time_stretch_->Destroy();
+        delete time_stretch_;
+        time_stretch_ = nullptr;
+    }
 
     pthread_mutex_destroy(&sync_mutex_);
     pthread_cond_destroy(&sync_cond_);
@@ -707,6 +734,30 @@ int AudioResample(MediaDecode* media_decode, PlayerState* player_state) {
     return resample_data_size;
 }
 
+int VideoPlayer::StretchAudio(int audio_size) {
+    int channels = media_decode_->audio_tgt.channels;
+    if (nullptr == time_stretch_) {
+        time_stretch_ = new TimeStretch();
+        time_stretch_->Init(media_decode_->audio_tgt.freq, channels);
+    }
+    // seek之后丢掉之前的数据
+    if (stretch_serial_ != player_state_->audio_clock_serial) {
+        stretch_serial_ = player_state_->audio_clock_serial;
+        time_stretch_->Clear();
+    }
+    time_stretch_->SetRatio(1.0f / speed_);
+    time_stretch_->Write(reinterpret_cast<short*>(player_state_->audio_buf), audio_size / sizeof(short));
+    int size = time_stretch_->Available() * static_cast<int>(sizeof(short));
+    if (size > stretch_buffer_size_) {
+        delete[] stretch_buffer_;
+        stretch_buffer_ = new uint8_t[size];
+        stretch_buffer_size_ = size;
+    }
+    time_stretch_->Read(reinterpret_cast<short*>(stretch_buffer_), size / sizeof(short));
+    player_state_->audio_buf = stretch_buffer_;
+    return size;
+}
+
 int VideoPlayer::ReadAudio(uint8_t* buffer, int buffer_size) {
     if (!media_decode_) {
         memset(buffer, 0, buffer_size);
@@ -724,6 +775,15 @@ int VideoPlayer::ReadAudio(uint8_t* buffer, int buffer_size) {
                 memset(buffer, 0, buffer_size);
                 return buffer_size;
             }
+            if (audio_size > 0 && (speed_ != 1.0f || nullptr != time_stretch_)) {
+                audio_size = StretchAudio(audio_size);
+                if (audio_size == 0) {
+                    // 变速处理需要积累足够的数据
+                    player_state_->audio_buf_size = 0;
+                    player_state_->audio_buf_index = 0;
+                    continue;
+                }
+            }
             if (audio_size < 0) {
                 player_state_->audio_buf = nullptr;
                 player_state_->audio_buf_size = AUDIO_MIN_BUFFER_SIZE / media_decode_->audio_tgt.frame_size * media_decode_->audio_tgt.frame_size;
@@ -749,8 +809,10 @@ int VideoPlayer::ReadAudio(uint8_t* buffer, int buffer_size) {
     player_state_->audio_write_buf_size = player_state_->audio_buf_size - player_state_->audio_buf_index;
     /* Let's assume the audio driver that is used by SDL has two periods. */
     if (!isnan(player_state_->audio_clock)) {
-        SetClockAt(&player_state_->sample_clock, player_state_->audio_clock - (double) (2 * player_state_->audio_hw_buf_size + player_state_->audio_write_buf_size) / media_decode_->audio_tgt.bytes_per_sec,
+        // 缓冲区里是变速之后的数据, 换算回媒体时间
+        SetClockAt(&player_state_->sample_clock, player_state_->audio_clock - (double) (2 * player_state_->audio_hw_buf_size + player_state_->audio_write_buf_size) / media_decode_->audio_tgt.bytes_per_sec * speed_,
                      player_state_->audio_clock_serial, player_state_->audio_callback_time / 1000000.0);
+        player_state_->sample_clock.speed = speed_;
         SyncClockToSlave(&player_state_->external_clock, &player_state_->sample_clock);
     }
     return len1;
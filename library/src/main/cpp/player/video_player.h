@@ -23,6 +23,7 @@
 #ifndef TRINITY_VIDEO_PLAYER_H
 #define TRINITY_VIDEO_PLAYER_H
 
+#include <atomic>
 #include <android/native_window.h>
 #include "audio_render.h"
 #include "handler.h"
@@ -30,6 +31,7 @@
 #include "yuv_render.h"
 #include "opengl.h"
 #include "gl_observer.h"
+#include "time_stretch.h"
 
 extern "C" {
 #include "ffmpeg_decode.h"
@@ -136,6 +138,8 @@ class VideoPlayer {
     void Stop();
     void Destroy();
     void Seek(int start_time);
+    // 播放速度, 2.0是2倍速, 声音变速不变调, 音频时钟按同样的速度前进
+    void SetSpeed(float speed);
     int64_t GetCurrentPosition();
 
     void SendGLMessage(Message* message);
@@ -154,6 +158,7 @@ class VideoPlayer {
     static void OnSeekEvent(SeekEvent* event, int seek_flag);
     static void OnAudioPrepareEvent(AudioEvent* event, int size);
     void StreamTogglePause(MediaDecode* media_decode, PlayerState* player_state);
+    int StretchAudio(int audio_size);
 
     static void RenderVideoFrame(VideoEvent* event);
     static void *RenderThread(void *context);
@@ -192,6 +197,12 @@ class VideoPlayer {
     GLfloat* vertex_coordinate_;
     GLfloat* texture_coordinate_;
     bool destroy_;
+    /** JNI线程设置, 音频回调中读取 **/
+    std::atomic<float> speed_;
+    TimeStretch* time_stretch_;
+    uint8_t* stretch_buffer_;
+    int stretch_buffer_size_;
+    int stretch_serial_;
 
  public:
     GLObserver* gl_observer_;
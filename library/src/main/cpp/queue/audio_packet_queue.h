@@ -33,14 +33,15 @@ typedef struct AudioPacket {
     short * buffer;
     uint8_t* data;
     int size;
-    float position;
+    /** 时间戳, 单位是每个声道的采样数, 采样率由队列的生产者和消费者约定, -1表示没有时间戳 **/
+    int64_t pts;
     long frameNum;
 
     AudioPacket() {
         buffer = nullptr;
         data = nullptr;
         size = 0;
-        position = -1;
+        pts = -1;
         frameNum = 0;
     }
     ~AudioPacket() {
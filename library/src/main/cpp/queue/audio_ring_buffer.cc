@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-06.
+//
+
+#include "audio_ring_buffer.h"
+#include <string.h>
+
+namespace trinity {
+
+AudioRingBuffer::AudioRingBuffer()
+    : buffer_(nullptr),
+      capacity_(0),
+      mask_(0),
+      read_position_(0),
+      write_position_(0) {
+}
+
+AudioRingBuffer::~AudioRingBuffer() {
+    Destroy();
+}
+
+int AudioRingBuffer::Init(int capacity) {
+    if (capacity <= 0) {
+        return -1;
+    }
+    uint32_t size = 1;
+    while (size < static_cast<uint32_t>(capacity)) {
+        size <<= 1;
+    }
+    buffer_ = new short[size];
+    memset(buffer_, 0, size * sizeof(short));
+    capacity_ = size;
+    mask_ = size - 1;
+    read_position_.store(0, std::memory_order_relaxed);
+    write_position_.store(0, std::memory_order_relaxed);
+    return 0;
+}
+
+int AudioRingBuffer::Write(const short* samples, int size) {
+    uint32_t write_position = write_position_.load(std::memory_order_relaxed);
+    uint32_t read_position = read_position_.load(std::memory_order_acquire);
+    uint32_t writable = capacity_ - (write_position - read_position);
+    uint32_t count = static_cast<uint32_t>(size) < writable ? static_cast<uint32_t>(size) : writable;
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t offset = write_position & mask_;
+    uint32_t first = capacity_ - offset < count ? capacity_ - offset : count;
+    memcpy(buffer_ + offset, samples, first * sizeof(short));
+    if (count > first) {
+        memcpy(buffer_, samples + first, (count - first) * sizeof(short));
+    }
+    write_position_.store(write_position + count, std::memory_order_release);
+    return static_cast<int>(count);
+}
+
+int AudioRingBuffer::GetWritable() {
+    uint32_t write_position = write_position_.load(std::memory_order_relaxed);
+    uint32_t read_position = read_position_.load(std::memory_order_acquire);
+    return static_cast<int>(capacity_ - (write_position - read_position));
+}
+
+int AudioRingBuffer::Read(short* samples, int size) {
+    uint32_t read_position = read_position_.load(std::memory_order_relaxed);
+    uint32_t write_position = write_position_.load(std::memory_order_acquire);
+    uint32_t readable = write_position - read_position;
+    uint32_t count = static_cast<uint32_t>(size) < readable ? static_cast<uint32_t>(size) : readable;
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t offset = read_position & mask_;
+    uint32_t first = capacity_ - offset < count ? capacity_ - offset : count;
+    memcpy(samples, buffer_ + offset, first * sizeof(short));
+    if (count > first) {
+        memcpy(samples + first, buffer_, (count - first) * sizeof(short));
+    }
+    read_position_.store(read_position + count, std::memory_order_release);
+    return static_cast<int>(count);
+}
+
+int AudioRingBuffer::GetReadable() {
+    uint32_t read_position = read_position_.load(std::memory_order_relaxed);
+    uint32_t write_position = write_position_.load(std::memory_order_acquire);
+    return static_cast<int>(write_position - read_position);
+}
+
+int AudioRingBuffer::GetCapacity() {
+    return static_cast<int>(capacity_);
+}
+
+void AudioRingBuffer::Clear() {
+    read_position_.store(0, std::memory_order_relaxed);
+    write_position_.store(0, std::memory_order_relaxed);
+}
+
+void AudioRingBuffer::Destroy() {
+    if (nullptr != buffer_) {
+        delete[] buffer_;
+        buffer_ = nullptr;
+    }
+    capacity_ = 0;
+    mask_ = 0;
+}
+
+}  // namespace trinity
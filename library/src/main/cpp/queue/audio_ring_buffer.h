@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-06.
+//
+
+#ifndef TRINITY_AUDIO_RING_BUFFER_H
+#define TRINITY_AUDIO_RING_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+
+namespace trinity {
+
+// 单生产者单消费者的无锁环形缓冲区
+// 写入和读取各自只能在一个线程中调用, 两边都不会阻塞
+// 读写位置是一直递增的计数, 容量为2的幂, 溢出后相减依然正确
+class AudioRingBuffer {
+ public:
+    AudioRingBuffer();
+    ~AudioRingBuffer();
+
+    // capacity为short的个数, 会向上取整到2的幂
+    int Init(int capacity);
+    // 生产者调用, 返回实际写入的数量
+    int Write(const short* samples, int size);
+    // 可以写入的数量
+    int GetWritable();
+    // 消费者调用, 返回实际读取的数量
+    int Read(short* samples, int size);
+    // 可以读取的数量
+    int GetReadable();
+    int GetCapacity();
+    // 只能在读写两边都停止的时候调用
+    void Clear();
+    void Destroy();
+
+ private:
+    short* buffer_;
+    uint32_t capacity_;
+    uint32_t mask_;
+    std::atomic<uint32_t> read_position_;
+    std::atomic<uint32_t> write_position_;
+};
+
+}  // namespace trinity
+
+#endif  // TRINITY_AUDIO_RING_BUFFER_H
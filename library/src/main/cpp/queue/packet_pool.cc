@@ -31,12 +31,14 @@ PacketPool::PacketPool()
       buffer_size_(0),
       buffer_(nullptr),
       buffer_cursor_(0),
+      audio_packet_pts_(0),
       temp_video_packet_(nullptr),
       temp_video_packet_ref_count_(0),
       accompany_buffer_size_(0),
       accompany_buffer_(nullptr),
       accompany_buffer_cursor_(0),
       total_discard_video_packet_duration_copy_(0),
+      video_offline_(false),
       audio_sample_rate_(0),
       channels_(0),
       audio_packet_queue_(nullptr),
@@ -58,14 +60,15 @@ PacketPool* PacketPool::GetInstance() {
     return instance_;
 }
 
-void PacketPool::InitAudioPacketQueue(int audioSampleRate) {
+void PacketPool::InitAudioPacketQueue(int audioSampleRate, int channels) {
     const char* name = "audioPacket queue_";
     audio_packet_queue_ = new AudioPacketQueue(name);
     this->audio_sample_rate_ = audioSampleRate;
-    this->channels_ = INPUT_CHANNEL_4_ANDROID;
+    this->channels_ = channels;
     buffer_size_ = audioSampleRate * channels_ * AUDIO_PACKET_DURATION_IN_SECS;
     buffer_ = new short[buffer_size_];
     buffer_cursor_ = 0;
+    audio_packet_pts_ = 0;
 }
 
 void PacketPool::AbortAudioPacketQueue() {
@@ -136,6 +139,9 @@ void PacketPool::PushAudioPacketToQueue(AudioPacket *audioPacket) {
                 short * audioBuffer = new short[buffer_size_];
                 memcpy(audioBuffer, buffer_, buffer_size_ * sizeof(short));
                 targetAudioPacket->buffer = audioBuffer;
+                // 队列里的数据是连续的, 按累计的采样数计算时间戳
+                targetAudioPacket->pts = audio_packet_pts_;
+                audio_packet_pts_ += buffer_size_ / channels_;
                 audio_packet_queue_->Put(targetAudioPacket);
                 buffer_cursor_ = 0;
             }
@@ -236,7 +242,7 @@ void PacketPool::PushAccompanyPacketToQueue(AudioPacket *accompanyPacket) {
             short *audioBuffer = new short[accompany_buffer_size_];
             memcpy(audioBuffer, accompany_buffer_, accompany_buffer_size_ * sizeof(short));
             targetAudioPacket->buffer = audioBuffer;
-            targetAudioPacket->position = accompanyPacket->position;
+            targetAudioPacket->pts = accompanyPacket->pts;
             targetAudioPacket->frameNum = accompanyPacket->frameNum;
             accompany_packet_queue_->Put(targetAudioPacket);
             accompany_buffer_cursor_ = 0;
@@ -278,6 +284,16 @@ void PacketPool::InitRecordingVideoPacketQueue() {
         total_discard_video_packet_duration_ = 0;
         temp_video_packet_ = nullptr;
         temp_video_packet_ref_count_ = 0;
+        if (video_offline_) {
+            video_packet_queue_->SetMaxSize(VIDEO_PACKET_QUEUE_THRRESHOLD);
+        }
+    }
+}
+
+void PacketPool::SetRecordingVideoPacketQueueOffline(bool offline) {
+    video_offline_ = offline;
+    if (nullptr != video_packet_queue_) {
+        video_packet_queue_->SetMaxSize(offline ? VIDEO_PACKET_QUEUE_THRRESHOLD : 0);
     }
 }
 
@@ -296,6 +312,7 @@ void PacketPool::DestroyRecordingVideoPacketQueue() {
             temp_video_packet_ = nullptr;
         }
     }
+    video_offline_ = false;
 }
 
 int PacketPool::GetRecordingVideoPacket(VideoPacket **videoPacket,
@@ -314,7 +331,8 @@ bool PacketPool::DetectDiscardVideoPacket() {
 bool PacketPool::PushRecordingVideoPacketToQueue(VideoPacket *videoPacket) {
     bool dropFrame = false;
     if (nullptr != video_packet_queue_) {
-        while (DetectDiscardVideoPacket()) {
+        // 离线导出由Put阻塞控制速度, 不丢帧
+        while (!video_offline_ && DetectDiscardVideoPacket()) {
             dropFrame = true;
             int discardVideoFrameCnt = 0;
             int discardVideoFrameDuration = video_packet_queue_->DiscardGOP(&discardVideoFrameCnt);
@@ -50,6 +50,8 @@ class PacketPool {
     int buffer_size_;
     short *buffer_;
     int buffer_cursor_;
+    /** 下一个音频包的时间戳, 单位是采样数 **/
+    int64_t audio_packet_pts_;
     bool DetectDiscardVideoPacket();
     /** 为了计算每一帧的时间长度 **/
     VideoPacket *temp_video_packet_;
@@ -58,6 +60,8 @@ class PacketPool {
     short* accompany_buffer_;
     int accompany_buffer_cursor_;
     int total_discard_video_packet_duration_copy_;
+    /** 离线导出时视频队列不丢帧, 满了阻塞等待 **/
+    bool video_offline_;
     pthread_rwlock_t accompany_drop_frame_lock_;
 
  private:
@@ -68,7 +72,7 @@ class PacketPool {
     PacketPool();
     virtual ~PacketPool();
 
-    virtual void InitAudioPacketQueue(int audio_sample_rate);
+    virtual void InitAudioPacketQueue(int audio_sample_rate, int channels = INPUT_CHANNEL_4_ANDROID);
     virtual void AbortAudioPacketQueue();
     virtual void DestroyAudioPacketQueue();
     virtual int GetAudioPacket(AudioPacket** audio_packet, bool block);
@@ -95,6 +99,9 @@ class PacketPool {
     bool DetectDiscardAccompanyPacket();
 
     void InitRecordingVideoPacketQueue();
+    // 离线导出时不使用录制的丢帧策略, 队列超过VIDEO_PACKET_QUEUE_THRRESHOLD时Push阻塞等待
+    // DestroyRecordingVideoPacketQueue之后恢复成录制模式
+    void SetRecordingVideoPacketQueueOffline(bool offline);
     void AbortRecordingVideoPacketQueue();
     void DestroyRecordingVideoPacketQueue();
     int GetRecordingVideoPacket(VideoPacket **videoPacket, bool block);
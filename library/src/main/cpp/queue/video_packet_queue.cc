@@ -37,6 +37,8 @@ VideoPacketQueue::VideoPacketQueue(const char *queueNameParam) {
 void VideoPacketQueue::Init() {
     pthread_mutex_init(&lock_, NULL);
     pthread_cond_init(&condition_, NULL);
+    pthread_cond_init(&full_condition_, NULL);
+    max_size_ = 0;
     packet_size_ = 0;
     first_ = NULL;
     last_ = NULL;
@@ -48,6 +50,7 @@ VideoPacketQueue::~VideoPacketQueue() {
     Flush();
     pthread_mutex_destroy(&lock_);
     pthread_cond_destroy(&condition_);
+    pthread_cond_destroy(&full_condition_);
 }
 
 int VideoPacketQueue::Size() {
@@ -87,6 +90,15 @@ int VideoPacketQueue::Put(VideoPacket *pkt) {
     pkt1->pkt = pkt;
     pkt1->next = NULL;
     pthread_mutex_lock(&lock_);
+    while (max_size_ > 0 && packet_size_ >= max_size_ && !abort_request_) {
+        pthread_cond_wait(&full_condition_, &lock_);
+    }
+    if (abort_request_) {
+        pthread_mutex_unlock(&lock_);
+        delete pkt1;
+        delete pkt;
+        return -1;
+    }
     if (last_ == NULL) {
         first_ = pkt1;
     } else {
@@ -188,6 +200,7 @@ int VideoPacketQueue::Get(VideoPacket **pkt, bool block) {
             if (!first_)
                 last_ = NULL;
             packet_size_--;
+            pthread_cond_signal(&full_condition_);
             *pkt = pkt1->pkt;
             if (NON_DROP_FRAME_FLAG != current_time_mills_) {
                 (*pkt)->timeMills = current_time_mills_;
@@ -208,10 +221,18 @@ int VideoPacketQueue::Get(VideoPacket **pkt, bool block) {
     return ret;
 }
 
+void VideoPacketQueue::SetMaxSize(int max_size) {
+    pthread_mutex_lock(&lock_);
+    max_size_ = max_size;
+    pthread_cond_broadcast(&full_condition_);
+    pthread_mutex_unlock(&lock_);
+}
+
 void VideoPacketQueue::Abort() {
     pthread_mutex_lock(&lock_);
     abort_request_ = true;
     pthread_cond_signal(&condition_);
+    pthread_cond_broadcast(&full_condition_);
     pthread_mutex_unlock(&lock_);
 }
 
@@ -45,14 +45,18 @@ typedef struct VideoPacket {
     int size;
     int timeMills;
     int duration;
+    /** 单位是毫秒, 没有设置时使用timeMills **/
     int64_t pts;
     int64_t dts;
+    /** 解封装时已知是关键帧, 没有设置时由muxer根据IDR判断 **/
+    bool key;
 
     VideoPacket() {
         buffer = nullptr;
         size = 0;
         pts = PTS_PARAM_UN_SETTIED_FLAG;
         dts = DTS_PARAM_UN_SETTIED_FLAG;
+        key = false;
         duration = 0;
         timeMills = 0;
     }
@@ -82,6 +86,7 @@ typedef struct VideoPacket {
         memcpy(result->buffer, buffer, size);
         result->size = size;
         result->timeMills = timeMills;
+        result->key = key;
         return result;
     }
 } VideoPacket;
@@ -108,6 +113,8 @@ class VideoPacketQueue {
     int Get(VideoPacket **videoPacket, bool block);
     int DiscardGOP(int *discardVideoFrameCnt);
     int Size();
+    // 设置队列的最大长度, 队列满时Put会阻塞等待, 0表示不限制
+    void SetMaxSize(int max_size);
     void Abort();
 
  private:
@@ -117,6 +124,8 @@ class VideoPacketQueue {
     bool abort_request_;
     pthread_mutex_t lock_;
     pthread_cond_t condition_;
+    pthread_cond_t full_condition_;
+    int max_size_;
     const char* queue_name_;
     float current_time_mills_;
 };
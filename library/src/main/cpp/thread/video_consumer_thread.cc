@@ -30,29 +30,31 @@ VideoConsumerThread::VideoConsumerThread()
       video_packet_pool_(nullptr),
       audio_packet_pool_(nullptr),
       stopping_(false),
-      mp4_muxer_(nullptr) {
+      mp4_muxer_(nullptr),
+      fragment_duration_(0),
+      expected_duration_(0) {
     pthread_mutex_init(&lock_, nullptr);
     pthread_cond_init(&condition_, nullptr);
 }
 
 VideoConsumerThread::~VideoConsumerThread() {}
 
-static int AudioPacketCallback(AudioPacket** packet, void* context) {
+static int AudioPacketCallback(AudioPacket** packet, bool block, void* context) {
     VideoConsumerThread* thread = reinterpret_cast<VideoConsumerThread*>(context);
-    return thread->GetAudioPacket(packet);
+    return thread->GetAudioPacket(packet, block);
 }
 
-static int VideoPacketCallback(VideoPacket** packet, void* context) {
+static int VideoPacketCallback(VideoPacket** packet, bool block, void* context) {
     VideoConsumerThread* thread = reinterpret_cast<VideoConsumerThread*>(context);
-    return thread->GetH264Packet(packet);
+    return thread->GetH264Packet(packet, block);
 }
 
-int VideoConsumerThread::GetH264Packet(VideoPacket** packet) {
-    return video_packet_pool_->GetRecordingVideoPacket(packet, true);
+int VideoConsumerThread::GetH264Packet(VideoPacket** packet, bool block) {
+    return video_packet_pool_->GetRecordingVideoPacket(packet, block);
 }
 
-int VideoConsumerThread::GetAudioPacket(AudioPacket** packet) {
-    return audio_packet_pool_->GetAudioPacket(packet, true);
+int VideoConsumerThread::GetAudioPacket(AudioPacket** packet, bool block) {
+    return audio_packet_pool_->GetAudioPacket(packet, block);
 }
 
 int VideoConsumerThread::Init(const char* path, int video_width, int video_height, int frame_rate, int video_bit_Rate,
@@ -60,6 +62,8 @@ int VideoConsumerThread::Init(const char* path, int video_width, int video_heigh
     Init();
     if (nullptr == mp4_muxer_) {
         mp4_muxer_ = new H264Muxer();
+        mp4_muxer_->SetFragmentDuration(fragment_duration_);
+        mp4_muxer_->SetExpectedDuration(expected_duration_);
         int ret = mp4_muxer_->Init(path, video_width, video_height, frame_rate, video_bit_Rate, audio_sample_rate, audio_channels, audio_bit_rate, audio_codec_name);
         if (ret < 0) {
             Release();
@@ -73,6 +77,14 @@ int VideoConsumerThread::Init(const char* path, int video_width, int video_heigh
     return 0;
 }
 
+void VideoConsumerThread::SetFragmentDuration(int duration) {
+    fragment_duration_ = duration;
+}
+
+void VideoConsumerThread::SetExpectedDuration(int64_t duration) {
+    expected_duration_ = duration;
+}
+
 void VideoConsumerThread::Start() {
     HandleRun(nullptr);
 }
@@ -126,6 +138,10 @@ void VideoConsumerThread::HandleRun(void *context) {
             break;
         }
     }
+    // 出错退出时不会再消费数据, 离线导出的生产者可能阻塞在已满的队列上
+    if (!stopping_) {
+        video_packet_pool_->AbortRecordingVideoPacketQueue();
+    }
 }
 
 void *VideoConsumerThread::StartThread(void *context) {
@@ -46,9 +46,15 @@ public:
     void Notify();
     void Stop();
 
-    int GetH264Packet(VideoPacket** packet);
+    // 需要在Init之前调用, 大于0时写入分段mp4, 单位是毫秒
+    void SetFragmentDuration(int duration);
 
-    int GetAudioPacket(AudioPacket** packet);
+    // 需要在Init之前调用, 按预计的时长在文件头预留moov, 单位是毫秒
+    void SetExpectedDuration(int64_t duration);
+
+    int GetH264Packet(VideoPacket** packet, bool block);
+
+    int GetAudioPacket(AudioPacket** packet, bool block);
 
 protected:
     virtual void HandleRun(void* context);
@@ -66,6 +72,8 @@ protected:
     AudioPacketPool* audio_packet_pool_;
     bool stopping_;
     Mp4Muxer* mp4_muxer_;
+    int fragment_duration_;
+    int64_t expected_duration_;
 };
 
 }
@@ -29,6 +29,7 @@
 #include "audio_render.h"
 #include "video_editor.h"
 #include "video_export.h"
+#include "mp4_defragment.h"
 
 extern "C" {
 #include "libavformat/avformat.h"
@@ -51,6 +52,7 @@ extern "C" {
 #define AUDIO_PLAYER "com/trinity/player/AudioPlayer"
 #define VIDEO_EDITOR "com/trinity/editor/VideoEditor"
 #define VIDEO_EXPORT "com/trinity/editor/VideoExport"
+#define MP4_DEFRAGMENT "com/trinity/util/Mp4Defragment"
 
 using namespace trinity;
 
@@ -188,6 +190,14 @@ Android_JNI_record_start(JNIEnv *env, jobject object, jlong handle, jstring path
     env->ReleaseStringUTFChars(path, output);
 }
 
+static void Android_JNI_record_set_fragment_duration(JNIEnv *env, jobject object, jlong handle, jint duration) {
+    if (handle <= 0) {
+        return;
+    }
+    auto *record = reinterpret_cast<CameraRecord *>(handle);
+    record->SetFragmentDuration(duration);
+}
+
 static void Android_JNI_record_stop(JNIEnv *env, jobject object, jlong handle) {
     if (handle <= 0) {
         return;
@@ -213,6 +223,14 @@ Android_JNI_audio_record_processor_init(JNIEnv *env, jobject object, jint sample
     return reinterpret_cast<jlong>(recorder);
 }
 
+static void Android_JNI_audio_record_processor_set_speed(JNIEnv *env, jobject object, jlong handle, jfloat speed) {
+    if (handle <= 0) {
+        return;
+    }
+    auto *recorder = reinterpret_cast<RecordProcessor *>(handle);
+    recorder->SetSpeed(speed);
+}
+
 static void Android_JNI_audio_record_processor_flush_audio_buffer_to_queue(JNIEnv *env, jobject object, jlong handle) {
     if (handle <= 0) {
         return;
@@ -565,6 +583,14 @@ static void Android_JNI_video_editor_resume(JNIEnv* env, jobject object, jlong h
     editor->Resume();
 }
 
+static void Android_JNI_video_editor_setSpeed(JNIEnv* env, jobject object, jlong handle, jfloat speed) {
+    if (handle <= 0) {
+        return;
+    }
+    VideoEditor* editor = reinterpret_cast<VideoEditor*>(handle);
+    editor->SetSpeed(speed);
+}
+
 static void Android_JNI_video_editor_stop(JNIEnv* env, jobject object, jlong handle) {
     if (handle <= 0) {
         return;
@@ -582,6 +608,16 @@ static void Android_JNI_video_editor_release(JNIEnv* env, jobject object, jlong
     delete editor;
 }
 
+static jint Android_JNI_mp4_defragment_process(JNIEnv* env, jobject object, jstring input, jstring output) {
+    const char* input_path = env->GetStringUTFChars(input, JNI_FALSE);
+    const char* output_path = env->GetStringUTFChars(output, JNI_FALSE);
+    Mp4Defragment defragment;
+    int ret = defragment.Process(input_path, output_path);
+    env->ReleaseStringUTFChars(input, input_path);
+    env->ReleaseStringUTFChars(output, output_path);
+    return ret;
+}
+
 static jlong Android_JNI_video_export_create(JNIEnv* env, jobject object, jstring resource_path) {
     VideoExport* video_export = new VideoExport(env, object);
     return reinterpret_cast<jlong>(video_export);
@@ -628,6 +664,7 @@ static JNINativeMethod recordMethods[] = {
         {"setRenderType",        "(JI)V",                           (void **) Android_JNI_renderType },
         {"setSpeed",             "(JF)V",                           (void **) Android_JNI_setSpeed },
         {"setFrame",             "(JI)V",                           (void **) Android_JNI_setFrame },
+        {"setFragmentDuration",  "(JI)V",                           (void **) Android_JNI_record_set_fragment_duration },
         {"updateTextureMatrix",  "(J[F)V",                          (void **) Android_JNI_updateTextureMatrix},
         {"destroyWindowSurface", "(J)V",                            (void **) Android_JNI_destroyWindowSurface},
         {"destroyEGLContext",    "(J)V",                            (void **) Android_JNI_destroyEGLContext},
@@ -638,6 +675,7 @@ static JNINativeMethod recordMethods[] = {
 
 static JNINativeMethod audioRecordProcessorMethods[] = {
         {"init",                    "(II)J",   (void **) Android_JNI_audio_record_processor_init},
+        {"setSpeed",                "(JF)V",   (void **) Android_JNI_audio_record_processor_set_speed},
         {"flushAudioBufferToQueue", "(J)V",    (void **) Android_JNI_audio_record_processor_flush_audio_buffer_to_queue},
         {"destroy",                 "(J)V",    (void **) Android_JNI_audio_record_processor_destroy},
         {"pushAudioBufferToQueue",  "(J[SI)I", (void **) Android_JNI_audio_record_processor_push_audio_buffer_to_queue},
@@ -682,6 +720,7 @@ static JNINativeMethod videoEditorMethods[] = {
         {"play",                "(JZ)I",                                                 (void **) Android_JNI_video_editor_play },
         {"pause",               "(J)V",                                                  (void **) Android_JNI_video_editor_pause },
         {"resume",              "(J)V",                                                  (void **) Android_JNI_video_editor_resume },
+        {"setSpeed",            "(JF)V",                                                 (void **) Android_JNI_video_editor_setSpeed },
         {"stop",                "(J)V",                                                  (void **) Android_JNI_video_editor_stop },
         {"release",             "(J)V",                                                  (void **) Android_JNI_video_editor_release }
 };
@@ -693,6 +732,10 @@ static JNINativeMethod videoExportMethods[] = {
         {"release",             "(J)V",                                                  (void **) Android_JNI_video_export_release }
 };
 
+static JNINativeMethod mp4DefragmentMethods[] = {
+        {"process",             "(Ljava/lang/String;Ljava/lang/String;)I",               (void **) Android_JNI_mp4_defragment_process }
+};
+
 void logCallback(void *ptr, int level, const char *fmt, va_list vl) {
     if (level > av_log_get_level())
         return;
@@ -743,6 +786,10 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
     env->RegisterNatives(videoExport, videoExportMethods, NELEM(videoExportMethods));
     env->DeleteLocalRef(videoExport);
 
+    jclass mp4Defragment = env->FindClass(MP4_DEFRAGMENT);
+    env->RegisterNatives(mp4Defragment, mp4DefragmentMethods, NELEM(mp4DefragmentMethods));
+    env->DeleteLocalRef(mp4Defragment);
+
     av_register_all();
     avcodec_register_all();
     avfilter_register_all();
@@ -134,6 +134,12 @@ interface TrinityVideoEditor {
    */
   fun resume()
 
+  /**
+   * 设置预览的播放速度, 声音变速不变调
+   * @param speed 2.0为2倍速, 0.5为慢放
+   */
+  fun setSpeed(speed: Float)
+
   /**
    * 停止播放, 释放资源
    */
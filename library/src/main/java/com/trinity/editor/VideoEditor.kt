@@ -316,6 +316,15 @@ class VideoEditor(
 
   private external fun resume(id: Long)
 
+  /**
+   * 设置预览的播放速度
+   */
+  override fun setSpeed(speed: Float) {
+    setSpeed(mId, speed)
+  }
+
+  private external fun setSpeed(id: Long, speed: Float)
+
   /**
    * 停止播放, 释放资源
    */
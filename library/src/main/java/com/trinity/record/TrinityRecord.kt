@@ -108,6 +108,8 @@ class TrinityRecord(
   private var mMusicInfo: MusicInfo ?= null
   // 录制速度
   private var mSpeed = Speed.NORMAL
+  // 分段mp4每一段的时长, 单位是毫秒, 0为普通mp4
+  private var mFragmentDuration = 0
   // 是否请求打开摄像头
   // 如果textureId还没创建好时设置为true
   // 在textureId创建成功时,打开摄像头
@@ -191,6 +193,16 @@ class TrinityRecord(
     mSpeed = speed
   }
 
+  /**
+   * 设置录制为分段mp4, 在录制过程中设置无效
+   * 每一段都可以单独播放, 录制异常退出时已经写入的段不会丢失
+   * 可以使用Mp4Defragment转换成普通的mp4
+   * @param duration 每一段的时长, 单位是毫秒, 0为普通mp4
+   */
+  fun setFragmentDuration(duration: Int) {
+    mFragmentDuration = duration
+  }
+
   /**
    * 设置画幅
    * 目前画幅有: 垂直 横向 1:1方形
@@ -394,6 +406,7 @@ class TrinityRecord(
     resetStopState()
     try {
       mAudioRecordService.init()
+      mAudioRecordService.setSpeed(1.0f / mSpeed.value)
     } catch (e: AudioConfigurationException) {
       e.printStackTrace()
       return -1
@@ -410,6 +423,7 @@ class TrinityRecord(
 
     mAudioRecordService.start()
     setSpeed(mHandle, 1.0f / mSpeed.value)
+    setFragmentDuration(mHandle, mFragmentDuration)
     startEncode(mHandle, path, width, height, videoBitRate, frameRate,
       useHardWareEncode,
       audioSampleRate, audioChannel, audioBitRate)
@@ -668,6 +682,13 @@ class TrinityRecord(
    */
   private external fun setFrame(handle: Long, frame: Int)
 
+  /**
+   * 设置分段mp4每一段的时长
+   * @param handle c++对象地址
+   * @param duration 单位是毫秒, 0为普通mp4
+   */
+  private external fun setFragmentDuration(handle: Long, duration: Int)
+
   /**
    * 设置texture矩阵
    * @param handle c++对象地址
@@ -7,6 +7,10 @@ class AudioRecordProcessor : RecordProcessor {
         handle = init(audioSampleRate, audioBufferSize)
     }
 
+    override fun setSpeed(speed: Float) {
+        setSpeed(handle, speed)
+    }
+
     override fun pushAudioBufferToQueue(audioSamples: ShortArray, audioSampleSize: Int) {
         pushAudioBufferToQueue(handle, audioSamples, audioSampleSize)
     }
@@ -21,6 +25,7 @@ class AudioRecordProcessor : RecordProcessor {
     }
 
     private external fun init(audioSampleRate: Int, audioBufferSize: Int): Long
+    private external fun setSpeed(handle: Long, speed: Float)
     private external fun flushAudioBufferToQueue(handle: Long)
     private external fun destroy(handle: Long)
     private external fun pushAudioBufferToQueue(
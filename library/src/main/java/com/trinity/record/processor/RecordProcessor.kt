@@ -7,6 +7,12 @@ interface RecordProcessor {
     fun initAudioBufferSize(audioSampleRate: Int, audioBufferSize: Int)
 
     fun destroy()
+
+    /**
+     * 设置录制速度, 输出时长和录制时长的比例, 声音变速不变调
+     */
+    fun setSpeed(speed: Float)
+
     /**
      * 将audioBuffer放入队列中
      */
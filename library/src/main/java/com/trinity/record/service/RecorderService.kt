@@ -53,6 +53,11 @@ interface RecorderService {
    */
   fun destroyAudioRecorderProcessor()
 
+  /**
+   * 设置录制速度, 和视频时间戳的缩放比例一致
+   */
+  fun setSpeed(speed: Float)
+
   /**
    * 开始录音
    */
@@ -157,6 +157,10 @@ class AudioRecordRecorderServiceImpl private constructor() : RecorderService {
     return result
   }
 
+  override fun setSpeed(speed: Float) {
+    recordProcessor?.setSpeed(speed)
+  }
+
   override fun destroyAudioRecorderProcessor() {
     recordProcessor?.destroy()
   }
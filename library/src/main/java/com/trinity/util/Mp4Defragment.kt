@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+package com.trinity.util
+
+/**
+ * 把分段mp4转换成普通的mp4, moov写在mdat之前
+ * 不解码, 直接复制压缩数据, 异常退出的录制文件中已经写入的段都会保留
+ * 会读写整个文件, 不要在主线程调用
+ */
+object Mp4Defragment {
+
+  /**
+   * @param input 分段mp4的路径
+   * @param output 输出的路径, 不能和input相同
+   * @return 成功返回0, 失败时不会保留output
+   */
+  external fun process(input: String, output: String): Int
+}
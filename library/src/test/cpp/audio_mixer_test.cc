@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include <math.h>
+#include <gtest/gtest.h>
+#include "audio_mixer.h"
+
+namespace trinity {
+
+#define TEST_SAMPLE_RATE    48000
+#define TEST_CHANNELS       2
+
+// 输出固定值, 读完frames帧之后结束
+class ConstantSource : public AudioSource {
+ public:
+    ConstantSource(float value, int64_t frames) : value_(value), remain_(frames) {}
+
+    virtual int Read(float** buffer, int frames) {
+        int count = remain_ < frames ? static_cast<int>(remain_) : frames;
+        for (int c = 0; c < TEST_CHANNELS; c++) {
+            for (int i = 0; i < count; i++) {
+                buffer[c][i] = value_;
+            }
+        }
+        remain_ -= count;
+        return count;
+    }
+
+ private:
+    float value_;
+    int64_t remain_;
+};
+
+static int MaxAbs(const short* samples, int size) {
+    int result = 0;
+    for (int i = 0; i < size; i++) {
+        int value = abs(samples[i]);
+        if (value > result) {
+            result = value;
+        }
+    }
+    return result;
+}
+
+TEST(AudioMixerTest, SingleTrackPassThrough) {
+    AudioMixer mixer;
+    ASSERT_EQ(0, mixer.Init(TEST_SAMPLE_RATE, TEST_CHANNELS));
+    mixer.AddTrack(new ConstantSource(0.5f, TEST_SAMPLE_RATE), 0, 0);
+    short output[1024 * TEST_CHANNELS];
+    ASSERT_EQ(1024, mixer.Mix(output, 1024));
+    for (int i = 0; i < 1024 * TEST_CHANNELS; i++) {
+        ASSERT_NEAR(16384, output[i], 1);
+    }
+    mixer.Destroy();
+}
+
+TEST(AudioMixerTest, LimiterPreventsClipping) {
+    AudioMixer mixer;
+    ASSERT_EQ(0, mixer.Init(TEST_SAMPLE_RATE, TEST_CHANNELS));
+    // 两条轨道叠加后是1.6, 不经过限幅会削波
+    mixer.AddTrack(new ConstantSource(0.8f, TEST_SAMPLE_RATE), 0, 0);
+    mixer.AddTrack(new ConstantSource(0.8f, TEST_SAMPLE_RATE), 0, 0);
+    short output[4096 * TEST_CHANNELS];
+    ASSERT_EQ(4096, mixer.Mix(output, 4096));
+    int limit = static_cast<int>(ceilf(MIXER_LIMITER_THRESHOLD * 32767.0f));
+    EXPECT_LE(MaxAbs(output, 4096 * TEST_CHANNELS), limit);
+    // 持续的高电平保持在阈值附近, 不会被压得太低
+    EXPECT_GE(output[4095 * TEST_CHANNELS], limit - 2);
+    mixer.Destroy();
+}
+
+TEST(AudioMixerTest, LimiterReleasesAfterPeak) {
+    AudioMixer mixer;
+    ASSERT_EQ(0, mixer.Init(TEST_SAMPLE_RATE, TEST_CHANNELS));
+    // 前1024帧超过阈值, 之后只剩一条0.5的轨道
+    mixer.AddTrack(new ConstantSource(0.8f, 1024), 0, 0);
+    mixer.AddTrack(new ConstantSource(0.5f, TEST_SAMPLE_RATE), 0, 0);
+    short output[1024 * TEST_CHANNELS];
+    mixer.Mix(output, 1024);
+    EXPECT_LE(output[0], static_cast<int>(ceilf(MIXER_LIMITER_THRESHOLD * 32767.0f)));
+    // 释放时间之后增益恢复到1
+    int release_frames = TEST_SAMPLE_RATE * MIXER_LIMITER_RELEASE_MS / 1000 * 10;
+    for (int i = 0; i < release_frames / 1024; i++) {
+        mixer.Mix(output, 1024);
+    }
+    EXPECT_NEAR(16384, output[1023 * TEST_CHANNELS], 2);
+    mixer.Destroy();
+}
+
+TEST(AudioMixerTest, TrackStartsAtStartTime) {
+    AudioMixer mixer;
+    ASSERT_EQ(0, mixer.Init(TEST_SAMPLE_RATE, TEST_CHANNELS));
+    // 10毫秒是480帧, 不是块大小的整数倍
+    mixer.AddTrack(new ConstantSource(0.5f, TEST_SAMPLE_RATE), 10, 0);
+    short output[1024 * TEST_CHANNELS];
+    mixer.Mix(output, 1024);
+    EXPECT_EQ(0, output[479 * TEST_CHANNELS]);
+    EXPECT_NEAR(16384, output[480 * TEST_CHANNELS], 1);
+    mixer.Destroy();
+}
+
+TEST(AudioMixerTest, FinishedTracksAreRemoved) {
+    AudioMixer mixer;
+    ASSERT_EQ(0, mixer.Init(TEST_SAMPLE_RATE, TEST_CHANNELS));
+    mixer.AddTrack(new ConstantSource(0.5f, 1500), 0, 0);
+    short output[1024 * TEST_CHANNELS];
+    mixer.Mix(output, 1024);
+    EXPECT_EQ(1, mixer.GetActiveTrackSize());
+    EXPECT_FALSE(mixer.IsFinished());
+    mixer.Mix(output, 1024);
+    EXPECT_TRUE(mixer.IsFinished());
+    // 数据结束之后是静音
+    EXPECT_NEAR(16384, output[475 * TEST_CHANNELS], 1);
+    EXPECT_EQ(0, output[476 * TEST_CHANNELS]);
+    mixer.Destroy();
+}
+
+TEST(AudioMixerTest, SetVolumeRampsWithinOneBlock) {
+    AudioMixer mixer;
+    ASSERT_EQ(0, mixer.Init(TEST_SAMPLE_RATE, TEST_CHANNELS));
+    int id = mixer.AddTrack(new ConstantSource(0.5f, TEST_SAMPLE_RATE), 0, 0);
+    short output[1024 * TEST_CHANNELS];
+    mixer.Mix(output, 1024);
+    mixer.SetVolume(id, 0.0f);
+    mixer.Mix(output, 1024);
+    // 音量在一块内平滑过渡到0, 没有突变
+    EXPECT_NEAR(16384, output[0], 64);
+    EXPECT_LT(abs(output[1023 * TEST_CHANNELS]), 64);
+    mixer.Mix(output, 1024);
+    EXPECT_EQ(0, MaxAbs(output, 1024 * TEST_CHANNELS));
+    mixer.Destroy();
+}
+
+}  // namespace trinity
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <gtest/gtest.h>
+#include "audio_ring_buffer.h"
+
+namespace trinity {
+
+TEST(AudioRingBufferTest, CapacityRoundsUpToPowerOfTwo) {
+    AudioRingBuffer buffer;
+    ASSERT_EQ(0, buffer.Init(3000));
+    EXPECT_EQ(4096, buffer.GetCapacity());
+    EXPECT_EQ(4096, buffer.GetWritable());
+    EXPECT_EQ(0, buffer.GetReadable());
+    EXPECT_EQ(-1, buffer.Init(0));
+}
+
+TEST(AudioRingBufferTest, WriteStopsWhenFull) {
+    AudioRingBuffer buffer;
+    ASSERT_EQ(0, buffer.Init(8));
+    short samples[12] = { 0 };
+    EXPECT_EQ(8, buffer.Write(samples, 12));
+    EXPECT_EQ(0, buffer.Write(samples, 1));
+    EXPECT_EQ(0, buffer.GetWritable());
+    short output[12];
+    EXPECT_EQ(8, buffer.Read(output, 12));
+    EXPECT_EQ(0, buffer.Read(output, 1));
+}
+
+TEST(AudioRingBufferTest, WrapAroundKeepsOrder) {
+    AudioRingBuffer buffer;
+    ASSERT_EQ(0, buffer.Init(16));
+    short input[7];
+    short output[7];
+    short next_write = 0;
+    short next_read = 0;
+    // 每次7个不能整除容量, 读写位置会在缓冲区的各个位置回绕
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < 7; i++) {
+            input[i] = next_write++;
+        }
+        ASSERT_EQ(7, buffer.Write(input, 7));
+        ASSERT_EQ(7, buffer.GetReadable());
+        ASSERT_EQ(7, buffer.Read(output, 7));
+        for (int i = 0; i < 7; i++) {
+            ASSERT_EQ(next_read++, output[i]);
+        }
+    }
+}
+
+TEST(AudioRingBufferTest, PartialReadAcrossBoundary) {
+    AudioRingBuffer buffer;
+    ASSERT_EQ(0, buffer.Init(8));
+    short input[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    short output[8];
+    ASSERT_EQ(6, buffer.Write(input, 6));
+    ASSERT_EQ(5, buffer.Read(output, 5));
+    // 写入位置从6开始, 后面的5个回绕到开头
+    ASSERT_EQ(7, buffer.Write(input, 8));
+    ASSERT_EQ(8, buffer.Read(output, 8));
+    EXPECT_EQ(5, output[0]);
+    for (int i = 0; i < 7; i++) {
+        EXPECT_EQ(i, output[i + 1]);
+    }
+}
+
+TEST(AudioRingBufferTest, ClearResetsPositions) {
+    AudioRingBuffer buffer;
+    ASSERT_EQ(0, buffer.Init(8));
+    short samples[5] = { 0 };
+    buffer.Write(samples, 5);
+    buffer.Clear();
+    EXPECT_EQ(0, buffer.GetReadable());
+    EXPECT_EQ(8, buffer.GetWritable());
+}
+
+#define TEST_STREAM_SIZE    (1024 * 1024)
+
+static void* ProduceSamples(void* context) {
+    AudioRingBuffer* buffer = reinterpret_cast<AudioRingBuffer*>(context);
+    short samples[333];
+    int written = 0;
+    while (written < TEST_STREAM_SIZE) {
+        int count = TEST_STREAM_SIZE - written < 333 ? TEST_STREAM_SIZE - written : 333;
+        for (int i = 0; i < count; i++) {
+            samples[i] = static_cast<short>(written + i);
+        }
+        int ret = 0;
+        while (ret < count) {
+            int size = buffer->Write(samples + ret, count - ret);
+            if (size == 0) {
+                sched_yield();
+            }
+            ret += size;
+        }
+        written += count;
+    }
+    return nullptr;
+}
+
+TEST(AudioRingBufferTest, SingleProducerSingleConsumer) {
+    AudioRingBuffer buffer;
+    ASSERT_EQ(0, buffer.Init(1024));
+    pthread_t producer;
+    ASSERT_EQ(0, pthread_create(&producer, nullptr, ProduceSamples, &buffer));
+    short samples[500];
+    int read = 0;
+    bool in_order = true;
+    while (read < TEST_STREAM_SIZE) {
+        int count = buffer.Read(samples, 500);
+        if (count == 0) {
+            sched_yield();
+        }
+        for (int i = 0; i < count; i++) {
+            if (samples[i] != static_cast<short>(read + i)) {
+                in_order = false;
+            }
+        }
+        read += count;
+    }
+    pthread_join(producer, nullptr);
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(0, buffer.GetReadable());
+}
+
+}  // namespace trinity
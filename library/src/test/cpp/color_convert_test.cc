@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include <stdlib.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include "color_convert.h"
+
+namespace trinity {
+
+typedef std::vector<uint8_t> Bytes;
+
+// 每行后面留出padding, 检查不会写到宽度外面
+static const int kPadding = 16;
+static const uint8_t kGuard = 0xA5;
+
+struct Planes {
+    Bytes y;
+    Bytes u;
+    Bytes v;
+    Bytes uv;
+    int y_stride;
+    int chroma_stride;
+    int uv_stride;
+
+    Planes(int width, int height) {
+        int chroma_width = (width + 1) / 2;
+        int chroma_height = (height + 1) / 2;
+        y_stride = width + kPadding;
+        chroma_stride = chroma_width + kPadding;
+        uv_stride = chroma_width * 2 + kPadding;
+        y.assign(y_stride * height, kGuard);
+        u.assign(chroma_stride * chroma_height, kGuard);
+        v.assign(chroma_stride * chroma_height, kGuard);
+        uv.assign(uv_stride * chroma_height, kGuard);
+    }
+};
+
+static void Convert(ColorConvert* convert, const Bytes& rgba, int width, int height, Planes* planes) {
+    int rgba_stride = (width + kPadding) * 4;
+    ASSERT_EQ(0, convert->RGBAToI420(rgba.data(), rgba_stride, width, height,
+            planes->y.data(), planes->y_stride, planes->u.data(), planes->chroma_stride,
+            planes->v.data(), planes->chroma_stride));
+    ASSERT_EQ(0, convert->RGBAToNV12(rgba.data(), rgba_stride, width, height,
+            planes->y.data(), planes->y_stride, planes->uv.data(), planes->uv_stride));
+}
+
+static void ExpectGuard(const Bytes& plane, int stride, int width, int rows) {
+    for (int row = 0; row < rows; row++) {
+        for (int x = width; x < stride; x++) {
+            ASSERT_EQ(kGuard, plane[row * stride + x]) << "row " << row << " x " << x;
+        }
+    }
+}
+
+TEST(ColorConvertTest, SimdMatchesScalarForOddSizes) {
+    if (!ColorConvert().IsSimd()) {
+        printf("no simd in this build, only the scalar path is tested\n");
+    }
+    const int widths[] = { 1, 2, 15, 16, 17, 31, 33, 47, 64 };
+    const int heights[] = { 1, 2, 3, 17 };
+    const ColorSpace spaces[] = { COLOR_SPACE_BT601, COLOR_SPACE_BT709 };
+    srand(1);
+    for (int width : widths) {
+        for (int height : heights) {
+            // 包含0和255, 检查饱和的情况
+            Bytes rgba((width + kPadding) * 4 * height);
+            for (size_t i = 0; i < rgba.size(); i++) {
+                int value = rand() % 260;
+                rgba[i] = static_cast<uint8_t>(value > 255 ? (value & 1) * 255 : value);
+            }
+            for (ColorSpace space : spaces) {
+                for (int full_range = 0; full_range < 2; full_range++) {
+                    SCOPED_TRACE(testing::Message() << width << "x" << height << " space " << space
+                            << " full_range " << full_range);
+                    ColorConvert scalar;
+                    scalar.SetColorSpace(space, full_range != 0);
+                    scalar.SetSimd(false);
+                    ColorConvert simd;
+                    simd.SetColorSpace(space, full_range != 0);
+                    Planes expect(width, height);
+                    Planes actual(width, height);
+                    Convert(&scalar, rgba, width, height, &expect);
+                    Convert(&simd, rgba, width, height, &actual);
+                    EXPECT_EQ(expect.y, actual.y);
+                    EXPECT_EQ(expect.u, actual.u);
+                    EXPECT_EQ(expect.v, actual.v);
+                    EXPECT_EQ(expect.uv, actual.uv);
+                    int chroma_width = (width + 1) / 2;
+                    int chroma_height = (height + 1) / 2;
+                    ExpectGuard(actual.y, actual.y_stride, width, height);
+                    ExpectGuard(actual.u, actual.chroma_stride, chroma_width, chroma_height);
+                    ExpectGuard(actual.v, actual.chroma_stride, chroma_width, chroma_height);
+                    ExpectGuard(actual.uv, actual.uv_stride, chroma_width * 2, chroma_height);
+                }
+            }
+        }
+    }
+}
+
+TEST(ColorConvertTest, KnownColors) {
+    // BT.601 limited range下的白色, 黑色和红色
+    uint8_t rgba[] = { 255, 255, 255, 255, 0, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255 };
+    uint8_t y[4];
+    uint8_t u[1];
+    uint8_t v[1];
+    ColorConvert convert;
+    convert.SetSimd(false);
+    ASSERT_EQ(0, convert.RGBAToI420(rgba, 8, 2, 2, y, 2, u, 1, v, 1));
+    EXPECT_EQ(235, y[0]);
+    EXPECT_EQ(16, y[1]);
+    EXPECT_EQ(82, y[2]);
+    EXPECT_EQ(82, y[3]);
+}
+
+TEST(ColorConvertTest, RejectsInvalidInput) {
+    ColorConvert convert;
+    uint8_t buffer[16];
+    EXPECT_EQ(-1, convert.RGBAToI420(nullptr, 8, 2, 2, buffer, 2, buffer, 1, buffer, 1));
+    EXPECT_EQ(-1, convert.RGBAToI420(buffer, 8, 2, 2, buffer, 2, nullptr, 1, buffer, 1));
+    EXPECT_EQ(-1, convert.RGBAToNV12(buffer, 8, 0, 2, buffer, 2, buffer, 2));
+}
+
+TEST(ColorConvertTest, Benchmark) {
+    // 输出720p时C实现和SIMD实现每帧的时间, 只用来对比, 不检查结果
+    ColorConvert convert;
+    convert.SetSimd(false);
+    int64_t scalar = convert.Benchmark(1280, 720, 20);
+    convert.SetSimd(true);
+    int64_t simd = convert.Benchmark(1280, 720, 20);
+    EXPECT_GE(scalar, 0);
+    EXPECT_GE(simd, 0);
+    RecordProperty("scalar_us", static_cast<int>(scalar));
+    RecordProperty("simd_us", static_cast<int>(simd));
+    printf("ColorConvert 1280x720 I420 scalar: %lld us %s: %lld us\n", static_cast<long long>(scalar),
+            ColorConvert::GetSimdName(), static_cast<long long>(simd));
+}
+
+}  // namespace trinity
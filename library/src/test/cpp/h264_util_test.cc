@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+#include <vector>
+#include <gtest/gtest.h>
+#include "h264_util.h"
+
+namespace trinity {
+
+typedef std::vector<uint8_t> Bytes;
+
+// 4字节起始码的sps, 内容中有防竞争字节00 00 03
+static const uint8_t kSps[] = { 0x67, 0x42, 0xC0, 0x1E, 0x00, 0x00, 0x03, 0x00, 0x40, 0xF1 };
+static const uint8_t kPps[] = { 0x68, 0xCE, 0x3C, 0x80 };
+// 3字节起始码的IDR, 包含多段防竞争字节, 长度超过8个字节的部分没有0
+static const uint8_t kIdr[] = { 0x65, 0x88, 0x84, 0x00, 0x00, 0x03, 0x01, 0x21, 0x22, 0x23, 0x24, 0x25,
+                                0x26, 0x27, 0x28, 0x29, 0x2A, 0x00, 0x00, 0x03, 0x00, 0x11 };
+static const uint8_t kSlice[] = { 0x41, 0x9A, 0x00, 0x00, 0x03, 0x02, 0x7F };
+
+static void AppendNal(Bytes* out, const uint8_t* nal, int size, int start_code_size) {
+    if (start_code_size == 4) {
+        out->push_back(0);
+    }
+    out->push_back(0);
+    out->push_back(0);
+    out->push_back(1);
+    out->insert(out->end(), nal, nal + size);
+}
+
+static Bytes BuildAnnexb(int idr_start_code_size) {
+    Bytes annexb;
+    AppendNal(&annexb, kSps, sizeof(kSps), 4);
+    AppendNal(&annexb, kPps, sizeof(kPps), 4);
+    AppendNal(&annexb, kIdr, sizeof(kIdr), idr_start_code_size);
+    AppendNal(&annexb, kSlice, sizeof(kSlice), 3);
+    return annexb;
+}
+
+// 解析AVCC中4字节长度开头的NAL
+static std::vector<Bytes> SplitAvcc(const uint8_t* avcc, int size) {
+    std::vector<Bytes> nals;
+    int offset = 0;
+    while (offset + 4 <= size) {
+        int length = (avcc[offset] << 24) | (avcc[offset + 1] << 16) | (avcc[offset + 2] << 8) | avcc[offset + 3];
+        offset += 4;
+        if (offset + length > size) {
+            break;
+        }
+        nals.push_back(Bytes(avcc + offset, avcc + offset + length));
+        offset += length;
+    }
+    EXPECT_EQ(size, offset);
+    return nals;
+}
+
+static Bytes ToBytes(const uint8_t* data, int size) {
+    return Bytes(data, data + size);
+}
+
+TEST(H264UtilTest, FindStartCode) {
+    Bytes buffer = BuildAnnexb(3);
+    EXPECT_EQ(1, H264FindStartCode(buffer.data(), 0, static_cast<int>(buffer.size())));
+    // 防竞争字节00 00 03不是起始码
+    uint8_t emulation[] = { 0x11, 0x00, 0x00, 0x03, 0x01, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+    EXPECT_EQ(static_cast<int>(sizeof(emulation)), H264FindStartCode(emulation, 0, sizeof(emulation)));
+    // 起始码在一段没有0的数据之后, 跨过8字节的边界
+    uint8_t later[] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0x00, 0x00, 0x01, 0x65 };
+    EXPECT_EQ(9, H264FindStartCode(later, 0, sizeof(later)));
+    EXPECT_EQ(static_cast<int>(sizeof(later)), H264FindStartCode(later, 10, sizeof(later)));
+}
+
+TEST(H264UtilTest, ParseNalsWithMixedStartCodes) {
+    Bytes buffer = BuildAnnexb(3);
+    H264Nal nals[H264_MAX_NAL_COUNT];
+    int count = H264ParseNals(buffer.data(), static_cast<int>(buffer.size()), nals, H264_MAX_NAL_COUNT);
+    ASSERT_EQ(4, count);
+    const uint8_t* expect[] = { kSps, kPps, kIdr, kSlice };
+    int expect_size[] = { sizeof(kSps), sizeof(kPps), sizeof(kIdr), sizeof(kSlice) };
+    int expect_start_code[] = { 4, 4, 3, 3 };
+    int expect_type[] = { 7, 8, 5, 1 };
+    for (int i = 0; i < count; i++) {
+        EXPECT_EQ(expect_type[i], nals[i].type);
+        EXPECT_EQ(expect_start_code[i], nals[i].start_code_size);
+        EXPECT_EQ(ToBytes(expect[i], expect_size[i]), ToBytes(buffer.data() + nals[i].offset, nals[i].size));
+    }
+    EXPECT_EQ(-1, H264ParseNals(buffer.data(), static_cast<int>(buffer.size()), nals, 3));
+}
+
+TEST(H264UtilTest, AnnexbToAvccRoundTrip) {
+    for (int start_code_size = 3; start_code_size <= 4; start_code_size++) {
+        Bytes buffer = BuildAnnexb(start_code_size);
+        Bytes original = buffer;
+        H264Nal nals[H264_MAX_NAL_COUNT];
+        int count = H264ParseNals(buffer.data(), static_cast<int>(buffer.size()), nals, H264_MAX_NAL_COUNT);
+        ASSERT_EQ(4, count);
+        int avcc_size = H264AvccSize(nals, count, false);
+        Bytes avcc(avcc_size);
+        ASSERT_EQ(avcc_size, H264WriteAvcc(buffer.data(), nals, count, avcc.data(), false));
+        // 写到另外的buffer时输入不变, 防竞争字节原样保留
+        EXPECT_EQ(original, buffer);
+        std::vector<Bytes> split = SplitAvcc(avcc.data(), avcc_size);
+        ASSERT_EQ(4u, split.size());
+        EXPECT_EQ(ToBytes(kSps, sizeof(kSps)), split[0]);
+        EXPECT_EQ(ToBytes(kPps, sizeof(kPps)), split[1]);
+        EXPECT_EQ(ToBytes(kIdr, sizeof(kIdr)), split[2]);
+        EXPECT_EQ(ToBytes(kSlice, sizeof(kSlice)), split[3]);
+    }
+}
+
+TEST(H264UtilTest, AnnexbToAvccSkipsParameterSets) {
+    Bytes buffer = BuildAnnexb(4);
+    H264Nal nals[H264_MAX_NAL_COUNT];
+    int count = H264ParseNals(buffer.data(), static_cast<int>(buffer.size()), nals, H264_MAX_NAL_COUNT);
+    int avcc_size = H264AvccSize(nals, count, true);
+    EXPECT_EQ(static_cast<int>(8 + sizeof(kIdr) + sizeof(kSlice)), avcc_size);
+    Bytes avcc(avcc_size);
+    ASSERT_EQ(avcc_size, H264WriteAvcc(buffer.data(), nals, count, avcc.data(), true));
+    std::vector<Bytes> split = SplitAvcc(avcc.data(), avcc_size);
+    ASSERT_EQ(2u, split.size());
+    EXPECT_EQ(ToBytes(kIdr, sizeof(kIdr)), split[0]);
+}
+
+TEST(H264UtilTest, InPlaceAvcc) {
+    // 只有4字节起始码时可以直接改写成长度
+    Bytes buffer;
+    AppendNal(&buffer, kIdr, sizeof(kIdr), 4);
+    AppendNal(&buffer, kSlice, sizeof(kSlice), 4);
+    H264Nal nals[H264_MAX_NAL_COUNT];
+    int count = H264ParseNals(buffer.data(), static_cast<int>(buffer.size()), nals, H264_MAX_NAL_COUNT);
+    ASSERT_EQ(2, count);
+    int size = H264WriteAvcc(buffer.data(), nals, count, buffer.data(), false);
+    ASSERT_EQ(static_cast<int>(buffer.size()), size);
+    std::vector<Bytes> split = SplitAvcc(buffer.data(), size);
+    ASSERT_EQ(2u, split.size());
+    EXPECT_EQ(ToBytes(kIdr, sizeof(kIdr)), split[0]);
+    EXPECT_EQ(ToBytes(kSlice, sizeof(kSlice)), split[1]);
+
+    // 3字节起始码放不下长度, 返回-1并且不修改输入
+    Bytes short_code = BuildAnnexb(3);
+    Bytes original = short_code;
+    count = H264ParseNals(short_code.data(), static_cast<int>(short_code.size()), nals, H264_MAX_NAL_COUNT);
+    EXPECT_EQ(-1, H264WriteAvcc(short_code.data(), nals, count, short_code.data(), false));
+    EXPECT_EQ(original, short_code);
+}
+
+TEST(H264UtilTest, AvccHasIdr) {
+    // SEI在IDR前面时仍然是关键帧, 只有SEI和P帧时不是
+    uint8_t sei[] = { 0x06, 0x05, 0x01, 0x80 };
+    Bytes key;
+    AppendNal(&key, sei, sizeof(sei), 4);
+    AppendNal(&key, kIdr, sizeof(kIdr), 4);
+    Bytes delta;
+    AppendNal(&delta, sei, sizeof(sei), 4);
+    AppendNal(&delta, kSlice, sizeof(kSlice), 4);
+    Bytes* buffers[] = { &key, &delta };
+    for (int i = 0; i < 2; i++) {
+        Bytes* buffer = buffers[i];
+        H264Nal nals[H264_MAX_NAL_COUNT];
+        int count = H264ParseNals(buffer->data(), static_cast<int>(buffer->size()), nals, H264_MAX_NAL_COUNT);
+        int size = H264WriteAvcc(buffer->data(), nals, count, buffer->data(), false);
+        ASSERT_EQ(static_cast<int>(buffer->size()), size);
+        EXPECT_EQ(i == 0, H264AvccHasIdr(buffer->data(), size));
+    }
+    // 长度越界时不会读到buffer外面
+    uint8_t broken[] = { 0x00, 0x00, 0x00, 0x10, 0x65 };
+    EXPECT_FALSE(H264AvccHasIdr(broken, sizeof(broken)));
+}
+
+static Bytes BuildAvcc() {
+    Bytes extradata = { 0x01, kSps[1], kSps[2], kSps[3], 0xFF, 0xE1 };
+    extradata.push_back(0);
+    extradata.push_back(sizeof(kSps));
+    extradata.insert(extradata.end(), kSps, kSps + sizeof(kSps));
+    extradata.push_back(1);
+    extradata.push_back(0);
+    extradata.push_back(sizeof(kPps));
+    extradata.insert(extradata.end(), kPps, kPps + sizeof(kPps));
+    return extradata;
+}
+
+TEST(H264UtilTest, AvccExtradataToAnnexbRoundTrip) {
+    Bytes extradata = BuildAvcc();
+    int size = H264AvccToAnnexb(extradata.data(), static_cast<int>(extradata.size()), nullptr);
+    ASSERT_EQ(static_cast<int>(8 + sizeof(kSps) + sizeof(kPps)), size);
+    Bytes annexb(size);
+    ASSERT_EQ(size, H264AvccToAnnexb(extradata.data(), static_cast<int>(extradata.size()), annexb.data()));
+    H264Nal nals[H264_MAX_NAL_COUNT];
+    int count = H264ParseNals(annexb.data(), size, nals, H264_MAX_NAL_COUNT);
+    ASSERT_EQ(2, count);
+    EXPECT_EQ(4, nals[0].start_code_size);
+    EXPECT_EQ(ToBytes(kSps, sizeof(kSps)), ToBytes(annexb.data() + nals[0].offset, nals[0].size));
+    EXPECT_EQ(ToBytes(kPps, sizeof(kPps)), ToBytes(annexb.data() + nals[1].offset, nals[1].size));
+}
+
+TEST(H264UtilTest, AvccExtradataRejectsInvalidInput) {
+    Bytes extradata = BuildAvcc();
+    EXPECT_EQ(-1, H264AvccToAnnexb(nullptr, 0, nullptr));
+    EXPECT_EQ(-1, H264AvccToAnnexb(extradata.data(), 6, nullptr));
+    // 截断在pps的数据中间
+    EXPECT_EQ(-1, H264AvccToAnnexb(extradata.data(), static_cast<int>(extradata.size()) - 1, nullptr));
+    // Annex-B格式的extradata不是avcC
+    Bytes annexb = BuildAnnexb(4);
+    EXPECT_EQ(-1, H264AvccToAnnexb(annexb.data(), static_cast<int>(annexb.size()), nullptr));
+}
+
+TEST(H264UtilTest, ReadUE) {
+    // 1 010 011 00100 00101 0001000: 0, 1, 2, 3, 4, 7
+    uint8_t buffer[] = { 0xA6, 0x42, 0x88 };
+    int expect[] = { 0, 1, 2, 3, 4, 7 };
+    int bit = 0;
+    for (int i = 0; i < 6; i++) {
+        EXPECT_EQ(expect[i], H264ReadUE(buffer, sizeof(buffer), &bit));
+    }
+    // 全是0时越界
+    uint8_t zeros[] = { 0x00, 0x00 };
+    bit = 0;
+    EXPECT_EQ(-1, H264ReadUE(zeros, sizeof(zeros), &bit));
+}
+
+TEST(H264UtilTest, ParameterSetId) {
+    // sps的id在第4个字节, 00100是3
+    uint8_t sps[] = { 0x67, 0x42, 0xC0, 0x1E, 0x20 };
+    EXPECT_EQ(3, H264ParameterSetId(sps, sizeof(sps)));
+    // pps的id紧跟nal头, 010是1
+    uint8_t pps[] = { 0x68, 0x40 };
+    EXPECT_EQ(1, H264ParameterSetId(pps, sizeof(pps)));
+    EXPECT_EQ(-1, H264ParameterSetId(kIdr, sizeof(kIdr)));
+}
+
+}  // namespace trinity
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2019 Trinity. All rights reserved.
+ * Copyright (C) 2019 Wang LianJie <wlanjie888@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Created by wlanjie on 2019-09-12.
+//
+
+// 主机上运行测试时代替xlog, 日志直接输出到stderr
+
+#ifndef __ANDROID_XLOG__
+#define __ANDROID_XLOG__
+
+#include <stdio.h>
+
+#define __LOG__(LEVEL, FMT, ...)  fprintf(stderr, LEVEL " " FMT "\n", ##__VA_ARGS__)
+
+#define LOGV(FMT, ...)  __LOG__("V", FMT, ##__VA_ARGS__)
+#define LOGD(FMT, ...)  __LOG__("D", FMT, ##__VA_ARGS__)
+#define LOGI(FMT, ...)  __LOG__("I", FMT, ##__VA_ARGS__)
+#define LOGW(FMT, ...)  __LOG__("W", FMT, ##__VA_ARGS__)
+#define LOGE(FMT, ...)  __LOG__("E", FMT, ##__VA_ARGS__)
+
+#endif  // __ANDROID_XLOG__